@@ -113,6 +113,7 @@ struct poolparam;
 struct transport;
 struct req;
 struct sess;
+struct skey_oc;
 struct suckaddr;
 struct vrt_priv;
 struct vsb;
@@ -160,9 +161,16 @@ struct ws {
 };
 
 /*--------------------------------------------------------------------
- *
+ * The well known headers from tbl/http_headers.h get an index in
+ * struct http, so looking them up does not scan all the headers.
  */
 
+enum http_hidx {
+#define HTTPH(a, b, c) HIDX_##b,
+#include "tbl/http_headers.h"
+	HIDX__MAX
+};
+
 struct http {
 	unsigned		magic;
 #define HTTP_MAGIC		0x6428b5c9
@@ -182,8 +190,14 @@ struct http {
 	uint16_t		status;
 	uint8_t			protover;
 	uint8_t			conds;		/* If-* headers present */
+
+	uint16_t		hidx_n;		/* hd[FIRST...hidx_n> indexed */
+	uint16_t		hidx[HIDX__MAX];/* 1st hd[] of known headers */
 };
 
+/* What the index adds to a struct http, the mempools make up for it */
+#define HTTP_HIDX_SIZE		(sizeof(uint16_t) * (1 + HIDX__MAX))
+
 /*--------------------------------------------------------------------
  * VFP filter state
  */
@@ -433,6 +447,7 @@ struct objcore {
 	VTAILQ_ENTRY(objcore)	ban_list;
 	VSTAILQ_ENTRY(objcore)	exp_list;
 	struct ban		*ban;
+	struct skey_oc		*skey;
 };
 
 /* Busy Object structure ---------------------------------------------
@@ -542,6 +557,8 @@ struct req {
 
 	/* The busy objhead we sleep on */
 	struct objhead		*hash_objhead;
+	struct objcore		*hash_oc;	/* Handed over on wakeup */
+	double			t_hash_sleep;
 
 	/* Built Vary string */
 	uint8_t			*vary_b;
@@ -760,6 +777,7 @@ void http_ForceHeader(struct http *to, const char *hdr, const char *val);
 void http_PrintfHeader(struct http *to, const char *fmt, ...)
     __v_printflike(2, 3);
 void http_TimeHeader(struct http *to, const char *fmt, double now);
+void http_IndexHdrs(struct http *hp);
 void http_SetHeader(struct http *to, const char *hdr);
 void http_SetH(const struct http *to, unsigned n, const char *fm);
 void http_ForceField(const struct http *to, unsigned n, const char *t);
@@ -851,7 +869,7 @@ struct VSC_C_lck *Lck_CreateClass(const char *name);
 /* cache_mempool.c */
 void MPL_AssertSane(void *item);
 struct mempool * MPL_New(const char *name, volatile struct poolparam *pp,
-    volatile unsigned *cur_size);
+    volatile unsigned *cur_size, unsigned extra);
 void MPL_Destroy(struct mempool **mpp);
 void *MPL_Get(struct mempool *mpl, unsigned *size);
 void MPL_Free(struct mempool *mpl, void *item);
@@ -862,6 +880,9 @@ void ObjDestroy(struct worker *, struct objcore **);
 typedef int objiterate_f(void *priv, int flush, const void *ptr, ssize_t len);
 int ObjIterate(struct worker *, struct objcore *,
     void *priv, objiterate_f *func, int final);
+typedef int objiteratefd_f(void *priv, int fd, off_t off, ssize_t len);
+int ObjIterateFd(struct worker *, struct objcore *,
+    void *priv, objiterate_f *func, objiteratefd_f *ffunc);
 int ObjGetSpace(struct worker *, struct objcore *, ssize_t *sz, uint8_t **ptr);
 void ObjExtend(struct worker *, struct objcore *, ssize_t l);
 uint64_t ObjWaitExtend(const struct worker *, const struct objcore *,
@@ -920,6 +941,7 @@ int Pool_Task_Arg(struct worker *, enum task_prio, task_func_t *,
 void Pool_Sumstat(struct worker *w);
 int Pool_TrySumstat(struct worker *wrk);
 void Pool_PurgeStat(unsigned nobj);
+void Pool_FoldStat(void);
 int Pool_Task_Any(struct pool_task *task, enum task_prio prio);
 
 /* cache_range.c [VRG] */
@@ -980,6 +1002,7 @@ const char *SES_Get_String_Attr(const struct sess *sp, enum sess_attr a);
 
 /* cache_shmlog.c */
 extern struct VSC_C_main *VSC_C_main;
+struct VSC_C_main *VSC_Shard(void);
 void *VSM_Alloc(unsigned size, const char *class, const char *type,
     const char *ident);
 void VSM_Free(void *ptr);
@@ -1018,6 +1041,9 @@ void VSL_Flush(struct vsl_log *, int overflow);
 
 #endif
 
+/* cache_skey.c [SKEY] */
+unsigned SKEY_Purge(struct worker *, const char *key);
+
 /* cache_vary.c */
 int VRY_Create(struct busyobj *bo, struct vsb **psb);
 int VRY_Match(struct req *, const uint8_t *vary);
@@ -1088,7 +1114,7 @@ void RFC2616_Vary_AE(struct http *hp);
 
 /* stevedore.c */
 int STV_NewObject(struct worker *, struct objcore *,
-    const struct stevedore *, unsigned len);
+    const struct stevedore *, unsigned len, unsigned bodylen);
 
 /*
  * A normal pointer difference is signed, but we never want a negative value
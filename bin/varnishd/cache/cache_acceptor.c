@@ -72,8 +72,25 @@ struct poolsock {
 	struct listen_sock		*lsock;
 	struct pool_task		task;
 	struct pool			*pool;
+	unsigned			pool_no;
 };
 
+/*--------------------------------------------------------------------
+ * With listen_reuseport each pool has its own socket, pools beyond
+ * those the manager opened sockets for share the first.
+ */
+
+static inline int
+vca_sock(const struct poolsock *ps)
+{
+	const struct listen_sock *ls;
+
+	ls = ps->lsock;
+	if (ps->pool_no < ls->npsock)
+		return (ls->psock[ps->pool_no]);
+	return (ls->sock);
+}
+
 /*--------------------------------------------------------------------
  * TCP options we want to control
  */
@@ -411,7 +428,7 @@ vca_accept_task(struct worker *wrk, void *arg)
 
 		wa.acceptaddrlen = sizeof wa.acceptaddr;
 		do {
-			i = accept(ls->sock, (void*)&wa.acceptaddr,
+			i = accept(vca_sock(ps), (void*)&wa.acceptaddr,
 				   &wa.acceptaddrlen);
 		} while (i < 0 && errno == EAGAIN);
 
@@ -482,7 +499,7 @@ vca_accept_task(struct worker *wrk, void *arg)
  */
 
 void
-VCA_NewPool(struct pool *pp)
+VCA_NewPool(struct pool *pp, unsigned pool_no)
 {
 	struct listen_sock *ls;
 	struct poolsock *ps;
@@ -494,6 +511,7 @@ VCA_NewPool(struct pool *pp)
 		ps->task.func = vca_accept_task;
 		ps->task.priv = ps;
 		ps->pool = pp;
+		ps->pool_no = pool_no;
 		VTAILQ_INSERT_TAIL(&pp->poolsocks, ps, list);
 		AZ(Pool_Task(pp, &ps->task, TASK_QUEUE_VCA));
 	}
@@ -512,11 +530,36 @@ VCA_DestroyPool(struct pool *pp)
 
 /*--------------------------------------------------------------------*/
 
+static void
+vca_listen(int sock)
+{
+	int i;
+
+	assert (sock > 0);		// We know where stdin is
+	if (cache_param->tcp_fastopen) {
+		i = VTCP_fastopen(sock, cache_param->listen_depth);
+		if (i)
+			VSL(SLT_Error, sock,
+			    "Kernel TCP Fast Open: sock=%d, ret=%d %s",
+			    sock, i, strerror(errno));
+	}
+	AZ(listen(sock, cache_param->listen_depth));
+	vca_tcp_opt_set(sock, 1);
+	if (cache_param->accept_filter) {
+		i = VTCP_filter_http(sock);
+		if (i)
+			VSL(SLT_Error, sock,
+			    "Kernel filtering: sock=%d, ret=%d %s",
+			    sock, i, strerror(errno));
+	}
+}
+
 static void *
 vca_acct(void *arg)
 {
 	struct listen_sock *ls;
 	double t0, now;
+	unsigned u;
 
 	THR_SetName("cache-acceptor");
 	(void)arg;
@@ -525,25 +568,9 @@ vca_acct(void *arg)
 
 	VTAILQ_FOREACH(ls, &heritage.socks, list) {
 		CHECK_OBJ_NOTNULL(ls->transport, TRANSPORT_MAGIC);
-		assert (ls->sock > 0);		// We know where stdin is
-		if (cache_param->tcp_fastopen) {
-			int i;
-			i = VTCP_fastopen(ls->sock, cache_param->listen_depth);
-			if (i)
-				VSL(SLT_Error, ls->sock,
-				    "Kernel TCP Fast Open: sock=%d, ret=%d %s",
-				    ls->sock, i, strerror(errno));
-		}
-		AZ(listen(ls->sock, cache_param->listen_depth));
-		vca_tcp_opt_set(ls->sock, 1);
-		if (cache_param->accept_filter) {
-			int i;
-			i = VTCP_filter_http(ls->sock);
-			if (i)
-				VSL(SLT_Error, ls->sock,
-				    "Kernel filtering: sock=%d, ret=%d %s",
-				    ls->sock, i, strerror(errno));
-		}
+		vca_listen(ls->sock);
+		for (u = 1; u < ls->npsock; u++)
+			vca_listen(ls->psock[u]);
 	}
 
 	need_test = 1;
@@ -558,6 +585,8 @@ vca_acct(void *arg)
 					continue;	// raced VCA_Shutdown
 				assert (ls->sock > 0);
 				vca_tcp_opt_set(ls->sock, 1);
+				for (u = 1; u < ls->npsock; u++)
+					vca_tcp_opt_set(ls->psock[u], 1);
 			}
 		}
 		now = VTIM_real();
@@ -626,11 +655,17 @@ void
 VCA_Shutdown(void)
 {
 	struct listen_sock *ls;
+	unsigned u;
 	int i;
 
 	VTAILQ_FOREACH(ls, &heritage.socks, list) {
 		i = ls->sock;
 		ls->sock = -2;
+		for (u = 0; u < ls->npsock; u++) {
+			if (u > 0)
+				(void)close(ls->psock[u]);
+			ls->psock[u] = -2;
+		}
 		(void)close(i);
 	}
 }
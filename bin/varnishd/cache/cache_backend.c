@@ -74,13 +74,13 @@ vbe_dir_getfd(struct worker *wrk, struct backend *bp, struct busyobj *bo)
 
 	if (!VBE_Healthy(bp, NULL)) {
 		// XXX: per backend stats ?
-		VSC_C_main->backend_unhealthy++;
+		VSC_Shard()->backend_unhealthy++;
 		return (NULL);
 	}
 
 	if (bp->max_connections > 0 && bp->n_conn >= bp->max_connections) {
 		// XXX: per backend stats ?
-		VSC_C_main->backend_busy++;
+		VSC_Shard()->backend_busy++;
 		return (NULL);
 	}
 
@@ -95,7 +95,7 @@ vbe_dir_getfd(struct worker *wrk, struct backend *bp, struct busyobj *bo)
 	vc = VBT_Get(bp->tcp_pool, tmod, bp, wrk);
 	if (vc == NULL) {
 		// XXX: Per backend stats ?
-		VSC_C_main->backend_fail++;
+		VSC_Shard()->backend_fail++;
 		bo->htc = NULL;
 		return (NULL);
 	}
@@ -107,6 +107,8 @@ vbe_dir_getfd(struct worker *wrk, struct backend *bp, struct busyobj *bo)
 	bp->n_conn++;
 	bp->vsc->conn++;
 	bp->vsc->req++;
+	if (vc->reused)
+		bp->vsc->reuse++;
 	Lck_Unlock(&bp->mtx);
 
 	if (bp->proxy_header != 0)
@@ -161,12 +163,16 @@ vbe_dir_finish(const struct director *d, struct worker *wrk,
 		    bp->display_name);
 		VBT_Close(bp->tcp_pool, &vbc);
 		Lck_Lock(&bp->mtx);
+		bp->vsc->close++;
 	} else {
 		VSLb(bo->vsl, SLT_BackendReuse, "%d %s", vbc->fd,
 		    bp->display_name);
 		Lck_Lock(&bp->mtx);
-		VSC_C_main->backend_recycle++;
-		VBT_Recycle(wrk, bp->tcp_pool, &vbc);
+		VSC_Shard()->backend_recycle++;
+		if (VBT_Recycle(wrk, bp->tcp_pool, &vbc))
+			bp->vsc->close++;
+		else
+			bp->vsc->recycle++;
 	}
 	assert(bp->n_conn > 0);
 	bp->n_conn--;
@@ -205,7 +211,7 @@ vbe_dir_gethdrs(const struct director *d, struct worker *wrk,
 			return (-1);
 		}
 		AN(bo->htc);
-		if (vbc->state != VBC_STATE_STOLEN)
+		if (!vbc->reused)
 			extrachance = 0;
 
 		i = V1F_SendReq(wrk, bo, &bo->acct.bereq_hdrbytes, 0);
@@ -235,7 +241,7 @@ vbe_dir_gethdrs(const struct director *d, struct worker *wrk,
 		    bo->req->req_body_status != REQ_BODY_NONE &&
 		    bo->req->req_body_status != REQ_BODY_CACHED)
 			break;
-		VSC_C_main->backend_retry++;
+		VSC_Shard()->backend_retry++;
 	} while (extrachance);
 	return (-1);
 }
@@ -91,10 +91,23 @@ struct vbc {
 #define VBC_STATE_USED		(1<<1)
 #define VBC_STATE_STOLEN	(1<<2)
 #define VBC_STATE_CLEANUP	(1<<3)
+#define VBC_STATE_CONNECT	(1<<4)
+	uint8_t			warm;
+	uint8_t			reused;
 	struct waited		waited[1];
 	struct tcp_pool		*tcp_pool;
+	struct tcp_shard	*tcp_shard;
+	const struct waiter	*waiter;
 
 	pthread_cond_t		*cond;
+
+	double			t_connect;
+	double			connect_tmo;
+
+	/* Connect completion, finished in a pool task */
+	struct pool_task	task;
+	double			t_done;
+	int			err;
 };
 
 /*---------------------------------------------------------------------
@@ -123,11 +136,12 @@ struct tcp_pool *VBT_Ref(const struct suckaddr *ip4,
     const struct suckaddr *ip6);
 void VBT_Rel(struct tcp_pool **tpp);
 int VBT_Open(const struct tcp_pool *tp, double tmo, const struct suckaddr **sa);
-void VBT_Recycle(const struct worker *, struct tcp_pool *, struct vbc **);
+int VBT_Recycle(const struct worker *, struct tcp_pool *, struct vbc **);
 void VBT_Close(struct tcp_pool *tp, struct vbc **vbc);
 struct vbc *VBT_Get(struct tcp_pool *, double tmo, const struct backend *,
     struct worker *);
 void VBT_Wait(struct worker *, struct vbc *);
+void VBT_Init(void);
 
 /* cache_vcl.c */
 int VCL_AddBackend(struct vcl *, struct backend *);
@@ -111,7 +111,7 @@ VRT_new_backend(VRT_CTX, const struct vrt_backend *vrt)
 
 	Lck_Lock(&backends_mtx);
 	VTAILQ_INSERT_TAIL(&backends, b, list);
-	VSC_C_main->n_backend++;
+	VSC_Shard()->n_backend++;
 	b->tcp_pool = VBT_Ref(vrt->ipv4_suckaddr, vrt->ipv6_suckaddr);
 	if (vbp != NULL) {
 		tp = VBT_Ref(vrt->ipv4_suckaddr, vrt->ipv6_suckaddr);
@@ -204,9 +204,9 @@ VBE_Delete(struct backend *be)
 		VTAILQ_REMOVE(&cool_backends, be, list);
 	else
 		VTAILQ_REMOVE(&backends, be, list);
-	VSC_C_main->n_backend--;
-	VBT_Rel(&be->tcp_pool);
+	VSC_Shard()->n_backend--;
 	Lck_Unlock(&backends_mtx);
+	VBT_Rel(&be->tcp_pool);
 
 #define DA(x)	do { if (be->x != NULL) free(be->x); } while (0)
 #define DN(x)	/**/
@@ -462,4 +462,5 @@ VBE_InitCfg(void)
 
 	CLI_AddFuncs(backend_cmds);
 	Lck_New(&backends_mtx, lck_vbe);
+	VBT_Init();
 }
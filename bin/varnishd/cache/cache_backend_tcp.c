@@ -30,10 +30,20 @@
  * These are really a lot more general than just backends, but backends
  * are all we use them for, so they live here for now.
  *
+ * Connections are established with a non-blocking connect(2) which the
+ * waiter tells us has completed.  Fetches which find no idle connection
+ * queue up on the pool and get the first connection which becomes
+ * ready, newly connected or recycled.  Connections which nobody waits
+ * for go idle, and we keep backend_warm_connections idle ones around.
+ *
+ * Each pool is split in shards, one per thread pool, and a fetch only
+ * looks at other shards when its own has no idle connection.
+ *
  */
 
 #include "config.h"
 
+#include <errno.h>
 #include <stdlib.h>
 
 #include "cache.h"
@@ -47,6 +57,29 @@
 #include "cache_backend.h"
 #include "cache_pool.h"
 
+struct tcp_shard {
+	unsigned		magic;
+#define TCP_SHARD_MAGIC		0x1d7b0a4c
+	struct tcp_pool		*tcp_pool;
+	struct lock		mtx;
+
+	VTAILQ_HEAD(, vbc)	connlist;
+	int			n_conn;
+
+	VTAILQ_HEAD(, vbc)	killlist;
+	int			n_kill;
+
+	VTAILQ_HEAD(, tcp_wait)	waitlist;
+	int			n_wait;
+
+	VTAILQ_HEAD(, vbc)	connectlist;	/* Waiting for connect */
+	int			n_connecting;
+	int			n_used;
+
+	unsigned		warm_ok;
+	unsigned		dying;
+};
+
 struct tcp_pool {
 	unsigned		magic;
 #define TCP_POOL_MAGIC		0x28b0e42a
@@ -57,20 +90,347 @@ struct tcp_pool {
 
 	VTAILQ_ENTRY(tcp_pool)	list;
 	int			refcnt;
-	struct lock		mtx;
-
-	VTAILQ_HEAD(, vbc)	connlist;
-	int			n_conn;
 
-	VTAILQ_HEAD(, vbc)	killlist;
-	int			n_kill;
+	unsigned		nshard;
+	struct tcp_shard	*shard;
+};
 
-	int			n_used;
+struct tcp_refill {
+	unsigned		magic;
+#define TCP_REFILL_MAGIC	0x4f1e92d7
+	struct pool_task	task;
+	struct tcp_shard	*ts;
+	const struct waiter	*wtr;
+	double			tmo;
+	int			n;
+};
 
+struct tcp_wait {
+	unsigned		magic;
+#define TCP_WAIT_MAGIC		0x5e0f1c73
+	VTAILQ_ENTRY(tcp_wait)	list;
+	pthread_cond_t		*cond;
+	struct vbc		*vbc;
+	int			err;
 };
 
+static struct lock		pools_mtx;
 static VTAILQ_HEAD(, tcp_pool)	pools = VTAILQ_HEAD_INITIALIZER(pools);
 
+static waiter_handle_f tcp_handle;
+
+/*--------------------------------------------------------------------
+ * Pick the address to connect to, the preferred one first and then the
+ * other one if that failed.
+ */
+
+static const struct suckaddr *
+vbt_addr(const struct tcp_pool *tp, const struct suckaddr *prev)
+{
+	const struct suckaddr *a, *b;
+
+	if (cache_param->prefer_ipv6) {
+		a = tp->ip6;
+		b = tp->ip4;
+	} else {
+		a = tp->ip4;
+		b = tp->ip6;
+	}
+	if (prev == NULL)
+		return (a != NULL ? a : b);
+	if (prev == a)
+		return (b);
+	return (NULL);
+}
+
+static int
+vbt_connect(const struct tcp_pool *tp, struct vbc *vbc)
+{
+
+	while (1) {
+		vbc->addr = vbt_addr(tp, vbc->addr);
+		if (vbc->addr == NULL)
+			return (-1);
+		vbc->fd = VTCP_connect(vbc->addr, -1);
+		if (vbc->fd >= 0)
+			return (0);
+	}
+}
+
+/*--------------------------------------------------------------------
+ * Give a connection to the fetch at the head of the queue
+ */
+
+static void
+vbt_hand(struct tcp_shard *ts, struct vbc *vbc)
+{
+	struct tcp_wait *tw;
+
+	Lck_AssertHeld(&ts->mtx);
+	tw = VTAILQ_FIRST(&ts->waitlist);
+	CHECK_OBJ_NOTNULL(tw, TCP_WAIT_MAGIC);
+	VTAILQ_REMOVE(&ts->waitlist, tw, list);
+	ts->n_wait--;
+	vbc->state = VBC_STATE_USED;
+	tw->vbc = vbc;
+	AZ(pthread_cond_signal(tw->cond));
+}
+
+/*--------------------------------------------------------------------
+ * A connect failed.  If that leaves more fetches waiting than there are
+ * connects in progress, the first one fails too.
+ */
+
+static void
+vbt_failed(struct tcp_shard *ts, int err)
+{
+	struct tcp_wait *tw;
+
+	Lck_AssertHeld(&ts->mtx);
+	ts->warm_ok = 0;
+	if (ts->n_wait <= ts->n_connecting)
+		return;
+	tw = VTAILQ_FIRST(&ts->waitlist);
+	CHECK_OBJ_NOTNULL(tw, TCP_WAIT_MAGIC);
+	VTAILQ_REMOVE(&ts->waitlist, tw, list);
+	ts->n_wait--;
+	tw->err = err != 0 ? err : EIO;
+	AZ(pthread_cond_signal(tw->cond));
+}
+
+/*--------------------------------------------------------------------
+ * Put a connection on the idle list, watched by the waiter.  The list
+ * is LIFO, so the connection used last, which has the warmest TCP
+ * state, gets used first.
+ */
+
+static int
+vbt_idle(struct tcp_shard *ts, struct vbc *vbc, int warm)
+{
+
+	Lck_AssertHeld(&ts->mtx);
+	vbc->waited->priv1 = vbc;
+	vbc->waited->fd = vbc->fd;
+	vbc->waited->idle = VTIM_real();
+	vbc->waited->writable = 0;
+	vbc->state = VBC_STATE_AVAIL;
+	vbc->waited->func = tcp_handle;
+	vbc->waited->tmo = &cache_param->backend_idle_timeout;
+	if (Wait_Enter(vbc->waiter, vbc->waited)) {
+		VTCP_close(&vbc->fd);
+		memset(vbc, 0x33, sizeof *vbc);
+		free(vbc);
+		return (-1);
+	}
+	VTAILQ_INSERT_HEAD(&ts->connlist, vbc, list);
+	ts->n_conn++;
+	VSC_Shard()->backend_conn_idle++;
+	vbc->warm = warm;
+	if (warm)
+		VSC_Shard()->backend_conn_warm++;
+	return (0);
+}
+
+static void
+vbt_unidle(struct tcp_shard *ts, struct vbc *vbc)
+{
+
+	Lck_AssertHeld(&ts->mtx);
+	ts->n_conn--;
+	VSC_Shard()->backend_conn_idle--;
+	if (vbc->warm)
+		VSC_Shard()->backend_conn_warm--;
+	vbc->warm = 0;
+}
+
+/*--------------------------------------------------------------------
+ * How many connections we should start to serve the queue and keep
+ * the idle list warm.  They are counted as connecting right away.
+ */
+
+static int
+vbt_fill(struct tcp_shard *ts)
+{
+	int n;
+
+	Lck_AssertHeld(&ts->mtx);
+	n = ts->n_wait;
+	if (ts->warm_ok && !ts->dying)
+		n += cache_param->backend_warm_connections;
+	n -= ts->n_conn + ts->n_connecting;
+	if (n <= 0)
+		return (0);
+	ts->n_connecting += n;
+	VSC_Shard()->backend_conn_connecting += n;
+	return (n);
+}
+
+/*--------------------------------------------------------------------
+ * Start a connection, tcp_handle() takes it from there.  It sits on the
+ * connectlist meanwhile, so VBT_Rel() can abort it.
+ */
+
+static void
+vbt_start(struct tcp_shard *ts, const struct waiter *wtr, double tmo)
+{
+	struct vbc *vbc;
+	int err;
+
+	ALLOC_OBJ(vbc, VBC_MAGIC);
+	AN(vbc);
+	INIT_OBJ(vbc->waited, WAITED_MAGIC);
+	vbc->tcp_pool = ts->tcp_pool;
+	vbc->tcp_shard = ts;
+	vbc->waiter = wtr;
+	vbc->t_connect = VTIM_real();
+	/* A connect_timeout of zero leaves it to the kernel */
+	vbc->connect_tmo = tmo > 0. ? tmo : 1e6;
+	if (!vbt_connect(ts->tcp_pool, vbc)) {
+		vbc->state = VBC_STATE_CONNECT;
+		vbc->waited->priv1 = vbc;
+		vbc->waited->fd = vbc->fd;
+		vbc->waited->idle = vbc->t_connect;
+		vbc->waited->writable = 1;
+		vbc->waited->func = tcp_handle;
+		vbc->waited->tmo = &vbc->connect_tmo;
+		Lck_Lock(&ts->mtx);
+		if (ts->dying) {
+			err = ECONNABORTED;
+		} else {
+			VTAILQ_INSERT_TAIL(&ts->connectlist, vbc, list);
+			if (!Wait_Enter(wtr, vbc->waited)) {
+				Lck_Unlock(&ts->mtx);
+				return;
+			}
+			err = errno;
+			VTAILQ_REMOVE(&ts->connectlist, vbc, list);
+		}
+		VTCP_close(&vbc->fd);
+	} else {
+		err = errno;
+		Lck_Lock(&ts->mtx);
+	}
+	FREE_OBJ(vbc);
+	ts->n_connecting--;
+	VSC_Shard()->backend_conn_connecting--;
+	vbt_failed(ts, err);
+	Lck_Unlock(&ts->mtx);
+}
+
+/*--------------------------------------------------------------------
+ * Refill a shard from a pool task, the waiter must not be entered from
+ * its own callbacks.  The connections were counted in n_connecting by
+ * vbt_fill(), which keeps the shard from going away meanwhile.
+ */
+
+static void __match_proto__(task_func_t)
+vbt_refill_task(struct worker *wrk, void *priv)
+{
+	struct tcp_refill *tr;
+
+	(void)wrk;
+	CAST_OBJ_NOTNULL(tr, priv, TCP_REFILL_MAGIC);
+	while (tr->n-- > 0)
+		vbt_start(tr->ts, tr->wtr, tr->tmo);
+	FREE_OBJ(tr);
+}
+
+static void
+vbt_refill(struct tcp_shard *ts, const struct waiter *wtr, double tmo, int n)
+{
+	struct tcp_refill *tr;
+
+	ALLOC_OBJ(tr, TCP_REFILL_MAGIC);
+	AN(tr);
+	tr->ts = ts;
+	tr->wtr = wtr;
+	tr->tmo = tmo;
+	tr->n = n;
+	tr->task.func = vbt_refill_task;
+	tr->task.priv = tr;
+	if (Pool_Task_Any(&tr->task, TASK_QUEUE_BO) == 0)
+		return;
+	FREE_OBJ(tr);
+	Lck_Lock(&ts->mtx);
+	ts->n_connecting -= n;
+	VSC_Shard()->backend_conn_connecting -= n;
+	Lck_Unlock(&ts->mtx);
+}
+
+/*--------------------------------------------------------------------
+ * A connect completed, failed or timed out.  The waiter has filled in
+ * vbc->fd, vbc->err and vbc->t_done.  Trying the other address and
+ * going idle enter the waiter again, so tcp_handle() only calls us
+ * directly when the connection goes to a fetch or gets closed.
+ */
+
+static void
+vbt_connected(struct tcp_shard *ts, struct vbc *vbc)
+{
+	double d;
+	int err;
+
+	Lck_AssertHeld(&ts->mtx);
+	ts->n_connecting--;
+	VSC_Shard()->backend_conn_connecting--;
+	if (vbc->fd < 0 && !ts->dying && !vbt_connect(ts->tcp_pool, vbc)) {
+		/* Try the other address */
+		ts->n_connecting++;
+		VSC_Shard()->backend_conn_connecting++;
+		vbc->waited->fd = vbc->fd;
+		vbc->waited->idle = vbc->t_done;
+		VTAILQ_INSERT_TAIL(&ts->connectlist, vbc, list);
+		if (!Wait_Enter(vbc->waiter, vbc->waited))
+			return;
+		vbc->err = errno;
+		VTAILQ_REMOVE(&ts->connectlist, vbc, list);
+		VTCP_close(&vbc->fd);
+		ts->n_connecting--;
+		VSC_Shard()->backend_conn_connecting--;
+	}
+	if (vbc->fd < 0) {
+		err = vbc->err;
+		FREE_OBJ(vbc);
+		vbt_failed(ts, err);
+		return;
+	}
+
+	ts->warm_ok = 1;
+	VSC_Shard()->backend_conn++;
+	d = vbc->t_done - vbc->t_connect;
+	if (d < 1e-3)
+		VSC_Shard()->backend_connect_lt1ms++;
+	else if (d < 1e-2)
+		VSC_Shard()->backend_connect_lt10ms++;
+	else if (d < 1e-1)
+		VSC_Shard()->backend_connect_lt100ms++;
+	else
+		VSC_Shard()->backend_connect_ge100ms++;
+
+	if (ts->dying) {
+		VTCP_close(&vbc->fd);
+		FREE_OBJ(vbc);
+	} else if (!VTAILQ_EMPTY(&ts->waitlist))
+		vbt_hand(ts, vbc);
+	else
+		(void)vbt_idle(ts, vbc, 1);
+}
+
+static void __match_proto__(task_func_t)
+vbt_connected_task(struct worker *wrk, void *priv)
+{
+	struct vbc *vbc;
+	struct tcp_shard *ts;
+
+	(void)wrk;
+	CAST_OBJ_NOTNULL(vbc, priv, VBC_MAGIC);
+	ts = vbc->tcp_shard;
+	CHECK_OBJ_NOTNULL(ts, TCP_SHARD_MAGIC);
+	Lck_Lock(&ts->mtx);
+	vbt_connected(ts, vbc);
+	Lck_Unlock(&ts->mtx);
+}
+
 /*--------------------------------------------------------------------
  * Waiter-handler
  */
@@ -78,53 +438,91 @@ static VTAILQ_HEAD(, tcp_pool)	pools = VTAILQ_HEAD_INITIALIZER(pools);
 static void  __match_proto__(waiter_handle_f)
 tcp_handle(struct waited *w, enum wait_event ev, double now)
 {
-	struct vbc *vbc;
-	struct tcp_pool *tp;
+	struct vbc *vbc, *defer = NULL;
+	struct tcp_shard *ts;
+	const struct waiter *wtr = NULL;
+	double tmo = 0.;
+	int n = 0;
 
 	CAST_OBJ_NOTNULL(vbc, w->priv1, VBC_MAGIC);
-	(void)ev;
-	(void)now;
 	CHECK_OBJ_NOTNULL(vbc->tcp_pool, TCP_POOL_MAGIC);
-	tp = vbc->tcp_pool;
+	ts = vbc->tcp_shard;
+	CHECK_OBJ_NOTNULL(ts, TCP_SHARD_MAGIC);
 
-	Lck_Lock(&tp->mtx);
+	Lck_Lock(&ts->mtx);
 
 	switch(vbc->state) {
+	case VBC_STATE_CONNECT:
+		VTAILQ_REMOVE(&ts->connectlist, vbc, list);
+		if (ev == WAITER_ACTION) {
+			vbc->fd = VTCP_connected(vbc->fd);
+			vbc->err = errno;
+		} else {
+			VTCP_close(&vbc->fd);
+			vbc->err = ev == WAITER_TIMEOUT ? ETIMEDOUT : ECONNREFUSED;
+		}
+		vbc->t_done = now;
+		if (vbc->fd >= 0 &&
+		    (ts->dying || !VTAILQ_EMPTY(&ts->waitlist)))
+			vbt_connected(ts, vbc);
+		else
+			defer = vbc;
+		break;
 	case VBC_STATE_STOLEN:
 		vbc->state = VBC_STATE_USED;
-		VTAILQ_REMOVE(&tp->connlist, vbc, list);
+		VTAILQ_REMOVE(&ts->connlist, vbc, list);
 		AN(vbc->cond);
 		AZ(pthread_cond_signal(vbc->cond));
 		break;
 	case VBC_STATE_AVAIL:
 		VTCP_close(&vbc->fd);
-		VTAILQ_REMOVE(&tp->connlist, vbc, list);
-		tp->n_conn--;
+		VTAILQ_REMOVE(&ts->connlist, vbc, list);
+		vbt_unidle(ts, vbc);
+		wtr = vbc->waiter;
+		tmo = vbc->connect_tmo;
 		FREE_OBJ(vbc);
+		n = vbt_fill(ts);
 		break;
 	case VBC_STATE_CLEANUP:
 		VTCP_close(&vbc->fd);
-		tp->n_kill--;
-		VTAILQ_REMOVE(&tp->killlist, vbc, list);
+		ts->n_kill--;
+		VTAILQ_REMOVE(&ts->killlist, vbc, list);
 		memset(vbc, 0x11, sizeof *vbc);
 		free(vbc);
 		break;
 	default:
 		WRONG("Wrong vbc state");
 	}
-	Lck_Unlock(&tp->mtx);
+	Lck_Unlock(&ts->mtx);
+	if (defer != NULL) {
+		defer->task.func = vbt_connected_task;
+		defer->task.priv = defer;
+		if (Pool_Task_Any(&defer->task, TASK_QUEUE_BO)) {
+			Lck_Lock(&ts->mtx);
+			vbt_connected(ts, defer);
+			Lck_Unlock(&ts->mtx);
+		}
+	}
+	if (n > 0)
+		vbt_refill(ts, wtr, tmo, n);
 }
 
 /*--------------------------------------------------------------------
  * Reference a TCP pool given by {ip4, ip6} pair.  Create if it
  * doesn't exist already.
+ *
+ * The pool is split in a shard per thread pool, each with its own
+ * lock, so hot backends do not serialize all fetches on one mutex.
  */
 
 struct tcp_pool *
 VBT_Ref(const struct suckaddr *ip4, const struct suckaddr *ip6)
 {
 	struct tcp_pool *tp;
+	struct tcp_shard *ts;
+	unsigned u;
 
+	Lck_Lock(&pools_mtx);
 	VTAILQ_FOREACH(tp, &pools, list) {
 		assert(tp->refcnt > 0);
 		if (ip4 == NULL) {
@@ -146,6 +544,7 @@ VBT_Ref(const struct suckaddr *ip4, const struct suckaddr *ip6)
 				continue;
 		}
 		tp->refcnt++;
+		Lck_Unlock(&pools_mtx);
 		return (tp);
 	}
 
@@ -156,51 +555,97 @@ VBT_Ref(const struct suckaddr *ip4, const struct suckaddr *ip6)
 	if (ip6 != NULL)
 		tp->ip6 = VSA_Clone(ip6);
 	tp->refcnt = 1;
-	Lck_New(&tp->mtx, lck_backend_tcp);
-	VTAILQ_INIT(&tp->connlist);
-	VTAILQ_INIT(&tp->killlist);
+	tp->nshard = cache_param->wthread_pools;
+	if (tp->nshard == 0)
+		tp->nshard = 1;
+	tp->shard = calloc(tp->nshard, sizeof *tp->shard);
+	AN(tp->shard);
+	for (u = 0; u < tp->nshard; u++) {
+		ts = &tp->shard[u];
+		INIT_OBJ(ts, TCP_SHARD_MAGIC);
+		ts->tcp_pool = tp;
+		ts->warm_ok = 1;
+		Lck_New(&ts->mtx, lck_backend_tcp);
+		VTAILQ_INIT(&ts->connlist);
+		VTAILQ_INIT(&ts->killlist);
+		VTAILQ_INIT(&ts->waitlist);
+		VTAILQ_INIT(&ts->connectlist);
+	}
 	VTAILQ_INSERT_HEAD(&pools, tp, list);
+	Lck_Unlock(&pools_mtx);
 	return (tp);
 }
 
 /*--------------------------------------------------------------------
  * Release TCP pool, destroy if last reference.
+ *
+ * Connects in progress are aborted with shutdown(2), which makes the
+ * waiter report them at once, and then we wait for the waiter to be
+ * done with them and the killed connections.  Callers should not hold
+ * locks, the connects which were already handed to a pool task only
+ * finish when a worker thread gets to them.
  */
 
 void
 VBT_Rel(struct tcp_pool **tpp)
 {
 	struct tcp_pool *tp;
+	struct tcp_shard *ts;
 	struct vbc *vbc, *vbc2;
+	unsigned u;
 
 	TAKE_OBJ_NOTNULL(tp, tpp, TCP_POOL_MAGIC);
+	Lck_Lock(&pools_mtx);
 	assert(tp->refcnt > 0);
-	if (--tp->refcnt > 0)
+	if (--tp->refcnt > 0) {
+		Lck_Unlock(&pools_mtx);
 		return;
-	AZ(tp->n_used);
+	}
 	VTAILQ_REMOVE(&pools, tp, list);
+	Lck_Unlock(&pools_mtx);
+	for (u = 0; u < tp->nshard; u++) {
+		ts = &tp->shard[u];
+		CHECK_OBJ_NOTNULL(ts, TCP_SHARD_MAGIC);
+		Lck_Lock(&ts->mtx);
+		AZ(ts->n_used);
+		AZ(ts->n_wait);
+		ts->dying = 1;
+		VTAILQ_FOREACH_SAFE(vbc, &ts->connlist, list, vbc2) {
+			VTAILQ_REMOVE(&ts->connlist, vbc, list);
+			vbt_unidle(ts, vbc);
+			assert(vbc->state == VBC_STATE_AVAIL);
+			vbc->state = VBC_STATE_CLEANUP;
+			(void)shutdown(vbc->fd, SHUT_WR);
+			VTAILQ_INSERT_TAIL(&ts->killlist, vbc, list);
+			ts->n_kill++;
+		}
+		VTAILQ_FOREACH(vbc, &ts->connectlist, list) {
+			assert(vbc->state == VBC_STATE_CONNECT);
+			(void)shutdown(vbc->fd, SHUT_RDWR);
+		}
+		Lck_Unlock(&ts->mtx);
+	}
+	for (u = 0; u < tp->nshard; u++) {
+		ts = &tp->shard[u];
+		Lck_Lock(&ts->mtx);
+		while (ts->n_kill || ts->n_connecting) {
+			Lck_Unlock(&ts->mtx);
+			(void)usleep(20000);
+			Lck_Lock(&ts->mtx);
+		}
+		Lck_Unlock(&ts->mtx);
+		Lck_Delete(&ts->mtx);
+		AZ(ts->n_conn);
+		AZ(ts->n_kill);
+		AZ(ts->n_connecting);
+		assert(VTAILQ_EMPTY(&ts->connectlist));
+	}
+	free(tp->shard);
+
+	/* Connects in progress used the addresses until now */
 	free(tp->name);
 	free(tp->ip4);
 	free(tp->ip6);
-	Lck_Lock(&tp->mtx);
-	VTAILQ_FOREACH_SAFE(vbc, &tp->connlist, list, vbc2) {
-		VTAILQ_REMOVE(&tp->connlist, vbc, list);
-		tp->n_conn--;
-		assert(vbc->state == VBC_STATE_AVAIL);
-		vbc->state = VBC_STATE_CLEANUP;
-		(void)shutdown(vbc->fd, SHUT_WR);
-		VTAILQ_INSERT_TAIL(&tp->killlist, vbc, list);
-		tp->n_kill++;
-	}
-	while (tp->n_kill) {
-		Lck_Unlock(&tp->mtx);
-		(void)usleep(20000);
-		Lck_Lock(&tp->mtx);
-	}
-	Lck_Unlock(&tp->mtx);
-	Lck_Delete(&tp->mtx);
-	AZ(tp->n_conn);
-	AZ(tp->n_kill);
 
 	FREE_OBJ(tp);
 }
@@ -235,47 +680,44 @@ VBT_Open(const struct tcp_pool *tp, double tmo, const struct suckaddr **sa)
 }
 
 /*--------------------------------------------------------------------
- * Recycle a connection.
+ * Recycle a connection.  It goes back to the shard it came from.
+ * Returns non-zero if it had to be closed instead.
  */
 
-void
+int
 VBT_Recycle(const struct worker *wrk, struct tcp_pool *tp, struct vbc **vbcp)
 {
+	struct tcp_shard *ts;
 	struct vbc *vbc;
-	int i = 0;
+	int i = 0, retval = 0;
 
 	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
 	CHECK_OBJ_NOTNULL(tp, TCP_POOL_MAGIC);
 	vbc = *vbcp;
 	*vbcp = NULL;
 	CHECK_OBJ_NOTNULL(vbc, VBC_MAGIC);
+	ts = vbc->tcp_shard;
+	CHECK_OBJ_NOTNULL(ts, TCP_SHARD_MAGIC);
+	assert(ts->tcp_pool == tp);
 
 	assert(vbc->state == VBC_STATE_USED);
 	assert(vbc->fd > 0);
 
-	Lck_Lock(&tp->mtx);
-	tp->n_used--;
+	Lck_Lock(&ts->mtx);
+	ts->n_used--;
 
-	vbc->waited->priv1 = vbc;
-	vbc->waited->fd = vbc->fd;
-	vbc->waited->idle = VTIM_real();
-	vbc->state = VBC_STATE_AVAIL;
-	vbc->waited->func = tcp_handle;
-	vbc->waited->tmo = &cache_param->backend_idle_timeout;
-	if (Wait_Enter(wrk->pool->waiter, vbc->waited)) {
-		VTCP_close(&vbc->fd);
-		memset(vbc, 0x33, sizeof *vbc);
-		free(vbc);
-		// XXX: stats
-		vbc = NULL;
+	if (!VTAILQ_EMPTY(&ts->waitlist)) {
+		/* Somebody is waiting, no need to involve the waiter */
+		VSC_Shard()->backend_reuse++;
+		vbc->reused = 1;
+		vbt_hand(ts, vbc);
 	} else {
-		VTAILQ_INSERT_HEAD(&tp->connlist, vbc, list);
-		i++;
+		vbc->waiter = wrk->pool->waiter;
+		retval = vbt_idle(ts, vbc, 0);
+		if (!retval)
+			i++;
 	}
-
-	if (vbc != NULL)
-		tp->n_conn++;
-	Lck_Unlock(&tp->mtx);
+	Lck_Unlock(&ts->mtx);
 
 	if (i && DO_DEBUG(DBG_VTC_MODE)) {
 		/*
@@ -293,6 +735,7 @@ VBT_Recycle(const struct worker *wrk, struct tcp_pool *tp, struct vbc **vbcp)
 		 */
 		(void)usleep(10000);
 	}
+	return (retval);
 }
 
 /*--------------------------------------------------------------------
@@ -302,81 +745,150 @@ VBT_Recycle(const struct worker *wrk, struct tcp_pool *tp, struct vbc **vbcp)
 void
 VBT_Close(struct tcp_pool *tp, struct vbc **vbcp)
 {
+	struct tcp_shard *ts;
 	struct vbc *vbc;
 
 	CHECK_OBJ_NOTNULL(tp, TCP_POOL_MAGIC);
 	vbc = *vbcp;
 	*vbcp = NULL;
 	CHECK_OBJ_NOTNULL(vbc, VBC_MAGIC);
+	ts = vbc->tcp_shard;
+	CHECK_OBJ_NOTNULL(ts, TCP_SHARD_MAGIC);
+	assert(ts->tcp_pool == tp);
 
 	assert(vbc->state == VBC_STATE_USED);
 	assert(vbc->fd > 0);
 
-	Lck_Lock(&tp->mtx);
-	tp->n_used--;
+	Lck_Lock(&ts->mtx);
+	ts->n_used--;
 	if (vbc->state == VBC_STATE_STOLEN) {
 		(void)shutdown(vbc->fd, SHUT_WR);
 		vbc->state = VBC_STATE_CLEANUP;
-		VTAILQ_INSERT_HEAD(&tp->killlist, vbc, list);
-		tp->n_kill++;
+		VTAILQ_INSERT_HEAD(&ts->killlist, vbc, list);
+		ts->n_kill++;
 	} else {
 		assert(vbc->state == VBC_STATE_USED);
 		VTCP_close(&vbc->fd);
 		memset(vbc, 0x44, sizeof *vbc);
 		free(vbc);
 	}
-	Lck_Unlock(&tp->mtx);
+	Lck_Unlock(&ts->mtx);
+}
+
+/*--------------------------------------------------------------------
+ * Take the most recently used idle connection of a shard, if any.
+ * The waiter still has it, so it is marked stolen until the waiter
+ * lets go of it, see VBT_Wait().
+ */
+
+static struct vbc *
+vbt_steal(struct tcp_shard *ts, struct worker *wrk)
+{
+	struct vbc *vbc;
+
+	Lck_AssertHeld(&ts->mtx);
+	vbc = VTAILQ_FIRST(&ts->connlist);
+	CHECK_OBJ_ORNULL(vbc, VBC_MAGIC);
+	if (vbc == NULL || vbc->state == VBC_STATE_STOLEN)
+		return (NULL);
+	assert(vbc->tcp_shard == ts);
+	assert(vbc->state == VBC_STATE_AVAIL);
+	VTAILQ_REMOVE(&ts->connlist, vbc, list);
+	VTAILQ_INSERT_TAIL(&ts->connlist, vbc, list);
+	vbt_unidle(ts, vbc);
+	VSC_Shard()->backend_reuse++;
+	vbc->state = VBC_STATE_STOLEN;
+	vbc->reused = 1;
+	vbc->cond = &wrk->cond;
+	ts->n_used++;
+	return (vbc);
 }
 
 /*--------------------------------------------------------------------
- * Get a connection
+ * Get a connection, from our own shard if it has an idle one, else
+ * from another shard which has one and whose lock is free.  Failing
+ * that, queue up for the next connection ready in our own shard.
  */
 
 struct vbc *
 VBT_Get(struct tcp_pool *tp, double tmo, const struct backend *be,
     struct worker *wrk)
 {
+	struct tcp_shard *ts, *ts2;
 	struct vbc *vbc;
+	struct tcp_wait tw;
+	double when = 0.;
+	unsigned u;
+	int n;
 
 	CHECK_OBJ_NOTNULL(tp, TCP_POOL_MAGIC);
 	CHECK_OBJ_NOTNULL(be, BACKEND_MAGIC);
 	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	CHECK_OBJ_NOTNULL(wrk->pool, POOL_MAGIC);
+
+	ts = &tp->shard[wrk->pool->pool_no % tp->nshard];
+	CHECK_OBJ_NOTNULL(ts, TCP_SHARD_MAGIC);
+
+	Lck_Lock(&ts->mtx);
+	vbc = vbt_steal(ts, wrk);
+	if (vbc != NULL) {
+		n = vbt_fill(ts);
+		Lck_Unlock(&ts->mtx);
+		while (n-- > 0)
+			vbt_start(ts, wrk->pool->waiter, tmo);
+		return (vbc);
+	}
+	Lck_Unlock(&ts->mtx);
+
+	for (u = 1; u < tp->nshard; u++) {
+		ts2 = &tp->shard[(ts - tp->shard + u) % tp->nshard];
+		if (VTAILQ_EMPTY(&ts2->connlist) || Lck_Trylock(&ts2->mtx))
+			continue;
+		vbc = vbt_steal(ts2, wrk);
+		Lck_Unlock(&ts2->mtx);
+		if (vbc != NULL) {
+			VSC_Shard()->backend_steal++;
+			return (vbc);
+		}
+	}
 
-	Lck_Lock(&tp->mtx);
-	vbc = VTAILQ_FIRST(&tp->connlist);
-	CHECK_OBJ_ORNULL(vbc, VBC_MAGIC);
-	if (vbc == NULL || vbc->state == VBC_STATE_STOLEN)
-		vbc = NULL;
-	else {
-		assert(vbc->tcp_pool == tp);
-		assert(vbc->state == VBC_STATE_AVAIL);
-		VTAILQ_REMOVE(&tp->connlist, vbc, list);
-		VTAILQ_INSERT_TAIL(&tp->connlist, vbc, list);
-		tp->n_conn--;
-		VSC_C_main->backend_reuse++;
-		vbc->state = VBC_STATE_STOLEN;
-		vbc->cond = &wrk->cond;
+	INIT_OBJ(&tw, TCP_WAIT_MAGIC);
+	tw.cond = &wrk->cond;
+	if (tmo > 0.)
+		when = VTIM_real() + tmo;
+
+	Lck_Lock(&ts->mtx);
+	vbc = vbt_steal(ts, wrk);
+	if (vbc == NULL) {
+		VTAILQ_INSERT_TAIL(&ts->waitlist, &tw, list);
+		ts->n_wait++;
+		ts->n_used++;		// Opening mostly works
+		VSC_Shard()->backend_wait++;
 	}
-	tp->n_used++;			// Opening mostly works
-	Lck_Unlock(&tp->mtx);
+	n = vbt_fill(ts);
+	Lck_Unlock(&ts->mtx);
+
+	while (n-- > 0)
+		vbt_start(ts, wrk->pool->waiter, tmo);
 
 	if (vbc != NULL)
 		return (vbc);
 
-	ALLOC_OBJ(vbc, VBC_MAGIC);
-	AN(vbc);
-	INIT_OBJ(vbc->waited, WAITED_MAGIC);
-	vbc->state = VBC_STATE_USED;
-	vbc->tcp_pool = tp;
-	vbc->fd = VBT_Open(tp, tmo, &vbc->addr);
-	if (vbc->fd < 0) {
-		FREE_OBJ(vbc);
-		Lck_Lock(&tp->mtx);
-		tp->n_used--;		// Nope, didn't work after all.
-		Lck_Unlock(&tp->mtx);
-	} else
-		VSC_C_main->backend_conn++;
-
+	Lck_Lock(&ts->mtx);
+	while (tw.vbc == NULL && tw.err == 0) {
+		if (Lck_CondWait(&wrk->cond, &ts->mtx, when) == ETIMEDOUT)
+			break;
+	}
+	vbc = tw.vbc;
+	if (vbc == NULL) {
+		if (tw.err == 0) {
+			/* Timed out, still in the queue */
+			VTAILQ_REMOVE(&ts->waitlist, &tw, list);
+			ts->n_wait--;
+		}
+		ts->n_used--;		// Nope, didn't work after all.
+	}
+	Lck_Unlock(&ts->mtx);
 	return (vbc);
 }
 
@@ -386,17 +898,26 @@ VBT_Get(struct tcp_pool *tp, double tmo, const struct backend *be,
 void
 VBT_Wait(struct worker *wrk, struct vbc *vbc)
 {
-	struct tcp_pool *tp;
+	struct tcp_shard *ts;
 
 	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
 	CHECK_OBJ_NOTNULL(vbc, VBC_MAGIC);
-	tp = vbc->tcp_pool;
-	CHECK_OBJ_NOTNULL(tp, TCP_POOL_MAGIC);
+	ts = vbc->tcp_shard;
+	CHECK_OBJ_NOTNULL(ts, TCP_SHARD_MAGIC);
 	assert(vbc->cond == &wrk->cond);
-	Lck_Lock(&tp->mtx);
+	Lck_Lock(&ts->mtx);
 	while (vbc->state == VBC_STATE_STOLEN)
-		AZ(Lck_CondWait(&wrk->cond, &tp->mtx, 0));
+		AZ(Lck_CondWait(&wrk->cond, &ts->mtx, 0));
 	assert(vbc->state == VBC_STATE_USED);
 	vbc->cond = NULL;
-	Lck_Unlock(&tp->mtx);
+	Lck_Unlock(&ts->mtx);
+}
+
+/*--------------------------------------------------------------------*/
+
+void
+VBT_Init(void)
+{
+
+	Lck_New(&pools_mtx, lck_backend_tcp);
 }
@@ -48,13 +48,15 @@ struct ban * volatile ban_start;
 static pthread_t ban_thread;
 static int ban_holds;
 
-struct ban_test {
-	uint8_t			oper;
-	uint8_t			arg1;
-	const char		*arg1_spec;
-	const char		*arg2;
-	const void		*arg2_spec;
-};
+#if defined(USE_PCRE_JIT)
+#  define BAN_STUDY_JIT_COMPILE PCRE_STUDY_JIT_COMPILE
+#else
+#  define BAN_STUDY_JIT_COMPILE 0
+#endif
+
+#if PCRE_MAJOR < 8 || (PCRE_MAJOR == 8 && PCRE_MINOR < 20)
+#  define pcre_free_study pcre_free
+#endif
 
 /*--------------------------------------------------------------------
  * Storage handling of bans
@@ -74,11 +76,16 @@ ban_alloc(void)
 void
 BAN_Free(struct ban *b)
 {
+	unsigned u;
 
 	CHECK_OBJ_NOTNULL(b, BAN_MAGIC);
 	AZ(b->refcount);
 	assert(VTAILQ_EMPTY(&b->objcore));
 
+	for (u = 0; u < b->ntest; u++)
+		if (b->test[u].arg2_extra != NULL)
+			pcre_free_study(b->test[u].arg2_extra);
+	free(b->test);
 	if (b->spec != NULL)
 		free(b->spec);
 	FREE_OBJ(b);
@@ -164,7 +171,7 @@ ban_mark_completed(struct ban *b)
 		b->spec[BANS_FLAGS] |= BANS_FLAG_COMPLETED;
 		VWMB();
 		vbe32enc(b->spec + BANS_LENGTH, BANS_HEAD_LEN);
-		VSC_C_main->bans_completed++;
+		VSC_Shard()->bans_completed++;
 		VSC_C_main->bans_persisted_fragmentation +=
 		    ln - ban_len(b->spec);
 	}
@@ -210,6 +217,49 @@ ban_iter(const uint8_t **bs, struct ban_test *bt)
 		bt->arg2_spec = ban_get_lump(bs);
 }
 
+/*--------------------------------------------------------------------
+ * Compile the tests of a ban spec.  Studying the regexps can fail for
+ * lack of memory, we just go without the extra in that case.
+ */
+
+int
+ban_compile(struct ban *b)
+{
+	struct ban_test bt, *t;
+	const uint8_t *bs, *be;
+	const char *err;
+	unsigned n;
+
+	CHECK_OBJ_NOTNULL(b, BAN_MAGIC);
+	AN(b->spec);
+	AZ(b->test);
+
+	be = b->spec + ban_len(b->spec);
+	n = 0;
+	for (bs = b->spec + BANS_HEAD_LEN; bs < be; n++)
+		ban_iter(&bs, &bt);
+	if (n == 0)
+		return (0);
+
+	b->test = calloc(n, sizeof *b->test);
+	if (b->test == NULL)
+		return (-1);
+	for (bs = b->spec + BANS_HEAD_LEN; bs < be; b->ntest++) {
+		assert(b->ntest < n);
+		t = &b->test[b->ntest];
+		ban_iter(&bs, t);
+		if (t->arg2_spec == NULL)
+			continue;
+		err = NULL;
+		t->arg2_extra =
+		    pcre_study(t->arg2_spec, BAN_STUDY_JIT_COMPILE, &err);
+		if (err != NULL)
+			AZ(t->arg2_extra);
+	}
+	assert(b->ntest == n);
+	return (0);
+}
+
 /*--------------------------------------------------------------------
  * A new object is created, grab a reference to the newest ban
  */
@@ -375,20 +425,21 @@ ban_reload(const uint8_t *ban, unsigned len)
 			duplicate = 1;
 	}
 
-	VSC_C_main->bans++;
-	VSC_C_main->bans_added++;
+	VSC_Shard()->bans++;
+	VSC_Shard()->bans_added++;
 
 	b2 = ban_alloc();
 	AN(b2);
 	b2->spec = malloc(len);
 	AN(b2->spec);
 	memcpy(b2->spec, ban, len);
+	AZ(ban_compile(b2));
 	if (ban[BANS_FLAGS] & BANS_FLAG_REQ) {
-		VSC_C_main->bans_req++;
+		VSC_Shard()->bans_req++;
 		b2->flags |= BANS_FLAG_REQ;
 	}
 	if (duplicate)
-		VSC_C_main->bans_dups++;
+		VSC_Shard()->bans_dups++;
 	if (duplicate || (ban[BANS_FLAGS] & BANS_FLAG_COMPLETED))
 		ban_mark_completed(b2);
 	if (b == NULL)
@@ -403,7 +454,7 @@ ban_reload(const uint8_t *ban, unsigned len)
 			continue;
 		if (ban_equal(b->spec, ban)) {
 			ban_mark_completed(b);
-			VSC_C_main->bans_dups++;
+			VSC_Shard()->bans_dups++;
 		}
 	}
 }
@@ -453,32 +504,31 @@ BAN_Time(const struct ban *b)
  */
 
 int
-ban_evaluate(struct worker *wrk, const uint8_t *bs, struct objcore *oc,
+ban_evaluate(struct worker *wrk, const struct ban *b, struct objcore *oc,
     const struct http *reqhttp, unsigned *tests)
 {
-	struct ban_test bt;
-	const uint8_t *be;
+	const struct ban_test *bt;
 	const char *p;
 	const char *arg1;
+	unsigned u;
 
-	be = bs + ban_len(bs);
-	bs += BANS_HEAD_LEN;
-	while (bs < be) {
+	CHECK_OBJ_NOTNULL(b, BAN_MAGIC);
+	for (u = 0; u < b->ntest; u++) {
 		(*tests)++;
-		ban_iter(&bs, &bt);
+		bt = &b->test[u];
 		arg1 = NULL;
-		switch (bt.arg1) {
+		switch (bt->arg1) {
 		case BANS_ARG_URL:
 			AN(reqhttp);
 			arg1 = reqhttp->hd[HTTP_HDR_URL].b;
 			break;
 		case BANS_ARG_REQHTTP:
 			AN(reqhttp);
-			(void)http_GetHdr(reqhttp, bt.arg1_spec, &p);
+			(void)http_GetHdr(reqhttp, bt->arg1_spec, &p);
 			arg1 = p;
 			break;
 		case BANS_ARG_OBJHTTP:
-			arg1 = HTTP_GetHdrPack(wrk, oc, bt.arg1_spec);
+			arg1 = HTTP_GetHdrPack(wrk, oc, bt->arg1_spec);
 			break;
 		case BANS_ARG_OBJSTATUS:
 			arg1 = HTTP_GetHdrPack(wrk, oc, H__Status);
@@ -487,25 +537,25 @@ ban_evaluate(struct worker *wrk, const uint8_t *bs, struct objcore *oc,
 			WRONG("Wrong BAN_ARG code");
 		}
 
-		switch (bt.oper) {
+		switch (bt->oper) {
 		case BANS_OPER_EQ:
-			if (arg1 == NULL || strcmp(arg1, bt.arg2))
+			if (arg1 == NULL || strcmp(arg1, bt->arg2))
 				return (0);
 			break;
 		case BANS_OPER_NEQ:
-			if (arg1 != NULL && !strcmp(arg1, bt.arg2))
+			if (arg1 != NULL && !strcmp(arg1, bt->arg2))
 				return (0);
 			break;
 		case BANS_OPER_MATCH:
 			if (arg1 == NULL ||
-			    pcre_exec(bt.arg2_spec, NULL, arg1, strlen(arg1),
-			    0, 0, NULL, 0) < 0)
+			    pcre_exec(bt->arg2_spec, bt->arg2_extra, arg1,
+			    strlen(arg1), 0, 0, NULL, 0) < 0)
 				return (0);
 			break;
 		case BANS_OPER_NMATCH:
 			if (arg1 != NULL &&
-			    pcre_exec(bt.arg2_spec, NULL, arg1, strlen(arg1),
-			    0, 0, NULL, 0) >= 0)
+			    pcre_exec(bt->arg2_spec, bt->arg2_extra, arg1,
+			    strlen(arg1), 0, 0, NULL, 0) >= 0)
 				return (0);
 			break;
 		default:
@@ -573,14 +623,14 @@ BAN_CheckObject(struct worker *wrk, struct objcore *oc, struct req *req)
 		CHECK_OBJ_NOTNULL(b, BAN_MAGIC);
 		if (b->flags & BANS_FLAG_COMPLETED)
 			continue;
-		if (ban_evaluate(wrk, b->spec, oc, req->http, &tests))
+		if (ban_evaluate(wrk, b, oc, req->http, &tests))
 			break;
 	}
 
 	Lck_Lock(&ban_mtx);
 	bn->refcount--;
-	VSC_C_main->bans_tested++;
-	VSC_C_main->bans_tests_tested += tests;
+	VSC_Shard()->bans_tested++;
+	VSC_Shard()->bans_tests_tested += tests;
 
 	if (b == bn) {
 		/* not banned */
@@ -603,7 +653,7 @@ BAN_CheckObject(struct worker *wrk, struct objcore *oc, struct req *req)
 		return (0);
 	} else {
 		VSLb(vsl, SLT_ExpBan, "%u banned lookup", ObjGetXID(wrk, oc));
-		VSC_C_main->bans_obj_killed++;
+		VSC_Shard()->bans_obj_killed++;
 		return (1);
 	}
 }
@@ -84,6 +84,22 @@
 #define BANS_ARG_OBJHTTP	0x1a
 #define BANS_ARG_OBJSTATUS	0x1b
 
+/*--------------------------------------------------------------------
+ * A test picked apart from the spec.  Bans are compiled into an array
+ * of these when they are created, with the regexps studied (and JIT
+ * compiled if PCRE supports it), so evaluation does not have to walk
+ * the spec for every object.  The pointers point into the spec.
+ */
+
+struct ban_test {
+	uint8_t			oper;
+	uint8_t			arg1;
+	const char		*arg1_spec;
+	const char		*arg2;
+	const void		*arg2_spec;
+	pcre_extra		*arg2_extra;
+};
+
 /*--------------------------------------------------------------------*/
 
 struct ban {
@@ -96,6 +112,8 @@ struct ban {
 
 	VTAILQ_HEAD(,objcore)	objcore;
 	uint8_t			*spec;
+	struct ban_test		*test;
+	unsigned		ntest;
 };
 
 VTAILQ_HEAD(banhead_s,ban);
@@ -112,7 +130,8 @@ unsigned ban_len(const uint8_t *banspec);
 void ban_info_new(const uint8_t *ban, unsigned len);
 void ban_info_drop(const uint8_t *ban, unsigned len);
 
-int ban_evaluate(struct worker *wrk, const uint8_t *bs, struct objcore *oc,
+int ban_compile(struct ban *b);
+int ban_evaluate(struct worker *wrk, const struct ban *b, struct objcore *oc,
     const struct http *reqhttp, unsigned *tests);
 double ban_time(const uint8_t *banspec);
 int ban_equal(const uint8_t *bs1, const uint8_t *bs2);
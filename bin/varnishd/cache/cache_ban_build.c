@@ -283,6 +283,11 @@ BAN_Commit(struct ban_proto *bp)
 	ln += BANS_HEAD_LEN;
 	vbe32enc(b->spec + BANS_LENGTH, ln);
 
+	if (ban_compile(b)) {
+		BAN_Free(b);
+		return (ban_error(bp, ban_build_err_no_mem));
+	}
+
 	Lck_Lock(&ban_mtx);
 	if (ban_shutdown) {
 		/* We could have raced a shutdown */
@@ -294,14 +299,14 @@ BAN_Commit(struct ban_proto *bp)
 	VTAILQ_INSERT_HEAD(&ban_head, b, list);
 	ban_start = b;
 
-	VSC_C_main->bans++;
-	VSC_C_main->bans_added++;
+	VSC_Shard()->bans++;
+	VSC_Shard()->bans_added++;
 	VSC_C_main->bans_persisted_bytes += ln;
 
 	if (b->flags & BANS_FLAG_OBJ)
-		VSC_C_main->bans_obj++;
+		VSC_Shard()->bans_obj++;
 	if (b->flags & BANS_FLAG_REQ)
-		VSC_C_main->bans_req++;
+		VSC_Shard()->bans_req++;
 
 	if (bi != NULL)
 		ban_info_new(b->spec, ln);	/* Notify stevedores */
@@ -313,7 +318,7 @@ BAN_Commit(struct ban_proto *bp)
 			if (!(bi->flags & BANS_FLAG_COMPLETED) &&
 			    ban_equal(b->spec, bi->spec)) {
 				ban_mark_completed(bi);
-				VSC_C_main->bans_dups++;
+				VSC_Shard()->bans_dups++;
 			}
 		}
 	}
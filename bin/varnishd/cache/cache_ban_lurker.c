@@ -30,6 +30,8 @@
 
 #include "config.h"
 
+#include <pcre.h>
+
 #include "cache.h"
 #include "cache_ban.h"
 
@@ -41,6 +43,42 @@ static struct objcore oc_mark_end = { .magic = OBJCORE_MAGIC, };
 static unsigned ban_batch;
 static unsigned ban_generation;
 
+/*
+ * The objects of a ban are tested in jobs of up to BAN_JOB_SHARE objects
+ * per thread.  The lurker collects a job, queues ban_lurker_threads - 1
+ * pool tasks to help with it, and they all pick objects off the job
+ * until it is empty.  Testing only needs the job lock, ban_mtx is taken
+ * once per job to move the surviving objects up the ban list.
+ */
+
+#define BAN_JOB_SHARE		16
+#define BAN_JOB_MAXTHREADS	64
+#define BAN_JOB_MAX		(BAN_JOB_SHARE * BAN_JOB_MAXTHREADS)
+
+struct ban_eqidx;
+
+struct ban_job {
+	unsigned		magic;
+#define BAN_JOB_MAGIC		0x4e1b8a6d
+	struct lock		mtx;
+	pthread_cond_t		cond;
+	struct ban		*bt;
+	const struct ban_eqidx	*bx;
+	unsigned		next;
+	unsigned		noc;
+	struct objcore		*oc[BAN_JOB_MAX];
+	uint8_t			res[BAN_JOB_MAX];
+#define BAN_JOB_KEEP		0
+#define BAN_JOB_KILL		1
+#define BAN_JOB_MOVED		2
+	unsigned		nhelper;
+	unsigned		tested;
+	unsigned		tests;
+	struct pool_task	task[BAN_JOB_MAXTHREADS];
+};
+
+static struct ban_job ban_job[1];
+
 pthread_cond_t	ban_lurker_cond;
 
 void
@@ -77,13 +115,13 @@ ban_cleantail(const struct ban *victim)
 		if (b != VTAILQ_FIRST(&ban_head) && b->refcount == 0) {
 			assert(VTAILQ_EMPTY(&b->objcore));
 			if (b->flags & BANS_FLAG_COMPLETED)
-				VSC_C_main->bans_completed--;
+				VSC_Shard()->bans_completed--;
 			if (b->flags & BANS_FLAG_OBJ)
-				VSC_C_main->bans_obj--;
+				VSC_Shard()->bans_obj--;
 			if (b->flags & BANS_FLAG_REQ)
-				VSC_C_main->bans_req--;
-			VSC_C_main->bans--;
-			VSC_C_main->bans_deleted++;
+				VSC_Shard()->bans_req--;
+			VSC_Shard()->bans--;
+			VSC_Shard()->bans_deleted++;
 			VTAILQ_REMOVE(&ban_head, b, list);
 			VTAILQ_INSERT_TAIL(&freelist, b, list);
 			VSC_C_main->bans_persisted_fragmentation +=
@@ -117,6 +155,148 @@ ban_cleantail(const struct ban *victim)
  * re-try them in order.
  */
 
+/*--------------------------------------------------------------------
+ * Equality tests on object fields are what bans generated from
+ * applications mostly look like, and they come in numbers.  Rather
+ * than testing each object against every such ban in turn, we put the
+ * bans consisting of a single obj.http.* or obj.status equality test in
+ * a hash table keyed by field and value, so an object needs only one
+ * lookup per field no matter how many bans there are.
+ *
+ * The remaining bans are tested one by one as before.
+ */
+
+struct ban_eqfld {
+	uint8_t			arg1;
+	const char		*hdr;
+};
+
+struct ban_eqent {
+	struct ban		*ban;
+	unsigned		fld;
+	unsigned		hash;
+	struct ban_eqent	*next;
+};
+
+struct ban_eqidx {
+	unsigned		nfld;
+	struct ban_eqfld	*fld;
+	unsigned		nent;
+	struct ban_eqent	*ent;
+	unsigned		mask;
+	struct ban_eqent	**bucket;
+	unsigned		nrest;
+	struct ban		**rest;
+};
+
+static unsigned
+ban_eqhash(unsigned fld, const char *s)
+{
+	unsigned h = 2166136261U ^ fld;
+
+	for (; *s != '\0'; s++) {
+		h ^= (uint8_t)*s;
+		h *= 16777619U;
+	}
+	return (h);
+}
+
+static void
+ban_eqidx_build(struct ban_eqidx *bx, const struct banhead_s *obans)
+{
+	const struct ban_test *bt;
+	struct ban_eqent *be;
+	struct ban *bl;
+	const char *hdr;
+	unsigned n, u;
+
+	memset(bx, 0, sizeof *bx);
+	n = 0;
+	VTAILQ_FOREACH(bl, obans, l_list)
+		n++;
+	if (n == 0)
+		return;
+	for (bx->mask = 1; bx->mask < n * 2; bx->mask <<= 1)
+		continue;
+	bx->fld = calloc(n, sizeof *bx->fld);
+	bx->ent = calloc(n, sizeof *bx->ent);
+	bx->bucket = calloc(bx->mask, sizeof *bx->bucket);
+	bx->rest = calloc(n, sizeof *bx->rest);
+	AN(bx->fld);
+	AN(bx->ent);
+	AN(bx->bucket);
+	AN(bx->rest);
+	bx->mask--;
+
+	/* Oldest first, in the order they are tested */
+	VTAILQ_FOREACH_REVERSE(bl, obans, banhead_s, l_list) {
+		CHECK_OBJ_NOTNULL(bl, BAN_MAGIC);
+		if (bl->flags & BANS_FLAG_COMPLETED)
+			continue;
+		bt = bl->test;
+		if (bl->ntest != 1 || bt->oper != BANS_OPER_EQ || (
+		    bt->arg1 != BANS_ARG_OBJHTTP &&
+		    bt->arg1 != BANS_ARG_OBJSTATUS)) {
+			bx->rest[bx->nrest++] = bl;
+			continue;
+		}
+		hdr = bt->arg1 == BANS_ARG_OBJHTTP ? bt->arg1_spec : H__Status;
+		for (u = 0; u < bx->nfld; u++)
+			if (bx->fld[u].arg1 == bt->arg1 &&
+			    bx->fld[u].hdr[0] == hdr[0] &&
+			    !strcasecmp(bx->fld[u].hdr + 1, hdr + 1))
+				break;
+		if (u == bx->nfld) {
+			bx->fld[u].arg1 = bt->arg1;
+			bx->fld[u].hdr = hdr;
+			bx->nfld++;
+		}
+		be = &bx->ent[bx->nent++];
+		be->ban = bl;
+		be->fld = u;
+		be->hash = ban_eqhash(u, bt->arg2);
+		be->next = bx->bucket[be->hash & bx->mask];
+		bx->bucket[be->hash & bx->mask] = be;
+	}
+}
+
+static void
+ban_eqidx_free(struct ban_eqidx *bx)
+{
+
+	free(bx->fld);
+	free(bx->ent);
+	free(bx->bucket);
+	free(bx->rest);
+	memset(bx, 0, sizeof *bx);
+}
+
+static int
+ban_eqidx_test(struct worker *wrk, const struct ban_eqidx *bx,
+    struct objcore *oc, unsigned *tested, unsigned *tests)
+{
+	const struct ban_eqent *be;
+	const char *arg1;
+	unsigned u, h;
+
+	for (u = 0; u < bx->nfld; u++) {
+		(*tested)++;
+		(*tests)++;
+		arg1 = HTTP_GetHdrPack(wrk, oc, bx->fld[u].hdr);
+		if (arg1 == NULL)
+			continue;
+		h = ban_eqhash(u, arg1);
+		for (be = bx->bucket[h & bx->mask]; be != NULL; be = be->next)
+			if (be->hash == h && be->fld == u &&
+			    !(be->ban->flags & BANS_FLAG_COMPLETED) &&
+			    !strcmp(be->ban->test->arg2, arg1))
+				return (1);
+	}
+	return (0);
+}
+
+/*--------------------------------------------------------------------*/
+
 static struct objcore *
 ban_lurker_getfirst(struct vsl_log *vsl, struct ban *bt)
 {
@@ -148,7 +328,7 @@ ban_lurker_getfirst(struct vsl_log *vsl, struct ban *bt)
 
 			/* hold off to give lookup a chance and reiterate */
 			Lck_Unlock(&ban_mtx);
-			VSC_C_main->bans_lurker_contention++;
+			VSC_Shard()->bans_lurker_contention++;
 			VSL_Flush(vsl, 0);
 			VTIM_sleep(cache_param->ban_lurker_holdoff);
 			Lck_Lock(&ban_mtx);
@@ -194,14 +374,172 @@ ban_lurker_getfirst(struct vsl_log *vsl, struct ban *bt)
 	return (oc);
 }
 
+/*--------------------------------------------------------------------
+ * Test an object against the bans, return non-zero if it is banned.
+ */
+
+static int
+ban_lurker_test_oc(struct worker *wrk, const struct ban_job *job,
+    struct objcore *oc, unsigned *tested, unsigned *tests)
+{
+	const struct ban_eqidx *bx;
+	struct ban *bl;
+	unsigned u;
+
+	bx = job->bx;
+	if (oc->ban == job->bt &&
+	    ban_eqidx_test(wrk, bx, oc, tested, tests))
+		return (1);
+	for (u = 0; u < bx->nrest; u++) {
+		if (oc->ban != job->bt) {
+			/*
+			 * HSH_Lookup() grabbed this oc, killed
+			 * it or tested it to top.  We're done.
+			 */
+			break;
+		}
+		bl = bx->rest[u];
+		if (bl == NULL || bl->flags & BANS_FLAG_COMPLETED)
+			continue;
+		AZ(bl->flags & BANS_FLAG_REQ);
+		(*tested)++;
+		if (ban_evaluate(wrk, bl, oc, NULL, tests))
+			return (1);
+	}
+	return (0);
+}
+
 static void
+ban_job_work(struct worker *wrk, struct ban_job *job)
+{
+	unsigned u, tested = 0, tests = 0;
+
+	Lck_Lock(&job->mtx);
+	while (job->next < job->noc) {
+		u = job->next++;
+		Lck_Unlock(&job->mtx);
+		if (ban_lurker_test_oc(wrk, job, job->oc[u], &tested, &tests))
+			job->res[u] = BAN_JOB_KILL;
+		else
+			job->res[u] = BAN_JOB_KEEP;
+		Lck_Lock(&job->mtx);
+	}
+	job->tested += tested;
+	job->tests += tests;
+	Lck_Unlock(&job->mtx);
+}
+
+static void __match_proto__(task_func_t)
+ban_job_helper(struct worker *wrk, void *priv)
+{
+	struct ban_job *job;
+
+	CAST_OBJ_NOTNULL(job, priv, BAN_JOB_MAGIC);
+	ban_job_work(wrk, job);
+	Lck_Lock(&job->mtx);
+	assert(job->nhelper > 0);
+	if (--job->nhelper == 0)
+		AZ(pthread_cond_signal(&job->cond));
+	Lck_Unlock(&job->mtx);
+}
+
+/*--------------------------------------------------------------------
+ * Run a job and dispose of its objects.  Pool tasks which cannot be
+ * queued leave more work for the others.
+ */
+
+static void
+ban_job_run(struct worker *wrk, struct vsl_log *vsl, struct ban_job *job,
+    struct ban *bd)
+{
+	struct ban *bt;
+	struct objcore *oc;
+	unsigned u, n;
+
+	CHECK_OBJ_NOTNULL(job, BAN_JOB_MAGIC);
+	bt = job->bt;
+	AZ(job->next);
+	AZ(job->nhelper);
+	job->tested = 0;
+	job->tests = 0;
+
+	n = cache_param->ban_lurker_threads;
+	if (n > BAN_JOB_MAXTHREADS)
+		n = BAN_JOB_MAXTHREADS;
+	if (n > (job->noc + BAN_JOB_SHARE - 1) / BAN_JOB_SHARE)
+		n = (job->noc + BAN_JOB_SHARE - 1) / BAN_JOB_SHARE;
+	for (u = 0; u + 1 < n; u++) {
+		job->task[u].func = ban_job_helper;
+		job->task[u].priv = job;
+		Lck_Lock(&job->mtx);
+		job->nhelper++;
+		Lck_Unlock(&job->mtx);
+		if (Pool_Task_Any(&job->task[u], TASK_QUEUE_REQ)) {
+			Lck_Lock(&job->mtx);
+			job->nhelper--;
+			Lck_Unlock(&job->mtx);
+			break;
+		}
+	}
+	ban_job_work(wrk, job);
+	Lck_Lock(&job->mtx);
+	while (job->nhelper > 0)
+		(void)Lck_CondWait(&job->cond, &job->mtx, 0);
+	Lck_Unlock(&job->mtx);
+	assert(job->next == job->noc);
+
+	VSC_Shard()->bans_lurker_tested += job->tested;
+	VSC_Shard()->bans_lurker_tests_tested += job->tests;
+
+	Lck_Lock(&ban_mtx);
+	for (u = 0; u < job->noc; u++) {
+		oc = job->oc[u];
+		if (job->res[u] != BAN_JOB_KEEP || oc->ban != bt)
+			continue;
+		bt->refcount--;
+		VTAILQ_REMOVE(&bt->objcore, oc, ban_list);
+		oc->ban = bd;
+		bd->refcount++;
+		VTAILQ_INSERT_TAIL(&bd->objcore, oc, ban_list);
+		job->res[u] = BAN_JOB_MOVED;
+	}
+	Lck_Unlock(&ban_mtx);
+
+	for (u = 0; u < job->noc; u++) {
+		oc = job->oc[u];
+		if (job->res[u] == BAN_JOB_KILL) {
+			VSLb(vsl, SLT_ExpBan, "%u banned by lurker",
+			    ObjGetXID(wrk, oc));
+			HSH_Kill(oc);
+			VSC_Shard()->bans_lurker_obj_killed++;
+		} else if (job->res[u] == BAN_JOB_MOVED)
+			ObjSendEvent(wrk, oc, OEV_BANCHG);
+		(void)HSH_DerefObjCore(wrk, &oc, 0);
+		job->oc[u] = NULL;
+	}
+	if (VSC_C_main->bans_lurker_backlog > job->noc)
+		VSC_C_main->bans_lurker_backlog -= job->noc;
+	else
+		VSC_C_main->bans_lurker_backlog = 0;
+	job->next = 0;
+	job->noc = 0;
+}
+
+/*--------------------------------------------------------------------
+ * Test the objects hanging on bt against obans, and move them to bd.
+ * Returns the number of objects tested, and the time spent testing
+ * them in *tact.
+ */
+
+static unsigned
 ban_lurker_test_ban(struct worker *wrk, struct vsl_log *vsl, struct ban *bt,
-    struct banhead_s *obans, struct ban *bd)
+    struct banhead_s *obans, struct ban *bd, double *tact)
 {
-	struct ban *bl, *bln;
+	struct ban_eqidx bx;
+	struct ban_job *job;
 	struct objcore *oc;
-	unsigned tests;
-	int i;
+	unsigned u, nobj, nmax;
+	double t0, t;
 
 	/*
 	 * First see if there is anything to do, and if so, insert markers
@@ -214,59 +552,62 @@ ban_lurker_test_ban(struct worker *wrk, struct vsl_log *vsl, struct ban *bt,
 	}
 	Lck_Unlock(&ban_mtx);
 	if (oc == NULL)
-		return;
-
-	while (1) {
-		if (++ban_batch > cache_param->ban_lurker_batch) {
+		return (0);
+
+	job = ban_job;
+	CHECK_OBJ_NOTNULL(job, BAN_JOB_MAGIC);
+	job->bt = bt;
+	job->bx = &bx;
+	t0 = VTIM_mono();
+	ban_eqidx_build(&bx, obans);
+	t = VTIM_mono() - t0;
+	nobj = 0;
+	do {
+		if (ban_batch >= cache_param->ban_lurker_batch) {
 			VTIM_sleep(cache_param->ban_lurker_sleep);
 			ban_batch = 0;
 		}
-		oc = ban_lurker_getfirst(vsl, bt);
-		if (oc == NULL)
-			return;
-		i = 0;
-		VTAILQ_FOREACH_REVERSE_SAFE(bl, obans, banhead_s, l_list, bln) {
-			if (oc->ban != bt) {
-				/*
-				 * HSH_Lookup() grabbed this oc, killed
-				 * it or tested it to top.  We're done.
-				 */
-				break;
-			}
-			if (bl->flags & BANS_FLAG_COMPLETED) {
-				/* Ban was overtaken by new (dup) ban */
-				VTAILQ_REMOVE(obans, bl, l_list);
-				continue;
-			}
-			AZ(bl->flags & BANS_FLAG_REQ);
-			tests = 0;
-			i = ban_evaluate(wrk, bl->spec, oc, NULL, &tests);
-			VSC_C_main->bans_lurker_tested++;
-			VSC_C_main->bans_lurker_tests_tested += tests;
-			if (i) {
-				VSLb(vsl, SLT_ExpBan, "%u banned by lurker",
-				    ObjGetXID(wrk, oc));
-				HSH_Kill(oc);
-				VSC_C_main->bans_lurker_obj_killed++;
-				break;
+		t0 = VTIM_mono();
+
+		/* Bans overtaken by new (dup) bans need no testing */
+		for (u = 0; u < bx.nrest; u++) {
+			if (bx.rest[u] != NULL &&
+			    bx.rest[u]->flags & BANS_FLAG_COMPLETED) {
+				VTAILQ_REMOVE(obans, bx.rest[u], l_list);
+				bx.rest[u] = NULL;
 			}
 		}
-		if (i == 0 && oc->ban == bt) {
-			Lck_Lock(&ban_mtx);
-			if (oc->ban == bt) {
-				bt->refcount--;
-				VTAILQ_REMOVE(&bt->objcore, oc, ban_list);
-				oc->ban = bd;
-				bd->refcount++;
-				VTAILQ_INSERT_TAIL(&bd->objcore, oc, ban_list);
-				i = 1;
-			}
-			Lck_Unlock(&ban_mtx);
-			if (i)
-				ObjSendEvent(wrk, oc, OEV_BANCHG);
+
+		nmax = cache_param->ban_lurker_threads * BAN_JOB_SHARE;
+		if (nmax > BAN_JOB_MAX)
+			nmax = BAN_JOB_MAX;
+		if (nmax > cache_param->ban_lurker_batch - ban_batch)
+			nmax = cache_param->ban_lurker_batch - ban_batch;
+		AZ(job->noc);
+		while (job->noc < nmax) {
+			oc = ban_lurker_getfirst(vsl, bt);
+			if (oc == NULL)
+				break;
+			job->oc[job->noc++] = oc;
 		}
-		(void)HSH_DerefObjCore(wrk, &oc, 0);
+		ban_batch += job->noc;
+		nobj += job->noc;
+		if (job->noc > 0)
+			ban_job_run(wrk, vsl, job, bd);
+		t += VTIM_mono() - t0;
+	} while (oc != NULL);
+	*tact += t;
+
+	if (DO_DEBUG(DBG_LURKER)) {
+		VSLb(vsl, SLT_Debug,
+		    "lurker: %u objects, %u+%u bans, %.0f objects/s",
+		    nobj, bx.nent, bx.nrest, nobj / t);
+		VSL_Flush(vsl, 0);
 	}
+	ban_eqidx_free(&bx);
+	job->bx = NULL;
+	job->bt = NULL;
+	return (nobj);
 }
 
 /*--------------------------------------------------------------------
@@ -284,7 +625,17 @@ ban_lurker_work(struct worker *wrk, struct vsl_log *vsl)
 {
 	struct ban *b, *bd;
 	struct banhead_s obans;
-	double d, dt, n;
+	double d, dt, n, tact;
+	uint64_t nobj;
+
+	/* Objects not on the newest ban are waiting for us */
+	nobj = 0;
+	Lck_Lock(&ban_mtx);
+	for (b = VTAILQ_NEXT(ban_start, list); b != NULL;
+	    b = VTAILQ_NEXT(b, list))
+		nobj += b->refcount;
+	VSC_C_main->bans_lurker_backlog = nobj;
+	Lck_Unlock(&ban_mtx);
 
 	dt = 49.62;		// Random, non-magic
 	if (cache_param->ban_lurker_sleep == 0) {
@@ -298,9 +649,12 @@ ban_lurker_work(struct worker *wrk, struct vsl_log *vsl)
 	d = VTIM_real() - cache_param->ban_lurker_age;
 	bd = NULL;
 	VTAILQ_INIT(&obans);
+	nobj = 0;
+	tact = 0.0;
 	for (; b != NULL; b = VTAILQ_NEXT(b, list)) {
 		if (bd != NULL && bd != b)
-			ban_lurker_test_ban(wrk, vsl, b, &obans, bd);
+			nobj += ban_lurker_test_ban(wrk, vsl, b, &obans, bd,
+			    &tact);
 		if (b->flags & BANS_FLAG_COMPLETED)
 			continue;
 		if (b->flags & BANS_FLAG_REQ) {
@@ -317,6 +671,8 @@ ban_lurker_work(struct worker *wrk, struct vsl_log *vsl)
 			dt = n;
 		}
 	}
+	if (nobj > 0 && tact > 0.0)
+		VSC_C_main->bans_lurker_rate = (uint64_t)(nobj / tact);
 
 	/*
 	 * conceptually, all obans are now completed. Remove the tail. If it
@@ -351,6 +707,10 @@ ban_lurker(struct worker *wrk, void *priv)
 	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
 	AZ(priv);
 
+	INIT_OBJ(ban_job, BAN_JOB_MAGIC);
+	Lck_New(&ban_job->mtx, lck_banjob);
+	AZ(pthread_cond_init(&ban_job->cond, NULL));
+
 	VSL_Setup(&vsl, NULL, 0);
 
 	while (!ban_shutdown) {
@@ -141,3 +141,25 @@ VDP_DeliverObj(struct req *req)
 		return (r);
 	return (0);
 }
+
+/*--------------------------------------------------------------------
+ * If the transport is the only VDP, nothing needs to see the body
+ * and it can be handed file ranges instead of bytes where the storage
+ * has them.
+ */
+
+int
+VDP_DeliverObjFd(struct req *req, objiteratefd_f *ffunc)
+{
+	int r;
+
+	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
+	AN(ffunc);
+	if (VTAILQ_FIRST(&req->vdp) != VTAILQ_LAST(&req->vdp, vdp_entry_s) ||
+	    (req->objcore->flags & OC_F_PRIVATE))
+		return (VDP_DeliverObj(req));
+	r = ObjIterateFd(req->wrk, req->objcore, req, vdp_objiterator, ffunc);
+	if (r < 0)
+		return (r);
+	return (0);
+}
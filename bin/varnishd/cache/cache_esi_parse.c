@@ -196,7 +196,7 @@ vep_error(const struct vep_state *vep, const char *p)
 {
 	intmax_t l;
 
-	VSC_C_main->esi_errors++;
+	VSC_Shard()->esi_errors++;
 	l = (intmax_t)(vep->ver_p - vep->hack_p);
 	VSLb(vep->vc->wrk->vsl, SLT_ESI_xmlerror, "ERR at %jd %s", l, p);
 
@@ -211,7 +211,7 @@ vep_warn(const struct vep_state *vep, const char *p)
 {
 	intmax_t l;
 
-	VSC_C_main->esi_warnings++;
+	VSC_Shard()->esi_warnings++;
 	l = (intmax_t)(vep->ver_p - vep->hack_p);
 	VSLb(vep->vc->wrk->vsl, SLT_ESI_xmlerror, "WARN at %jd %s", l, p);
 
@@ -26,12 +26,19 @@
  * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
  * SUCH DAMAGE.
  *
- * LRU and object timer handling.
+ * Object timer handling.
+ *
+ * Objects are spread over expiry_threads shards by address, each with
+ * its own inbox, timers and thread.  Timers which expire within the
+ * reach of a hierarchical timing wheel go there, the rest go on a
+ * binary heap.
  *
  */
 
 #include "config.h"
 
+#include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #include "cache.h"
@@ -40,6 +47,35 @@
 #include "hash/hash_slinger.h"
 #include "vtim.h"
 
+/*
+ * Three levels of 256 slots.  The first level has a slot per EXP_TICK
+ * seconds, each further level is 256 times coarser, so the wheel
+ * reaches a bit more than 12 days into the future.  Objects expire
+ * up to one tick late.
+ */
+#define EXP_TICK		(1. / 16)
+#define EXP_WBITS		8
+#define EXP_WSLOTS		(1U << EXP_WBITS)
+#define EXP_WMASK		(EXP_WSLOTS - 1)
+#define EXP_WLEVELS		3
+
+/*
+ * A slot is a vector of objcores and oc->timer_idx tells where in the
+ * wheel an object is, so that removal is O(1).  The top bit keeps
+ * wheel indices apart from binheap indices.
+ */
+#define EXP_IDX_WHEEL		(1U << 31)
+#define EXP_IDX_POSBITS		21
+#define EXP_IDX_MAXPOS		((1U << EXP_IDX_POSBITS) - 1)
+
+#define EXP_BATCH		64
+
+struct exp_slot {
+	struct objcore			**oc;
+	unsigned			n;
+	unsigned			l;
+};
+
 struct exp_priv {
 	unsigned			magic;
 #define EXP_PRIV_MAGIC			0x9db22482
@@ -51,11 +87,28 @@ struct exp_priv {
 	VSTAILQ_HEAD(,objcore)		inbox;
 	struct binheap			*heap;
 	pthread_cond_t			condvar;
+	uint64_t			mailed;
+
+	uint64_t			tick;
+	unsigned			nwheel;
+	struct exp_slot			wheel[EXP_WLEVELS * EXP_WSLOTS];
 
 	pthread_rwlock_t		cb_rwl;
+	char				name[24];
 };
 
 static struct exp_priv *exphdl;
+static unsigned exp_nshard;
+
+static struct exp_priv *
+exp_shard(const struct objcore *oc)
+{
+	struct exp_priv *ep;
+
+	ep = &exphdl[((uintptr_t)oc >> 6) % exp_nshard];
+	CHECK_OBJ_NOTNULL(ep, EXP_PRIV_MAGIC);
+	return (ep);
+}
 
 /*--------------------------------------------------------------------
  * Calculate an objects effective ttl time, taking req.ttl into account
@@ -82,25 +135,28 @@ EXP_Ttl(const struct req *req, const struct objcore *oc)
 static void
 exp_mail_it(struct objcore *oc, uint8_t cmds)
 {
+	struct exp_priv *ep;
+
 	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
 	assert(oc->refcnt > 0);
 
-	Lck_Lock(&exphdl->mtx);
+	ep = exp_shard(oc);
+	Lck_Lock(&ep->mtx);
 	if ((cmds | oc->exp_flags) & OC_EF_REFD) {
 		if (!(oc->exp_flags & OC_EF_POSTED)) {
 			if (cmds & OC_EF_REMOVE)
-				VSTAILQ_INSERT_HEAD(&exphdl->inbox,
+				VSTAILQ_INSERT_HEAD(&ep->inbox,
 				    oc, exp_list);
 			else
-				VSTAILQ_INSERT_TAIL(&exphdl->inbox,
+				VSTAILQ_INSERT_TAIL(&ep->inbox,
 				    oc, exp_list);
 		}
 		oc->exp_flags |= cmds | OC_EF_POSTED;
 		AN(oc->exp_flags & OC_EF_REFD);
-		VSC_C_main->exp_mailed++;
-		AZ(pthread_cond_signal(&exphdl->condvar));
+		ep->mailed++;
+		AZ(pthread_cond_signal(&ep->condvar));
 	}
-	Lck_Unlock(&exphdl->mtx);
+	Lck_Unlock(&ep->mtx);
 }
 
 /*--------------------------------------------------------------------
@@ -169,6 +225,138 @@ EXP_Rearm(struct objcore *oc, double now, double ttl, double grace, double keep)
 		exp_mail_it(oc, OC_EF_MOVE);
 }
 
+/*--------------------------------------------------------------------
+ * The timing wheel
+ */
+
+static uint64_t
+exp_tick(double when)
+{
+
+	if (when <= 0)
+		return (0);
+	return ((uint64_t)ceil(when / EXP_TICK));
+}
+
+static int
+exp_wheel_insert(struct exp_priv *ep, struct objcore *oc)
+{
+	struct exp_slot *sl;
+	uint64_t tk, d;
+	unsigned lvl, u;
+
+	tk = exp_tick(oc->timer_when);
+	if (tk < ep->tick)
+		tk = ep->tick;
+	d = tk - ep->tick;
+	for (lvl = 0; lvl < EXP_WLEVELS; lvl++) {
+		if (d < (uint64_t)1 << ((lvl + 1) * EXP_WBITS))
+			break;
+	}
+	if (lvl == EXP_WLEVELS)
+		return (0);
+	u = lvl * EXP_WSLOTS + ((tk >> (lvl * EXP_WBITS)) & EXP_WMASK);
+	sl = &ep->wheel[u];
+	if (sl->n == EXP_IDX_MAXPOS)
+		return (0);
+	if (sl->n == sl->l) {
+		sl->l = sl->l ? sl->l * 2 : 16;
+		if (sl->l > EXP_IDX_MAXPOS)
+			sl->l = EXP_IDX_MAXPOS;
+		sl->oc = realloc(sl->oc, sl->l * sizeof *sl->oc);
+		AN(sl->oc);
+	}
+	sl->oc[sl->n] = oc;
+	oc->timer_idx = EXP_IDX_WHEEL | (u << EXP_IDX_POSBITS) | sl->n;
+	sl->n++;
+	ep->nwheel++;
+	ep->wrk->stats->exp_wheel++;
+	return (1);
+}
+
+static void
+exp_wheel_delete(struct exp_priv *ep, struct objcore *oc)
+{
+	struct exp_slot *sl;
+	unsigned u, pos;
+
+	u = oc->timer_idx;
+	assert(u & EXP_IDX_WHEEL);
+	pos = u & EXP_IDX_MAXPOS;
+	u = (u & ~EXP_IDX_WHEEL) >> EXP_IDX_POSBITS;
+	assert(u < EXP_WLEVELS * EXP_WSLOTS);
+	sl = &ep->wheel[u];
+	assert(pos < sl->n);
+	assert(sl->oc[pos] == oc);
+	if (pos != --sl->n) {
+		sl->oc[pos] = sl->oc[sl->n];
+		sl->oc[pos]->timer_idx = (oc->timer_idx & ~EXP_IDX_MAXPOS) | pos;
+	}
+	oc->timer_idx = BINHEAP_NOIDX;
+	ep->nwheel--;
+}
+
+static void
+exp_timer_insert(struct exp_priv *ep, struct objcore *oc)
+{
+
+	assert(oc->timer_idx == BINHEAP_NOIDX);
+	if (!exp_wheel_insert(ep, oc))
+		binheap_insert(ep->heap, oc);
+	assert(oc->timer_idx != BINHEAP_NOIDX);
+}
+
+static void
+exp_timer_delete(struct exp_priv *ep, struct objcore *oc)
+{
+
+	assert(oc->timer_idx != BINHEAP_NOIDX);
+	if (oc->timer_idx & EXP_IDX_WHEEL)
+		exp_wheel_delete(ep, oc);
+	else
+		binheap_delete(ep->heap, oc->timer_idx);
+	assert(oc->timer_idx == BINHEAP_NOIDX);
+}
+
+/* Redistribute a slot of a coarser level as its time comes closer */
+
+static void
+exp_wheel_cascade(struct exp_priv *ep, unsigned lvl)
+{
+	struct exp_slot *sl;
+	struct objcore **v;
+	unsigned u, n;
+
+	sl = &ep->wheel[lvl * EXP_WSLOTS +
+	    ((ep->tick >> (lvl * EXP_WBITS)) & EXP_WMASK)];
+	v = sl->oc;
+	n = sl->n;
+	memset(sl, 0, sizeof *sl);
+	ep->nwheel -= n;
+	for (u = 0; u < n; u++) {
+		v[u]->timer_idx = BINHEAP_NOIDX;
+		exp_timer_insert(ep, v[u]);
+	}
+	free(v);
+}
+
+/* When will the wheel next need attention */
+
+static double
+exp_wheel_next(const struct exp_priv *ep)
+{
+	uint64_t tk;
+
+	if (ep->nwheel == 0)
+		return (INFINITY);
+	for (tk = ep->tick; ; tk++) {
+		if (ep->wheel[tk & EXP_WMASK].n > 0)
+			return (tk * EXP_TICK);
+		if ((tk & EXP_WMASK) == EXP_WMASK)
+			return ((tk + 1) * EXP_TICK);
+	}
+}
+
 /*--------------------------------------------------------------------
  * Handle stuff in the inbox
  */
@@ -185,10 +373,8 @@ exp_inbox(struct exp_priv *ep, struct objcore *oc, unsigned flags)
 	    flags, oc, oc->timer_when, oc->flags);
 
 	if (flags & OC_EF_REMOVE) {
-		if (!(flags & OC_EF_INSERT)) {
-			assert(oc->timer_idx != BINHEAP_NOIDX);
-			binheap_delete(ep->heap, oc->timer_idx);
-		}
+		if (!(flags & OC_EF_INSERT))
+			exp_timer_delete(ep, oc);
 		assert(oc->timer_idx == BINHEAP_NOIDX);
 		oc->exp_flags &= ~OC_EF_REFD;
 		assert(oc->refcnt > 0);
@@ -213,42 +399,27 @@ exp_inbox(struct exp_priv *ep, struct objcore *oc, unsigned flags)
 	 */
 
 	if (flags & OC_EF_INSERT) {
-		assert(oc->timer_idx == BINHEAP_NOIDX);
-		binheap_insert(exphdl->heap, oc);
-		assert(oc->timer_idx != BINHEAP_NOIDX);
+		exp_timer_insert(ep, oc);
 	} else if (flags & OC_EF_MOVE) {
-		assert(oc->timer_idx != BINHEAP_NOIDX);
-		binheap_reorder(exphdl->heap, oc->timer_idx);
-		assert(oc->timer_idx != BINHEAP_NOIDX);
+		/* It may have to change between the wheel and the heap */
+		exp_timer_delete(ep, oc);
+		exp_timer_insert(ep, oc);
 	} else {
 		WRONG("Objcore state wrong in inbox");
 	}
 }
 
 /*--------------------------------------------------------------------
- * Expire stuff from the binheap
+ * Expire stuff from the binheap and the wheel
  */
 
-static double
-exp_expire(struct exp_priv *ep, double now)
+static void
+exp_expire_oc(struct exp_priv *ep, struct objcore *oc, double now)
 {
-	struct objcore *oc;
-
-	CHECK_OBJ_NOTNULL(ep, EXP_PRIV_MAGIC);
-
-	oc = binheap_root(ep->heap);
-	if (oc == NULL)
-		return (now + 355./113.);
-	VSLb(&ep->vsl, SLT_ExpKill, "EXP_expire p=%p e=%.9f f=0x%x", oc,
-	    oc->timer_when - now, oc->flags);
 
 	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
 
-	/* Ready ? */
-	if (oc->timer_when > now)
-		return (oc->timer_when);
-
-	VSC_C_main->n_expired++;
+	ep->wrk->stats->n_expired++;
 
 	Lck_Lock(&ep->mtx);
 	if (oc->exp_flags & OC_EF_POSTED) {
@@ -262,10 +433,8 @@ exp_expire(struct exp_priv *ep, double now)
 		if (!(oc->flags & OC_F_DYING))
 			HSH_Kill(oc);
 
-		/* Remove from binheap */
-		assert(oc->timer_idx != BINHEAP_NOIDX);
-		binheap_delete(ep->heap, oc->timer_idx);
-		assert(oc->timer_idx == BINHEAP_NOIDX);
+		/* Remove from binheap or wheel */
+		exp_timer_delete(ep, oc);
 
 		CHECK_OBJ_NOTNULL(oc->objhead, OBJHEAD_MAGIC);
 		VSLb(&ep->vsl, SLT_ExpKill, "EXP_Expired x=%u t=%.0f",
@@ -273,6 +442,70 @@ exp_expire(struct exp_priv *ep, double now)
 		ObjSendEvent(ep->wrk, oc, OEV_EXPIRE);
 		(void)HSH_DerefObjCore(ep->wrk, &oc, 0);
 	}
+}
+
+/*
+ * Objects which were posted while due are left in their slot, the
+ * inbox will take them out shortly.
+ */
+
+static void
+exp_wheel_expire(struct exp_priv *ep, double now)
+{
+	struct exp_slot *sl;
+	uint64_t target;
+	unsigned u;
+
+	target = (uint64_t)floor(now / EXP_TICK);
+	if (ep->nwheel == 0) {
+		if (ep->tick <= target)
+			ep->tick = target + 1;
+		return;
+	}
+	for (; ep->tick <= target; ep->tick++) {
+		if ((ep->tick & EXP_WMASK) == 0) {
+			for (u = EXP_WLEVELS - 1; u > 0; u--)
+				if ((ep->tick &
+				    (((uint64_t)1 << (u * EXP_WBITS)) - 1)) == 0)
+					exp_wheel_cascade(ep, u);
+		}
+		sl = &ep->wheel[ep->tick & EXP_WMASK];
+		for (u = sl->n; u > 0; u--) {
+			if (u > sl->n)
+				continue;
+			exp_expire_oc(ep, sl->oc[u - 1], now);
+		}
+		if (sl->n == 0) {
+			free(sl->oc);
+			memset(sl, 0, sizeof *sl);
+		}
+	}
+}
+
+static double
+exp_expire(struct exp_priv *ep, double now)
+{
+	struct objcore *oc;
+	double t;
+
+	CHECK_OBJ_NOTNULL(ep, EXP_PRIV_MAGIC);
+
+	exp_wheel_expire(ep, now);
+	t = exp_wheel_next(ep);
+
+	oc = binheap_root(ep->heap);
+	if (oc == NULL)
+		return (fmin(t, now + 355./113.));
+	VSLb(&ep->vsl, SLT_ExpKill, "EXP_expire p=%p e=%.9f f=0x%x", oc,
+	    oc->timer_when - now, oc->flags);
+
+	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+
+	/* Ready ? */
+	if (oc->timer_when > now)
+		return (fmin(t, oc->timer_when));
+
+	exp_expire_oc(ep, oc, now);
 	return (0);
 }
 
@@ -306,27 +539,45 @@ static void * __match_proto__(bgthread_t)
 exp_thread(struct worker *wrk, void *priv)
 {
 	struct objcore *oc;
+	struct objcore *boc[EXP_BATCH];
+	unsigned bflags[EXP_BATCH];
 	double t = 0, tnext = 0;
 	struct exp_priv *ep;
-	unsigned flags = 0;
+	unsigned u, n;
 
 	CAST_OBJ_NOTNULL(ep, priv, EXP_PRIV_MAGIC);
 	ep->wrk = wrk;
 	VSL_Setup(&ep->vsl, NULL, 0);
 	ep->heap = binheap_new(NULL, object_cmp, object_update);
 	AN(ep->heap);
+	ep->tick = exp_tick(VTIM_real());
 	while (1) {
 
 		Lck_Lock(&ep->mtx);
-		oc = VSTAILQ_FIRST(&ep->inbox);
-		CHECK_OBJ_ORNULL(oc, OBJCORE_MAGIC);
-		if (oc != NULL) {
+		for (n = 0; n < EXP_BATCH; n++) {
+			oc = VSTAILQ_FIRST(&ep->inbox);
+			if (oc == NULL)
+				break;
+			CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
 			assert(oc->refcnt >= 1);
-			VSTAILQ_REMOVE(&ep->inbox, oc, objcore, exp_list);
-			VSC_C_main->exp_received++;
+			VSTAILQ_REMOVE_HEAD(&ep->inbox, exp_list);
+			boc[n] = oc;
+			bflags[n] = oc->exp_flags;
+			/*
+			 * Once we have a removal in hand, nobody else
+			 * gets to mail this object to us.
+			 */
+			if (bflags[n] & OC_EF_REMOVE)
+				oc->exp_flags = 0;
+			else
+				oc->exp_flags &= OC_EF_REFD;
+		}
+		wrk->stats->exp_mailed += ep->mailed;
+		ep->mailed = 0;
+		if (n > 0) {
+			wrk->stats->exp_received += n;
+			wrk->stats->exp_batches++;
 			tnext = 0;
-			flags = oc->exp_flags;
-			oc->exp_flags &= OC_EF_REFD;
 		} else if (tnext > t) {
 			VSL_Flush(&ep->vsl, 0);
 			Pool_Sumstat(wrk);
@@ -336,9 +587,11 @@ exp_thread(struct worker *wrk, void *priv)
 
 		t = VTIM_real();
 
-		if (oc != NULL)
-			exp_inbox(ep, oc, flags);
-		else
+		if (n > 0) {
+			for (u = 0; u < n; u++)
+				exp_inbox(ep, boc[u], bflags[u]);
+			(void)Pool_TrySumstat(wrk);
+		} else
 			tnext = exp_expire(ep, t);
 	}
 	NEEDLESS(return NULL);
@@ -351,14 +604,23 @@ EXP_Init(void)
 {
 	struct exp_priv *ep;
 	pthread_t pt;
-
-	ALLOC_OBJ(ep, EXP_PRIV_MAGIC);
-	AN(ep);
-
-	Lck_New(&ep->mtx, lck_exp);
-	AZ(pthread_cond_init(&ep->condvar, NULL));
-	VSTAILQ_INIT(&ep->inbox);
-	AZ(pthread_rwlock_init(&ep->cb_rwl, NULL));
-	exphdl = ep;
-	WRK_BgThread(&pt, "cache-timeout", exp_thread, ep);
+	unsigned u;
+
+	exp_nshard = cache_param->expiry_threads;
+	AN(exp_nshard);
+	exphdl = calloc(exp_nshard, sizeof *exphdl);
+	AN(exphdl);
+	for (u = 0; u < exp_nshard; u++) {
+		ep = &exphdl[u];
+		ep->magic = EXP_PRIV_MAGIC;
+		Lck_New(&ep->mtx, lck_exp);
+		AZ(pthread_cond_init(&ep->condvar, NULL));
+		VSTAILQ_INIT(&ep->inbox);
+		AZ(pthread_rwlock_init(&ep->cb_rwl, NULL));
+		if (exp_nshard == 1)
+			bprintf(ep->name, "%s", "cache-timeout");
+		else
+			bprintf(ep->name, "cache-timeout-%u", u);
+		WRK_BgThread(&pt, ep->name, exp_thread, ep);
+	}
 }
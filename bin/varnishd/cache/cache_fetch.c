@@ -44,7 +44,7 @@
  */
 
 static int
-vbf_allocobj(struct busyobj *bo, unsigned l)
+vbf_allocobj(struct busyobj *bo, unsigned l, unsigned bodylen)
 {
 	struct objcore *oc;
 	const struct stevedore *stv;
@@ -67,7 +67,7 @@ vbf_allocobj(struct busyobj *bo, unsigned l)
 	if (stv == NULL)
 		return (0);
 
-	if (STV_NewObject(bo->wrk, bo->fetch_objcore, stv, l))
+	if (STV_NewObject(bo->wrk, bo->fetch_objcore, stv, l, bodylen))
 		return (1);
 
 	if (stv == stv_transient)
@@ -83,15 +83,16 @@ vbf_allocobj(struct busyobj *bo, unsigned l)
 	oc->grace = 0.0;
 	oc->keep = 0.0;
 	return (STV_NewObject(bo->wrk, bo->fetch_objcore,
-	    stv_transient, l));
+	    stv_transient, l, bodylen));
 }
 
 /*--------------------------------------------------------------------
  * Turn the beresp into a obj
+ * bodylen is the length of the body, if it is known, otherwise zero.
  */
 
 static int
-vbf_beresp2obj(struct busyobj *bo)
+vbf_beresp2obj(struct busyobj *bo, unsigned bodylen)
 {
 	unsigned l, l2;
 	const char *b;
@@ -130,7 +131,7 @@ vbf_beresp2obj(struct busyobj *bo)
 	if (bo->uncacheable)
 		bo->fetch_objcore->flags |= OC_F_PASS;
 
-	if (!vbf_allocobj(bo, l))
+	if (!vbf_allocobj(bo, l, bodylen))
 		return (-1);
 
 	if (vary != NULL) {
@@ -157,6 +158,9 @@ vbf_beresp2obj(struct busyobj *bo)
 		AZ(ObjSetDouble(bo->wrk, bo->fetch_objcore, OA_LASTMODIFIED,
 		    floor(bo->fetch_objcore->t_origin)));
 
+	if (!bo->uncacheable)
+		SKEY_NewObjCore(bo->fetch_objcore, bo->beresp);
+
 	return (0);
 }
 
@@ -577,6 +581,7 @@ static enum fetch_step
 vbf_stp_fetch(struct worker *wrk, struct busyobj *bo)
 {
 	const char *p;
+	unsigned bodylen = 0;
 
 	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
 	CHECK_OBJ_NOTNULL(bo, BUSYOBJ_MAGIC);
@@ -660,7 +665,16 @@ vbf_stp_fetch(struct worker *wrk, struct busyobj *bo)
 		return (F_STP_ERROR);
 	}
 
-	if (vbf_beresp2obj(bo)) {
+	/*
+	 * If we know what we will store, the body can go in the same
+	 * allocation as the object.  Filters change the length.
+	 */
+	if (bo->htc->body_status == BS_LENGTH &&
+	    bo->htc->content_length <= UINT_MAX &&
+	    !bo->do_esi && !bo->do_gzip && !bo->do_gunzip)
+		bodylen = (unsigned)bo->htc->content_length;
+
+	if (vbf_beresp2obj(bo, bodylen)) {
 		(void)VFP_Error(bo->vfc, "Could not get storage");
 		bo->htc->doclose = SC_RX_BODY;
 		VFP_Close(bo->vfc);
@@ -778,7 +792,7 @@ vbf_stp_condfetch(struct worker *wrk, struct busyobj *bo)
 	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
 	CHECK_OBJ_NOTNULL(bo, BUSYOBJ_MAGIC);
 
-	AZ(vbf_beresp2obj(bo));
+	AZ(vbf_beresp2obj(bo, 0));
 
 	if (ObjHasAttr(bo->wrk, bo->stale_oc, OA_ESIDATA))
 		AZ(ObjCopyAttr(bo->wrk, bo->fetch_objcore, bo->stale_oc,
@@ -885,7 +899,7 @@ vbf_stp_error(struct worker *wrk, struct busyobj *bo)
 	bo->vfc->http = bo->beresp;
 	bo->vfc->esi_req = bo->bereq;
 
-	if (vbf_beresp2obj(bo)) {
+	if (vbf_beresp2obj(bo, VSB_len(synth_body))) {
 		(void)VFP_Error(bo->vfc, "Could not get storage");
 		VSB_destroy(&synth_body);
 		return (F_STP_FAIL);
@@ -112,6 +112,7 @@ void VDP_push(struct req *, vdp_bytes *func, void *priv, int bottom,
     const char *id);
 void VDP_close(struct req *req);
 int VDP_DeliverObj(struct req *req);
+int VDP_DeliverObjFd(struct req *req, objiteratefd_f *ffunc);
 
 vdp_bytes VDP_gunzip;
 vdp_bytes VDP_ESI;
@@ -99,14 +99,14 @@ vgz_gunzip(struct vsl_log *vsl, const char *id)
 static struct vgz *
 VGZ_NewGunzip(struct vsl_log *vsl, const char *id)
 {
-	VSC_C_main->n_gunzip++;
+	VSC_Shard()->n_gunzip++;
 	return (vgz_gunzip(vsl, id));
 }
 
 static struct vgz *
 VGZ_NewTestGunzip(struct vsl_log *vsl, const char *id)
 {
-	VSC_C_main->n_test_gunzip++;
+	VSC_Shard()->n_test_gunzip++;
 	return (vgz_gunzip(vsl, id));
 }
 
@@ -116,7 +116,7 @@ VGZ_NewGzip(struct vsl_log *vsl, const char *id)
 	struct vgz *vg;
 	int i;
 
-	VSC_C_main->n_gzip++;
+	VSC_Shard()->n_gzip++;
 	ALLOC_OBJ(vg, VGZ_MAGIC);
 	AN(vg);
 	vg->vsl = vsl;
@@ -74,6 +74,8 @@ static struct objhead *private_oh;
 
 static void hsh_rush1(struct worker *, struct objhead *, struct rush *, int);
 static void hsh_rush2(struct worker *, struct rush *);
+static void hsh_handoff(struct worker *, struct objhead *, struct objcore *,
+    struct rush *);
 
 /*---------------------------------------------------------------------*/
 
@@ -162,6 +164,7 @@ HSH_DeleteObjHead(struct worker *wrk, struct objhead *oh)
 	AZ(oh->refcnt);
 	assert(VTAILQ_EMPTY(&oh->objcs));
 	assert(VTAILQ_EMPTY(&oh->waitinglist));
+	VRY_IdxFree(wrk, oh);
 	Lck_Delete(&oh->mtx);
 	wrk->stats->n_objecthead--;
 	FREE_OBJ(oh);
@@ -302,8 +305,13 @@ HSH_Insert(struct worker *wrk, const void *digest, struct objcore *oc,
 	VTAILQ_REMOVE(&oh->objcs, oc, hsh_list);
 	VTAILQ_INSERT_HEAD(&oh->objcs, oc, hsh_list);
 	oc->flags &= ~OC_F_BUSY;
-	if (!VTAILQ_EMPTY(&oh->waitinglist))
-		hsh_rush1(wrk, oh, &rush, HSH_RUSH_POLICY);
+	VRY_IdxInsert(wrk, oh, oc);
+	if (!VTAILQ_EMPTY(&oh->waitinglist)) {
+		if (cache_param->waitinglist_handoff)
+			hsh_handoff(wrk, oh, oc, &rush);
+		else
+			hsh_rush1(wrk, oh, &rush, HSH_RUSH_POLICY);
+	}
 	Lck_Unlock(&oh->mtx);
 	hsh_rush2(wrk, &rush);
 }
@@ -330,6 +338,37 @@ hsh_insert_busyobj(struct worker *wrk, struct objhead *oh)
 	return (oc);
 }
 
+/*---------------------------------------------------------------------
+ * A req which was handed an object when it came off the waiting list
+ * does not need to look again.  The object may only just have started
+ * streaming, so make sure it is delivered like any other hit.
+ */
+
+static enum lookup_e
+hsh_handedoff(struct req *req, struct objcore **ocp)
+{
+	struct objhead *oh;
+	struct objcore *oc;
+	struct boc *boc;
+
+	oh = req->hash_objhead;
+	req->hash_objhead = NULL;
+	TAKE_OBJ_NOTNULL(oc, &req->hash_oc, OBJCORE_MAGIC);
+	assert(oc->objhead == oh);
+	AZ(oc->flags & OC_F_BUSY);
+
+	/* The objcore holds a ref on the objhead too */
+	assert(HSH_DerefObjHead(req->wrk, &oh));
+
+	boc = HSH_RefBoc(oc);
+	if (boc != NULL) {
+		ObjWaitState(oc, BOS_STREAM);
+		HSH_DerefBoc(req->wrk, oc);
+	}
+	*ocp = oc;
+	return (HSH_HIT);
+}
+
 /*---------------------------------------------------------------------
  */
 
@@ -341,8 +380,10 @@ HSH_Lookup(struct req *req, struct objcore **ocp, struct objcore **bocp,
 	struct objhead *oh;
 	struct objcore *oc;
 	struct objcore *exp_oc;
+	struct objcore *cand[VRY_IDX_MAX * 2];
 	double exp_t_origin;
-	int busy_found;
+	int busy_found, ncand;
+	unsigned u;
 	enum lookup_e retval;
 	const uint8_t *vary;
 
@@ -368,6 +409,8 @@ HSH_Lookup(struct req *req, struct objcore **ocp, struct objcore **bocp,
 		 */
 		CHECK_OBJ_NOTNULL(req->hash_objhead, OBJHEAD_MAGIC);
 		oh = req->hash_objhead;
+		if (req->hash_oc != NULL)
+			return (hsh_handedoff(req, ocp));
 		Lck_Lock(&oh->mtx);
 		req->hash_objhead = NULL;
 	} else {
@@ -391,13 +434,42 @@ HSH_Lookup(struct req *req, struct objcore **ocp, struct objcore **bocp,
 	busy_found = 0;
 	exp_oc = NULL;
 	exp_t_origin = 0.0;
-	VTAILQ_FOREACH(oc, &oh->objcs, hsh_list) {
+
+	/*
+	 * If the objhead has an index of variants, we only need to look
+	 * at the objects it gives us, and the busy objects, which are not
+	 * indexed and always at the end of the list.
+	 */
+	ncand = VRY_IdxLookup(req, oh, cand);
+	for (oc = VTAILQ_LAST(&oh->objcs, objcore_head);
+	    ncand >= 0 && oc != NULL && (oc->flags & OC_F_BUSY);
+	    oc = VTAILQ_PREV(oc, objcore_head, hsh_list)) {
+		if (ncand == VRY_IDX_MAX * 2)
+			ncand = -1;
+		else
+			cand[ncand++] = oc;
+	}
+
+	for (u = 0; ; u++) {
+		if (ncand >= 0)
+			oc = u < ncand ? cand[u] : NULL;
+		else if (u == 0)
+			oc = VTAILQ_FIRST(&oh->objcs);
+		else
+			oc = VTAILQ_NEXT(oc, hsh_list);
+		if (oc == NULL)
+			break;
+
 		/* Must be at least our own ref + the objcore we examine */
 		assert(oh->refcnt > 1);
 		CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
 		assert(oc->objhead == oh);
 		assert(oc->refcnt > 0);
 
+		wrk->stats->cache_scanned++;
+		if (u + 1 == VRY_IDX_MIN && oh->vary_idx == NULL)
+			VRY_IdxBuild(wrk, oh);
+
 		if (oc->flags & OC_F_DYING)
 			continue;
 		if (oc->flags & OC_F_FAILED)
@@ -512,12 +584,43 @@ HSH_Lookup(struct req *req, struct objcore **ocp, struct objcore **bocp,
 	 * calls us again
 	 */
 	req->hash_objhead = oh;
+	req->t_hash_sleep = VTIM_mono();
 	req->wrk = NULL;
 	req->waitinglist = 1;
 	Lck_Unlock(&oh->mtx);
 	return (HSH_BUSY);
 }
 
+/*---------------------------------------------------------------------
+ * Take a req off the waiting list and onto the rush
+ */
+
+static void
+hsh_wakeup(struct worker *wrk, struct objhead *oh, struct rush *r,
+    struct req *req, double now)
+{
+	double d;
+
+	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
+	Lck_AssertHeld(&oh->mtx);
+	wrk->stats->busy_wakeup++;
+	d = now - req->t_hash_sleep;
+	if (d < 1e-3)
+		wrk->stats->busy_dwell_lt1ms++;
+	else if (d < 1e-2)
+		wrk->stats->busy_dwell_lt10ms++;
+	else if (d < 1e-1)
+		wrk->stats->busy_dwell_lt100ms++;
+	else if (d < 1.)
+		wrk->stats->busy_dwell_lt1s++;
+	else
+		wrk->stats->busy_dwell_ge1s++;
+	AZ(req->wrk);
+	VTAILQ_REMOVE(&oh->waitinglist, req, w_list);
+	VTAILQ_INSERT_TAIL(&r->reqs, req, w_list);
+	req->waitinglist = 0;
+}
+
 /*---------------------------------------------------------------------
  * Pick the req's we are going to rush from the waiting list
  */
@@ -527,6 +630,7 @@ hsh_rush1(struct worker *wrk, struct objhead *oh, struct rush *r, int max)
 {
 	unsigned u;
 	struct req *req;
+	double now;
 
 	if (max == 0)
 		return;
@@ -539,16 +643,63 @@ hsh_rush1(struct worker *wrk, struct objhead *oh, struct rush *r, int max)
 	CHECK_OBJ_NOTNULL(r, RUSH_MAGIC);
 	VTAILQ_INIT(&r->reqs);
 	Lck_AssertHeld(&oh->mtx);
+	now = VTIM_mono();
 	for (u = 0; u < max; u++) {
 		req = VTAILQ_FIRST(&oh->waitinglist);
 		if (req == NULL)
 			break;
+		hsh_wakeup(wrk, oh, r, req, now);
+	}
+}
+
+/*---------------------------------------------------------------------
+ * Hand a freshly unbusied object to every req on the waiting list which
+ * would have found it on a new lookup.  The ones with a different Vary
+ * are rushed as usual, so they can go and fetch their own variant.
+ *
+ * Unlike a lookup, we do not check bans: the object is brand new.
+ */
+
+static void
+hsh_handoff(struct worker *wrk, struct objhead *oh, struct objcore *oc,
+    struct rush *r)
+{
+	struct req *req, *req2;
+	const uint8_t *vary = NULL;
+	unsigned u = 0;
+	double now;
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	CHECK_OBJ_NOTNULL(oh, OBJHEAD_MAGIC);
+	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+	AZ(oc->flags & OC_F_BUSY);
+
+	if (oc->ttl <= 0. || oc->flags & (OC_F_PRIVATE | OC_F_PASS |
+	    OC_F_HFP | OC_F_FAILED | OC_F_DYING)) {
+		/* Nothing to hand over, they must look again */
+		hsh_rush1(wrk, oh, r, HSH_RUSH_POLICY);
+		return;
+	}
+
+	CHECK_OBJ_NOTNULL(r, RUSH_MAGIC);
+	VTAILQ_INIT(&r->reqs);
+	Lck_AssertHeld(&oh->mtx);
+	if (ObjHasAttr(wrk, oc, OA_VARY))
+		vary = ObjGetAttr(wrk, oc, OA_VARY, NULL);
+	now = VTIM_mono();
+	VTAILQ_FOREACH_SAFE(req, &oh->waitinglist, w_list, req2) {
 		CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
-		wrk->stats->busy_wakeup++;
-		AZ(req->wrk);
-		VTAILQ_REMOVE(&oh->waitinglist, req, w_list);
-		VTAILQ_INSERT_TAIL(&r->reqs, req, w_list);
-		req->waitinglist = 0;
+		AZ(req->hash_oc);
+		if (EXP_Ttl(req, oc) >= req->t_req &&
+		    (vary == NULL || VRY_Match(req, vary))) {
+			oc->refcnt++;
+			if (oc->hits < LONG_MAX)
+				oc->hits++;
+			req->hash_oc = oc;
+			wrk->stats->busy_handoff++;
+		} else if (u++ >= cache_param->rush_exponent)
+			continue;
+		hsh_wakeup(wrk, oh, r, req, now);
 	}
 }
 
@@ -715,8 +866,13 @@ HSH_Unbusy(struct worker *wrk, struct objcore *oc)
 	VTAILQ_REMOVE(&oh->objcs, oc, hsh_list);
 	VTAILQ_INSERT_HEAD(&oh->objcs, oc, hsh_list);
 	oc->flags &= ~OC_F_BUSY;
-	if (!VTAILQ_EMPTY(&oh->waitinglist))
-		hsh_rush1(wrk, oh, &rush, HSH_RUSH_POLICY);
+	VRY_IdxInsert(wrk, oh, oc);
+	if (!VTAILQ_EMPTY(&oh->waitinglist)) {
+		if (cache_param->waitinglist_handoff)
+			hsh_handoff(wrk, oh, oc, &rush);
+		else
+			hsh_rush1(wrk, oh, &rush, HSH_RUSH_POLICY);
+	}
 	Lck_Unlock(&oh->mtx);
 	if (!(oc->flags & OC_F_PRIVATE))
 		EXP_Insert(wrk, oc);
@@ -869,8 +1025,10 @@ HSH_DerefObjCore(struct worker *wrk, struct objcore **ocp, int rushmax)
 	Lck_Lock(&oh->mtx);
 	assert(oh->refcnt > 0);
 	r = --oc->refcnt;
-	if (!r)
+	if (!r) {
 		VTAILQ_REMOVE(&oh->objcs, oc, hsh_list);
+		VRY_IdxRemove(wrk, oh, oc);
+	}
 	if (!VTAILQ_EMPTY(&oh->waitinglist))
 		hsh_rush1(wrk, oh, &rush, rushmax);
 	Lck_Unlock(&oh->mtx);
@@ -882,6 +1040,7 @@ HSH_DerefObjCore(struct worker *wrk, struct objcore **ocp, int rushmax)
 
 	BAN_DestroyObj(oc);
 	AZ(oc->ban);
+	SKEY_DestroyObj(oc);
 
 	if (oc->stobj->stevedore != NULL)
 		ObjFreeObj(wrk, oc);
@@ -31,10 +31,13 @@
 
 #include "config.h"
 
+#include <ctype.h>
 #include <stddef.h>
 #include "cache.h"
 #include <stdio.h>
+#include <stdlib.h>
 
+#include "vcli_serve.h"
 #include "vend.h"
 #include "vct.h"
 #include "vtim.h"
@@ -46,6 +49,124 @@ const char H__Status[]	= "\010:status:";
 const char H__Proto[]	= "\007:proto:";
 const char H__Reason[]	= "\010:reason:";
 
+/*--------------------------------------------------------------------
+ * Known header index
+ *
+ * The well known headers are mapped to a slot in hidx_tbl[] by a
+ * perfect hash over the length and three characters of the name,
+ * the seed for which is found in HTTP_Init().  Names which are not
+ * in tbl/http_headers.h may land in a slot too, so the name is
+ * compared, but only to the one candidate.
+ *
+ * Each struct http has an index with the first hd[] of every known
+ * header amongst hd[HTTP_HDR_FIRST...hidx_n>.  Headers appended
+ * with our own functions extend the index, any other headers past
+ * hidx_n are simply searched.  Functions which remove or shuffle
+ * headers rebuild the index, and a hidx_n outside of the headers
+ * means that there is no index.
+ */
+
+#define HIDX_SLOTS	256
+
+static struct hidx_slot {
+	const char		*hdr;
+	unsigned		len;
+	enum http_hidx		idx;
+} hidx_tbl[HIDX_SLOTS];
+
+static unsigned hidx_seed;
+
+static inline unsigned
+http_hidx_hash(unsigned seed, unsigned l, const char *hdr)
+{
+	unsigned h;
+
+	h = seed ^ l;
+	h = h * 0x01000193 ^ (hdr[0] | 0x20);
+	h = h * 0x01000193 ^ (hdr[l >> 1] | 0x20);
+	h = h * 0x01000193 ^ (hdr[l - 1] | 0x20);
+	return ((h ^ (h >> 15)) & (HIDX_SLOTS - 1));
+}
+
+static int
+http_hidx_lookup(unsigned l, const char *hdr)
+{
+	const struct hidx_slot *hs;
+
+	if (l == 0)
+		return (-1);
+	hs = &hidx_tbl[http_hidx_hash(hidx_seed, l, hdr)];
+	if (hs->hdr == NULL || hs->len != l)
+		return (-1);
+	if (hs->hdr != hdr && strncasecmp(hs->hdr, hdr, l))
+		return (-1);
+	return (hs->idx);
+}
+
+static int
+http_hidx_insert(const char *hdr, enum http_hidx idx)
+{
+	struct hidx_slot *hs;
+	unsigned l;
+
+	l = hdr[0] - 1;
+	hs = &hidx_tbl[http_hidx_hash(hidx_seed, l, hdr + 1)];
+	if (hs->hdr != NULL)
+		return (-1);
+	hs->hdr = hdr + 1;
+	hs->len = l;
+	hs->idx = idx;
+	return (0);
+}
+
+static void
+http_hidx_init(void)
+{
+	int i;
+
+	for (hidx_seed = 1; hidx_seed < 100000; hidx_seed++) {
+		memset(hidx_tbl, 0, sizeof hidx_tbl);
+		i = 0;
+#define HTTPH(a, b, c) \
+		if (i == 0) \
+			i = http_hidx_insert(b, HIDX_##b);
+#include "tbl/http_headers.h"
+		if (i == 0)
+			return;
+	}
+	WRONG("No perfect hash for the known headers");
+}
+
+static void
+http_hidx_add(struct http *hp, unsigned u)
+{
+	const char *p;
+	int i;
+
+	if (u < HTTP_HDR_FIRST || u != hp->hidx_n)
+		return;
+	hp->hidx_n++;
+	Tcheck(hp->hd[u]);
+	p = memchr(hp->hd[u].b, ':', Tlen(hp->hd[u]));
+	if (p == NULL)
+		return;
+	i = http_hidx_lookup(p - hp->hd[u].b, hp->hd[u].b);
+	if (i >= 0 && hp->hidx[i] == 0)
+		hp->hidx[i] = (uint16_t)u;
+}
+
+void
+http_IndexHdrs(struct http *hp)
+{
+	unsigned u;
+
+	CHECK_OBJ_NOTNULL(hp, HTTP_MAGIC);
+	memset(hp->hidx, 0, sizeof hp->hidx);
+	hp->hidx_n = HTTP_HDR_FIRST;
+	for (u = HTTP_HDR_FIRST; u < hp->nhd; u++)
+		http_hidx_add(hp, u);
+}
+
 /*--------------------------------------------------------------------
  * These two functions are in an incestous relationship with the
  * order of macros in include/tbl/vsl_tags_http.h
@@ -102,7 +223,7 @@ static void
 http_fail(const struct http *hp)
 {
 
-	VSC_C_main->losthdr++;
+	VSC_Shard()->losthdr++;
 	VSLb(hp->vsl, SLT_Error, "out of workspace (%s)", hp->ws->id);
 	WS_MarkOverflow(hp->ws);
 }
@@ -167,6 +288,7 @@ HTTP_Setup(struct http *hp, struct ws *ws, struct vsl_log *vsl,
 {
 	http_Teardown(hp);
 	hp->nhd = HTTP_HDR_FIRST;
+	hp->hidx_n = HTTP_HDR_FIRST;
 	hp->logtag = whence;
 	hp->ws = ws;
 	hp->vsl = vsl;
@@ -256,14 +378,33 @@ http_IsHdr(const txt *hh, const char *hdr)
 static unsigned
 http_findhdr(const struct http *hp, unsigned l, const char *hdr)
 {
-	unsigned u;
+	unsigned u = HTTP_HDR_FIRST;
+	int i;
 
-	for (u = HTTP_HDR_FIRST; u < hp->nhd; u++) {
+	if (hp->hidx_n >= HTTP_HDR_FIRST && hp->hidx_n <= hp->nhd) {
+		i = http_hidx_lookup(l, hdr);
+		if (i >= 0) {
+			u = hp->hidx[i];
+			if (u != 0) {
+				assert(u < hp->hidx_n);
+				Tcheck(hp->hd[u]);
+				assert(hp->hd[u].e >= hp->hd[u].b + l + 1);
+				assert(hp->hd[u].b[l] == ':');
+				return (u);
+			}
+			u = hp->hidx_n;
+		}
+	}
+
+	for (; u < hp->nhd; u++) {
 		Tcheck(hp->hd[u]);
 		if (hp->hd[u].e < hp->hd[u].b + l + 1)
 			continue;
 		if (hp->hd[u].b[l] != ':')
 			continue;
+		/* Only case may differ, and that only in bit 0x20 */
+		if ((hp->hd[u].b[0] ^ hdr[0]) & ~0x20)
+			continue;
 		if (strncasecmp(hdr, hp->hd[u].b, l))
 			continue;
 		return (u);
@@ -332,6 +473,7 @@ http_CollectHdr(struct http *hp, const char *hdr)
 				http_fail(hp);
 				VSLb(hp->vsl, SLT_LostHeader, "%s", hdr + 1);
 				WS_Release(hp->ws, 0);
+				http_IndexHdrs(hp);
 				return;
 			}
 			memcpy(b, hp->hd[f].b, x);
@@ -349,6 +491,7 @@ http_CollectHdr(struct http *hp, const char *hdr)
 			http_fail(hp);
 			VSLb(hp->vsl, SLT_LostHeader, "%s", hdr + 1);
 			WS_Release(hp->ws, 0);
+			http_IndexHdrs(hp);
 			return;
 		}
 		memcpy(b, hp->hd[u].b + *hdr, x);
@@ -362,6 +505,7 @@ http_CollectHdr(struct http *hp, const char *hdr)
 	hp->hd[f].b = hp->ws->f;
 	hp->hd[f].e = b;
 	WS_ReleaseP(hp->ws, b + 1);
+	http_IndexHdrs(hp);
 }
 
 /*--------------------------------------------------------------------*/
@@ -790,6 +934,222 @@ http_PutResponse(struct http *to, const char *proto, uint16_t status,
 		http_SetH(to, HTTP_HDR_REASON, reason);
 }
 
+/*--------------------------------------------------------------------
+ * Objects keep their headers in OA_HEADERS in a packed format.
+ *
+ * Version 1, which silos written by older versions still hold:
+ *
+ *	be16	number of fields + 1
+ *	be16	status
+ *	"proto\0status\0reason\0"
+ *	"Name: value\0" for each header
+ *	"\0"
+ *
+ * Version 2 has a zero where version 1 has the count, and an index so
+ * fields can be found and decoded without scanning the strings:
+ *
+ *	be16	0
+ *	be16	status
+ *	be16	2
+ *	be16	number of fields, including proto, status and reason
+ *	be16	log2 of the number of hash slots
+ *	be16	0
+ *	be32, be32, be16, be16 for each field: offset of the field from
+ *		the start of the pack, its length, the length of its
+ *		name and the hash of the name
+ *	be16	for each hash slot: field number + 1, or zero if empty
+ *	"proto\0status\0reason\0"
+ *	"Name: value\0name\0" for each header, the name in lower case
+ *	"\0"
+ *
+ * Headers are hashed by their lower case name, and the slots are
+ * probed linearly.  The table is at most half full.
+ */
+
+#define HPK_HDR		12
+#define HPK_FLD		12
+#define HPK_PSEUDO	3	/* proto, status, reason */
+
+struct hdrpack {
+	const uint8_t		*base;
+	unsigned		v2;
+	unsigned		n;
+	unsigned		nslot;
+	const uint8_t		*fld;
+	const uint8_t		*slot;
+	/* iteration */
+	unsigned		i;
+	const char		*p;
+};
+
+static uint16_t
+hpk_hash(const char *lname, unsigned l)
+{
+	uint32_t h = 2166136261U;
+
+	while (l-- > 0) {
+		h ^= (uint8_t)*lname++;
+		h *= 16777619U;
+	}
+	return ((uint16_t)(h ^ (h >> 16)));
+}
+
+static unsigned
+hpk_slotbits(unsigned nhdr)
+{
+	unsigned b;
+
+	for (b = 2; (1U << b) < 2 * nhdr; b++)
+		continue;
+	return (b);
+}
+
+static unsigned
+hpk_namelen(txt t)
+{
+	const char *p;
+
+	p = memchr(t.b, ':', Tlen(t));
+	return (p == NULL ? 0 : pdiff(t.b, p));
+}
+
+static void
+hpk_init(struct hdrpack *hpk, const void *ptr)
+{
+
+	AN(ptr);
+	memset(hpk, 0, sizeof *hpk);
+	hpk->base = ptr;
+	if (vbe16dec(hpk->base) != 0) {
+		hpk->p = (const char *)hpk->base + 4;
+		return;
+	}
+	assert(vbe16dec(hpk->base + 4) == 2);
+	hpk->v2 = 1;
+	hpk->n = vbe16dec(hpk->base + 6);
+	assert(hpk->n >= HPK_PSEUDO);
+	hpk->nslot = 1U << vbe16dec(hpk->base + 8);
+	hpk->fld = hpk->base + HPK_HDR;
+	hpk->slot = hpk->fld + HPK_FLD * hpk->n;
+}
+
+/* Walk the fields in order, proto, status and reason first */
+static int
+hpk_next(struct hdrpack *hpk, txt *t, unsigned *nlen)
+{
+	const uint8_t *f;
+
+	AN(t);
+	AN(nlen);
+	if (hpk->v2) {
+		if (hpk->i >= hpk->n)
+			return (0);
+		f = hpk->fld + HPK_FLD * hpk->i++;
+		t->b = (const char *)hpk->base + vbe32dec(f);
+		t->e = t->b + vbe32dec(f + 4);
+		*nlen = vbe16dec(f + 8);
+		return (1);
+	}
+	if (hpk->i >= HPK_PSEUDO && *hpk->p == '\0')
+		return (0);
+	t->b = hpk->p;
+	t->e = strchr(t->b, '\0');
+	hpk->p = t->e + 1;
+	*nlen = hpk->i++ < HPK_PSEUDO ? 0 : hpk_namelen(*t);
+	return (1);
+}
+
+/* Find a field by its length prefixed "Name:" and return its value */
+static const char *
+hpk_get(const struct hdrpack *hpk0, const char *hdr)
+{
+	struct hdrpack hpk[1];
+	char lname[256];
+	const uint8_t *f;
+	const char *ptr;
+	unsigned l, u, v, nlen, mask;
+	uint16_t h;
+	txt t;
+
+	AN(hdr);
+	l = (uint8_t)hdr[0];
+	assert(l > 0);
+	assert(l == strlen(hdr + 1));
+	assert(hdr[l] == ':');
+	hdr++;
+	*hpk = *hpk0;
+
+	if (hdr[0] == ':') {
+		/* Special cases */
+		if (!strcmp(hdr, ":proto:"))
+			u = 0;
+		else if (!strcmp(hdr, ":status:"))
+			u = 1;
+		else if (!strcmp(hdr, ":reason:"))
+			u = 2;
+		else
+			WRONG("Unknown magic packed header");
+		do
+			AN(hpk_next(hpk, &t, &nlen));
+		while (u-- > 0);
+		return (t.b);
+	}
+
+	if (!hpk->v2) {
+		while (hpk_next(hpk, &t, &nlen)) {
+			if (hpk->i > HPK_PSEUDO &&
+			    !strncasecmp(t.b, hdr, l)) {
+				ptr = t.b + l;
+				while (vct_islws(*ptr))
+					ptr++;
+				return (ptr);
+			}
+		}
+		return (NULL);
+	}
+
+	l--;		/* Without the colon */
+	for (u = 0; u < l; u++)
+		lname[u] = (char)tolower((uint8_t)hdr[u]);
+	h = hpk_hash(lname, l);
+	mask = hpk->nslot - 1;
+	for (u = h & mask; ; u = (u + 1) & mask) {
+		v = vbe16dec(hpk->slot + 2 * u);
+		if (v == 0)
+			return (NULL);
+		f = hpk->fld + HPK_FLD * (v - 1);
+		if (vbe16dec(f + 10) != h || vbe16dec(f + 8) != l)
+			continue;
+		ptr = (const char *)hpk->base + vbe32dec(f);
+		if (memcmp(ptr + vbe32dec(f + 4) + 1, lname, l))
+			continue;
+		ptr += l + 1;
+		while (vct_islws(*ptr))
+			ptr++;
+		return (ptr);
+	}
+}
+
+/*--------------------------------------------------------------------
+ * Does this field go into the pack according to 'how' ?
+ */
+
+static int
+http_packit(const struct http *fm, unsigned u, unsigned how)
+{
+
+	if (u == HTTP_HDR_METHOD || u == HTTP_HDR_URL)
+		return (0);
+	Tcheck(fm->hd[u]);
+	if (fm->hdf[u] & HDF_FILTER)
+		return (0);
+#define HTTPH(a, b, c) \
+	if (((c) & how) && http_IsHdr(&fm->hd[u], (b))) \
+		return (0);
+#include "tbl/http_headers.h"
+	return (1);
+}
+
 /*--------------------------------------------------------------------
  * Estimate how much workspace we need to Filter this header according
  * to 'how'.
@@ -798,77 +1158,127 @@ http_PutResponse(struct http *to, const char *proto, uint16_t status,
 unsigned
 http_EstimateWS(const struct http *fm, unsigned how)
 {
-	unsigned u, l;
+	unsigned u, n, l;
 
-	l = 4;
 	CHECK_OBJ_NOTNULL(fm, HTTP_MAGIC);
+	l = HPK_HDR;
+	n = 0;
 	for (u = 0; u < fm->nhd; u++) {
-		if (u == HTTP_HDR_METHOD || u == HTTP_HDR_URL)
+		if (!http_packit(fm, u, how))
 			continue;
-		Tcheck(fm->hd[u]);
-		if (fm->hdf[u] & HDF_FILTER)
-			continue;
-#define HTTPH(a, b, c) \
-		if (((c) & how) && http_IsHdr(&fm->hd[u], (b))) \
-			continue;
-#include "tbl/http_headers.h"
-		l += Tlen(fm->hd[u]) + 1L;
+		l += HPK_FLD + Tlen(fm->hd[u]) + 1L;
+		if (n++ >= HPK_PSEUDO)
+			l += hpk_namelen(fm->hd[u]) + 1L;
 	}
+	l += 2U << hpk_slotbits(n);
 	return (PRNDUP(l + 1L));
 }
 
 /*--------------------------------------------------------------------
- * Encode http struct as byte string.
- *
- * XXX: We could save considerable special-casing below by encoding also
- * XXX: H__Status, H__Reason and H__Proto into the string, but it would
- * XXX: add 26-30 bytes to all encoded objects to save a little code.
- * XXX: It could possibly be a good idea for later HTTP versions.
+ * Encode http struct as byte string, see above.
  */
 
 void
 HTTP_Encode(const struct http *fm, uint8_t *p0, unsigned l, unsigned how)
 {
-	unsigned u, w;
-	uint16_t n;
-	uint8_t *p, *e;
+	unsigned u, v, n, nf, w, nlen, bits, mask;
+	uint8_t *f, *slot, *p, *e;
+	uint16_t h;
 
 	AN(p0);
 	AN(l);
-	p = p0;
-	e = p + l;
-	assert(p + 5 <= e);
-	assert(fm->nhd <= fm->shd);
-	n = HTTP_HDR_FIRST - 3;
-	vbe16enc(p + 2, fm->status);
-	p += 4;
 	CHECK_OBJ_NOTNULL(fm, HTTP_MAGIC);
-	for (u = 0; u < fm->nhd; u++) {
-		if (u == HTTP_HDR_METHOD || u == HTTP_HDR_URL)
-			continue;
-		Tcheck(fm->hd[u]);
-		if (fm->hdf[u] & HDF_FILTER)
-			continue;
-#define HTTPH(a, b, c) \
-		if (((c) & how) && http_IsHdr(&fm->hd[u], (b))) \
+	assert(fm->nhd <= fm->shd);
+	for (u = 0, nf = 0; u < fm->nhd; u++)
+		if (http_packit(fm, u, how))
+			nf++;
+	assert(nf >= HPK_PSEUDO);
+	assert(nf < 0xffff);
+	bits = hpk_slotbits(nf);
+	mask = (1U << bits) - 1;
+
+	e = p0 + l;
+	f = p0 + HPK_HDR;
+	slot = f + HPK_FLD * nf;
+	p = slot + 2 * (mask + 1);
+	assert(p <= e);
+	vbe16enc(p0, 0);
+	vbe16enc(p0 + 2, fm->status);
+	vbe16enc(p0 + 4, 2);
+	vbe16enc(p0 + 6, nf);
+	vbe16enc(p0 + 8, bits);
+	vbe16enc(p0 + 10, 0);
+	memset(slot, 0, 2 * (mask + 1));
+
+	for (u = 0, n = 0; u < fm->nhd; u++) {
+		if (!http_packit(fm, u, how))
 			continue;
-#include "tbl/http_headers.h"
 		http_VSLH(fm, u);
-		w = Tlen(fm->hd[u]) + 1L;
-		assert(p + w + 1 <= e);
+		w = Tlen(fm->hd[u]);
+		nlen = n < HPK_PSEUDO ? 0 : hpk_namelen(fm->hd[u]);
+		assert(p + w + 1 + (n < HPK_PSEUDO ? 0 : nlen + 1) < e);
+		vbe32enc(f, pdiff(p0, p));
+		vbe32enc(f + 4, w);
 		memcpy(p, fm->hd[u].b, w);
 		p += w;
+		*p++ = '\0';
+		h = 0;
+		if (n >= HPK_PSEUDO) {
+			for (v = 0; v < nlen; v++)
+				p[v] = (uint8_t)tolower((uint8_t)fm->hd[u].b[v]);
+			h = hpk_hash((const char *)p, nlen);
+			p += nlen;
+			*p++ = '\0';
+		}
+		if (nlen > 0) {
+			for (v = h & mask; vbe16dec(slot + 2 * v) != 0;
+			    v = (v + 1) & mask)
+				continue;
+			vbe16enc(slot + 2 * v, n + 1);
+		}
+		vbe16enc(f + 8, nlen);
+		vbe16enc(f + 10, h);
+		f += HPK_FLD;
 		n++;
 	}
+	assert(n == nf);
 	*p++ = '\0';
 	assert(p <= e);
-	vbe16enc(p0, n + 1);
 }
 
 /*--------------------------------------------------------------------
- * Decode byte string into http struct
+ * Decode byte string into http struct, without logging.
  */
 
+static int
+http_decode(struct http *to, const uint8_t *fm)
+{
+	struct hdrpack hpk[1];
+	unsigned nlen;
+	txt t;
+
+	CHECK_OBJ_NOTNULL(to, HTTP_MAGIC);
+	hpk_init(hpk, fm);
+	if (hpk->v2 && hpk->n + 2 > to->shd)
+		return (-1);
+	to->status = vbe16dec(fm + 2);
+	to->nhd = 0;
+	to->hidx_n = 0;
+	while (hpk_next(hpk, &t, &nlen)) {
+		if (to->nhd == HTTP_HDR_METHOD) {
+			to->hd[to->nhd].b = NULL;
+			to->hd[to->nhd++].e = NULL;
+			to->hd[to->nhd].b = NULL;
+			to->hd[to->nhd++].e = NULL;
+		}
+		if (to->nhd >= to->shd)
+			return (-1);
+		to->hd[to->nhd++] = t;
+	}
+	http_IndexHdrs(to);
+	return (0);
+}
+
 int
 HTTP_Decode(struct http *to, const uint8_t *fm)
 {
@@ -876,28 +1286,14 @@ HTTP_Decode(struct http *to, const uint8_t *fm)
 	CHECK_OBJ_NOTNULL(to, HTTP_MAGIC);
 	AN(to->vsl);
 	AN(fm);
-	if (vbe16dec(fm) <= to->shd) {
-		to->status = vbe16dec(fm + 2);
-		fm += 4;
-		for (to->nhd = 0; to->nhd < to->shd; to->nhd++) {
-			if (to->nhd == HTTP_HDR_METHOD ||
-			    to->nhd == HTTP_HDR_URL) {
-				to->hd[to->nhd].b = NULL;
-				to->hd[to->nhd].e = NULL;
-				continue;
-			}
-			if (*fm == '\0')
-				return (0);
-			to->hd[to->nhd].b = (const void*)fm;
-			fm = (const void*)strchr((const void*)fm, '\0');
-			to->hd[to->nhd].e = (const void*)fm;
-			fm++;
-			http_VSLH(to, to->nhd);
-		}
+	if (http_decode(to, fm) == 0) {
+		http_VSL_log(to);
+		return (0);
 	}
 	VSLb(to->vsl, SLT_Error,
 	    "Too many headers to Decode object (%u vs. %u)",
-	    vbe16dec(fm), to->shd);
+	    vbe16dec(fm) != 0 ? vbe16dec(fm) : vbe16dec(fm + 6) + 3U,
+	    to->shd);
 	return (-1);
 }
 
@@ -919,22 +1315,26 @@ HTTP_GetStatusPack(struct worker *wrk, struct objcore *oc)
 int
 HTTP_IterHdrPack(struct worker *wrk, struct objcore *oc, const char **p)
 {
-	const char *ptr;
+	struct hdrpack hpk[1];
+	unsigned nlen;
+	txt t;
 
 	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
 	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
 	AN(p);
 
+	hpk_init(hpk, ObjGetAttr(wrk, oc, OA_HEADERS, NULL));
 	if (*p == NULL) {
-		ptr = ObjGetAttr(wrk, oc, OA_HEADERS, NULL);
-		AN(ptr);
-		ptr += 4;	/* Skip nhd and status */
-		ptr = strchr(ptr, '\0') + 1;	/* Skip :proto: */
-		ptr = strchr(ptr, '\0') + 1;	/* Skip :status: */
-		ptr = strchr(ptr, '\0') + 1;	/* Skip :reason: */
-		*p = ptr;
+		/* Skip proto, status and reason */
+		while (hpk->i < HPK_PSEUDO)
+			AN(hpk_next(hpk, &t, &nlen));
+		if (!hpk_next(hpk, &t, &nlen))
+			return (0);
+		*p = t.b;
 	} else {
 		*p = strchr(*p, '\0') + 1;	/* Skip to next header */
+		if (hpk->v2)
+			*p = strchr(*p, '\0') + 1;	/* and its lower case name */
 	}
 	if (**p == '\0')
 		return (0);
@@ -944,46 +1344,13 @@ HTTP_IterHdrPack(struct worker *wrk, struct objcore *oc, const char **p)
 const char *
 HTTP_GetHdrPack(struct worker *wrk, struct objcore *oc, const char *hdr)
 {
-	const char *ptr;
-	unsigned l;
+	struct hdrpack hpk[1];
 
 	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
 	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
-	AN(hdr);
 
-	l = hdr[0];
-	assert(l > 0);
-	assert(l == strlen(hdr + 1));
-	assert(hdr[l] == ':');
-	hdr++;
-
-	if (hdr[0] == ':') {
-		/* Special cases */
-		ptr = ObjGetAttr(wrk, oc, OA_HEADERS, NULL);
-		AN(ptr);
-		ptr += 4;	/* Skip nhd and status */
-
-		if (!strcmp(hdr, ":proto:"))
-			return (ptr);
-		ptr = strchr(ptr, '\0') + 1;
-		if (!strcmp(hdr, ":status:"))
-			return (ptr);
-		ptr = strchr(ptr, '\0') + 1;
-		if (!strcmp(hdr, ":reason:"))
-			return (ptr);
-		WRONG("Unknown magic packed header");
-	}
-
-	HTTP_FOREACH_PACK(wrk, oc, ptr) {
-		if (!strncasecmp(ptr, hdr, l)) {
-			ptr += l;
-			while (vct_islws(*ptr))
-				ptr++;
-			return (ptr);
-		}
-	}
-
-	return (NULL);
+	hpk_init(hpk, ObjGetAttr(wrk, oc, OA_HEADERS, NULL));
+	return (hpk_get(hpk, hdr));
 }
 
 /*--------------------------------------------------------------------
@@ -994,10 +1361,11 @@ HTTP_GetHdrPack(struct worker *wrk, struct objcore *oc, const char *hdr)
 void
 HTTP_Merge(struct worker *wrk, struct objcore *oc, struct http *to)
 {
+	struct hdrpack hpk[1];
 	const char *ptr;
-	unsigned u;
-	const char *p;
+	unsigned u, nlen;
 	unsigned nhd_before_merge;
+	txt t;
 
 	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
 	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
@@ -1005,24 +1373,20 @@ HTTP_Merge(struct worker *wrk, struct objcore *oc, struct http *to)
 
 	ptr = ObjGetAttr(wrk, oc, OA_HEADERS, NULL);
 	AN(ptr);
+	hpk_init(hpk, ptr);
 
 	to->status = vbe16dec(ptr + 2);
-	ptr += 4;
 
-	for (u = 0; u < HTTP_HDR_FIRST; u++) {
-		if (u == HTTP_HDR_METHOD || u == HTTP_HDR_URL)
-			continue;
-		http_SetH(to, u, ptr);
-		ptr = strchr(ptr, '\0') + 1;
+	for (u = HTTP_HDR_PROTO; u < HTTP_HDR_FIRST; u++) {
+		AN(hpk_next(hpk, &t, &nlen));
+		http_SetH(to, u, t.b);
 	}
 	nhd_before_merge = to->nhd;
-	while (*ptr != '\0') {
-		p = strchr(ptr, ':');
-		AN(p);
-		u = http_findhdr(to, p - ptr, ptr);
+	while (hpk_next(hpk, &t, &nlen)) {
+		AN(nlen);
+		u = http_findhdr(to, nlen, t.b);
 		if (u == 0 || u >= nhd_before_merge)
-			http_SetHeader(to, ptr);
-		ptr = strchr(ptr, '\0') + 1;
+			http_SetHeader(to, t.b);
 	}
 }
 
@@ -1036,6 +1400,7 @@ http_filterfields(struct http *to, const struct http *fm, unsigned how)
 	CHECK_OBJ_NOTNULL(fm, HTTP_MAGIC);
 	CHECK_OBJ_NOTNULL(to, HTTP_MAGIC);
 	to->nhd = HTTP_HDR_FIRST;
+	http_IndexHdrs(to);
 	to->status = fm->status;
 	for (u = HTTP_HDR_FIRST; u < fm->nhd; u++) {
 		Tcheck(fm->hd[u]);
@@ -1050,6 +1415,7 @@ http_filterfields(struct http *to, const struct http *fm, unsigned how)
 		to->hd[to->nhd] = fm->hd[u];
 		to->hdf[to->nhd] = 0;
 		http_VSLH(to, to->nhd);
+		http_hidx_add(to, to->nhd);
 		to->nhd++;
 	}
 }
@@ -1125,6 +1491,7 @@ http_SetHeader(struct http *to, const char *hdr)
 		return;
 	}
 	http_SetH(to, to->nhd++, hdr);
+	http_hidx_add(to, to->nhd - 1);
 }
 
 /*--------------------------------------------------------------------*/
@@ -1163,6 +1530,7 @@ http_PrintfHeader(struct http *to, const char *fmt, ...)
 	to->hdf[to->nhd] = 0;
 	WS_Release(to->ws, n + 1);
 	http_VSLH(to, to->nhd);
+	http_hidx_add(to, to->nhd);
 	to->nhd++;
 }
 
@@ -1184,6 +1552,7 @@ http_TimeHeader(struct http *to, const char *fmt, double now)
 	to->hd[to->nhd].e = strchr(p, '\0');
 	to->hdf[to->nhd] = 0;
 	http_VSLH(to, to->nhd);
+	http_hidx_add(to, to->nhd);
 	to->nhd++;
 }
 
@@ -1194,6 +1563,8 @@ http_Unset(struct http *hp, const char *hdr)
 {
 	uint16_t u, v;
 
+	if (http_findhdr(hp, hdr[0] - 1, hdr + 1) == 0)
+		return;
 	for (v = u = HTTP_HDR_FIRST; u < hp->nhd; u++) {
 		Tcheck(hp->hd[u]);
 		if (http_IsHdr(&hp->hd[u], hdr)) {
@@ -1207,8 +1578,128 @@ http_Unset(struct http *hp, const char *hdr)
 		v++;
 	}
 	hp->nhd = v;
+	http_IndexHdrs(hp);
 }
 
+/*--------------------------------------------------------------------
+ * Time field lookups, as done by obj.http bans, and decoding for
+ * delivery, on a made up object.  Version 1 is made here only to
+ * compare with and to check that both versions give the same answers.
+ */
+
+static void
+http_pack_v1(const struct http *fm, uint8_t *p0, unsigned l)
+{
+	unsigned u, w;
+	uint8_t *p, *e;
+
+	p = p0 + 4;
+	e = p0 + l;
+	for (u = HTTP_HDR_PROTO; u < fm->nhd; u++) {
+		w = Tlen(fm->hd[u]) + 1;
+		assert(p + w + 1 <= e);
+		memcpy(p, fm->hd[u].b, w);
+		p += w;
+	}
+	*p = '\0';
+	vbe16enc(p0, fm->nhd + 1);
+	vbe16enc(p0 + 2, fm->status);
+}
+
+static void __match_proto__(cli_func_t)
+ccf_hdrpack_bench(struct cli *cli, const char * const *av, void *priv)
+{
+	struct http *hp, *to;
+	struct hdrpack hpk[1];
+	char **hdrs, hit[32], miss[32];
+	const char *r[2];
+	uint8_t *pk[2];
+	void *p;
+	unsigned u, v, nhdr = 20, n = 100000, l;
+	double t0, t1, t2, d[2][3];
+
+	(void)priv;
+	if (av[2] != NULL)
+		nhdr = strtoul(av[2], NULL, 0);
+	if (av[2] != NULL && av[3] != NULL)
+		n = strtoul(av[3], NULL, 0);
+	if (nhdr < 1 || nhdr > 1000 || n < 1) {
+		VCLI_Out(cli, "Need 1 to 1000 headers");
+		VCLI_SetResult(cli, CLIS_PARAM);
+		return;
+	}
+	u = nhdr + HTTP_HDR_FIRST;
+	p = malloc(HTTP_estimate(u));
+	AN(p);
+	hp = HTTP_create(p, u);
+	p = malloc(HTTP_estimate(u));
+	AN(p);
+	to = HTTP_create(p, u);
+	hdrs = calloc(nhdr, sizeof *hdrs);
+	AN(hdrs);
+	HTTP_Setup(hp, NULL, NULL, SLT_ObjMethod);
+	HTTP_Setup(to, NULL, NULL, SLT_RespMethod);
+	http_SetH(hp, HTTP_HDR_PROTO, "HTTP/1.1");
+	http_SetH(hp, HTTP_HDR_STATUS, "200");
+	http_SetH(hp, HTTP_HDR_REASON, "OK");
+	hp->status = 200;
+	for (u = 0; u < nhdr; u++) {
+		assert(asprintf(&hdrs[u], "X-Bench-%u: value %u", u, u) > 0);
+		http_SetHeader(hp, hdrs[u]);
+	}
+	/* The last header is the worst case for a linear scan */
+	bprintf(hit, "*X-Bench-%u:", nhdr - 1);
+	hit[0] = (char)(strlen(hit) - 1);
+	bprintf(miss, "%s", "*X-Missing:");
+	miss[0] = (char)(strlen(miss) - 1);
+
+	l = http_EstimateWS(hp, 0);
+	for (v = 0; v < 2; v++) {
+		pk[v] = malloc(l);
+		AN(pk[v]);
+	}
+	http_pack_v1(hp, pk[0], l);
+	HTTP_Encode(hp, pk[1], l, 0);
+
+	for (v = 0; v < 2; v++) {
+		hpk_init(hpk, pk[v]);
+		assert(hpk->v2 == v);
+		t0 = VTIM_mono();
+		for (u = 0; u < n; u++)
+			r[v] = hpk_get(hpk, hit);
+		t1 = VTIM_mono();
+		for (u = 0; u < n; u++)
+			AZ(hpk_get(hpk, miss));
+		t2 = VTIM_mono();
+		for (u = 0; u < n; u++)
+			AZ(http_decode(to, pk[v]));
+		d[v][2] = VTIM_mono() - t2;
+		d[v][1] = t2 - t1;
+		d[v][0] = t1 - t0;
+		assert(to->nhd == hp->nhd);
+		AN(r[v]);
+	}
+	AZ(strcmp(r[0], r[1]));
+	VCLI_Out(cli, "%u headers, %u bytes\n", nhdr, l);
+	for (v = 0; v < 2; v++)
+		VCLI_Out(cli, "v%u: hit %.0f ns, miss %.0f ns,"
+		    " decode %.0f ns\n", v + 1, 1e9 * d[v][0] / n,
+		    1e9 * d[v][1] / n, 1e9 * d[v][2] / n);
+
+	for (v = 0; v < 2; v++)
+		free(pk[v]);
+	for (u = 0; u < nhdr; u++)
+		free(hdrs[u]);
+	free(hdrs);
+	free(hp);
+	free(to);
+}
+
+static struct cli_proto http_cmds[] = {
+	{ CLICMD_DEBUG_HDRPACK_BENCH,		"d", ccf_hdrpack_bench },
+	{ NULL }
+};
+
 /*--------------------------------------------------------------------*/
 
 void
@@ -1217,4 +1708,7 @@ HTTP_Init(void)
 
 #define HTTPH(a, b, c) b[0] = (char)strlen(b + 1);
 #include "tbl/http_headers.h"
+	http_hidx_init();
+
+	CLI_AddFuncs(http_cmds);
 }
@@ -228,6 +228,7 @@ child_main(void)
 	Lck_New(&vxid_lock, lck_vxid);
 
 	CLI_Init();
+	VSL_Init();
 	PAN_Init();
 	VFP_Init();
 
@@ -247,6 +248,7 @@ child_main(void)
 	EXP_Init();
 	HSH_Init(heritage.hash);
 	BAN_Init();
+	SKEY_Init();
 
 	VCA_Init();
 
@@ -57,6 +57,7 @@ struct mempool {
 	struct lock			mtx;
 	volatile struct poolparam	*param;
 	volatile unsigned		*cur_size;
+	unsigned			extra;
 	uint64_t			live;
 	struct VSC_C_mempool		*vsc;
 	unsigned			n_pool;
@@ -65,6 +66,18 @@ struct mempool {
 	int				self_destruct;
 };
 
+/*---------------------------------------------------------------------
+ * The size of the items is the parameter plus whatever the user of the
+ * pool carves out of them before handing the rest to a workspace.
+ */
+
+static unsigned
+mpl_size(const struct mempool *mpl)
+{
+
+	return (*mpl->cur_size + mpl->extra);
+}
+
 /*---------------------------------------------------------------------
  */
 
@@ -75,7 +88,7 @@ mpl_alloc(const struct mempool *mpl)
 	struct memitem *mi;
 
 	CHECK_OBJ_NOTNULL(mpl, MEMPOOL_MAGIC);
-	tsz = *mpl->cur_size;
+	tsz = mpl_size(mpl);
 	mi = calloc(tsz, 1);
 	AN(mi);
 	mi->magic = MEMITEM_MAGIC;
@@ -109,7 +122,7 @@ mpl_guard(void *priv)
 		mpl->t_now = VTIM_real();
 
 		if (mi != NULL && (mpl->n_pool > mpl->param->max_pool ||
-		    mi->size < *mpl->cur_size)) {
+		    mi->size < mpl_size(mpl))) {
 			FREE_OBJ(mi);
 			mi = NULL;
 		}
@@ -166,7 +179,7 @@ mpl_guard(void *priv)
 		}
 
 		if (mpl->n_pool < mpl->param->min_pool &&
-		    mi != NULL && mi->size >= *mpl->cur_size) {
+		    mi != NULL && mi->size >= mpl_size(mpl)) {
 			CHECK_OBJ_NOTNULL(mi, MEMITEM_MAGIC);
 			mpl->vsc->pool = ++mpl->n_pool;
 			mi->touched = mpl->t_now;
@@ -223,7 +236,8 @@ mpl_guard(void *priv)
 
 struct mempool *
 MPL_New(const char *name,
-    volatile struct poolparam *pp, volatile unsigned *cur_size)
+    volatile struct poolparam *pp, volatile unsigned *cur_size,
+    unsigned extra)
 {
 	struct mempool *mpl;
 
@@ -232,6 +246,7 @@ MPL_New(const char *name,
 	bprintf(mpl->name, "MPL_%s", name);
 	mpl->param = pp;
 	mpl->cur_size = cur_size;
+	mpl->extra = extra;
 	VTAILQ_INIT(&mpl->list);
 	VTAILQ_INIT(&mpl->surplus);
 	Lck_New(&mpl->mtx, lck_mempool);
@@ -286,7 +301,7 @@ MPL_Get(struct mempool *mpl, unsigned *size)
 		mpl->vsc->pool = --mpl->n_pool;
 		CHECK_OBJ_NOTNULL(mi, MEMITEM_MAGIC);
 		VTAILQ_REMOVE(&mpl->list, mi, list);
-		if (mi->size < *mpl->cur_size) {
+		if (mi->size < mpl_size(mpl)) {
 			mpl->vsc->toosmall++;
 			VTAILQ_INSERT_HEAD(&mpl->surplus, mi, list);
 			mi = NULL;
@@ -323,7 +338,7 @@ MPL_Free(struct mempool *mpl, void *item)
 	mpl->vsc->frees++;
 	mpl->vsc->live = --mpl->live;
 
-	if (mi->size < *mpl->cur_size) {
+	if (mi->size < mpl_size(mpl)) {
 		mpl->vsc->toosmall++;
 		VTAILQ_INSERT_HEAD(&mpl->surplus, mi, list);
 	} else {
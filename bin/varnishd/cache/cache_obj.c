@@ -66,6 +66,7 @@
  * 23	  ObjGetXID()
  *
  * 23	ObjIterate()	... over body
+ * 23	ObjIterateFd()	... over body, as file ranges if possible
  *
  * 23	ObjTouch()	Signal to LRU(-like) facilities
  *
@@ -185,6 +186,28 @@ ObjIterate(struct worker *wrk, struct objcore *oc,
 	return (om->objiterator(wrk, oc, priv, func, final));
 }
 
+/*====================================================================
+ * ObjIterateFd()
+ *
+ * Like ObjIterate(), but where the stevedore can, body data is handed
+ * to ffunc as a range of a file instead of a pointer, so it can be
+ * sent without passing through our address space.
+ */
+
+int
+ObjIterateFd(struct worker *wrk, struct objcore *oc,
+    void *priv, objiterate_f *func, objiteratefd_f *ffunc)
+{
+	const struct obj_methods *om = obj_getmethods(oc);
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	AN(func);
+	AN(ffunc);
+	if (om->objiteratorfd == NULL)
+		return (ObjIterate(wrk, oc, priv, func, 0));
+	return (om->objiteratorfd(wrk, oc, priv, func, ffunc));
+}
+
 /*====================================================================
  * ObjGetSpace()
  *
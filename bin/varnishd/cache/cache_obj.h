@@ -36,6 +36,8 @@ typedef void objsetstate_f(struct worker *, const struct objcore *,
 
 typedef int objiterator_f(struct worker *, struct objcore *,
     void *priv, objiterate_f *func, int final);
+typedef int objiteratorfd_f(struct worker *, struct objcore *,
+    void *priv, objiterate_f *func, objiteratefd_f *ffunc);
 typedef int objgetspace_f(struct worker *, struct objcore *,
      ssize_t *sz, uint8_t **ptr);
 typedef void objextend_f(struct worker *, struct objcore *, ssize_t l);
@@ -60,5 +62,6 @@ struct obj_methods {
 	objsetattr_f	*objsetattr;
 	objtouch_f	*objtouch;
 	objsetstate_f	*objsetstate;
+	objiteratorfd_f	*objiteratorfd;
 };
 
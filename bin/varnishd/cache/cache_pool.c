@@ -36,12 +36,16 @@
 #include "config.h"
 
 #include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #include "cache.h"
 #include "cache_pool.h"
 
+#include "vtim.h"
+
 static pthread_t		thr_pool_herder;
+static pthread_t		thr_pool_folder;
 
 static struct lock		wstat_mtx;
 struct lock			pool_mtx;
@@ -120,6 +124,19 @@ Pool_PurgeStat(unsigned nobj)
 	Lck_Unlock(&wstat_mtx);
 }
 
+/*--------------------------------------------------------------------
+ * Fold the per-thread counter shards into the global stats counters
+ */
+
+void
+Pool_FoldStat(void)
+{
+
+	Lck_Lock(&wstat_mtx);
+	VSC_Fold();
+	Lck_Unlock(&wstat_mtx);
+}
+
 /*--------------------------------------------------------------------
  * Special function to summ stats
  */
@@ -149,15 +166,21 @@ static struct pool *
 pool_mkpool(unsigned pool_no)
 {
 	struct pool *pp;
-	int i;
+	char buf[16];
+	int i, node = -1;
 
 	ALLOC_OBJ(pp, POOL_MAGIC);
 	if (pp == NULL)
 		return (NULL);
+	pp->pool_no = pool_no;
 	pp->a_stat = calloc(1, sizeof *pp->a_stat);
 	AN(pp->a_stat);
 	pp->b_stat = calloc(1, sizeof *pp->b_stat);
 	AN(pp->b_stat);
+	bprintf(buf, "%u", pool_no);
+	pp->vsc = VSM_Alloc(sizeof *pp->vsc, VSC_CLASS, VSC_type_pool, buf);
+	AN(pp->vsc);
+	memset(pp->vsc, 0, sizeof *pp->vsc);
 	Lck_New(&pp->mtx, lck_wq);
 
 	VTAILQ_INIT(&pp->idle_queue);
@@ -165,13 +188,26 @@ pool_mkpool(unsigned pool_no)
 	for (i = 0; i < TASK_QUEUE_END; i++)
 		VTAILQ_INIT(&pp->queues[i]);
 	AZ(pthread_cond_init(&pp->herder_cond, NULL));
+
+	/*
+	 * The threads created from here on inherit our CPU binding, and
+	 * the memory they first touch comes from that node.
+	 */
+	if (cache_param->wthread_numa)
+		node = NUMA_Bind(pool_no);
+
 	AZ(pthread_create(&pp->herder_thr, NULL, pool_herder, pp));
 
 	while (VTAILQ_EMPTY(&pp->idle_queue))
 		(void)usleep(10000);
 
 	SES_NewPool(pp, pool_no);
-	VCA_NewPool(pp);
+	VCA_NewPool(pp, pool_no);
+
+	if (cache_param->wthread_numa) {
+		NUMA_Unbind();
+		VSL(SLT_Debug, 0, "Pool %u on NUMA node %d", pool_no, node);
+	}
 
 	return (pp);
 }
@@ -239,6 +275,7 @@ pool_poolherder(void *priv)
 			AZ(pthread_cond_destroy(&ppx->herder_cond));
 			free(ppx->a_stat);
 			free(ppx->b_stat);
+			VSM_Free(ppx->vsc);
 			SES_DestroyPool(ppx);
 			FREE_OBJ(ppx);
 			VSC_C_main->pools--;
@@ -249,6 +286,25 @@ pool_poolherder(void *priv)
 	NEEDLESS(return NULL);
 }
 
+/*--------------------------------------------------------------------
+ * The per-thread counter shards are folded often enough that nobody
+ * watching the counters will notice the delay.
+ */
+
+static void *
+pool_folder(void *priv)
+{
+
+	THR_SetName("pool_folder");
+	(void)priv;
+
+	while (1) {
+		Pool_FoldStat();
+		VTIM_sleep(0.1);
+	}
+	NEEDLESS(return NULL);
+}
+
 /*--------------------------------------------------------------------*/
 
 void
@@ -258,6 +314,7 @@ Pool_Init(void)
 	Lck_New(&wstat_mtx, lck_wstat);
 	Lck_New(&pool_mtx, lck_wq);
 	AZ(pthread_create(&thr_pool_herder, NULL, pool_poolherder, NULL));
+	AZ(pthread_create(&thr_pool_folder, NULL, pool_folder, NULL));
 	while (!VSC_C_main->pools)
 		(void)usleep(10000);
 }
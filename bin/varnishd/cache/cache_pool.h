@@ -37,6 +37,7 @@ struct pool {
 	unsigned			magic;
 #define POOL_MAGIC			0x606658fa
 	VTAILQ_ENTRY(pool)		list;
+	unsigned			pool_no;
 	VTAILQ_HEAD(,poolsock)		poolsocks;
 
 	int				die;
@@ -54,6 +55,7 @@ struct pool {
 	uintmax_t			nqueued;
 	struct dstat			*a_stat;
 	struct dstat			*b_stat;
+	struct VSC_C_pool		*vsc;
 
 	struct mempool			*mpl_req;
 	struct mempool			*mpl_sess;
@@ -63,5 +65,5 @@ struct pool {
 void *pool_herder(void*);
 task_func_t pool_stat_summ;
 extern struct lock			pool_mtx;
-void VCA_NewPool(struct pool *);
+void VCA_NewPool(struct pool *, unsigned pool_no);
 void VCA_DestroyPool(struct pool *);
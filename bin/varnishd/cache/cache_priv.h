@@ -101,8 +101,15 @@ task_func_t VPX_Proto_Sess;
 void SES_NewPool(struct pool *, unsigned pool_no);
 void SES_DestroyPool(struct pool *);
 
+/* cache_skey.c [SKEY] */
+void SKEY_Init(void);
+void SKEY_NewObjCore(struct objcore *, const struct http *);
+void SKEY_DestroyObj(struct objcore *);
+
 /* cache_shmlog.c */
 void VSM_Init(void);
+void VSL_Init(void);
+void VSC_Fold(void);
 void VSL_Setup(struct vsl_log *vsl, void *ptr, size_t len);
 void VSL_ChgId(struct vsl_log *vsl, const char *typ, const char *why,
     uint32_t vxid);
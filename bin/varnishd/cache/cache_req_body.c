@@ -70,7 +70,7 @@ vrb_pull(struct req *req, ssize_t maxsize, objiterate_f *func, void *priv)
 
 	req->storage = NULL;
 
-	XXXAN(STV_NewObject(req->wrk, req->body_oc, stv, 8));
+	XXXAN(STV_NewObject(req->wrk, req->body_oc, stv, 8, 0));
 
 	vfc->oc = req->body_oc;
 
@@ -230,7 +230,7 @@ cnt_synth(struct worker *wrk, struct req *req)
 	req->objcore = HSH_Private(wrk);
 	CHECK_OBJ_NOTNULL(req->objcore, OBJCORE_MAGIC);
 	szl = -1;
-	if (STV_NewObject(wrk, req->objcore, stv_transient, 1024)) {
+	if (STV_NewObject(wrk, req->objcore, stv_transient, 1024, 0)) {
 		szl = VSB_len(synth_body);
 		assert(szl >= 0);
 		sz = szl;
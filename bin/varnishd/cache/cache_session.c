@@ -480,7 +480,7 @@ ses_close_acct(enum sess_close reason)
 	switch (reason) {
 #define SESS_CLOSE(reason, stat, err, desc)		\
 	case SC_ ## reason:				\
-		VSC_C_main->sc_ ## stat++;		\
+		VSC_Shard()->sc_ ## stat++;		\
 		i = err;				\
 		break;
 #include "tbl/sess_close.h"
@@ -489,7 +489,7 @@ ses_close_acct(enum sess_close reason)
 		WRONG("Wrong event in ses_close_acct");
 	}
 	if (i)
-		VSC_C_main->sess_closed_err++;
+		VSC_Shard()->sess_closed_err++;
 }
 
 /*--------------------------------------------------------------------
@@ -593,10 +593,10 @@ SES_NewPool(struct pool *pp, unsigned pool_no)
 	CHECK_OBJ_NOTNULL(pp, POOL_MAGIC);
 	bprintf(nb, "req%u", pool_no);
 	pp->mpl_req = MPL_New(nb, &cache_param->req_pool,
-	    &cache_param->workspace_client);
+	    &cache_param->workspace_client, 3 * HTTP_HIDX_SIZE);
 	bprintf(nb, "sess%u", pool_no);
 	pp->mpl_sess = MPL_New(nb, &cache_param->sess_pool,
-	    &cache_param->workspace_session);
+	    &cache_param->workspace_session, 0);
 
 	pp->waiter = Waiter_New();
 }
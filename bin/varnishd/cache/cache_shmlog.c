@@ -31,12 +31,12 @@
 
 #include "cache.h"
 
-#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "common/heritage.h"
 
+#include "vcli_serve.h"
 #include "vsl_priv.h"
 #include "vmb.h"
 #include "vtim.h"
@@ -47,12 +47,82 @@ static pthread_mutex_t vsm_mtx;
 
 static struct VSL_head		*vsl_head;
 static const uint32_t		*vsl_end;
-static uint32_t			*vsl_ptr;
-static unsigned			vsl_segment_n;
+static unsigned			vsl_segment_base;
 static ssize_t			vsl_segsize;
 
+/*
+ * Writers reserve space in the log without a lock, by swapping in a
+ * new write position with compare-and-swap.  The position is the
+ * offset into the log and the number of times it wrapped.  All the
+ * space ahead of the writers is kept filled with end markers, so
+ * nobody needs to put one behind their record, and readers stop at the
+ * first record which is not finished yet, exactly as before.
+ *
+ * Whoever reserves space in a new segment cleans the one after it, and
+ * no one writes into a segment until it has been cleaned.  Readers two
+ * segments behind have already been overrun, so there is nobody left
+ * reading there.
+ */
+static volatile uint64_t	vsl_pos;
+static volatile unsigned	vsl_clean;
+
+#if defined(__GNUC__)
+#  define vsl_cas(p, o, n)	__sync_bool_compare_and_swap(p, o, n)
+#else
+static int
+vsl_cas(volatile uint64_t *p, uint64_t o, uint64_t n)
+{
+	int r = 0;
+
+	AZ(pthread_mutex_lock(&vsl_mtx));
+	if (*p == o) {
+		*p = n;
+		r = 1;
+	}
+	AZ(pthread_mutex_unlock(&vsl_mtx));
+	return (r);
+}
+#endif
+
 struct VSC_C_main       *VSC_C_main;
 
+/*
+ * Counters bumped from many threads are kept in per-thread shards,
+ * which only their own thread writes to, so counting needs neither a
+ * lock nor an atomic operation.  VSC_Fold() adds what each shard
+ * gained since the last time to VSC_C_main, so nobody outside varnishd
+ * can tell the difference, except that the counters lag a little.
+ *
+ * The shards are never reset, the gauges can go "negative" in them,
+ * but the differences still add up correctly modulo 2^64.
+ *
+ * VSC_Fold() only writes the fields a shard changed, so a counter must
+ * either always go through VSC_Shard() or never: counters which are
+ * set outright or read back by the code, such as bans_lurker_backlog
+ * or pools, stay in VSC_C_main under their own locks.  Counters in
+ * struct dstat are summed by Pool_Sumstat() under wstat_mtx, which is
+ * also held when folding.
+ *
+ * Each thread which counts anything carries a shard of two struct
+ * VSC_C_main, a few kilobytes.
+ */
+
+struct vsc_shard {
+	unsigned		magic;
+#define VSC_SHARD_MAGIC		0x3c9e6a15
+	int			dead;
+	VTAILQ_ENTRY(vsc_shard)	list;
+	struct VSC_C_main	seen;
+	char			pad1[64];
+	struct VSC_C_main	cnt;
+	char			pad2[64];
+};
+
+static pthread_mutex_t		vsc_mtx;
+static pthread_key_t		vsc_key;
+static VTAILQ_HEAD(, vsc_shard)	vsc_shards =
+    VTAILQ_HEAD_INITIALIZER(vsc_shards);
+
 
 static void
 vsl_sanity(const struct vsl_log *vsl)
@@ -99,26 +169,72 @@ vsl_hdr(enum VSL_tag_e tag, uint32_t *p, unsigned len, uint32_t vxid)
 }
 
 /*--------------------------------------------------------------------
- * Wrap the VSL buffer
+ * Segment bookkeeping
  */
 
+static inline unsigned
+vsl_segment(uint64_t pos)
+{
+
+	return (vsl_segment_base + (unsigned)(pos >> 32) * VSL_SEGMENTS +
+	    (unsigned)(pos & 0xffffffff) / vsl_segsize);
+}
+
 static void
-vsl_wrap(void)
+vsl_clean_segment(unsigned seg)
 {
+	uint32_t *p, *e;
 
-	assert(vsl_ptr >= vsl_head->log);
-	assert(vsl_ptr < vsl_end);
-	vsl_segment_n += VSL_SEGMENTS - (vsl_segment_n % VSL_SEGMENTS);
-	assert(vsl_segment_n % VSL_SEGMENTS == 0);
-	vsl_head->offset[0] = 0;
-	vsl_head->log[0] = VSL_ENDMARKER;
-	VWMB();
-	if (vsl_ptr != vsl_head->log) {
-		*vsl_ptr = VSL_WRAPMARKER;
-		vsl_ptr = vsl_head->log;
+	p = vsl_head->log + (seg % VSL_SEGMENTS) * vsl_segsize;
+	e = p + vsl_segsize;
+	while (p < e)
+		*p++ = VSL_ENDMARKER;
+}
+
+static inline void
+vsl_wait_clean(unsigned seg)
+{
+
+	while ((int)(vsl_clean - seg) < 0)
+		(void)usleep(10);
+	VRMB();
+}
+
+/*--------------------------------------------------------------------
+ * We reserved space which took us into one or more new segments.
+ * Segments are entered in order, because each of them waits for the
+ * previous one to clean it.
+ */
+
+static void
+vsl_enter(uint64_t opos, uint64_t npos, uint32_t *wrap)
+{
+	unsigned seg, nseg, wseg;
+
+	seg = vsl_segment(opos);
+	nseg = vsl_segment(npos);
+	wseg = vsl_segment(npos & ~(uint64_t)0xffffffff);
+	while (seg != nseg) {
+		seg++;
+		vsl_wait_clean(seg);
+		if (wrap != NULL && (int)(seg - wseg) < 0) {
+			/* Skipped at the end of the log */
+			vsl_head->offset[seg % VSL_SEGMENTS] =
+			    wrap - vsl_head->log;
+		} else if (wrap != NULL && seg == wseg) {
+			vsl_head->offset[seg % VSL_SEGMENTS] = 0;
+			VWMB();
+			*wrap = VSL_WRAPMARKER;
+			VSC_Shard()->shm_cycles++;
+		} else {
+			vsl_head->offset[seg % VSL_SEGMENTS] =
+			    npos & 0xffffffff;
+		}
+		vsl_clean_segment(seg + 1);
+		VWMB();
+		vsl_head->segment_n = seg;
+		vsl_clean = seg + 1;
 	}
-	vsl_head->segment_n = vsl_segment_n;
-	VSC_C_main->shm_cycles++;
 }
 
 /*--------------------------------------------------------------------
@@ -128,47 +244,43 @@ vsl_wrap(void)
 static uint32_t *
 vsl_get(unsigned len, unsigned records, unsigned flushes)
 {
-	uint32_t *p;
-	int err;
+	struct VSC_C_main *vsc;
+	uint64_t opos, npos;
+	uint32_t off, words, *wrap;
+	unsigned cont = 0;
 
-	err = pthread_mutex_trylock(&vsl_mtx);
-	if (err == EBUSY) {
-		AZ(pthread_mutex_lock(&vsl_mtx));
-		VSC_C_main->shm_cont++;
-	} else {
-		AZ(err);
-	}
-	assert(vsl_ptr < vsl_end);
-	AZ((uintptr_t)vsl_ptr & 0x3);
-
-	VSC_C_main->shm_writes++;
-	VSC_C_main->shm_flushes += flushes;
-	VSC_C_main->shm_records += records;
-
-	/* Wrap if necessary */
-	if (VSL_END(vsl_ptr, len) >= vsl_end)
-		vsl_wrap();
-
-	p = vsl_ptr;
-	vsl_ptr = VSL_END(vsl_ptr, len);
-	assert(vsl_ptr < vsl_end);
-	AZ((uintptr_t)vsl_ptr & 0x3);
+	words = 2 + VSL_WORDS(len);
+	assert(words < vsl_end - vsl_head->log);
 
-	*vsl_ptr = VSL_ENDMARKER;
-
-	while ((vsl_ptr - vsl_head->log) / vsl_segsize >
-	    vsl_segment_n % VSL_SEGMENTS) {
-		vsl_segment_n++;
-		vsl_head->offset[vsl_segment_n % VSL_SEGMENTS] =
-		    vsl_ptr - vsl_head->log;
+	while (1) {
+		opos = vsl_pos;
+		off = opos & 0xffffffff;
+		if (vsl_head->log + off + words >= vsl_end) {
+			/* Wrap */
+			npos = ((opos >> 32) + 1) << 32 | words;
+			off = 0;
+		} else
+			npos = opos + words;
+		if (vsl_cas(&vsl_pos, opos, npos))
+			break;
+		cont++;
 	}
 
-	AZ(pthread_mutex_unlock(&vsl_mtx));
-	/* Implicit VWMB() in mutex op ensures ENDMARKER and new table
-	   values are seen before new segment number */
-	vsl_head->segment_n = vsl_segment_n;
-
-	return (p);
+	vsc = VSC_Shard();
+	vsc->shm_cont += cont;
+	vsc->shm_writes++;
+	vsc->shm_flushes += flushes;
+	vsc->shm_records += records;
+
+	if (vsl_segment(opos) != vsl_segment(npos)) {
+		wrap = NULL;
+		if (off == 0)
+			wrap = vsl_head->log + (opos & 0xffffffff);
+		vsl_enter(opos, npos, wrap);
+	} else
+		vsl_wait_clean(vsl_segment(npos));
+
+	return (vsl_head->log + off);
 }
 
 /*--------------------------------------------------------------------
@@ -204,7 +316,7 @@ vslr(enum VSL_tag_e tag, uint32_t vxid, const char *b, unsigned len)
  * Add a unbuffered record to VSL
  *
  * NB: This variant should be used sparingly and only for low volume
- * NB: since it significantly adds to the mutex load on the VSL.
+ * NB: since every record competes with all other writers for log space.
  */
 
 void
@@ -467,6 +579,151 @@ VSL_End(struct vsl_log *vsl)
 	vsl->wid = 0;
 }
 
+/*--------------------------------------------------------------------
+ * Per-thread counter shards
+ */
+
+static void
+vsc_shard_fini(void *priv)
+{
+	struct vsc_shard *vs;
+
+	CAST_OBJ_NOTNULL(vs, priv, VSC_SHARD_MAGIC);
+	VWMB();
+	vs->dead = 1;
+}
+
+struct VSC_C_main *
+VSC_Shard(void)
+{
+	struct vsc_shard *vs;
+
+	vs = pthread_getspecific(vsc_key);
+	if (vs == NULL) {
+		ALLOC_OBJ(vs, VSC_SHARD_MAGIC);
+		AN(vs);
+		AZ(pthread_mutex_lock(&vsc_mtx));
+		VTAILQ_INSERT_TAIL(&vsc_shards, vs, list);
+		AZ(pthread_mutex_unlock(&vsc_mtx));
+		AZ(pthread_setspecific(vsc_key, vs));
+	}
+	return (&vs->cnt);
+}
+
+/*
+ * The caller must keep this from racing Pool_Sumstat(), which also
+ * adds to VSC_C_main.
+ */
+
+void
+VSC_Fold(void)
+{
+	struct vsc_shard *vs, *vs2;
+	uint64_t u;
+	int dead;
+
+	AZ(pthread_mutex_lock(&vsc_mtx));
+	VTAILQ_FOREACH_SAFE(vs, &vsc_shards, list, vs2) {
+		CHECK_OBJ_NOTNULL(vs, VSC_SHARD_MAGIC);
+		dead = vs->dead;
+		VRMB();
+#define VSC_FF(n,t,l,s,f,v,d,e)						\
+		u = *(volatile uint64_t *)&vs->cnt.n;			\
+		if (u != vs->seen.n) {					\
+			VSC_C_main->n += u - vs->seen.n;		\
+			vs->seen.n = u;					\
+		}
+#include "tbl/vsc_f_main.h"
+#undef VSC_FF
+		if (dead) {
+			VTAILQ_REMOVE(&vsc_shards, vs, list);
+			FREE_OBJ(vs);
+		}
+	}
+	AZ(pthread_mutex_unlock(&vsc_mtx));
+}
+
+/*--------------------------------------------------------------------
+ * Hammer the log from many threads, to measure how well the writers
+ * get along.
+ */
+
+struct vsl_bench {
+	unsigned		magic;
+#define VSL_BENCH_MAGIC		0x5c1d03e7
+	unsigned		n;
+	pthread_t		thr;
+};
+
+static void *
+vsl_bench_thread(void *priv)
+{
+	struct vsl_bench *vb;
+	struct vsl_log vsl[1];
+	unsigned u, v;
+
+	CAST_OBJ_NOTNULL(vb, priv, VSL_BENCH_MAGIC);
+	VSL_Setup(vsl, NULL, 0);
+	for (u = 0; u < vb->n; u++) {
+		for (v = 0; v < 20; v++)
+			VSLb(vsl, SLT_Debug, "shmlog_bench %u record %u", u, v);
+		VSL_Flush(vsl, 0);
+	}
+	free(vsl->wlb);
+	return (NULL);
+}
+
+static void __match_proto__(cli_func_t)
+ccf_shmlog_bench(struct cli *cli, const char * const *av, void *priv)
+{
+	struct vsl_bench *vb;
+	unsigned u, nthr = 8, n = 10000;
+	uint64_t cont;
+	double t;
+
+	(void)priv;
+	if (av[2] != NULL)
+		nthr = strtoul(av[2], NULL, 0);
+	if (av[2] != NULL && av[3] != NULL)
+		n = strtoul(av[3], NULL, 0);
+	if (nthr < 1 || nthr > 1024) {
+		VCLI_Out(cli, "Need 1 to 1024 threads");
+		VCLI_SetResult(cli, CLIS_PARAM);
+		return;
+	}
+	vb = calloc(nthr, sizeof *vb);
+	AN(vb);
+	Pool_FoldStat();
+	cont = VSC_C_main->shm_cont;
+	t = VTIM_mono();
+	for (u = 0; u < nthr; u++) {
+		vb[u].magic = VSL_BENCH_MAGIC;
+		vb[u].n = n;
+		AZ(pthread_create(&vb[u].thr, NULL, vsl_bench_thread, &vb[u]));
+	}
+	for (u = 0; u < nthr; u++)
+		AZ(pthread_join(vb[u].thr, NULL));
+	t = VTIM_mono() - t;
+	Pool_FoldStat();
+	cont = VSC_C_main->shm_cont - cont;
+	free(vb);
+	VCLI_Out(cli, "%u threads, %u records in %.3fs, %.0f records/s,"
+	    " %ju contended writes", nthr, nthr * n * 20, t,
+	    nthr * n * 20 / t, (uintmax_t)cont);
+}
+
+static struct cli_proto vsl_cmds[] = {
+	{ CLICMD_DEBUG_SHMLOG_BENCH,		"d", ccf_shmlog_bench },
+	{ NULL }
+};
+
+void
+VSL_Init(void)
+{
+
+	CLI_AddFuncs(vsl_cmds);
+}
+
 /*--------------------------------------------------------------------*/
 
 static void *
@@ -495,6 +752,8 @@ VSM_Init(void)
 
 	AZ(pthread_mutex_init(&vsl_mtx, NULL));
 	AZ(pthread_mutex_init(&vsm_mtx, NULL));
+	AZ(pthread_mutex_init(&vsc_mtx, NULL));
+	AZ(pthread_key_create(&vsc_key, vsc_shard_fini));
 
 	vsl_head = VSM_Alloc(cache_param->vsl_space, VSL_CLASS, "", "");
 	AN(vsl_head);
@@ -503,11 +762,13 @@ VSM_Init(void)
 	vsl_end = vsl_head->log + vsl_segsize * VSL_SEGMENTS;
 	/* Make segment_n always overflow on first log wrap to make any
 	   problems with regard to readers on that event visible */
-	vsl_segment_n = UINT_MAX - (VSL_SEGMENTS - 1);
-	AZ(vsl_segment_n % VSL_SEGMENTS);
-	vsl_head->segment_n = vsl_segment_n;
-	vsl_ptr = vsl_head->log;
-	*vsl_ptr = VSL_ENDMARKER;
+	vsl_segment_base = UINT_MAX - (VSL_SEGMENTS - 1);
+	AZ(vsl_segment_base % VSL_SEGMENTS);
+	vsl_head->segment_n = vsl_segment_base;
+	vsl_pos = 0;
+	for (i = 0; i < VSL_SEGMENTS; i++)
+		vsl_clean_segment(i);
+	vsl_clean = vsl_segment_base + 1;
 
 	memset(vsl_head, 0, sizeof *vsl_head);
 	vsl_head->segsize = vsl_segsize;
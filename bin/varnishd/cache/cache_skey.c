@@ -0,0 +1,338 @@
+/*-
+ * Copyright (c) 2017 Varnish Software AS
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Surrogate keys
+ *
+ * Backends tag objects with keys in the response header named by the
+ * surrogate_key_header parameter, and all objects carrying a key can
+ * then be purged without adding a ban.  We keep a tree of the keys in
+ * use, each with a list of the objcores which carry it, so a purge only
+ * visits the objects it kills.
+ *
+ * An objcore gets all its references in a single allocation, which is
+ * released when the objcore is destroyed.
+ */
+
+#include "config.h"
+
+#include "cache.h"
+
+#include <stdlib.h>
+
+#include "hash/hash_slinger.h"
+#include "vcli_serve.h"
+#include "vct.h"
+#include "vtim.h"
+#include "vtree.h"
+
+struct skey_ref;
+
+struct skey {
+	unsigned			magic;
+#define SKEY_MAGIC			0x2f0b5e13
+	VRB_ENTRY(skey)			tree;
+	VTAILQ_HEAD(skey_ref_s, skey_ref) refs;
+	unsigned			nref;
+	const char			*key;
+};
+
+struct skey_ref {
+	struct skey			*skey;
+	struct objcore			*oc;
+	VTAILQ_ENTRY(skey_ref)		list;
+};
+
+struct skey_oc {
+	unsigned			magic;
+#define SKEY_OC_MAGIC			0x5a1c7d0e
+	unsigned			n;
+	struct skey_ref			ref[];
+};
+
+VRB_HEAD(skey_tree, skey);
+
+static struct lock skey_mtx;
+static struct skey_tree skeys = VRB_INITIALIZER(&skeys);
+
+static inline int
+skey_cmp(const struct skey *a, const struct skey *b)
+{
+
+	return (strcmp(a->key, b->key));
+}
+
+VRB_PROTOTYPE_STATIC(skey_tree, skey, tree, skey_cmp)
+VRB_GENERATE_STATIC(skey_tree, skey, tree, skey_cmp)
+
+static inline int
+skey_issep(char c)
+{
+
+	return (vct_issp(c) || c == ',');
+}
+
+/*--------------------------------------------------------------------
+ * Find a key, creating it if need be.  The key string lives after the
+ * struct.
+ */
+
+static struct skey *
+skey_get(const char *key)
+{
+	struct skey *sk, k;
+	size_t l;
+
+	Lck_AssertHeld(&skey_mtx);
+	INIT_OBJ(&k, SKEY_MAGIC);
+	k.key = key;
+	sk = VRB_FIND(skey_tree, &skeys, &k);
+	if (sk != NULL)
+		return (sk);
+
+	l = strlen(key) + 1;
+	sk = malloc(sizeof *sk + l);
+	AN(sk);
+	INIT_OBJ(sk, SKEY_MAGIC);
+	VTAILQ_INIT(&sk->refs);
+	memcpy(sk + 1, key, l);
+	sk->key = (const char *)(sk + 1);
+	AZ(VRB_INSERT(skey_tree, &skeys, sk));
+	VSC_Shard()->n_skey++;
+	return (sk);
+}
+
+/*--------------------------------------------------------------------
+ * A new object is being created, index it under the keys it carries.
+ */
+
+void
+SKEY_NewObjCore(struct objcore *oc, const struct http *hp)
+{
+	char hdr[sizeof cache_param->surrogate_key_header.hdr];
+	struct skey_oc *so;
+	struct skey_ref *r;
+	struct skey *sk;
+	const char *b;
+	char *s, *p, *q;
+	unsigned n, l;
+
+	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+	AZ(oc->skey);
+
+	/* The parameter may change under us, check before we use it */
+	memcpy(hdr, TRUST_ME(cache_param->surrogate_key_header.hdr),
+	    sizeof hdr);
+	hdr[sizeof hdr - 1] = '\0';
+	l = (unsigned char)hdr[0];
+	if (l < 2 || l != strlen(hdr + 1) || hdr[l] != ':')
+		return;
+	if (!http_GetHdr(hp, hdr, &b))
+		return;
+
+	s = strdup(b);
+	AN(s);
+	n = 0;
+	for (p = s; *p != '\0'; ) {
+		while (skey_issep(*p))
+			p++;
+		if (*p == '\0')
+			break;
+		n++;
+		while (*p != '\0' && !skey_issep(*p))
+			p++;
+	}
+	if (n == 0) {
+		free(s);
+		return;
+	}
+
+	so = calloc(1, sizeof *so + n * sizeof *so->ref);
+	AN(so);
+	so->magic = SKEY_OC_MAGIC;
+	so->n = n;
+
+	Lck_Lock(&skey_mtx);
+	r = so->ref;
+	for (p = s; *p != '\0'; ) {
+		while (skey_issep(*p))
+			p++;
+		if (*p == '\0')
+			break;
+		for (q = p; *q != '\0' && !skey_issep(*q); q++)
+			continue;
+		if (*q != '\0')
+			*q++ = '\0';
+		sk = skey_get(p);
+		p = q;
+		if (VTAILQ_LAST(&sk->refs, skey_ref_s) != NULL &&
+		    VTAILQ_LAST(&sk->refs, skey_ref_s)->oc == oc)
+			continue;		/* Same key twice */
+		r->skey = sk;
+		r->oc = oc;
+		VTAILQ_INSERT_TAIL(&sk->refs, r, list);
+		sk->nref++;
+		r++;
+	}
+	VSC_Shard()->n_skey_ref += r - so->ref;
+	oc->skey = so;
+	Lck_Unlock(&skey_mtx);
+	free(s);
+}
+
+/*--------------------------------------------------------------------
+ * An object is destroyed, take it out of the index.
+ */
+
+void
+SKEY_DestroyObj(struct objcore *oc)
+{
+	struct skey_oc *so;
+	struct skey_ref *r;
+	struct skey *sk;
+	unsigned u;
+
+	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+	so = oc->skey;
+	if (so == NULL)
+		return;
+	CHECK_OBJ(so, SKEY_OC_MAGIC);
+	oc->skey = NULL;
+
+	Lck_Lock(&skey_mtx);
+	for (u = 0; u < so->n; u++) {
+		r = &so->ref[u];
+		sk = r->skey;
+		if (sk == NULL)
+			break;
+		CHECK_OBJ(sk, SKEY_MAGIC);
+		assert(r->oc == oc);
+		VTAILQ_REMOVE(&sk->refs, r, list);
+		VSC_Shard()->n_skey_ref--;
+		assert(sk->nref > 0);
+		if (--sk->nref > 0)
+			continue;
+		AN(VRB_REMOVE(skey_tree, &skeys, sk));
+		VSC_Shard()->n_skey--;
+		FREE_OBJ(sk);
+	}
+	Lck_Unlock(&skey_mtx);
+	FREE_OBJ(so);
+}
+
+/*--------------------------------------------------------------------
+ * Kill all objects carrying a key.
+ *
+ * Like the ban lurker we must not wait for the objhead lock while we
+ * hold the index lock, so contested objects are retried after giving
+ * way for a moment.  Busy objects are left alone, as in HSH_Purge().
+ */
+
+unsigned
+SKEY_Purge(struct worker *wrk, const char *key)
+{
+	struct skey *sk, k;
+	struct skey_ref *r;
+	struct objcore **ocp, *oc;
+	struct objhead *oh;
+	unsigned nobj, total = 0, u;
+	int contested;
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	AN(key);
+	INIT_OBJ(&k, SKEY_MAGIC);
+	k.key = key;
+
+	do {
+		contested = 0;
+		nobj = 0;
+		ocp = NULL;
+		Lck_Lock(&skey_mtx);
+		sk = VRB_FIND(skey_tree, &skeys, &k);
+		if (sk != NULL) {
+			ocp = malloc(sk->nref * sizeof *ocp);
+			AN(ocp);
+			VTAILQ_FOREACH(r, &sk->refs, list) {
+				oc = r->oc;
+				CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+				oh = oc->objhead;
+				CHECK_OBJ_NOTNULL(oh, OBJHEAD_MAGIC);
+				if (Lck_Trylock(&oh->mtx)) {
+					contested = 1;
+					continue;
+				}
+				if (oc->refcnt > 0 &&
+				    !(oc->flags & (OC_F_BUSY | OC_F_DYING))) {
+					oc->refcnt++;
+					assert(nobj < sk->nref);
+					ocp[nobj++] = oc;
+				}
+				Lck_Unlock(&oh->mtx);
+			}
+		}
+		Lck_Unlock(&skey_mtx);
+
+		for (u = 0; u < nobj; u++) {
+			HSH_Kill(ocp[u]);
+			(void)HSH_DerefObjCore(wrk, &ocp[u], 0);
+		}
+		free(ocp);
+		total += nobj;
+		if (contested)
+			VTIM_sleep(cache_param->ban_lurker_holdoff);
+	} while (contested);
+
+	Pool_PurgeStat(total);
+	return (total);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void __match_proto__(cli_func_t)
+ccf_purge_key(struct cli *cli, const char * const *av, void *priv)
+{
+	struct worker wrk[1];
+	unsigned n = 0;
+	int i;
+
+	(void)priv;
+	INIT_OBJ(wrk, WORKER_MAGIC);
+	for (i = 2; av[i] != NULL; i++)
+		n += SKEY_Purge(wrk, av[i]);
+	Pool_Sumstat(wrk);
+	VCLI_Out(cli, "Purged %u objects", n);
+}
+
+static struct cli_proto skey_cmds[] = {
+	{ CLICMD_PURGE_KEY,			"", ccf_purge_key },
+	{ NULL }
+};
+
+void
+SKEY_Init(void)
+{
+
+	Lck_New(&skey_mtx, lck_skey);
+	CLI_AddFuncs(skey_cmds);
+}
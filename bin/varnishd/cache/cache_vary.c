@@ -60,6 +60,7 @@
 
 #include "cache.h"
 
+#include "hash/hash_slinger.h"
 #include "vct.h"
 #include "vend.h"
 
@@ -383,3 +384,373 @@ VRY_Validate(const uint8_t *vary)
 	}
 	return (retval + 3);
 }
+
+/**********************************************************************
+ * Index of the variants on an objhead
+ *
+ * Objects which vary on a header like Accept-Language or a device
+ * class can pile up by the hundreds on a single objhead, and a lookup
+ * would have to try VRY_Match() against all of them.  Once an objhead
+ * has enough objects, we index its unbusied objects by a hash of their
+ * Vary matching string, and a lookup builds the matching string the
+ * request would have and only looks at the objects with the same hash.
+ *
+ * We keep one copy of the Vary string for each distinct set of headers
+ * varied on ("spec"), with no Vary being a spec of its own.  If the
+ * backend keeps changing its mind about Vary, we give up on the index.
+ *
+ * Accept-Encoding is left out of the hash, because vry_cmp() may treat
+ * any two values as the same, and it must be the same hash whether or
+ * not http_gzip_support is set.
+ *
+ * The index is protected by the objhead mutex.
+ */
+
+#define VRY_IDX_SPECS	4
+
+struct vry_ent {
+	uint32_t		hash;
+	unsigned		seq;
+	struct objcore		*oc;
+};
+
+struct vry_spec {
+	uint8_t			*vary;
+	unsigned		nref;
+};
+
+struct vry_idx {
+	unsigned		magic;
+#define VRY_IDX_MAGIC		0x6e1d5c73
+	unsigned		failed;
+	unsigned		seq;
+	unsigned		nspec;
+	struct vry_spec		spec[VRY_IDX_SPECS];
+	unsigned		nent;
+	unsigned		mask;
+	struct vry_ent		*ent;
+};
+
+static uint32_t
+vry_hash(const uint8_t *vary)
+{
+	uint32_t h = 0x811c9dc5;
+	unsigned u, l;
+
+	if (vary == NULL)
+		return (h);
+	while (vary[2]) {
+		if (strcasecmp(H_Accept_Encoding, (const char *)vary + 2))
+			l = VRY_Len(vary);
+		else
+			l = 2 + vary[2] + 2;
+		for (u = 0; u < l; u++) {
+			h ^= vary[u];
+			h *= 0x01000193;
+		}
+		vary += VRY_Len(vary);
+	}
+	return (h);
+}
+
+static int
+vry_samespec(const uint8_t *v1, const uint8_t *v2)
+{
+
+	if (v1 == NULL || v2 == NULL)
+		return (v1 == v2);
+	while (v1[2] && v2[2]) {
+		if (memcmp(v1 + 2, v2 + 2, v1[2] + 2))
+			return (0);
+		v1 += VRY_Len(v1);
+		v2 += VRY_Len(v2);
+	}
+	return (v1[2] == v2[2]);
+}
+
+static const uint8_t *
+vry_getvary(struct worker *wrk, struct objcore *oc)
+{
+
+	if (!ObjHasAttr(wrk, oc, OA_VARY))
+		return (NULL);
+	return (ObjGetAttr(wrk, oc, OA_VARY, NULL));
+}
+
+/*
+ * Build the Vary matching string the request would have for the
+ * headers in vary.  Returns non-zero if there is not enough space.
+ */
+
+static int
+vry_build(struct req *req, const uint8_t *vary)
+{
+	uint8_t *vsp = req->vary_b;
+	const char *h, *e;
+	unsigned lh, ln;
+
+	AN(vsp);
+	while (vary[2]) {
+		ln = 2 + vary[2] + 2;
+		if (http_GetHdr(req->http, (const char *)(vary + 2), &h)) {
+			e = strchr(h, '\0');
+			while (e > h && vct_issp(e[-1]))
+				e--;
+			lh = e - h;
+			assert(lh < 0xffff);
+		} else {
+			h = NULL;
+			lh = 0;
+		}
+		if (vsp + ln + lh + 3 >= req->vary_e) {
+			req->vary_l = NULL;
+			if (req->vary_b + 2 < req->vary_e)
+				req->vary_b[2] = 0;
+			return (-1);
+		}
+		vbe16enc(vsp, h == NULL ? 0xffff : (uint16_t)lh);
+		memcpy(vsp + 2, vary + 2, vary[2] + 2);
+		if (lh > 0)
+			memcpy(vsp + ln, h, lh);
+		vsp += ln + lh;
+		vary += VRY_Len(vary);
+	}
+	vsp[0] = 0xff;
+	vsp[1] = 0xff;
+	vsp[2] = 0;
+	(void)VRY_Validate(req->vary_b);
+	req->vary_l = vsp + 3;
+	return (0);
+}
+
+static void
+vry_idx_put(struct vry_idx *vi, uint32_t hash, unsigned seq,
+    struct objcore *oc)
+{
+	unsigned u;
+
+	for (u = hash & vi->mask; vi->ent[u].oc != NULL; u = (u + 1) & vi->mask)
+		continue;
+	vi->ent[u].hash = hash;
+	vi->ent[u].seq = seq;
+	vi->ent[u].oc = oc;
+	vi->nent++;
+}
+
+static void
+vry_idx_grow(struct vry_idx *vi)
+{
+	struct vry_ent *oent;
+	unsigned u, omask;
+
+	oent = vi->ent;
+	omask = vi->mask;
+	vi->mask = omask * 2 + 1;
+	vi->ent = calloc(vi->mask + 1L, sizeof *vi->ent);
+	AN(vi->ent);
+	vi->nent = 0;
+	for (u = 0; u <= omask; u++)
+		if (oent[u].oc != NULL)
+			vry_idx_put(vi, oent[u].hash, oent[u].seq, oent[u].oc);
+	free(oent);
+}
+
+static void
+vry_idx_fail(struct vry_idx *vi)
+{
+	unsigned u;
+
+	for (u = 0; u < vi->nspec; u++)
+		free(vi->spec[u].vary);
+	vi->nspec = 0;
+	free(vi->ent);
+	vi->ent = NULL;
+	vi->nent = 0;
+	vi->failed = 1;
+}
+
+static void
+vry_idx_insert(struct worker *wrk, struct vry_idx *vi, struct objcore *oc)
+{
+	const uint8_t *vary;
+	struct vry_spec *vs;
+	unsigned u, l;
+
+	CHECK_OBJ_NOTNULL(vi, VRY_IDX_MAGIC);
+	if (vi->failed)
+		return;
+	vary = vry_getvary(wrk, oc);
+	for (u = 0; u < vi->nspec; u++)
+		if (vry_samespec(vi->spec[u].vary, vary))
+			break;
+	if (u == VRY_IDX_SPECS) {
+		vry_idx_fail(vi);
+		return;
+	}
+	vs = &vi->spec[u];
+	if (u == vi->nspec) {
+		vi->nspec++;
+		vs->vary = NULL;
+		if (vary != NULL) {
+			l = VRY_Validate(vary);
+			vs->vary = malloc(l);
+			AN(vs->vary);
+			memcpy(vs->vary, vary, l);
+		}
+		vs->nref = 0;
+	}
+	vs->nref++;
+	if (vi->nent * 2 >= vi->mask)
+		vry_idx_grow(vi);
+	vry_idx_put(vi, vry_hash(vary), ++vi->seq, oc);
+}
+
+/*
+ * Index all the unbusied objects on an objhead.  The list has the most
+ * recently unbusied objects first, and we keep that order in seq.
+ */
+
+void
+VRY_IdxBuild(struct worker *wrk, struct objhead *oh)
+{
+	struct vry_idx *vi;
+	struct objcore *oc;
+
+	CHECK_OBJ_NOTNULL(oh, OBJHEAD_MAGIC);
+	Lck_AssertHeld(&oh->mtx);
+	AZ(oh->vary_idx);
+	ALLOC_OBJ(vi, VRY_IDX_MAGIC);
+	AN(vi);
+	vi->mask = 31;
+	vi->ent = calloc(vi->mask + 1L, sizeof *vi->ent);
+	AN(vi->ent);
+	VTAILQ_FOREACH_REVERSE(oc, &oh->objcs, objcore_head, hsh_list) {
+		if (vi->failed)
+			break;
+		if (!(oc->flags & OC_F_BUSY))
+			vry_idx_insert(wrk, vi, oc);
+	}
+	oh->vary_idx = vi;
+	wrk->stats->n_vary_idx++;
+}
+
+void
+VRY_IdxInsert(struct worker *wrk, struct objhead *oh, struct objcore *oc)
+{
+
+	CHECK_OBJ_NOTNULL(oh, OBJHEAD_MAGIC);
+	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+	Lck_AssertHeld(&oh->mtx);
+	AZ(oc->flags & OC_F_BUSY);
+	if (oh->vary_idx != NULL)
+		vry_idx_insert(wrk, oh->vary_idx, oc);
+}
+
+void
+VRY_IdxRemove(struct worker *wrk, struct objhead *oh, struct objcore *oc)
+{
+	struct vry_idx *vi;
+	const uint8_t *vary;
+	unsigned u, v, w;
+
+	CHECK_OBJ_NOTNULL(oh, OBJHEAD_MAGIC);
+	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+	Lck_AssertHeld(&oh->mtx);
+	vi = oh->vary_idx;
+	if (vi == NULL || vi->failed || (oc->flags & OC_F_BUSY))
+		return;
+	CHECK_OBJ(vi, VRY_IDX_MAGIC);
+	vary = vry_getvary(wrk, oc);
+
+	for (u = vry_hash(vary) & vi->mask; ; u = (u + 1) & vi->mask) {
+		AN(vi->ent[u].oc);
+		if (vi->ent[u].oc == oc)
+			break;
+	}
+	vi->nent--;
+
+	/* Shift the rest of the cluster back, so we need no tombstones */
+	for (v = (u + 1) & vi->mask; vi->ent[v].oc != NULL;
+	    v = (v + 1) & vi->mask) {
+		w = vi->ent[v].hash & vi->mask;
+		if (((v - w) & vi->mask) >= ((v - u) & vi->mask)) {
+			vi->ent[u] = vi->ent[v];
+			u = v;
+		}
+	}
+	memset(&vi->ent[u], 0, sizeof vi->ent[u]);
+
+	for (u = 0; u < vi->nspec; u++)
+		if (vry_samespec(vi->spec[u].vary, vary))
+			break;
+	assert(u < vi->nspec);
+	if (--vi->spec[u].nref > 0)
+		return;
+	free(vi->spec[u].vary);
+	vi->spec[u] = vi->spec[--vi->nspec];
+}
+
+void
+VRY_IdxFree(struct worker *wrk, struct objhead *oh)
+{
+	struct vry_idx *vi;
+
+	CHECK_OBJ_NOTNULL(oh, OBJHEAD_MAGIC);
+	vi = oh->vary_idx;
+	if (vi == NULL)
+		return;
+	oh->vary_idx = NULL;
+	CHECK_OBJ(vi, VRY_IDX_MAGIC);
+	vry_idx_fail(vi);
+	FREE_OBJ(vi);
+	wrk->stats->n_vary_idx--;
+}
+
+/*
+ * Find the objects which may match the request, most recently unbusied
+ * first.  Returns -1 if the caller must look at all the objects.
+ */
+
+int
+VRY_IdxLookup(struct req *req, struct objhead *oh, struct objcore **ocp)
+{
+	struct vry_idx *vi;
+	struct vry_ent *ve, *ent[VRY_IDX_MAX];
+	uint32_t hash;
+	unsigned u, v;
+	int i, n = 0;
+
+	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
+	CHECK_OBJ_NOTNULL(oh, OBJHEAD_MAGIC);
+	Lck_AssertHeld(&oh->mtx);
+	vi = oh->vary_idx;
+	if (vi == NULL)
+		return (-1);
+	CHECK_OBJ(vi, VRY_IDX_MAGIC);
+	if (vi->failed)
+		return (-1);
+
+	for (u = 0; u < vi->nspec; u++) {
+		if (vi->spec[u].vary == NULL)
+			hash = vry_hash(NULL);
+		else if (vry_build(req, vi->spec[u].vary))
+			return (-1);
+		else
+			hash = vry_hash(req->vary_b);
+		for (v = hash & vi->mask; vi->ent[v].oc != NULL;
+		    v = (v + 1) & vi->mask) {
+			ve = &vi->ent[v];
+			if (ve->hash != hash)
+				continue;
+			if (n == VRY_IDX_MAX)
+				return (-1);
+			/* Insertion sort on seq, newest first */
+			for (i = n++; i > 0 && ent[i - 1]->seq < ve->seq; i--)
+				ent[i] = ent[i - 1];
+			ent[i] = ve;
+		}
+	}
+	for (i = 0; i < n; i++)
+		ocp[i] = ent[i]->oc;
+	return (n);
+}
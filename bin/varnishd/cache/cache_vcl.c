@@ -774,8 +774,8 @@ vcl_load(struct cli *cli, struct vrt_ctx *ctx,
 	if (vcl_active == NULL)
 		vcl_active = vcl;
 	Lck_Unlock(&vcl_mtx);
-	VSC_C_main->n_vcl++;
-	VSC_C_main->n_vcl_avail++;
+	VSC_Shard()->n_vcl++;
+	VSC_Shard()->n_vcl_avail++;
 }
 
 /*--------------------------------------------------------------------*/
@@ -806,8 +806,8 @@ VCL_Poll(void)
 			vcl_KillBackends(vcl);
 			free(vcl->loaded_name);
 			VCL_Close(&vcl);
-			VSC_C_main->n_vcl--;
-			VSC_C_main->n_vcl_discard--;
+			VSC_Shard()->n_vcl--;
+			VSC_Shard()->n_vcl_discard--;
 		}
 	}
 	vcl_rel_ctx(&ctx);
@@ -898,8 +898,8 @@ vcl_cli_discard(struct cli *cli, const char * const *av, void *priv)
 	Lck_Lock(&vcl_mtx);
 	assert (vcl != vcl_active);	// MGT ensures this
 	AZ(vcl->nlabels);		// MGT ensures this
-	VSC_C_main->n_vcl_discard++;
-	VSC_C_main->n_vcl_avail--;
+	VSC_Shard()->n_vcl_discard++;
+	VSC_Shard()->n_vcl_avail--;
 	vcl->discard = 1;
 	if (vcl->label != NULL) {
 		AZ(strcmp(vcl->state, VCL_TEMP_LABEL));
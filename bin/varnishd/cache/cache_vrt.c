@@ -541,6 +541,28 @@ VRT_purge(VRT_CTX, double ttl, double grace, double keep)
 		    ttl, grace, keep);
 }
 
+long
+VRT_purge_key(VRT_CTX, const char *key)
+{
+	struct worker *wrk;
+
+	CHECK_OBJ_NOTNULL(ctx, VRT_CTX_MAGIC);
+	if (ctx->req != NULL) {
+		CHECK_OBJ_NOTNULL(ctx->req, REQ_MAGIC);
+		wrk = ctx->req->wrk;
+	} else if (ctx->bo != NULL) {
+		CHECK_OBJ_NOTNULL(ctx->bo, BUSYOBJ_MAGIC);
+		wrk = ctx->bo->wrk;
+	} else {
+		VRT_fail(ctx, "purge_key(): Only in client or backend methods");
+		return (0);
+	}
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	if (key == NULL || *key == '\0')
+		return (0);
+	return (SKEY_Purge(wrk, key));
+}
+
 /*--------------------------------------------------------------------
  * Simple stuff
  */
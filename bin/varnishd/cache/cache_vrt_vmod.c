@@ -189,7 +189,7 @@ VRT_Vmod_Init(VRT_CTX, struct vmod **hdl, void *ptr, int len, const char *nm,
 		REPLACE(v->nm, nm);
 		REPLACE(v->path, path);
 
-		VSC_C_main->vmods++;
+		VSC_Shard()->vmods++;
 		VTAILQ_INSERT_TAIL(&vmods, v, list);
 	}
 
@@ -225,7 +225,7 @@ VRT_Vmod_Fini(struct vmod **hdl)
 	AZ(unlink(v->backup));
 	free(v->backup);
 	VTAILQ_REMOVE(&vmods, v, list);
-	VSC_C_main->vmods--;
+	VSC_Shard()->vmods--;
 	FREE_OBJ(v);
 }
 
@@ -134,9 +134,14 @@ WRK_Thread(struct pool *qp, size_t stacksize, unsigned thread_workspace)
  */
 
 static void
-pool_addstat(struct dstat *dst, struct dstat *src)
+pool_addstat(struct pool *pp, struct dstat *src)
 {
+	struct dstat *dst;
 
+	Lck_AssertHeld(&pp->mtx);
+	pp->vsc->sess_conn += src->sess_conn;
+	pp->vsc->sess_fail += src->sess_fail;
+	dst = pp->a_stat;
 	dst->summs++;
 #define L0(n)
 #define L1(n) (dst->n += src->n)
@@ -330,7 +335,7 @@ Pool_Work_Thread(struct pool *pp, struct worker *wrk)
 
 		if ((tp == NULL && wrk->stats->summs > 0) ||
 		    (wrk->stats->summs >= cache_param->wthread_stats_rate))
-			pool_addstat(pp->a_stat, wrk->stats);
+			pool_addstat(pp, wrk->stats);
 
 		if (tp != NULL) {
 			wrk->stats->summs++;
@@ -426,15 +431,15 @@ pool_breed(struct pool *qp)
 		VSL(SLT_Debug, 0, "Create worker thread failed %d %s",
 		    errno, strerror(errno));
 		Lck_Lock(&pool_mtx);
-		VSC_C_main->threads_failed++;
+		VSC_Shard()->threads_failed++;
 		Lck_Unlock(&pool_mtx);
 		VTIM_sleep(cache_param->wthread_fail_delay);
 	} else {
 		qp->dry = 0;
 		qp->nthr++;
 		Lck_Lock(&pool_mtx);
-		VSC_C_main->threads++;
-		VSC_C_main->threads_created++;
+		VSC_Shard()->threads++;
+		VSC_Shard()->threads_created++;
 		Lck_Unlock(&pool_mtx);
 		VTIM_sleep(cache_param->wthread_add_delay);
 	}
@@ -493,8 +498,8 @@ pool_herder(void *priv)
 
 			Lck_Lock(&pp->mtx);
 			/* XXX: unsafe counters */
-			VSC_C_main->sess_queued += pp->nqueued;
-			VSC_C_main->sess_dropped += pp->ndropped;
+			VSC_Shard()->sess_queued += pp->nqueued;
+			VSC_Shard()->sess_dropped += pp->ndropped;
 			pp->nqueued = pp->ndropped = 0;
 
 			wrk = NULL;
@@ -522,8 +527,8 @@ pool_herder(void *priv)
 			if (wrk != NULL) {
 				pp->nthr--;
 				Lck_Lock(&pool_mtx);
-				VSC_C_main->threads--;
-				VSC_C_main->threads_destroyed++;
+				VSC_Shard()->threads--;
+				VSC_Shard()->threads_destroyed++;
 				Lck_Unlock(&pool_mtx);
 				delay = cache_param->wthread_destroy_delay;
 			} else if (delay < cache_param->wthread_destroy_delay)
@@ -544,7 +549,7 @@ pool_herder(void *priv)
 				VTIM_real() + delay);
 		} else {
 			/* XXX: unsafe counters */
-			VSC_C_main->threads_limited++;
+			VSC_Shard()->threads_limited++;
 			pp->dry = 0;
 		}
 		Lck_Unlock(&pp->mtx);
@@ -56,12 +56,18 @@ struct poolparam {
 	double			max_age;
 };
 
+/* A header name, in the "\<len>Name:" form http_GetHdr() takes */
+struct hdrparam {
+	char			hdr[66];
+};
+
 struct params {
 
 #define	ptyp_bool	unsigned
 #define	ptyp_bytes	ssize_t
 #define	ptyp_bytes_u	unsigned
 #define	ptyp_double	double
+#define	ptyp_hdrparam	struct hdrparam
 #define	ptyp_poolparam	struct poolparam
 #define	ptyp_timeout	double
 #define	ptyp_uint	unsigned
@@ -73,6 +79,7 @@ struct params {
 #undef ptyp_bytes
 #undef ptyp_bytes_u
 #undef ptyp_double
+#undef ptyp_hdrparam
 #undef ptyp_poolparam
 #undef ptyp_timeout
 #undef ptyp_uint
@@ -89,6 +96,7 @@ struct params {
 	unsigned		wthread_reserve;
 	double			wthread_timeout;
 	unsigned		wthread_pools;
+	unsigned		wthread_numa;
 	double			wthread_add_delay;
 	double			wthread_fail_delay;
 	double			wthread_destroy_delay;
@@ -77,6 +77,11 @@ const struct transport *XPORT_Find(const char *name);
 /* cache/cache_vcl.c */
 int VCL_TestLoad(const char *);
 
+/* common_numa.c */
+int NUMA_Bind(unsigned pool_no);
+void NUMA_Unbind(void);
+unsigned NUMA_Steer(unsigned *map, unsigned nmap, unsigned npool);
+
 /* common_vsm.c */
 struct vsm_sc;
 struct VSC_C_main;
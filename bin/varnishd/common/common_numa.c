@@ -0,0 +1,215 @@
+/*-
+ * Copyright (c) 2017 Varnish Software AS
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Placement of thread pools on NUMA nodes
+ *
+ * Pool n lives on node n modulo the number of nodes.  The child binds
+ * the threads of a pool to the CPUs of its node, and since the kernel
+ * allocates memory on the node of the CPU which first touches it, the
+ * workspaces, stacks and mempools of the pool end up there too.
+ *
+ * The manager uses the same placement to steer connections received
+ * on a CPU to a pool on that CPU's node.
+ *
+ * Without NUMA information all CPUs are on a single node.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/common.h"
+
+#if defined(__linux__) && defined(HAVE_PTHREAD_SETAFFINITY_NP)
+
+#include <pthread.h>
+#include <sched.h>
+
+#define NUMA_MAXNODE		64
+
+static cpu_set_t		numa_all;
+static int			numa_all_init;
+
+/*--------------------------------------------------------------------
+ * Parse a sysfs list like "0-3,8-11\n"
+ */
+
+static int
+numa_parse_list(const char *fn, cpu_set_t *cs)
+{
+	FILE *fi;
+	char buf[4096], *p, *q;
+	unsigned long a, b;
+
+	CPU_ZERO(cs);
+	fi = fopen(fn, "r");
+	if (fi == NULL)
+		return (-1);
+	p = fgets(buf, sizeof buf, fi);
+	(void)fclose(fi);
+	if (p == NULL)
+		return (-1);
+	while (*p != '\0' && *p != '\n') {
+		a = strtoul(p, &q, 10);
+		if (q == p)
+			return (-1);
+		b = a;
+		if (*q == '-') {
+			p = q + 1;
+			b = strtoul(p, &q, 10);
+			if (q == p || b < a)
+				return (-1);
+		}
+		for (; a <= b && a < CPU_SETSIZE; a++)
+			CPU_SET(a, cs);
+		p = q;
+		if (*p == ',')
+			p++;
+	}
+	return (0);
+}
+
+static unsigned
+numa_nodes(cpu_set_t *node)
+{
+	cpu_set_t online;
+	char fn[64];
+	unsigned u, n = 0;
+
+	if (!numa_all_init) {
+		AZ(sched_getaffinity(0, sizeof numa_all, &numa_all));
+		numa_all_init = 1;
+	}
+	if (!numa_parse_list("/sys/devices/system/node/online", &online)) {
+		for (u = 0; u < CPU_SETSIZE && n < NUMA_MAXNODE; u++) {
+			if (!CPU_ISSET(u, &online))
+				continue;
+			bprintf(fn, "/sys/devices/system/node/node%u/cpulist", u);
+			if (numa_parse_list(fn, &node[n]))
+				continue;
+			CPU_AND(&node[n], &node[n], &numa_all);
+			if (CPU_COUNT(&node[n]) > 0)
+				n++;
+		}
+	}
+	if (n == 0) {
+		node[0] = numa_all;
+		n = 1;
+	}
+	return (n);
+}
+
+/*--------------------------------------------------------------------
+ * Bind the calling thread to the CPUs of a pool's node, threads it
+ * creates inherit this.  Returns the node.
+ */
+
+int
+NUMA_Bind(unsigned pool_no)
+{
+	cpu_set_t node[NUMA_MAXNODE];
+	unsigned n;
+
+	n = numa_nodes(node);
+	n = pool_no % n;
+	if (pthread_setaffinity_np(pthread_self(), sizeof node[n], &node[n]))
+		return (-1);
+	return (n);
+}
+
+void
+NUMA_Unbind(void)
+{
+
+	if (numa_all_init)
+		(void)pthread_setaffinity_np(pthread_self(),
+		    sizeof numa_all, &numa_all);
+}
+
+/*--------------------------------------------------------------------
+ * Fill in the pool which should get connections received on each
+ * CPU.  The CPUs of a node are dealt out over the pools on it.
+ */
+
+unsigned
+NUMA_Steer(unsigned *map, unsigned nmap, unsigned npool)
+{
+	cpu_set_t node[NUMA_MAXNODE];
+	unsigned c, k, n, m, i[NUMA_MAXNODE];
+
+	AN(map);
+	assert(npool > 0);
+	n = numa_nodes(node);
+	memset(i, 0, sizeof i);
+	if (nmap > CPU_SETSIZE)
+		nmap = CPU_SETSIZE;
+	for (c = 0; c < nmap; c++) {
+		map[c] = c % npool;
+		for (k = 0; k < n; k++)
+			if (CPU_ISSET(c, &node[k]))
+				break;
+		if (k == n)
+			continue;
+		if (k >= npool) {
+			map[c] = k % npool;
+			continue;
+		}
+		/* Pools k, k + n, k + 2n ... live on node k */
+		m = (npool - k + n - 1) / n;
+		map[c] = k + n * (i[k]++ % m);
+	}
+	return (nmap);
+}
+
+#else
+
+int
+NUMA_Bind(unsigned pool_no)
+{
+
+	(void)pool_no;
+	return (-1);
+}
+
+void
+NUMA_Unbind(void)
+{
+}
+
+unsigned
+NUMA_Steer(unsigned *map, unsigned nmap, unsigned npool)
+{
+	unsigned c;
+
+	AN(map);
+	assert(npool > 0);
+	for (c = 0; c < nmap; c++)
+		map[c] = c % npool;
+	return (nmap);
+}
+
+#endif
@@ -48,6 +48,9 @@ struct listen_sock {
 	VTAILQ_ENTRY(listen_sock)	list;
 	VTAILQ_ENTRY(listen_sock)	arglist;
 	int				sock;
+	/* listen_reuseport: one per pool, psock[0] is sock */
+	int				*psock;
+	unsigned			npsock;
 	const struct listen_arg		*arg;
 	char				*name;
 	struct suckaddr			*addr;
@@ -0,0 +1,413 @@
+/*-
+ * Copyright (c) 2016 Varnish Software AS
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * An open addressing hash table with lock-free lookups
+ *
+ * The table uses linear probing over a power of two number of slots,
+ * indexed by the leading bytes of the (already uniformly distributed)
+ * digest.  Readers walk the table without taking any lock, and only
+ * lock the objhead they find.  Inserts, deletes and resizes are done
+ * under a single mutex, which is only taken on a miss.
+ *
+ * Deleted slots are marked with a tombstone, so that concurrent readers
+ * never see a probe sequence cut short.  When the table gets too full
+ * a new one is built under the mutex and published with a single
+ * pointer store.  Readers still walking the old table are safe, because
+ * retired tables and deleted objheads are kept on a cooloff list, just
+ * like the critbit hasher does, before they are freed.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "cache/cache.h"
+
+#include "hash/hash_slinger.h"
+#include "vmb.h"
+#include "vtim.h"
+
+static struct lock hlf_mtx;
+
+/*--------------------------------------------------------------------*/
+
+struct hlf_tbl {
+	unsigned			magic;
+#define HLF_TBL_MAGIC			0x2c47c5f3
+	unsigned			mask;
+	unsigned			nused;
+	unsigned			nfill;
+	volatile uintptr_t		*slot;
+	VSTAILQ_ENTRY(hlf_tbl)		list;
+};
+
+#define HLF_TOMB			((uintptr_t)1)
+
+static unsigned			hlf_nslot = 1U << 16;
+static struct hlf_tbl * volatile hlf_tbl;
+
+static VSTAILQ_HEAD(, hlf_tbl)	cool_t = VSTAILQ_HEAD_INITIALIZER(cool_t);
+static VSTAILQ_HEAD(, hlf_tbl)	dead_t = VSTAILQ_HEAD_INITIALIZER(dead_t);
+static VTAILQ_HEAD(, objhead)	cool_h = VTAILQ_HEAD_INITIALIZER(cool_h);
+static VTAILQ_HEAD(, objhead)	dead_h = VTAILQ_HEAD_INITIALIZER(dead_h);
+
+/*--------------------------------------------------------------------
+ * The ->init method allows the management process to pass arguments
+ */
+
+static void __match_proto__(hash_init_f)
+hlf_init(int ac, char * const *av)
+{
+	int i;
+	unsigned u;
+
+	if (ac == 0)
+		return;
+	if (ac > 1)
+		ARGV_ERR("(-hlockfree) too many arguments\n");
+	i = sscanf(av[0], "%u", &u);
+	if (i <= 0 || u == 0)
+		return;
+	if (u > (1U << 30))
+		ARGV_ERR("(-hlockfree) too many slots\n");
+	for (hlf_nslot = 16; hlf_nslot < u; hlf_nslot <<= 1)
+		continue;
+	fprintf(stderr, "Lockfree hash: %u initial slots\n", hlf_nslot);
+}
+
+/*--------------------------------------------------------------------*/
+
+static unsigned
+hlf_hash(const uint8_t *digest)
+{
+	unsigned u;
+
+	memcpy(&u, digest, sizeof u);
+	return (u);
+}
+
+static struct hlf_tbl *
+hlf_newtbl(unsigned nslot)
+{
+	struct hlf_tbl *t;
+
+	assert(nslot >= 16);
+	AZ(nslot & (nslot - 1));
+	ALLOC_OBJ(t, HLF_TBL_MAGIC);
+	XXXAN(t);
+	t->slot = calloc(nslot, sizeof *t->slot);
+	XXXAN(t->slot);
+	t->mask = nslot - 1;
+	return (t);
+}
+
+static void
+hlf_freetbl(struct hlf_tbl *t)
+{
+
+	CHECK_OBJ_NOTNULL(t, HLF_TBL_MAGIC);
+	free((void *)(uintptr_t)t->slot);
+	FREE_OBJ(t);
+}
+
+/*--------------------------------------------------------------------
+ * Find a digest in a table.  This is safe to call without the lock,
+ * but the objhead returned may be on its way out, so the caller must
+ * check the refcount under oh->mtx.
+ */
+
+static struct objhead *
+hlf_find(const struct hlf_tbl *t, const uint8_t *digest, uint64_t *probes)
+{
+	struct objhead *oh;
+	uintptr_t u;
+	unsigned i, n;
+
+	CHECK_OBJ_NOTNULL(t, HLF_TBL_MAGIC);
+	i = hlf_hash(digest) & t->mask;
+	for (n = 1; ; n++, i = (i + 1) & t->mask) {
+		u = t->slot[i];
+		if (u == 0)
+			break;
+		if (u == HLF_TOMB)
+			continue;
+		oh = (struct objhead *)u;
+		CHECK_OBJ_NOTNULL(oh, OBJHEAD_MAGIC);
+		if (!memcmp(oh->digest, digest, sizeof oh->digest)) {
+			*probes += n;
+			return (oh);
+		}
+	}
+	*probes += n;
+	return (NULL);
+}
+
+/*--------------------------------------------------------------------
+ * Place an objhead in the first free slot of its probe sequence.
+ * Must hold hlf_mtx or own the table exclusively.
+ */
+
+static void
+hlf_place(struct hlf_tbl *t, struct objhead *oh)
+{
+	uintptr_t u;
+	unsigned i;
+
+	CHECK_OBJ_NOTNULL(t, HLF_TBL_MAGIC);
+	i = hlf_hash(oh->digest) & t->mask;
+	while (1) {
+		u = t->slot[i];
+		if (u == 0 || u == HLF_TOMB)
+			break;
+		i = (i + 1) & t->mask;
+	}
+	if (u == 0)
+		t->nfill++;
+	t->nused++;
+	VWMB();
+	t->slot[i] = (uintptr_t)oh;
+}
+
+/*--------------------------------------------------------------------
+ * Build a new table, large enough for the live entries to stay below
+ * half full, and publish it.  The old one goes on the cooloff list.
+ * Must hold hlf_mtx.
+ */
+
+static void
+hlf_resize(void)
+{
+	struct hlf_tbl *ot, *nt;
+	struct objhead *oh;
+	unsigned u, nslot;
+	uintptr_t p;
+
+	Lck_AssertHeld(&hlf_mtx);
+	ot = hlf_tbl;
+	CHECK_OBJ_NOTNULL(ot, HLF_TBL_MAGIC);
+
+	nslot = ot->mask + 1;
+	while ((ot->nused + 1) * 2 > nslot)
+		nslot <<= 1;
+
+	nt = hlf_newtbl(nslot);
+	for (u = 0; u <= ot->mask; u++) {
+		p = ot->slot[u];
+		if (p == 0 || p == HLF_TOMB)
+			continue;
+		oh = (struct objhead *)p;
+		CHECK_OBJ_NOTNULL(oh, OBJHEAD_MAGIC);
+		hlf_place(nt, oh);
+	}
+	assert(nt->nused == ot->nused);
+
+	VWMB();
+	hlf_tbl = nt;
+	VSTAILQ_INSERT_TAIL(&cool_t, ot, list);
+	VSC_Shard()->hlf_resize++;
+	VSC_C_main->hlf_slots = nslot;
+}
+
+/*--------------------------------------------------------------------
+ * Lookup and optionally insert, must hold hlf_mtx.
+ */
+
+static struct objhead *
+hlf_insert(const uint8_t *digest, struct objhead **noh, uint64_t *probes)
+{
+	struct hlf_tbl *t;
+	struct objhead *oh;
+
+	Lck_AssertHeld(&hlf_mtx);
+	t = hlf_tbl;
+	oh = hlf_find(t, digest, probes);
+	if (oh != NULL || noh == NULL)
+		return (oh);
+
+	if ((t->nfill + 1) * 4 > (t->mask + 1) * 3) {
+		hlf_resize();
+		t = hlf_tbl;
+	}
+
+	oh = *noh;
+	*noh = NULL;
+	memcpy(oh->digest, digest, sizeof oh->digest);
+	hlf_place(t, oh);
+	return (oh);
+}
+
+/*--------------------------------------------------------------------
+ * Remove an objhead from the current table, must hold hlf_mtx.
+ *
+ * If the following slot is empty, no probe sequence can go through
+ * this slot, and it can be emptied rather than tombstoned.
+ */
+
+static void
+hlf_delete(struct objhead *oh)
+{
+	struct hlf_tbl *t;
+	unsigned i;
+
+	Lck_AssertHeld(&hlf_mtx);
+	t = hlf_tbl;
+	CHECK_OBJ_NOTNULL(t, HLF_TBL_MAGIC);
+	i = hlf_hash(oh->digest) & t->mask;
+	while (t->slot[i] != (uintptr_t)oh) {
+		AN(t->slot[i]);
+		i = (i + 1) & t->mask;
+	}
+	assert(t->nused > 0);
+	t->nused--;
+	if (t->slot[(i + 1) & t->mask] == 0) {
+		t->slot[i] = 0;
+		t->nfill--;
+	} else
+		t->slot[i] = HLF_TOMB;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void * __match_proto__(bgthread_t)
+hlf_cleaner(struct worker *wrk, void *priv)
+{
+	struct hlf_tbl *t, *t2;
+	struct objhead *oh, *oh2;
+
+	(void)priv;
+	while (1) {
+		VSTAILQ_FOREACH_SAFE(t, &dead_t, list, t2) {
+			VSTAILQ_REMOVE_HEAD(&dead_t, list);
+			hlf_freetbl(t);
+		}
+		VTAILQ_FOREACH_SAFE(oh, &dead_h, hoh_list, oh2) {
+			VTAILQ_REMOVE(&dead_h, oh, hoh_list);
+			HSH_DeleteObjHead(wrk, oh);
+		}
+		Lck_Lock(&hlf_mtx);
+		VSTAILQ_CONCAT(&dead_t, &cool_t);
+		VTAILQ_CONCAT(&dead_h, &cool_h, hoh_list);
+		Lck_Unlock(&hlf_mtx);
+		Pool_Sumstat(wrk);
+		VTIM_sleep(cache_param->critbit_cooloff);
+	}
+	NEEDLESS(return NULL);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void __match_proto__(hash_start_f)
+hlf_start(void)
+{
+	pthread_t tp;
+
+	Lck_New(&hlf_mtx, lck_hlf);
+	hlf_tbl = hlf_newtbl(hlf_nslot);
+	VSC_C_main->hlf_slots = hlf_nslot;
+	WRK_BgThread(&tp, "hlf-cleaner", hlf_cleaner, NULL);
+}
+
+static int __match_proto__(hash_deref_f)
+hlf_deref(struct objhead *oh)
+{
+
+	CHECK_OBJ_NOTNULL(oh, OBJHEAD_MAGIC);
+	Lck_Lock(&oh->mtx);
+	assert(oh->refcnt > 0);
+	oh->refcnt--;
+	if (oh->refcnt == 0) {
+		Lck_Lock(&hlf_mtx);
+		hlf_delete(oh);
+		VTAILQ_INSERT_TAIL(&cool_h, oh, hoh_list);
+		Lck_Unlock(&hlf_mtx);
+	}
+	Lck_Unlock(&oh->mtx);
+	return (1);
+}
+
+static struct objhead * __match_proto__(hash_lookup_f)
+hlf_lookup(struct worker *wrk, const void *digest, struct objhead **noh)
+{
+	struct objhead *oh;
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	AN(digest);
+	if (noh != NULL) {
+		CHECK_OBJ_NOTNULL(*noh, OBJHEAD_MAGIC);
+		assert((*noh)->refcnt == 1);
+	}
+
+	/* First try in read-only mode without holding a lock */
+
+	wrk->stats->hlf_nolock++;
+	oh = hlf_find(hlf_tbl, digest, &wrk->stats->hlf_probes);
+	if (oh != NULL) {
+		Lck_Lock(&oh->mtx);
+		/*
+		 * A refcount of zero indicates that the objhead is being
+		 * deleted, so fall through and try with the lock held.
+		 */
+		if (oh->refcnt > 0) {
+			oh->refcnt++;
+			return (oh);
+		}
+		Lck_Unlock(&oh->mtx);
+	}
+
+	while (1) {
+		/* No luck, try with lock held, so we can modify the table */
+		Lck_Lock(&hlf_mtx);
+		VSC_Shard()->hlf_lock++;
+		oh = hlf_insert(digest, noh, &wrk->stats->hlf_probes);
+		Lck_Unlock(&hlf_mtx);
+
+		if (oh == NULL)
+			return (NULL);
+
+		Lck_Lock(&oh->mtx);
+
+		CHECK_OBJ_NOTNULL(oh, OBJHEAD_MAGIC);
+		if (noh != NULL && *noh == NULL) {
+			assert(oh->refcnt > 0);
+			VSC_Shard()->hlf_insert++;
+			return (oh);
+		}
+		if (oh->refcnt > 0) {
+			oh->refcnt++;
+			return (oh);
+		}
+		Lck_Unlock(&oh->mtx);
+	}
+}
+
+const struct hash_slinger hlf_slinger = {
+	.magic  =	SLINGER_MAGIC,
+	.name   =	"lockfree",
+	.init	=	hlf_init,
+	.start  =	hlf_start,
+	.lookup =	hlf_lookup,
+	.deref  =	hlf_deref,
+};
@@ -87,9 +87,10 @@ struct objhead {
 
 	int			refcnt;
 	struct lock		mtx;
-	VTAILQ_HEAD(,objcore)	objcs;
+	VTAILQ_HEAD(objcore_head, objcore)	objcs;
 	uint8_t			digest[DIGEST_LEN];
 	VTAILQ_HEAD(, req)	waitinglist;
+	struct vry_idx		*vary_idx;
 
 	/*----------------------------------------------------
 	 * The fields below are for the sole private use of
@@ -112,8 +113,18 @@ int HSH_DerefObjHead(struct worker *, struct objhead **);
 int HSH_DerefObjCore(struct worker *, struct objcore **, int);
 #define HSH_RUSH_POLICY -1
 #define HSH_RUSH_ALL	INT_MAX
+
+/* cache_vary.c */
+#define VRY_IDX_MIN	16	/* Objects before we index an objhead */
+#define VRY_IDX_MAX	16	/* Candidates from a lookup */
+void VRY_IdxBuild(struct worker *, struct objhead *);
+void VRY_IdxInsert(struct worker *, struct objhead *, struct objcore *);
+void VRY_IdxRemove(struct worker *, struct objhead *, struct objcore *);
+void VRY_IdxFree(struct worker *, struct objhead *);
+int VRY_IdxLookup(struct req *, struct objhead *, struct objcore **);
 #endif /* VARNISH_CACHE_CHILD */
 
 extern const struct hash_slinger hsl_slinger;
 extern const struct hash_slinger hcl_slinger;
 extern const struct hash_slinger hcb_slinger;
+extern const struct hash_slinger hlf_slinger;
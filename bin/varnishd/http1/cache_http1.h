@@ -47,6 +47,7 @@ struct v1p_acct {
 	uint64_t        bereq;
 	uint64_t        in;
 	uint64_t        out;
+	uint64_t        splice;
 };
 
 void V1P_Process(struct req *, int fd, struct v1p_acct *);
@@ -60,3 +61,6 @@ void V1L_Reserve(struct worker *, struct ws *, int *fd, struct vsl_log *,
 unsigned V1L_Flush(const struct worker *w);
 unsigned V1L_FlushRelease(struct worker *w);
 size_t V1L_Write(const struct worker *w, const void *ptr, ssize_t len);
+#ifdef HAVE_SENDFILE
+unsigned V1L_SendFile(const struct worker *w, int fd, off_t off, ssize_t len);
+#endif
@@ -58,6 +58,21 @@ v1d_bytes(struct req *req, enum vdp_action act, void **priv,
 	return (0);
 }
 
+#ifdef HAVE_SENDFILE
+static int __match_proto__(objiteratefd_f)
+v1d_sendfile(void *priv, int fd, off_t off, ssize_t len)
+{
+	struct req *req;
+
+	CAST_OBJ_NOTNULL(req, priv, REQ_MAGIC);
+	req->acct.resp_bodybytes += len;
+	req->wrk->stats->s_sendfile_bytes += len;
+	if (V1L_SendFile(req->wrk, fd, off, len))
+		return (-1);
+	return (0);
+}
+#endif
+
 static void
 v1d_error(struct req *req, const char *msg)
 {
@@ -130,7 +145,13 @@ V1D_Deliver(struct req *req, struct boc *boc, int sendbody)
 	if (sendbody && req->resp_len != 0) {
 		if (req->res_mode & RES_CHUNKED)
 			V1L_Chunked(req->wrk);
-		err = VDP_DeliverObj(req);
+#ifdef HAVE_SENDFILE
+		if ((req->res_mode & RES_LEN) &&
+		    req->resp_len >= cache_param->sendfile_threshold)
+			err = VDP_DeliverObjFd(req, v1d_sendfile);
+		else
+#endif
+			err = VDP_DeliverObj(req);
 		if (!err && (req->res_mode & RES_CHUNKED))
 			V1L_EndChunk(req->wrk);
 	}
@@ -153,7 +153,7 @@ V1F_FetchRespHdr(struct busyobj *bo)
 	htc = bo->htc;
 	assert(*htc->rfd > 0);
 
-	VSC_C_main->backend_req++;
+	VSC_Shard()->backend_req++;
 
 	/* Receive response */
 
@@ -193,6 +193,8 @@ http1_reembark(struct worker *wrk, struct req *req)
 	/* Couldn't schedule, ditch */
 	wrk->stats->busy_wakeup--;
 	wrk->stats->busy_killed++;
+	if (req->hash_oc != NULL)
+		(void)HSH_DerefObjCore(wrk, &req->hash_oc, 0);
 	AN (req->vcl);
 	VCL_Rel(&req->vcl);
 	CNT_AcctLogCharge(wrk->stats, req);
@@ -448,6 +450,9 @@ HTTP1_Session(struct worker *wrk, struct req *req)
 			 */
 			if (VTCP_check_hup(sp->fd)) {
 				AN(req->hash_objhead);
+				if (req->hash_oc != NULL)
+					(void)HSH_DerefObjCore(wrk,
+					    &req->hash_oc, 0);
 				(void)HSH_DerefObjHead(wrk,
 				    &req->hash_objhead);
 				AZ(req->hash_objhead);
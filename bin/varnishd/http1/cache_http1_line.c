@@ -40,6 +40,10 @@
 #include <errno.h>
 #include <stdio.h>
 
+#ifdef HAVE_SYS_SENDFILE_H
+#  include <sys/sendfile.h>
+#endif
+
 #include "cache_http1.h"
 #include "vtim.h"
 
@@ -297,3 +301,69 @@ V1L_EndChunk(const struct worker *wrk)
 	v1l->cliov = 0;
 	(void)V1L_Write(wrk, "0\r\n\r\n", -1);
 }
+
+#ifdef HAVE_SENDFILE
+/*--------------------------------------------------------------------
+ * Send a range of a file after whatever we have queued so far.
+ */
+
+unsigned
+V1L_SendFile(const struct worker *wrk, int fd, off_t off, ssize_t len)
+{
+	struct v1l *v1l;
+	ssize_t i;
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	v1l = wrk->v1l;
+	CHECK_OBJ_NOTNULL(v1l, V1L_MAGIC);
+	AN(v1l->wfd);
+	assert(v1l->ciov == v1l->siov);		/* Not chunked */
+	assert(len > 0);
+
+	if (V1L_Flush(wrk) || *v1l->wfd < 0)
+		return (v1l->werr);
+
+	while (len > 0) {
+#if defined(__FreeBSD__)
+		off_t sent = 0;
+
+		i = sendfile(fd, *v1l->wfd, off, len, NULL, &sent, 0);
+		if (sent > 0)
+			i = sent;
+#elif defined(__linux__)
+		off_t o = off;
+
+		i = sendfile(*v1l->wfd, fd, &o, len);
+#endif
+		if (i > 0) {
+			v1l->cnt += i;
+			off += i;
+			len -= i;
+			continue;
+		}
+		if (i == 0) {
+			/* The file ended before the range did */
+			v1l->werr++;
+			VSLb(v1l->vsl, SLT_Debug,
+			    "Sendfile short file, left = %zd", len);
+			break;
+		}
+		assert(i == -1);
+		if (errno == EINTR)
+			continue;
+		if (errno == EAGAIN &&
+		    VTIM_real() - v1l->t0 <= cache_param->send_timeout) {
+			VSLb(v1l->vsl, SLT_Debug,
+			    "Hit idle send timeout, sendfile left = %zd; "
+			    "retrying", len);
+			continue;
+		}
+		v1l->werr++;
+		VSLb(v1l->vsl, SLT_Debug,
+		    "Sendfile error, retval = %zd, left = %zd, errno = %s",
+		    i, len, strerror(errno));
+		break;
+	}
+	return (v1l->werr);
+}
+#endif
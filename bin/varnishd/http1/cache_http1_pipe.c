@@ -33,35 +33,162 @@
 
 #include "cache/cache.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <poll.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "vrt.h"
+#include "vtcp.h"
 
 #include "cache_http1.h"
 
 static struct lock pipestat_mtx;
 
+/*--------------------------------------------------------------------
+ * One direction of a pipe relay.
+ *
+ * Both sockets are non-blocking while we relay, and we only ever have
+ * one batch of bytes in flight per direction: While bytes are pending
+ * we poll the destination for POLLOUT instead of polling the source
+ * for POLLIN, so a slow reader pushes back on the writer without us
+ * going to sleep on it.
+ *
+ * Where splice(2) is available the bytes go through a kernel pipe and
+ * never enter userland, otherwise (or if the kernel refuses to splice
+ * the sockets in question) we fall back to a malloc'ed buffer.
+ */
+
+#define V1P_SPLICE_LEN		(64 * 1024)
+
+struct v1p_dir {
+	int			src;
+	int			dst;
+	uint64_t		*cnt;
+	uint64_t		*splcnt;
+	ssize_t			pending;
+	int			done;
+	int			pfd[2];
+	char			*buf;
+	ssize_t			off;
+};
+
+static void
+v1p_dir_init(struct v1p_dir *d, int src, int dst, uint64_t *cnt,
+    uint64_t *splcnt)
+{
+
+	memset(d, 0, sizeof *d);
+	d->src = src;
+	d->dst = dst;
+	d->cnt = cnt;
+	d->splcnt = splcnt;
+	d->pfd[0] = -1;
+	d->pfd[1] = -1;
+#ifdef HAVE_SPLICE
+	if (pipe2(d->pfd, O_NONBLOCK | O_CLOEXEC)) {
+		d->pfd[0] = -1;
+		d->pfd[1] = -1;
+	}
+#endif
+	if (d->pfd[0] < 0) {
+		d->buf = malloc(BUFSIZ);
+		AN(d->buf);
+	}
+}
+
+static void
+v1p_dir_fini(struct v1p_dir *d)
+{
+
+	if (d->pfd[0] >= 0) {
+		closefd(&d->pfd[0]);
+		closefd(&d->pfd[1]);
+	}
+	free(d->buf);
+	d->buf = NULL;
+}
+
+static int
+v1p_again(void)
+{
+
+	return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+}
+
+/*--------------------------------------------------------------------
+ * Pick up bytes from the source.
+ * Returns -1 on EOF/error, 0 if there was nothing to read, 1 otherwise.
+ */
+
 static int
-rdf(int fd0, int fd1, uint64_t *pcnt)
+v1p_fill(struct v1p_dir *d)
 {
-	int i, j;
-	char buf[BUFSIZ], *p;
+	ssize_t i;
 
-	i = read(fd0, buf, sizeof buf);
+	assert(d->pending == 0);
+#ifdef HAVE_SPLICE
+	if (d->pfd[0] >= 0) {
+		i = splice(d->src, NULL, d->pfd[1], NULL, V1P_SPLICE_LEN,
+		    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (i < 0 && (errno == EINVAL || errno == ENOSYS)) {
+			/* The kernel cannot splice this, do it by hand */
+			v1p_dir_fini(d);
+			d->buf = malloc(BUFSIZ);
+			AN(d->buf);
+		}
+	}
+	if (d->pfd[0] < 0)
+#endif
+	{
+		AN(d->buf);
+		i = read(d->src, d->buf, BUFSIZ);
+		d->off = 0;
+	}
+	if (i < 0 && v1p_again())
+		return (0);
 	if (i <= 0)
-		return (1);
-	for (p = buf; i > 0; i -= j, p += j) {
-		j = write(fd1, p, i);
-		if (j <= 0)
-			return (1);
-		*pcnt += j;
-		if (i != j)
-			(void)usleep(100000);		/* XXX hack */
+		return (-1);
+	d->pending = i;
+	return (1);
+}
+
+/*--------------------------------------------------------------------
+ * Push pending bytes to the destination as far as it will take them.
+ * Returns -1 on error, 0 otherwise.
+ */
+
+static int
+v1p_drain(struct v1p_dir *d)
+{
+	ssize_t i;
+
+	while (d->pending > 0) {
+#ifdef HAVE_SPLICE
+		if (d->pfd[0] >= 0)
+			i = splice(d->pfd[0], NULL, d->dst, NULL,
+			    d->pending, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		else
+#endif
+			i = write(d->dst, d->buf + d->off, d->pending);
+		if (i < 0 && v1p_again())
+			return (0);
+		if (i <= 0)
+			return (-1);
+		assert(i <= d->pending);
+		d->pending -= i;
+		*d->cnt += i;
+		if (d->pfd[0] >= 0)
+			*d->splcnt += i;
+		else
+			d->off += i;
 	}
 	return (0);
 }
 
+/*--------------------------------------------------------------------*/
+
 void
 V1P_Charge(struct req *req, const struct v1p_acct *a, struct VSC_C_vbe *b)
 {
@@ -74,9 +201,10 @@ V1P_Charge(struct req *req, const struct v1p_acct *a, struct VSC_C_vbe *b)
 	    (uintmax_t)a->out);
 
 	Lck_Lock(&pipestat_mtx);
-	VSC_C_main->s_pipe_hdrbytes += a->req;
-	VSC_C_main->s_pipe_in += a->in;
-	VSC_C_main->s_pipe_out += a->out;
+	VSC_Shard()->s_pipe_hdrbytes += a->req;
+	VSC_Shard()->s_pipe_in += a->in;
+	VSC_Shard()->s_pipe_out += a->out;
+	VSC_Shard()->s_pipe_splice += a->splice;
 	b->pipe_hdrbytes += a->bereq;
 	b->pipe_out += a->in;
 	b->pipe_in += a->out;
@@ -87,7 +215,8 @@ void
 V1P_Process(struct req *req, int fd, struct v1p_acct *v1a)
 {
 	struct pollfd fds[2];
-	int i, j;
+	struct v1p_dir dir[2], *d;
+	int i, j, n;
 
 	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
 	CHECK_OBJ_NOTNULL(req->sp, SESS_MAGIC);
@@ -102,38 +231,60 @@ V1P_Process(struct req *req, int fd, struct v1p_acct *v1a)
 		req->htc->pipeline_e = NULL;
 		v1a->in += j;
 	}
+
+	v1p_dir_init(&dir[0], fd, req->sp->fd, &v1a->out, &v1a->splice);
+	v1p_dir_init(&dir[1], req->sp->fd, fd, &v1a->in, &v1a->splice);
+	(void)VTCP_nonblocking(fd);
+	(void)VTCP_nonblocking(req->sp->fd);
+
+	Lck_Lock(&pipestat_mtx);
+	VSC_Shard()->n_pipe++;
+	Lck_Unlock(&pipestat_mtx);
+
 	memset(fds, 0, sizeof fds);
-	fds[0].fd = fd;
-	fds[0].events = POLLIN | POLLERR;
-	fds[1].fd = req->sp->fd;
-	fds[1].events = POLLIN | POLLERR;
-
-	while (fds[0].fd > -1 || fds[1].fd > -1) {
-		fds[0].revents = 0;
-		fds[1].revents = 0;
+	while (!dir[0].done || !dir[1].done) {
+		for (n = 0; n < 2; n++) {
+			d = &dir[n];
+			fds[n].revents = 0;
+			if (d->done) {
+				fds[n].fd = -1;
+				fds[n].events = 0;
+			} else if (d->pending > 0) {
+				fds[n].fd = d->dst;
+				fds[n].events = POLLOUT;
+			} else {
+				fds[n].fd = d->src;
+				fds[n].events = POLLIN;
+			}
+		}
 		i = poll(fds, 2,
 		    (int)(cache_param->pipe_timeout * 1e3));
 		if (i < 1)
 			break;
-		if (fds[0].revents &&
-		    rdf(fd, req->sp->fd, &v1a->out)) {
-			if (fds[1].fd == -1)
-				break;
-			(void)shutdown(fd, SHUT_RD);
-			(void)shutdown(req->sp->fd, SHUT_WR);
-			fds[0].events = 0;
-			fds[0].fd = -1;
-		}
-		if (fds[1].revents &&
-		    rdf(req->sp->fd, fd, &v1a->in)) {
-			if (fds[0].fd == -1)
-				break;
-			(void)shutdown(req->sp->fd, SHUT_RD);
-			(void)shutdown(fd, SHUT_WR);
-			fds[1].events = 0;
-			fds[1].fd = -1;
+		for (n = 0; n < 2; n++) {
+			d = &dir[n];
+			if (d->done || fds[n].revents == 0)
+				continue;
+			i = 0;
+			if (d->pending == 0)
+				i = v1p_fill(d);
+			if (i >= 0 && d->pending > 0)
+				i = v1p_drain(d);
+			if (i >= 0)
+				continue;
+			(void)shutdown(d->src, SHUT_RD);
+			(void)shutdown(d->dst, SHUT_WR);
+			d->done = 1;
 		}
 	}
+
+	Lck_Lock(&pipestat_mtx);
+	VSC_Shard()->n_pipe--;
+	Lck_Unlock(&pipestat_mtx);
+
+	(void)VTCP_blocking(req->sp->fd);
+	v1p_dir_fini(&dir[0]);
+	v1p_dir_fini(&dir[1]);
 }
 
 /*--------------------------------------------------------------------*/
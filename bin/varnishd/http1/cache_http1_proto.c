@@ -117,6 +117,7 @@ http1_dissect_hdrs(struct http *hp, char *p, struct http_conn *htc,
 	assert(p > htc->rxbuf_b);
 	assert(p <= htc->rxbuf_e);
 	hp->nhd = HTTP_HDR_FIRST;
+	http_IndexHdrs(hp);
 	hp->conds = 0;
 	r = NULL;		/* For FlexeLint */
 	for (; p < htc->rxbuf_e; p = r) {
@@ -210,6 +211,7 @@ http1_dissect_hdrs(struct http *hp, char *p, struct http_conn *htc,
 		p += vct_skipcrlf(p);
 	HTC_RxPipeline(htc, p);
 	htc->rxbuf_e = p;
+	http_IndexHdrs(hp);
 	return (0);
 }
 
@@ -83,10 +83,23 @@ struct h2_req {
 	struct req			*req;
 	VTAILQ_ENTRY(h2_req)		list;
 	int64_t				window;
+	unsigned			weight;
+
+	/* Flow controlled receive side, for DATA frames */
+	int64_t				rx_window;
+	int64_t				rx_unacked;
+	uint8_t				*rxbuf;
+	size_t				rxbuf_b;
+	size_t				rxbuf_e;
+
+	h2_error			error;
 };
 
 VTAILQ_HEAD(h2_req_s, h2_req);
 
+struct h2_txframe;
+VTAILQ_HEAD(h2_txframe_s, h2_txframe);
+
 struct h2_sess {
 	unsigned			magic;
 #define H2_SESS_MAGIC			0xa16f7e4b
@@ -97,6 +110,16 @@ struct h2_sess {
 	int				bogosity;
 
 	struct h2_req_s			streams;
+	struct h2_req			*req0;
+	pthread_cond_t			cond;
+
+	/* Transmit queue, see cache_http2_send.c */
+	struct h2_txframe_s		txq;
+	pthread_cond_t			txcond;
+	uint64_t			tx_seq;
+	uint64_t			tx_done;
+	int				tx_busy;
+	int				tx_err;
 
 	struct req			*srq;
 	struct ws			*ws;
@@ -104,6 +127,10 @@ struct h2_sess {
 	struct vsl_log			*vsl;
 	struct vht_table		dectbl[1];
 
+	struct ws			rxws[1];
+	char				*rxspace;
+
+	unsigned			rxf_type;
 	unsigned			rxf_len;
 	unsigned			rxf_flags;
 	unsigned			rxf_stream;
@@ -113,6 +140,7 @@ struct h2_sess {
 	uint32_t			our_settings[H2_SETTINGS_N];
 
 	struct req			*new_req;
+	struct h2h_decode		*decode;
 	int				go_away;
 	uint32_t			go_away_last_stream;
 };
@@ -147,9 +175,10 @@ h2_error h2h_decode_fini(const struct h2_sess *h2, struct h2h_decode *d);
 h2_error h2h_decode_bytes(struct h2_sess *h2, struct h2h_decode *d,
     const uint8_t *ptr, size_t len);
 
-int H2_Send_Frame(struct worker *, const struct h2_sess *,
+int H2_Send_Frame(struct worker *, struct h2_sess *,
     enum h2_frame_e type, uint8_t flags, uint32_t len, uint32_t stream,
     const void *);
+int H2_Flush(struct worker *, struct h2_sess *);
 
 int H2_Send(struct worker *, struct h2_req *, int flush,
     enum h2_frame_e type, uint8_t flags, uint32_t len, const void *);
@@ -42,6 +42,7 @@
 #include "http2/cache_http2.h"
 
 #include "vct.h"
+#include "vend.h"
 
 /**********************************************************************/
 
@@ -85,11 +86,10 @@ h2_bytes(struct req *req, enum vdp_action act, void **priv,
 		return (0);
 	AZ(req->vdp_nxt);	       /* always at the bottom of the pile */
 
-	H2_Send(req->wrk, r2,
+	/* Fails if the stream was reset, which aborts the VDP chain */
+	return (H2_Send(req->wrk, r2,
 	    act == VDP_FLUSH ? 1 : 0,
-	    H2_FRAME_DATA, H2FF_NONE, len, ptr);
-
-	return (0);
+	    H2_FRAME_DATA, H2FF_NONE, len, ptr));
 }
 
 void __match_proto__(vtr_deliver_f)
@@ -102,8 +102,9 @@ h2_deliver(struct req *req, struct boc *boc, int sendbody)
 	struct http *hp;
 	struct sess *sp;
 	struct h2_req *r2;
-	int i, err;
+	int i, err = 0;
 	const struct hpack_static *hps;
+	char b[4];
 
 	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
 	CHECK_OBJ_ORNULL(boc, BOC_MAGIC);
@@ -211,9 +212,16 @@ h2_deliver(struct req *req, struct boc *boc, int sendbody)
 
 	if (sendbody && req->resp_len != 0)
 		err = VDP_DeliverObj(req);
-	/*XXX*/(void)err;
 
-	H2_Send(req->wrk, r2, 1, H2_FRAME_DATA, H2FF_DATA_END_STREAM, 0, NULL);
+	if (err == 0) {
+		(void)H2_Send(req->wrk, r2, 1,
+		    H2_FRAME_DATA, H2FF_DATA_END_STREAM, 0, NULL);
+	} else {
+		/* Not sent if the client reset the stream already */
+		vbe32enc(b, H2SE_INTERNAL_ERROR->val);
+		(void)H2_Send(req->wrk, r2, 1,
+		    H2_FRAME_RST_STREAM, 0, sizeof b, b);
+	}
 
 	AZ(req->wrk->v1l);
 	VDP_close(req);
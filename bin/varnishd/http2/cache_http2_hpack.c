@@ -198,6 +198,8 @@ h2h_decode_fini(const struct h2_sess *h2, struct h2h_decode *d)
 		ret = H2CE_COMPRESSION_ERROR;
 	} else
 		ret = d->error;
+	if (ret == NULL)
+		http_IndexHdrs(h2->new_req->http);
 	d->magic = 0;
 	return (ret);
 }
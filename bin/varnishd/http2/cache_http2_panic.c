@@ -45,6 +45,9 @@ h2_sess_panic(struct vsb *vsb, const struct sess *sp)
 
 	h2 = (void*)*up;
 	CHECK_OBJ_NOTNULL(h2, H2_SESS_MAGIC);
+	VSB_printf(vsb, "tx_seq %ju tx_done %ju tx_busy %d tx_err %d\n",
+	    (uintmax_t)h2->tx_seq, (uintmax_t)h2->tx_done,
+	    h2->tx_busy, h2->tx_err);
 	VSB_printf(vsb, "streams {\n");
 	VSB_indent(vsb, 2);
 	VTAILQ_FOREACH(r2, &h2->streams, list) {
@@ -56,6 +59,10 @@ h2_sess_panic(struct vsb *vsb, const struct sess *sp)
 			VSB_printf(vsb, " State %d", r2->state);
 			break;
 		}
+		VSB_printf(vsb, " window %jd rx_window %jd",
+		    (intmax_t)r2->window, (intmax_t)r2->rx_window);
+		if (r2->error != NULL)
+			VSB_printf(vsb, " error %s", r2->error->name);
 		VSB_printf(vsb, "\n");
 	}
 	VSB_indent(vsb, -2);
@@ -31,8 +31,11 @@
 
 #include "cache/cache.h"
 
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 
+#include "cache/cache_filter.h"
 #include "cache/cache_transport.h"
 #include "http2/cache_http2.h"
 
@@ -102,18 +105,6 @@ static const uint8_t H2_settings[] = {
 	0x00, 0x00, 0xff, 0xff
 };
 
-/**********************************************************************/
-#define DUMMY_FRAME(l) \
-	h2_error __match_proto__(h2_frame_f) \
-	h2_rx_##l(struct worker *wrk, struct h2_sess *h2, struct h2_req *r2) \
-	__match_proto__(h2_frame_f) \
-	{ (void)wrk; (void)r2; VSLb(h2->vsl, SLT_Debug, "XXX implement " #l); INCOMPL(); }
-
-DUMMY_FRAME(data)
-DUMMY_FRAME(rst_stream)
-DUMMY_FRAME(push_promise)
-DUMMY_FRAME(continuation)
-
 /**********************************************************************
  * The h2_sess struct needs many of the same things as a request,
  * WS, VSL, HTC &c,  but rather than implement all that stuff over, we
@@ -149,6 +140,9 @@ h2_new_sess(const struct worker *wrk, struct sess *sp, struct req *srq)
 		h2->htc->rfd = &sp->fd;
 		h2->sess = sp;
 		VTAILQ_INIT(&h2->streams);
+		AZ(pthread_cond_init(&h2->cond, NULL));
+		VTAILQ_INIT(&h2->txq);
+		AZ(pthread_cond_init(&h2->txcond, NULL));
 #define H2_SETTINGS(n,v,d)					\
 		do {						\
 			assert(v < H2_SETTINGS_N);		\
@@ -191,6 +185,12 @@ h2_new_req(const struct worker *wrk, struct h2_sess *h2,
 	r2->h2sess = h2;
 	r2->stream = stream;
 	r2->req = req;
+	if (stream == 0)
+		r2->window = 65535;			// rfc7540 6.9.1
+	else
+		r2->window = h2->their_settings[H2S_INITIAL_WINDOW_SIZE];
+	r2->rx_window = h2->our_settings[H2S_INITIAL_WINDOW_SIZE];
+	r2->weight = 16;				// rfc7540 5.3.5
 	req->transport_priv = r2;
 	// XXX: ordering ?
 	VTAILQ_INSERT_TAIL(&h2->streams, r2, list);
@@ -214,12 +214,20 @@ h2_del_req(struct worker *wrk, struct h2_req *r2)
 	/* XXX: PRIORITY reshuffle */
 	VTAILQ_REMOVE(&h2->streams, r2, list);
 	Lck_Unlock(&sp->mtx);
+	free(r2->rxbuf);
+	r2->rxbuf = NULL;
 	Req_Cleanup(sp, wrk, r2->req);
 	Req_Release(r2->req);
 	if (r)
 		return;
 
 	/* All streams gone, including stream #0, clean up */
+	free(h2->rxspace);
+	h2->rxspace = NULL;
+	AZ(pthread_cond_destroy(&h2->cond));
+	AZ(h2->tx_busy);
+	assert(VTAILQ_EMPTY(&h2->txq));
+	AZ(pthread_cond_destroy(&h2->txcond));
 	req = h2->srq;
 	Req_Cleanup(sp, wrk, req);
 	Req_Release(req);
@@ -231,13 +239,15 @@ h2_del_req(struct worker *wrk, struct h2_req *r2)
  * 'd' must point to six bytes.
  */
 
-static void
+static h2_error
 h2_setting(struct h2_sess *h2, const uint8_t *d)
 {
 	uint16_t x;
 	uint32_t y;
 	const char *n;
 	char nb[8];
+	struct h2_req *r2;
+	int64_t dw;
 
 	x = vbe16dec(d);
 	y = vbe32dec(d + 2);
@@ -247,8 +257,21 @@ h2_setting(struct h2_sess *h2, const uint8_t *d)
 		n = nb;
 	}
 	VSLb(h2->vsl, SLT_Debug, "H2SETTING %s 0x%08x", n, y);
+	if (x == H2S_INITIAL_WINDOW_SIZE) {
+		if (y >= (1LU << 31))
+			return (H2CE_FLOW_CONTROL_ERROR);	// rfc7540 6.5.2
+		/* Applies to all streams, but not the connection */
+		dw = (int64_t)y - h2->their_settings[x];
+		VTAILQ_FOREACH(r2, &h2->streams, list)
+			if (r2->stream != 0)
+				r2->window += dw;
+		AZ(pthread_cond_broadcast(&h2->cond));
+	}
+	if (x == H2S_MAX_FRAME_SIZE && (y < 0x4000 || y > 0xffffff))
+		return (H2CE_PROTOCOL_ERROR);		// rfc7540 6.5.2
 	if (x > 0 && x < H2_SETTINGS_N)
 		h2->their_settings[x] = y;
+	return (0);
 }
 
 /**********************************************************************/
@@ -327,6 +350,53 @@ h2_rx_goaway(struct worker *wrk, struct h2_sess *h2, struct h2_req *r2)
 	return (0);
 }
 
+/**********************************************************************
+ * Incoming RST_STREAM: The client gave up on the stream.
+ *
+ * Whatever the worker is doing on the stream is now pointless, so we
+ * flag the error and wake it up if it is waiting for window or body.
+ * H2_Send() and the body VFP fail from then on, which aborts the VDP
+ * and VFP chains at their next step and frees the worker.
+ */
+
+h2_error __match_proto__(h2_frame_f)
+h2_rx_rst_stream(struct worker *wrk, struct h2_sess *h2, struct h2_req *r2)
+{
+	uint32_t err;
+
+	(void)wrk;
+	Lck_AssertHeld(&h2->sess->mtx);
+	if (h2->rxf_len != 4)
+		return (H2CE_FRAME_SIZE_ERROR);		// rfc7540 6.4
+	if (h2->rxf_stream == 0 || r2->state == H2_S_IDLE)
+		return (H2CE_PROTOCOL_ERROR);		// rfc7540 6.4
+	err = vbe32dec(h2->rxf_data);
+	VSLb(h2->vsl, SLT_Debug, "H2: stream %u: RST_STREAM 0x%x",
+	    r2->stream, err);
+	r2->state = H2_S_CLOSED;
+	if (r2->error == NULL)
+		r2->error = H2SE_CANCEL;
+	AZ(pthread_cond_broadcast(&h2->cond));
+	return (0);
+}
+
+/**********************************************************************
+ * Clients cannot push, rfc7540 8.2
+ */
+
+h2_error __match_proto__(h2_frame_f)
+h2_rx_push_promise(struct worker *wrk, struct h2_sess *h2, struct h2_req *r2)
+{
+
+	(void)wrk;
+	(void)h2;
+	(void)r2;
+	return (H2CE_PROTOCOL_ERROR);
+}
+
+/**********************************************************************
+ */
+
 h2_error __match_proto__(h2_frame_f)
 h2_rx_window_update(struct worker *wrk, struct h2_sess *h2, struct h2_req *r2)
 {
@@ -342,21 +412,38 @@ h2_rx_window_update(struct worker *wrk, struct h2_sess *h2, struct h2_req *r2)
 	r2->window += wu;
 	if (r2->window >= (1LLU << 31))
 		return (H2SE_FLOW_CONTROL_ERROR);
+	AZ(pthread_cond_broadcast(&h2->cond));
 	return (0);
 }
 
 /**********************************************************************
- * Incoming PRIORITY, possibly an ACK of one we sent.
+ * Incoming PRIORITY
+ *
+ * We only use the weight, to order frames of different streams which
+ * are ready to be sent at the same time.  The dependency tree is
+ * ignored.
  */
 
+static h2_error
+h2_priority(struct h2_req *r2, const uint8_t *p)
+{
+
+	if ((vbe32dec(p) & ~(1LU<<31)) == r2->stream)
+		return (H2SE_PROTOCOL_ERROR);		// rfc7540 5.3.1
+	r2->weight = p[4] + 1U;
+	return (0);
+}
+
 h2_error __match_proto__(h2_frame_f)
 h2_rx_priority(struct worker *wrk, struct h2_sess *h2, struct h2_req *r2)
 {
 
 	(void)wrk;
-	(void)h2;
-	xxxassert(r2->stream & 1);
-	return (0);
+	if (r2->stream == 0)
+		return (H2CE_PROTOCOL_ERROR);		// rfc7540 6.3
+	if (h2->rxf_len != 5)
+		return (H2SE_FRAME_SIZE_ERROR);		// rfc7540 6.3
+	return (h2_priority(r2, h2->rxf_data));
 }
 
 /**********************************************************************
@@ -368,6 +455,7 @@ h2_rx_settings(struct worker *wrk, struct h2_sess *h2, struct h2_req *r2)
 {
 	const uint8_t *p = h2->rxf_data;
 	unsigned l = h2->rxf_len;
+	h2_error h2e;
 
 	(void)wrk;
 	(void)r2;
@@ -375,8 +463,11 @@ h2_rx_settings(struct worker *wrk, struct h2_sess *h2, struct h2_req *r2)
 	if (h2->rxf_flags == H2FF_SETTINGS_ACK) {
 		XXXAZ(h2->rxf_len);
 	} else if (h2->rxf_flags == 0) {
-		for (;l >= 6; l -= 6, p += 6)
-			h2_setting(h2, p);
+		for (;l >= 6; l -= 6, p += 6) {
+			h2e = h2_setting(h2, p);
+			if (h2e != 0)
+				return (h2e);
+		}
 		if (l > 0)
 			VSLb(h2->vsl, SLT_Debug,
 			    "NB: SETTINGS had %u dribble-bytes", l);
@@ -397,32 +488,127 @@ h2_do_req(struct worker *wrk, void *priv)
 {
 	struct req *req;
 	struct h2_req *r2;
+	struct h2_sess *h2;
+	char b[4];
 
 	CAST_OBJ_NOTNULL(req, priv, REQ_MAGIC);
 	CAST_OBJ_NOTNULL(r2, req->transport_priv, H2_REQ_MAGIC);
+	h2 = r2->h2sess;
 	THR_SetRequest(req);
 	assert(CNT_Request(wrk, req) != REQ_FSM_DISEMBARK);
 	THR_SetRequest(NULL);
 	VSL(SLT_Debug, 0, "H2REQ CNT done");
 	/* XXX clean up req */
+	Lck_Lock(&h2->sess->mtx);
+	if (r2->error == NULL &&
+	    (r2->state == H2_S_OPEN || r2->state == H2_S_CLOS_LOC)) {
+		/*
+		 * We are done, but the client is still sending a body
+		 * we will never read.  Ask it to stop, rfc7540 8.1
+		 */
+		vbe32enc(b, H2SE_NO_ERROR->val);
+		(void)H2_Send_Frame(wrk, h2, H2_FRAME_RST_STREAM,
+		    0, sizeof b, r2->stream, b);
+	}
 	r2->state = H2_S_CLOSED;
+	(void)H2_Flush(wrk, h2);
+	Lck_Unlock(&h2->sess->mtx);
 	h2_del_req(wrk, r2);
 }
 
+/*
+ * The header block is complete, decide about the body and hand
+ * the request to a worker.
+ */
+
+static h2_error
+h2_end_headers(struct worker *wrk, struct h2_sess *h2,
+    struct req *req, struct h2_req *r2)
+{
+	h2_error h2e;
+	ssize_t cl;
+
+	h2e = h2h_decode_fini(h2, h2->decode);
+	h2->decode = NULL;
+	if (h2e != 0)
+		return (h2e);
+	VSLb_ts_req(req, "Req", req->t_req);
+	http_SetH(req->http, HTTP_HDR_PROTO, "HTTP/2.0");
+
+	cl = http_GetContentLength(req->http);
+	assert(cl >= -2);
+	if (cl == -2)
+		return (H2SE_PROTOCOL_ERROR);
+	if (req->req_body_status == REQ_BODY_NONE) {
+		r2->state = H2_S_CLOS_REM;
+	} else {
+		r2->state = H2_S_OPEN;
+		req->htc->content_length = cl;
+		if (cl >= 0)
+			req->req_body_status = REQ_BODY_WITH_LEN;
+		else
+			req->req_body_status = REQ_BODY_WITHOUT_LEN;
+	}
+
+	wrk->stats->client_req++;
+	wrk->stats->s_req++;
+	req->ws_req = WS_Snapshot(req->ws);
+	HTTP_Copy(req->http0, req->http);
+
+	req->task.func = h2_do_req;
+	req->task.priv = req;
+	XXXAZ(Pool_Task(wrk->pool, &req->task, TASK_QUEUE_REQ));
+	return (0);
+}
+
+/*
+ * Feed a fragment of a header block to the decoder, and finish up
+ * if it was the last one.
+ */
+
+static h2_error
+h2_decode_fragment(struct worker *wrk, struct h2_sess *h2,
+    struct h2_req *r2, const uint8_t *p, size_t l, int end)
+{
+	h2_error h2e;
+
+	h2e = h2h_decode_bytes(h2, h2->decode, p, l);
+	if (h2e != 0) {
+		(void)h2h_decode_fini(h2, h2->decode);
+		h2->decode = NULL;
+		return (h2e);
+	}
+	if (end)
+		return (h2_end_headers(wrk, h2, r2->req, r2));
+	return (0);
+}
+
 h2_error __match_proto__(h2_frame_f)
 h2_rx_headers(struct worker *wrk, struct h2_sess *h2, struct h2_req *r2)
 {
 	struct req *req;
-	struct h2h_decode d[1];
 	const uint8_t *p;
 	size_t l;
 
-	/* XXX: This still lacks support for CONTINUATION frames, half
-	 * read frames and proper error handling.
-	 */
+	if (r2->state != H2_S_IDLE)
+		return (H2CE_PROTOCOL_ERROR);	// XXX: trailers
 
-	xxxassert(r2->state == H2_S_IDLE);
-	r2->state = H2_S_OPEN;
+	p = h2->rxf_data;
+	l = h2->rxf_len;
+	if (h2->rxf_flags & H2FF_HEADERS_PADDED) {
+		if (l < 1 || *p >= l)
+			return (H2CE_PROTOCOL_ERROR);	// rfc7540 6.2
+		l -= 1 + *p;
+		p += 1;
+	}
+	if (h2->rxf_flags & H2FF_HEADERS_PRIORITY) {
+		if (l < 5)
+			return (H2CE_FRAME_SIZE_ERROR);
+		if (h2_priority(r2, p) != 0)
+			return (H2CE_PROTOCOL_ERROR);
+		p += 5;
+		l -= 5;
+	}
 
 	req = r2->req;
 	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
@@ -444,36 +630,234 @@ h2_rx_headers(struct worker *wrk, struct h2_sess *h2, struct h2_req *r2)
 	req->vcl = wrk->vcl;
 	wrk->vcl = NULL;
 
+	if (h2->rxf_flags & H2FF_HEADERS_END_STREAM)
+		req->req_body_status = REQ_BODY_NONE;
+	else
+		req->req_body_status = REQ_BODY_WITHOUT_LEN;
+
 	HTTP_Setup(req->http, req->ws, req->vsl, SLT_ReqMethod);
-	h2h_decode_init(h2, d);
-	/* XXX: Error handling */
+	AZ(h2->decode);
+	h2->decode = WS_Alloc(req->ws, sizeof *h2->decode);
+	if (h2->decode == NULL)
+		return (H2SE_ENHANCE_YOUR_CALM);
+	h2h_decode_init(h2, h2->decode);
+	return (h2_decode_fragment(wrk, h2, r2, p, l,
+	    h2->rxf_flags & H2FF_HEADERS_END_HEADERS));
+}
+
+/**********************************************************************
+ * Incoming CONTINUATION, more of the header block the previous HEADERS
+ * frame started.  h2_procframe() makes sure nothing else gets between
+ * them.
+ */
+
+h2_error __match_proto__(h2_frame_f)
+h2_rx_continuation(struct worker *wrk, struct h2_sess *h2, struct h2_req *r2)
+{
+
+	if (h2->decode == NULL || h2->new_req != r2->req)
+		return (H2CE_PROTOCOL_ERROR);		// rfc7540 6.10
+	return (h2_decode_fragment(wrk, h2, r2, h2->rxf_data, h2->rxf_len,
+	    h2->rxf_flags & H2FF_CONTINUATION_END_HEADERS));
+}
+
+/**********************************************************************
+ * Incoming DATA, the request body.
+ *
+ * The session thread stashes the payload in a per-stream buffer, which
+ * the request body VFP in the worker drains.  The buffer is as large
+ * as the receive window we advertise, and the window is only reopened
+ * as the worker consumes, so the client cannot overrun us.  The
+ * connection window is reopened as frames arrive, since the per-stream
+ * windows already bound what we hold on to.
+ */
+
+static h2_error
+h2_rx_data_conn(struct worker *wrk, struct h2_sess *h2)
+{
+	struct h2_req *r0;
+	char b[4];
+
+	r0 = h2->req0;
+	CHECK_OBJ_NOTNULL(r0, H2_REQ_MAGIC);
+	if (h2->rxf_len > r0->rx_window)
+		return (H2CE_FLOW_CONTROL_ERROR);
+	r0->rx_window -= h2->rxf_len;
+	r0->rx_unacked += h2->rxf_len;
+	if (r0->rx_unacked >= h2->our_settings[H2S_INITIAL_WINDOW_SIZE] / 2) {
+		vbe32enc(b, (uint32_t)r0->rx_unacked);
+		(void)H2_Send_Frame(wrk, h2, H2_FRAME_WINDOW_UPDATE,
+		    0, sizeof b, 0, b);
+		r0->rx_window += r0->rx_unacked;
+		r0->rx_unacked = 0;
+	}
+	return (0);
+}
+
+h2_error __match_proto__(h2_frame_f)
+h2_rx_data(struct worker *wrk, struct h2_sess *h2, struct h2_req *r2)
+{
+	const uint8_t *p;
+	size_t l, sz;
+	h2_error h2e;
+
+	Lck_AssertHeld(&h2->sess->mtx);
+	if (h2->rxf_stream == 0 || r2->state == H2_S_IDLE)
+		return (H2CE_PROTOCOL_ERROR);		// rfc7540 6.1
+
+	/* The entire frame, padding included, is flow controlled */
+	h2e = h2_rx_data_conn(wrk, h2);
+	if (h2e != 0)
+		return (h2e);
+
+	if (r2->state != H2_S_OPEN && r2->state != H2_S_CLOS_LOC)
+		return (H2SE_STREAM_CLOSED);		// rfc7540 6.1
+	if (h2->rxf_len > r2->rx_window)
+		return (H2SE_FLOW_CONTROL_ERROR);
+	r2->rx_window -= h2->rxf_len;
+
 	p = h2->rxf_data;
 	l = h2->rxf_len;
-	if (h2->rxf_flags & H2FF_HEADERS_PADDED) {
+	if (h2->rxf_flags & H2FF_DATA_PADDED) {
+		if (l < 1 || *p >= l)
+			return (H2CE_PROTOCOL_ERROR);	// rfc7540 6.1
+		/* Padding is not for the VFP, credit it right away */
+		r2->rx_unacked += 1 + *p;
 		l -= 1 + *p;
 		p += 1;
 	}
-	if (h2->rxf_flags & H2FF_HEADERS_PRIORITY) {
-		p += 5;
-		l -= 5;
-	}
-	XXXAZ(h2h_decode_bytes(h2, d, p, l));
-	XXXAZ(h2h_decode_fini(h2, d));
-	VSLb_ts_req(req, "Req", req->t_req);
-	http_SetH(req->http, HTTP_HDR_PROTO, "HTTP/2.0");
 
-	req->req_body_status = REQ_BODY_NONE;
-	wrk->stats->client_req++;
-	wrk->stats->s_req++;
-	req->ws_req = WS_Snapshot(req->ws);
-	HTTP_Copy(req->http0, req->http);
+	if (l > 0) {
+		sz = h2->our_settings[H2S_INITIAL_WINDOW_SIZE];
+		if (r2->rxbuf == NULL) {
+			r2->rxbuf = malloc(sz);
+			AN(r2->rxbuf);
+		}
+		if (r2->rxbuf_e + l > sz) {
+			memmove(r2->rxbuf, r2->rxbuf + r2->rxbuf_b,
+			    r2->rxbuf_e - r2->rxbuf_b);
+			r2->rxbuf_e -= r2->rxbuf_b;
+			r2->rxbuf_b = 0;
+		}
+		assert(r2->rxbuf_e + l <= sz);
+		memcpy(r2->rxbuf + r2->rxbuf_e, p, l);
+		r2->rxbuf_e += l;
+	}
 
-	req->task.func = h2_do_req;
-	req->task.priv = req;
-	XXXAZ(Pool_Task(wrk->pool, &req->task, TASK_QUEUE_REQ));
+	if (h2->rxf_flags & H2FF_DATA_END_STREAM) {
+		if (r2->state == H2_S_OPEN)
+			r2->state = H2_S_CLOS_REM;
+		else
+			r2->state = H2_S_CLOSED;
+	}
+	AZ(pthread_cond_broadcast(&h2->cond));
 	return (0);
 }
 
+/*
+ * The request body VFP, which runs in the worker.
+ */
+
+static enum vfp_status __match_proto__(vfp_pull_f)
+h2_vfp_body(struct vfp_ctx *vc, struct vfp_entry *vfe, void *ptr,
+    ssize_t *lp)
+{
+	struct h2_req *r2;
+	struct h2_sess *h2;
+	enum vfp_status retval;
+	ssize_t l;
+	char b[4];
+
+	CHECK_OBJ_NOTNULL(vc, VFP_CTX_MAGIC);
+	CHECK_OBJ_NOTNULL(vfe, VFP_ENTRY_MAGIC);
+	CAST_OBJ_NOTNULL(r2, vfe->priv1, H2_REQ_MAGIC);
+	h2 = r2->h2sess;
+	CHECK_OBJ_NOTNULL(h2, H2_SESS_MAGIC);
+	AN(ptr);
+	AN(lp);
+
+	l = *lp;
+	*lp = 0;
+	Lck_Lock(&h2->sess->mtx);
+	while (r2->error == NULL && r2->rxbuf_e == r2->rxbuf_b &&
+	    (r2->state == H2_S_OPEN || r2->state == H2_S_CLOS_LOC)) {
+		if (Lck_CondWait(&h2->cond, &h2->sess->mtx,
+		    VTIM_real() + cache_param->timeout_idle) == ETIMEDOUT)
+			break;
+	}
+	if (r2->error != NULL) {
+		Lck_Unlock(&h2->sess->mtx);
+		return (VFP_Error(vc, "H2: stream reset"));
+	}
+	if (r2->rxbuf_e == r2->rxbuf_b) {
+		if (r2->state == H2_S_OPEN || r2->state == H2_S_CLOS_LOC)
+			retval = VFP_Error(vc, "H2: body timeout");
+		else if (vfe->priv2 > 0)
+			retval = VFP_Error(vc, "H2: insufficient bytes");
+		else
+			retval = VFP_END;
+		Lck_Unlock(&h2->sess->mtx);
+		return (retval);
+	}
+	if (vfe->priv2 == 0) {
+		Lck_Unlock(&h2->sess->mtx);
+		return (VFP_Error(vc, "H2: body longer than Content-Length"));
+	}
+
+	if (l > r2->rxbuf_e - r2->rxbuf_b)
+		l = r2->rxbuf_e - r2->rxbuf_b;
+	if (vfe->priv2 > 0 && l > vfe->priv2)
+		l = vfe->priv2;
+	memcpy(ptr, r2->rxbuf + r2->rxbuf_b, l);
+	r2->rxbuf_b += l;
+	if (r2->rxbuf_b == r2->rxbuf_e) {
+		r2->rxbuf_b = 0;
+		r2->rxbuf_e = 0;
+	}
+	if (vfe->priv2 > 0)
+		vfe->priv2 -= l;
+	*lp = l;
+
+	/* Reopen the stream window for what we consumed */
+	r2->rx_unacked += l;
+	if ((r2->state == H2_S_OPEN || r2->state == H2_S_CLOS_LOC) &&
+	    r2->rx_unacked >= h2->our_settings[H2S_INITIAL_WINDOW_SIZE] / 2) {
+		vbe32enc(b, (uint32_t)r2->rx_unacked);
+		(void)H2_Send_Frame(vc->wrk, h2, H2_FRAME_WINDOW_UPDATE,
+		    0, sizeof b, r2->stream, b);
+		r2->rx_window += r2->rx_unacked;
+		r2->rx_unacked = 0;
+		(void)H2_Flush(vc->wrk, h2);
+	}
+	Lck_Unlock(&h2->sess->mtx);
+	return (VFP_OK);
+}
+
+static const struct vfp h2_body = {
+	.name = "H2_BODY",
+	.pull = h2_vfp_body,
+};
+
+static void __match_proto__(vtr_req_body_f)
+h2_req_body(struct req *req)
+{
+	struct h2_req *r2;
+	struct vfp_entry *vfe;
+
+	CHECK_OBJ_NOTNULL(req, REQ_MAGIC);
+	CAST_OBJ_NOTNULL(r2, req->transport_priv, H2_REQ_MAGIC);
+	if (req->req_body_status != REQ_BODY_WITH_LEN &&
+	    req->req_body_status != REQ_BODY_WITHOUT_LEN)
+		return;
+	vfe = VFP_Push(req->vfc, &h2_body, 0);
+	if (vfe == NULL) {
+		req->req_body_status = REQ_BODY_FAIL;
+		return;
+	}
+	vfe->priv1 = r2;
+	vfe->priv2 = req->htc->content_length;
+}
+
 /**********************************************************************/
 
 enum htc_status_e __match_proto__(htc_complete_f)
@@ -503,7 +887,11 @@ h2_frame_complete(struct http_conn *htc)
 		return (HTC_S_MORE);
 	u = vbe32dec(htc->rxbuf_b) >> 8;
 	VSL(SLT_Debug, 0, "RX %p %d %u", htc->rxbuf_b, l, u);
-	if (l < u + 9)	// XXX: Only for !DATA frames
+	/*
+	 * A frame which cannot fit in the buffer exceeds our
+	 * MAX_FRAME_SIZE, let h2_rxframe() complain about it.
+	 */
+	if (l < u + 9 && u + 9L < htc->ws->r - htc->rxbuf_b)
 		return (HTC_S_MORE);
 	return (HTC_S_COMPLETE);
 }
@@ -536,37 +924,50 @@ h2_procframe(struct worker *wrk, struct h2_sess *h2)
 		return (H2CE_PROTOCOL_ERROR);		// rfc7540 5.1.1
 	}
 
+	if (h2->decode != NULL && (h2->rxf_type != H2_FRAME_CONTINUATION ||
+	    h2->rxf_stream != h2->highest_stream))
+		return (H2CE_PROTOCOL_ERROR);		// rfc7540 6.10
+
 	VTAILQ_FOREACH(r2, &h2->streams, list)
 		if (r2->stream == h2->rxf_stream)
 			break;
-	if (r2 == NULL) {
-		if (h2->rxf_stream <= h2->highest_stream)
+	if (r2 == NULL && h2->rxf_stream <= h2->highest_stream) {
+		/* Frames racing the end of a stream we are done with */
+		if (h2->rxf_type == H2_FRAME_RST_STREAM)
+			return (0);			// rfc7540 5.1
+		if (h2->rxf_type != H2_FRAME_DATA)
 			return (H2CE_PROTOCOL_ERROR);	// rfc7540 5.1.1
-		h2->highest_stream = h2->rxf_stream;
-		r2 = h2_new_req(wrk, h2, h2->rxf_stream, NULL);
-		AN(r2);
-	}
-
-	if (h2->htc->rxbuf_b[3] >= H2FMAX) {
-		h2->bogosity++;
-		VSLb(h2->vsl, SLT_Debug,
-		    "H2: Unknown Frame 0x%02x", h2->htc->rxbuf_b[3]);
-		return (0);				// rfc7540 4.1
-	}
-	h2f = h2flist + h2->htc->rxbuf_b[3];
-	if (h2f->name == NULL || h2f->func == NULL) {
-		h2->bogosity++;
-		VSLb(h2->vsl, SLT_Debug,
-		    "H2: Unimplemented Frame 0x%02x", h2->htc->rxbuf_b[3]);
-		return (0);				// rfc7540 4.1
-	}
-	if (h2->rxf_flags & ~h2f->flags) {
-		h2->bogosity++;
-		VSLb(h2->vsl, SLT_Debug, "H2: Bad flags 0x%02x on %s",
-		    h2->rxf_flags, h2f->name);
-		h2->rxf_flags &= h2f->flags;		// rfc7540 4.1
-	}
-	h2e = h2f->func(wrk, h2, r2);
+		h2e = h2_rx_data_conn(wrk, h2);
+		if (h2e == 0)
+			h2e = H2SE_STREAM_CLOSED;	// rfc7540 6.1
+	} else {
+		if (r2 == NULL) {
+			h2->highest_stream = h2->rxf_stream;
+			r2 = h2_new_req(wrk, h2, h2->rxf_stream, NULL);
+			AN(r2);
+		}
+
+		if (h2->rxf_type >= H2FMAX) {
+			h2->bogosity++;
+			VSLb(h2->vsl, SLT_Debug,
+			    "H2: Unknown Frame 0x%02x", h2->rxf_type);
+			return (0);			// rfc7540 4.1
+		}
+		h2f = h2flist + h2->rxf_type;
+		if (h2f->name == NULL || h2f->func == NULL) {
+			h2->bogosity++;
+			VSLb(h2->vsl, SLT_Debug,
+			    "H2: Unimplemented Frame 0x%02x", h2->rxf_type);
+			return (0);			// rfc7540 4.1
+		}
+		if (h2->rxf_flags & ~h2f->flags) {
+			h2->bogosity++;
+			VSLb(h2->vsl, SLT_Debug, "H2: Bad flags 0x%02x on %s",
+			    h2->rxf_flags, h2f->name);
+			h2->rxf_flags &= h2f->flags;	// rfc7540 4.1
+		}
+		h2e = h2f->func(wrk, h2, r2);
+	}
 	if (h2e == 0)
 		return (0);
 	if (h2->rxf_stream == 0 || h2e->connection)
@@ -577,6 +978,17 @@ h2_procframe(struct worker *wrk, struct h2_sess *h2)
 	vbe32enc(b, h2e->val);
 	(void)H2_Send_Frame(wrk, h2, H2_FRAME_RST_STREAM,
 	    0, sizeof b, h2->rxf_stream, b);
+	if (r2 == NULL)
+		return (0);
+	if (r2->state != H2_S_IDLE) {
+		/* A worker has the stream, it will clean up */
+		if (r2->error == NULL)
+			r2->error = h2e;
+		r2->state = H2_S_CLOSED;
+		AZ(pthread_cond_broadcast(&h2->cond));
+		return (0);
+	}
+	AZ(h2->decode);
 	Lck_Unlock(&h2->sess->mtx);
 	h2_del_req(wrk, r2);
 	Lck_Lock(&h2->sess->mtx);
@@ -595,7 +1007,7 @@ h2_rxframe(struct worker *wrk, struct h2_sess *h2)
 	hs = HTC_RxStuff(h2->htc, h2_frame_complete,
 	    NULL, NULL, NAN,
 	    h2->sess->t_idle + cache_param->timeout_idle + 100,
-	    1024);
+	    h2->our_settings[H2S_MAX_FRAME_SIZE] + 9);
 	if (hs != HTC_S_COMPLETE) {
 		Lck_Lock(&h2->sess->mtx);
 		VSLb(h2->vsl, SLT_Debug, "H2: No frame (hs=%d)", hs);
@@ -604,10 +1016,23 @@ h2_rxframe(struct worker *wrk, struct h2_sess *h2)
 	}
 
 	h2->rxf_len =  vbe32dec(h2->htc->rxbuf_b) >> 8;
+	h2->rxf_type = (uint8_t)h2->htc->rxbuf_b[3];
 	h2->rxf_flags = h2->htc->rxbuf_b[4];
-	h2->rxf_stream = vbe32dec(h2->htc->rxbuf_b + 5);
+	h2->rxf_stream = vbe32dec(h2->htc->rxbuf_b + 5) & ~(1LU<<31);
 	h2->rxf_data = (void*)(h2->htc->rxbuf_b + 9);
-	/* XXX: later full DATA will not be rx'ed yet. */
+
+	if (h2->rxf_len > h2->our_settings[H2S_MAX_FRAME_SIZE]) {
+		Lck_Lock(&h2->sess->mtx);
+		VSLb(h2->vsl, SLT_Debug, "H2: Frame too big (%u)",
+		    h2->rxf_len);
+		vbe32enc(b, h2->highest_stream);
+		vbe32enc(b + 4, H2CE_FRAME_SIZE_ERROR->val);
+		(void)H2_Send_Frame(wrk, h2, H2_FRAME_GOAWAY,
+		    0, sizeof b, 0, b);
+		(void)H2_Flush(wrk, h2);
+		Lck_Unlock(&h2->sess->mtx);
+		return (0);				// rfc7540 4.2
+	}
 	HTC_RxPipeline(h2->htc, h2->htc->rxbuf_b + h2->rxf_len + 9);
 
 	h2_vsl_frame(h2, h2->htc->rxbuf_b, 9L + h2->rxf_len);
@@ -621,6 +1046,9 @@ h2_rxframe(struct worker *wrk, struct h2_sess *h2)
 		(void)H2_Send_Frame(wrk, h2, H2_FRAME_GOAWAY,
 		    0, sizeof b, 0, b);
 	}
+	/* Send what the frame made us queue, no stream is held here */
+	if (H2_Flush(wrk, h2))
+		h2e = H2CE_INTERNAL_ERROR;
 	Lck_Unlock(&h2->sess->mtx);
 	return (h2e ? 0 : 1);
 }
@@ -671,7 +1099,8 @@ h2_b64url_settings(struct h2_sess *h2, struct req *req)
 		n -= 8;
 		if (up == u + sizeof u) {
 			AZ(n);
-			h2_setting(h2, (void*)u);
+			if (h2_setting(h2, (void*)u) != 0)
+				return (-1);
 			up = u;
 		}
 	}
@@ -713,6 +1142,7 @@ h2_new_ou_session(struct worker *wrk, struct h2_sess *h2,
 {
 	ssize_t sz;
 	enum htc_status_e hs;
+	struct h2_req *r2;
 
 	sz = write(h2->sess->fd, h2_resp_101, strlen(h2_resp_101));
 	assert(sz == strlen(h2_resp_101));
@@ -732,7 +1162,9 @@ h2_new_ou_session(struct worker *wrk, struct h2_sess *h2,
 	HTC_RxInit(h2->htc, wrk->aws);
 
 	/* Start req thread */
-	(void)h2_new_req(wrk, h2, 1, req);
+	r2 = h2_new_req(wrk, h2, 1, req);
+	r2->state = H2_S_CLOS_REM;			// rfc7540 8.1.1
+	h2->highest_stream = 1;
 	req->req_step = R_STP_RECV;
 	req->transport = &H2_transport;
 	req->task.func = h2_do_req;
@@ -765,7 +1197,7 @@ h2_new_session(struct worker *wrk, void *arg)
 	struct sess *sp;
 	struct h2_sess *h2;
 	struct h2_req *r2, *r22;
-	uintptr_t wsp;
+	unsigned u;
 
 	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
 	CAST_OBJ_NOTNULL(req, arg, REQ_MAGIC);
@@ -774,20 +1206,18 @@ h2_new_session(struct worker *wrk, void *arg)
 
 	assert(req->transport == &H2_transport);
 
-	wsp = WS_Snapshot(wrk->aws);
-
 	switch(req->err_code) {
 	case 0:
 		/* Direct H2 connection (via Proxy) */
 		h2 = h2_new_sess(wrk, sp, req);
 		Lck_Lock(&h2->sess->mtx);
-		(void)h2_new_req(wrk, h2, 0, NULL);
+		h2->req0 = h2_new_req(wrk, h2, 0, NULL);
 		break;
 	case 1:
 		/* Prior Knowledge H1->H2 upgrade */
 		h2 = h2_new_sess(wrk, sp, req);
 		Lck_Lock(&h2->sess->mtx);
-		(void)h2_new_req(wrk, h2, 0, NULL);
+		h2->req0 = h2_new_req(wrk, h2, 0, NULL);
 
 		if (!h2_new_pu_session(wrk, h2))
 			return;
@@ -796,7 +1226,7 @@ h2_new_session(struct worker *wrk, void *arg)
 		/* Optimistic H1->H2 upgrade */
 		h2 = h2_new_sess(wrk, sp, NULL);
 		Lck_Lock(&h2->sess->mtx);
-		(void)h2_new_req(wrk, h2, 0, NULL);
+		h2->req0 = h2_new_req(wrk, h2, 0, NULL);
 
 		if (!h2_new_ou_session(wrk, h2, req))
 			return;
@@ -809,14 +1239,37 @@ h2_new_session(struct worker *wrk, void *arg)
 
 	H2_Send_Frame(wrk, h2,
 	    H2_FRAME_SETTINGS, H2FF_NONE, sizeof H2_settings, 0, H2_settings);
+	(void)H2_Flush(wrk, h2);
 
 	/* and off we go... */
 	Lck_Unlock(&h2->sess->mtx);
 
+	/* Frames can be up to MAX_FRAME_SIZE, more than fits in wrk->aws */
+	u = h2->our_settings[H2S_MAX_FRAME_SIZE] + 9 + 16;
+	h2->rxspace = malloc(u);
+	AN(h2->rxspace);
+	WS_Init(h2->rxws, "h2r", h2->rxspace, u);
+	HTC_RxPipeline(h2->htc, h2->htc->rxbuf_b);
+	WS_ReleaseP(h2->htc->ws, h2->htc->rxbuf_b);
+	HTC_RxInit(h2->htc, h2->rxws);
+
 	while (h2_rxframe(wrk, h2)) {
-		WS_Reset(wrk->aws, wsp);
-		HTC_RxInit(h2->htc, wrk->aws);
+		WS_Reset(h2->rxws, 0);
+		HTC_RxInit(h2->htc, h2->rxws);
+	}
+
+	/* Fail the streams still in progress, and wake up their workers */
+	Lck_Lock(&h2->sess->mtx);
+	if (h2->decode != NULL) {
+		(void)h2h_decode_fini(h2, h2->decode);
+		h2->decode = NULL;
+	}
+	VTAILQ_FOREACH(r2, &h2->streams, list) {
+		if (r2->state != H2_S_IDLE && r2->error == NULL)
+			r2->error = H2SE_CANCEL;
 	}
+	AZ(pthread_cond_broadcast(&h2->cond));
+	Lck_Unlock(&h2->sess->mtx);
 
 	/* Delete all idle streams */
 	VTAILQ_FOREACH_SAFE(r2, &h2->streams, list, r22) {
@@ -831,4 +1284,5 @@ struct transport H2_transport = {
 	.new_session =		h2_new_session,
 	.sess_panic =		h2_sess_panic,
 	.deliver =		h2_deliver,
+	.req_body =		h2_req_body,
 };
@@ -29,12 +29,17 @@
 
 #include "config.h"
 
+#include <sys/uio.h>
 #include "cache/cache.h"
 
+#include <errno.h>
+#include <stdlib.h>
+
 #include "cache/cache_transport.h"
 #include "http2/cache_http2.h"
 
 #include "vend.h"
+#include "vtim.h"
 
 static void
 h2_mk_hdr(uint8_t *hdr, enum h2_frame_e type, uint8_t flags,
@@ -50,45 +55,322 @@ h2_mk_hdr(uint8_t *hdr, enum h2_frame_e type, uint8_t flags,
 }
 
 /*
- * This is the "raw" frame sender, all per stream accounting and
- * prioritization must have happened before this is called, and
- * the session mtx must be held.
+ * Frames are sent through a per-session transmit queue.  Whoever finds
+ * frames queued and nobody writing takes a batch off the queue and
+ * writev(2)s it without holding the session mtx, while other streams
+ * queue up behind it for the next batch.
+ *
+ * Within a batch, frames of streams with a higher weight go first, and
+ * control frames before those, but the frames of one stream keep their
+ * order and nothing overtakes a CONTINUATION frame.
+ */
+
+struct h2_txframe {
+	unsigned			magic;
+#define H2_TXFRAME_MAGIC		0x1c5e8d2b
+	VTAILQ_ENTRY(h2_txframe)	list;
+	uint64_t			seq;
+	uint32_t			stream;
+	unsigned			weight;
+	unsigned			malloced;
+	uint32_t			len;
+	const void			*ptr;
+	uint8_t				hdr[9];
+};
+
+#define H2_TX_BATCH		32	/* Frames per writev(2) */
+#define H2_TX_WEIGHT_CTRL	257	/* Above any stream weight */
+
+static void
+h2_tx_queue(struct h2_sess *h2, struct h2_txframe *f, enum h2_frame_e type,
+    uint8_t flags, uint32_t len, uint32_t stream, const void *ptr,
+    unsigned weight)
+{
+
+	Lck_AssertHeld(&h2->sess->mtx);
+	CHECK_OBJ_NOTNULL(f, H2_TXFRAME_MAGIC);
+	assert(len == 0 || ptr != NULL);
+	h2_mk_hdr(f->hdr, type, flags, len, stream);
+	f->stream = stream;
+	f->weight = weight;
+	f->len = len;
+	f->ptr = ptr;
+	f->seq = ++h2->tx_seq;
+	VTAILQ_INSERT_TAIL(&h2->txq, f, list);
+}
+
+static void
+h2_tx_prune(struct iovec **iovp, unsigned *niovp, size_t len)
+{
+	struct iovec *iov;
+
+	iov = *iovp;
+	while (len > 0) {
+		assert(*niovp > 0);
+		if (len < iov->iov_len) {
+			iov->iov_base = (char*)iov->iov_base + len;
+			iov->iov_len -= len;
+			break;
+		}
+		len -= iov->iov_len;
+		iov++;
+		(*niovp)--;
+	}
+	*iovp = iov;
+}
+
+/*
+ * Write a batch, retrying after partial writes until send_timeout like
+ * V1L_Flush() does.  Called without the session mtx, so it must not
+ * touch the session beyond the fd.
+ */
+
+static int
+h2_tx_writev(struct worker *wrk, int fd, struct iovec *iov, unsigned niov,
+    size_t len, unsigned *stalls)
+{
+	double t0;
+	ssize_t i;
+
+	t0 = VTIM_real();
+	while (1) {
+		i = writev(fd, iov, niov);
+		wrk->stats->h2_tx_writev++;
+		if (i <= 0)
+			return (i < 0 ? errno : EPIPE);
+		if ((size_t)i == len)
+			return (0);
+		(*stalls)++;
+		wrk->stats->h2_tx_stall++;
+		if (VTIM_real() - t0 > cache_param->send_timeout)
+			return (ETIMEDOUT);
+		h2_tx_prune(&iov, &niov, i);
+		len -= i;
+	}
+}
+
+static void
+h2_tx_batch(struct worker *wrk, struct h2_sess *h2)
+{
+	struct h2_txframe *fl[H2_TX_BATCH], *f;
+	struct iovec iov[H2_TX_BATCH * 2];
+	unsigned n, u, niov, stalls = 0;
+	uint64_t seq = 0;
+	size_t len = 0;
+	int err;
+
+	Lck_AssertHeld(&h2->sess->mtx);
+	AZ(h2->tx_busy);
+
+	for (n = 0; n < H2_TX_BATCH; n++) {
+		f = VTAILQ_FIRST(&h2->txq);
+		if (f == NULL)
+			break;
+		CHECK_OBJ_NOTNULL(f, H2_TXFRAME_MAGIC);
+		VTAILQ_REMOVE(&h2->txq, f, list);
+		assert(f->seq > seq);
+		seq = f->seq;
+		for (u = n; u > 0; u--) {
+			if (fl[u - 1]->weight >= f->weight ||
+			    fl[u - 1]->stream == f->stream ||
+			    fl[u - 1]->hdr[3] == H2_FRAME_CONTINUATION)
+				break;
+			fl[u] = fl[u - 1];
+		}
+		fl[u] = f;
+	}
+	AN(n);
+
+	niov = 0;
+	for (u = 0; u < n; u++) {
+		f = fl[u];
+		VSLb_bin(h2->vsl, SLT_H2TxHdr, 9, f->hdr);
+		iov[niov].iov_base = f->hdr;
+		iov[niov++].iov_len = sizeof f->hdr;
+		len += sizeof f->hdr;
+		if (f->len == 0)
+			continue;
+		VSLb_bin(h2->vsl, SLT_H2TxBody, f->len, f->ptr);
+		iov[niov].iov_base = TRUST_ME(f->ptr);
+		iov[niov++].iov_len = f->len;
+		len += f->len;
+	}
+
+	if (h2->tx_err == 0) {
+		h2->tx_busy = 1;
+		Lck_Unlock(&h2->sess->mtx);
+		wrk->stats->h2_tx_frames += n;
+		err = h2_tx_writev(wrk, h2->sess->fd, iov, niov, len, &stalls);
+		Lck_Lock(&h2->sess->mtx);
+		h2->tx_busy = 0;
+		if (stalls > 0)
+			VSLb(h2->vsl, SLT_Debug,
+			    "H2: write stalled %u times", stalls);
+		if (err != 0) {
+			VSLb(h2->vsl, SLT_Debug, "H2: write error: %s",
+			    strerror(err));
+			h2->tx_err = err;
+		}
+	}
+
+	for (u = 0; u < n; u++)
+		if (fl[u]->malloced)
+			FREE_OBJ(fl[u]);
+	h2->tx_done = seq;
+	AZ(pthread_cond_broadcast(&h2->txcond));
+}
+
+/*
+ * Wait until everything queued so far is written, writing it ourselves
+ * if nobody else is.  Must be called with the session mtx held, but
+ * drops it while writing or waiting, so callers must not hang on to
+ * anything another thread can free.
+ */
+
+int
+H2_Flush(struct worker *wrk, struct h2_sess *h2)
+{
+	uint64_t seq;
+
+	CHECK_OBJ_NOTNULL(h2, H2_SESS_MAGIC);
+	Lck_AssertHeld(&h2->sess->mtx);
+	seq = h2->tx_seq;
+	while (h2->tx_done < seq) {
+		if (h2->tx_busy)
+			(void)Lck_CondWait(&h2->txcond, &h2->sess->mtx, 0);
+		else
+			h2_tx_batch(wrk, h2);
+	}
+	return (h2->tx_err != 0 ? -1 : 0);
+}
+
+/*
+ * Queue a copy of a control frame, it goes out with the next
+ * H2_Flush(), which the session thread does after every frame it
+ * received.  The session mtx must be held.
  */
 
 int
-H2_Send_Frame(struct worker *wrk, const struct h2_sess *h2,
+H2_Send_Frame(struct worker *wrk, struct h2_sess *h2,
     enum h2_frame_e type, uint8_t flags,
     uint32_t len, uint32_t stream, const void *ptr)
 {
-	uint8_t hdr[9];
+	struct h2_txframe *f;
+	uint8_t *p;
 
-	Lck_AssertHeld(&h2->sess->mtx);
 	(void)wrk;
+	CHECK_OBJ_NOTNULL(h2, H2_SESS_MAGIC);
+	Lck_AssertHeld(&h2->sess->mtx);
+	assert(len == 0 || ptr != NULL);
 
-	h2_mk_hdr(hdr, type, flags, len, stream);
-	VSLb_bin(h2->vsl, SLT_H2TxHdr, 9, hdr);
+	p = malloc(sizeof *f + len);
+	AN(p);
+	f = (void*)p;
+	INIT_OBJ(f, H2_TXFRAME_MAGIC);
+	f->malloced = 1;
+	if (len > 0)
+		memcpy(p + sizeof *f, ptr, len);
+	h2_tx_queue(h2, f, type, flags, len, stream, p + sizeof *f,
+	    H2_TX_WEIGHT_CTRL);
+	return (h2->tx_err != 0 ? -1 : 0);
+}
 
-	/*XXX*/(void)write(h2->sess->fd, hdr, sizeof hdr);
-	if (len > 0) {
-		/*XXX*/(void)write(h2->sess->fd, ptr, len);
-		VSLb_bin(h2->vsl, SLT_H2TxBody, len, ptr);
+/*
+ * Wait until the stream and the connection both have send window,
+ * and return how many of len bytes we may send.  If the peer does
+ * not open the window within send_timeout, we give up on the stream.
+ */
+
+static int64_t
+h2_send_window(struct worker *wrk, struct h2_req *r2, uint32_t len)
+{
+	struct h2_sess *h2;
+	int64_t w;
+	char b[4];
+
+	h2 = r2->h2sess;
+	CHECK_OBJ_NOTNULL(h2->req0, H2_REQ_MAGIC);
+	Lck_AssertHeld(&h2->sess->mtx);
+	while (1) {
+		if (r2->error != NULL)
+			return (-1);
+		w = r2->window;
+		if (h2->req0->window < w)
+			w = h2->req0->window;
+		if (w > 0)
+			break;
+		if (h2->tx_done < h2->tx_seq) {
+			/* The peer must see what we have queued first */
+			if (H2_Flush(wrk, h2))
+				return (-1);
+			continue;
+		}
+		if (Lck_CondWait(&h2->cond, &h2->sess->mtx,
+		    VTIM_real() + cache_param->send_timeout) == ETIMEDOUT) {
+			VSLb(h2->vsl, SLT_Debug,
+			    "H2: stream %u: send window timeout", r2->stream);
+			r2->error = H2SE_CANCEL;
+			vbe32enc(b, r2->error->val);
+			(void)H2_Send_Frame(wrk, h2, H2_FRAME_RST_STREAM,
+			    0, sizeof b, r2->stream, b);
+			return (-1);
+		}
 	}
+	if (w > len)
+		w = len;
+	return (w);
+}
+
+/*
+ * Queue a frame of a stream from a buffer the caller owns.  When the
+ * ntf frames in tf[] are used up, flush and start over.  Flushing
+ * drops the session mtx, so header blocks must come with room for
+ * all their frames: nothing may come between HEADERS and the last
+ * CONTINUATION [RFC7540 6.10].
+ */
+
+#define H2_TX_STACK		8
+
+static int
+h2_send_queue(struct worker *wrk, struct h2_req *r2, struct h2_txframe *tf,
+    unsigned ntf, unsigned *np, enum h2_frame_e type, uint8_t flags,
+    uint32_t len, const void *ptr)
+{
+	struct h2_txframe *f;
+
+	if (*np == ntf) {
+		*np = 0;
+		if (H2_Flush(wrk, r2->h2sess))
+			return (-1);
+	}
+	f = &tf[(*np)++];
+	INIT_OBJ(f, H2_TXFRAME_MAGIC);
+	h2_tx_queue(r2->h2sess, f, type, flags, len, r2->stream, ptr,
+	    r2->weight);
 	return (0);
 }
 
 /*
  * This is the per-stream frame sender.
- * XXX: windows
- * XXX: priority
+ *
+ * DATA is charged against the stream and connection windows, and
+ * header blocks larger than the peers MAX_FRAME_SIZE are continued
+ * in CONTINUATION frames.  The frames are queued from the callers
+ * buffer, so we do not return until they are written.
  */
 
 int
 H2_Send(struct worker *wrk, struct h2_req *r2, int flush,
     enum h2_frame_e type, uint8_t flags, uint32_t len, const void *ptr)
 {
-	int retval;
+	struct h2_txframe tf[H2_TX_STACK], *tfp = tf;
+	unsigned n = 0, ntf = H2_TX_STACK;
+	int retval = 0;
 	struct h2_sess *h2;
-	uint32_t mfs, tf;
+	enum h2_frame_e ft;
+	uint32_t mfs, tl;
+	int64_t w;
+	uint8_t ff;
 	const char *p;
 
 	(void)flush;
@@ -99,27 +381,72 @@ H2_Send(struct worker *wrk, struct h2_req *r2, int flush,
 	assert(len == 0 || ptr != NULL);
 
 	Lck_Lock(&h2->sess->mtx);
+	if (r2->error != NULL || h2->tx_err != 0) {
+		/* The stream was reset, don't send anything more */
+		Lck_Unlock(&h2->sess->mtx);
+		return (-1);
+	}
 	mfs = h2->their_settings[H2S_MAX_FRAME_SIZE];
-	if (len < mfs) {
-		retval = H2_Send_Frame(wrk, h2,
-		    type, flags, len, r2->stream, ptr);
-	} else if (type == H2_FRAME_DATA) {
-		AN(ptr);
-		AN(len);
-		p = ptr;
+	p = ptr;
+	if (type == H2_FRAME_DATA) {
 		do {
-			tf = mfs;
-			if (tf > len)
-				tf = len;
-			retval = H2_Send_Frame(wrk, h2, type,
-			    tf == len ? flags : 0,
-			    tf, r2->stream, p);
-			p += tf;
-			len -= tf;
-		} while (len > 0);
+			tl = len;
+			if (tl > mfs)
+				tl = mfs;
+			if (tl > 0) {
+				w = h2_send_window(wrk, r2, tl);
+				if (w < 0) {
+					retval = -1;
+					break;
+				}
+				tl = (uint32_t)w;
+				r2->window -= tl;
+				h2->req0->window -= tl;
+			}
+			retval = h2_send_queue(wrk, r2, tf, ntf, &n, type,
+			    tl == len ? flags : 0, tl, p);
+			p += tl;
+			len -= tl;
+		} while (retval == 0 && len > 0);
 	} else {
-		INCOMPL();
+		assert(len <= mfs || type == H2_FRAME_HEADERS);
+		ntf = len == 0 ? 1 : (len + mfs - 1) / mfs;
+		if (ntf > H2_TX_STACK) {
+			tfp = calloc(ntf, sizeof *tfp);
+			AN(tfp);
+		} else
+			ntf = H2_TX_STACK;
+		ft = type;
+		ff = flags & ~H2FF_HEADERS_END_HEADERS;
+		do {
+			tl = len;
+			if (tl > mfs)
+				tl = mfs;
+			if (tl == len)
+				ff = ft == type ? flags :
+				    flags & H2FF_HEADERS_END_HEADERS;
+			retval = h2_send_queue(wrk, r2, tfp, ntf, &n, ft, ff,
+			    tl, p);
+			assert(retval == 0);
+			ft = H2_FRAME_CONTINUATION;
+			ff = 0;
+			p += tl;
+			len -= tl;
+		} while (retval == 0 && len > 0);
+	}
+	if (H2_Flush(wrk, h2))
+		retval = -1;
+	if (tfp != tf)
+		free(tfp);
+	if (retval == 0 && (flags & H2FF_DATA_END_STREAM) &&
+	    (type == H2_FRAME_DATA || type == H2_FRAME_HEADERS)) {
+		if (r2->state == H2_S_OPEN)
+			r2->state = H2_S_CLOS_LOC;
+		else if (r2->state == H2_S_CLOS_REM)
+			r2->state = H2_S_CLOSED;
 	}
+	if (retval == 0 && type == H2_FRAME_RST_STREAM)
+		r2->state = H2_S_CLOSED;
 	Lck_Unlock(&h2->sess->mtx);
 	return (retval);
 }
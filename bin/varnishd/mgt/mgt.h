@@ -51,6 +51,7 @@ extern int		exit_status;
 
 void MAC_Arg(const char *);
 void MAC_reopen_sockets(struct cli *);
+void MAC_check_sockets(struct cli *);
 
 /* mgt_child.c */
 int MCH_Init(int launch);
@@ -51,23 +51,100 @@
 static VTAILQ_HEAD(,listen_arg) listen_args =
     VTAILQ_HEAD_INITIALIZER(listen_args);
 
-static int
-mac_opensocket(struct listen_sock *ls)
+static void
+mac_closesocket(struct listen_sock *ls)
 {
-	int fail;
+	unsigned u;
 
 	CHECK_OBJ_NOTNULL(ls, LISTEN_SOCK_MAGIC);
+	for (u = 1; u < ls->npsock; u++) {
+		if (ls->psock[u] < 0)
+			continue;
+		MCH_Fd_Inherit(ls->psock[u], NULL);
+		closefd(&ls->psock[u]);
+	}
+	free(ls->psock);
+	ls->psock = NULL;
+	ls->npsock = 0;
 	if (ls->sock > 0) {
 		MCH_Fd_Inherit(ls->sock, NULL);
 		closefd(&ls->sock);
 	}
-	ls->sock = VTCP_bind(ls->addr, NULL);
+}
+
+/*--------------------------------------------------------------------
+ * Steer connections by receiving CPU, with thread_pool_numa to a pool
+ * on the node of that CPU.
+ */
+
+static int
+mac_steer(int sock, unsigned npool)
+{
+	unsigned *map = NULL, nmap = 0;
+	long ncpu;
+	int i, e;
+
+	ncpu = sysconf(_SC_NPROCESSORS_CONF);
+	if (mgt_param.wthread_numa && ncpu > 0) {
+		nmap = ncpu;
+		map = calloc(nmap, sizeof *map);
+		AN(map);
+		nmap = NUMA_Steer(map, nmap, npool);
+	}
+	i = VTCP_reuseport_cpu(sock, map, nmap, npool);
+	e = errno;
+	free(map);
+	errno = e;
+	return (i);
+}
+
+/*--------------------------------------------------------------------
+ * With npool > 0 we bind npool sockets with SO_REUSEPORT, one for each
+ * thread pool, the first of which is also ls->sock.
+ */
+
+static int
+mac_opensocket(struct listen_sock *ls, unsigned npool)
+{
+	int fail;
+	unsigned u;
+
+	mac_closesocket(ls);
+	if (npool == 0)
+		ls->sock = VTCP_bind(ls->addr, NULL);
+	else
+		ls->sock = VTCP_bind_reuseport(ls->addr, NULL);
 	fail = errno;
 	if (ls->sock < 0) {
 		AN(fail);
 		return (fail);
 	}
 	MCH_Fd_Inherit(ls->sock, "sock");
+	if (npool == 0)
+		return (0);
+
+	ls->psock = calloc(npool, sizeof *ls->psock);
+	AN(ls->psock);
+	ls->npsock = npool;
+	ls->psock[0] = ls->sock;
+	for (u = 1; u < npool; u++)
+		ls->psock[u] = -1;
+	for (u = 1; u < npool; u++) {
+		ls->psock[u] = VTCP_bind_reuseport(ls->addr, NULL);
+		fail = errno;
+		if (ls->psock[u] < 0) {
+			AN(fail);
+			mac_closesocket(ls);
+			return (fail);
+		}
+		MCH_Fd_Inherit(ls->psock[u], "sock");
+	}
+	if (mgt_param.listen_reuseport_cpu &&
+	    mac_steer(ls->sock, npool)) {
+		fail = errno;
+		mac_closesocket(ls);
+		return (fail);
+	}
 	return (0);
 }
 
@@ -79,11 +156,14 @@ void
 MAC_reopen_sockets(struct cli *cli)
 {
 	struct listen_sock *ls;
+	unsigned npool = 0;
 	int fail;
 
+	if (mgt_param.listen_reuseport)
+		npool = mgt_param.wthread_pools;
 	VTAILQ_FOREACH(ls, &heritage.socks, list) {
 		VJ_master(JAIL_MASTER_PRIVPORT);
-		fail = mac_opensocket(ls);
+		fail = mac_opensocket(ls, npool);
 		VJ_master(JAIL_MASTER_LOW);
 		if (fail == 0)
 			continue;
@@ -98,6 +178,27 @@ MAC_reopen_sockets(struct cli *cli)
 	}
 }
 
+/*=====================================================================
+ * Before the child starts, reopen the accept sockets if they do not
+ * match the listen_reuseport parameter.
+ */
+
+void
+MAC_check_sockets(struct cli *cli)
+{
+	struct listen_sock *ls;
+	unsigned npool = 0;
+
+	if (mgt_param.listen_reuseport)
+		npool = mgt_param.wthread_pools;
+	VTAILQ_FOREACH(ls, &heritage.socks, list) {
+		if (ls->npsock != npool) {
+			MAC_reopen_sockets(cli);
+			return;
+		}
+	}
+}
+
 /*--------------------------------------------------------------------*/
 
 static int __match_proto__(vss_resolved_f)
@@ -126,7 +227,7 @@ mac_callback(void *priv, const struct suckaddr *sa)
 	AN(ls->name);
 	ls->transport = la->transport;
 	VJ_master(JAIL_MASTER_PRIVPORT);
-	fail = mac_opensocket(ls);
+	fail = mac_opensocket(ls, 0);
 	VJ_master(JAIL_MASTER_LOW);
 	if (fail) {
 		free(ls->addr);
@@ -298,6 +298,8 @@ mgt_launch_child(struct cli *cli)
 		return;
 	}
 
+	MAC_check_sockets(cli);
+
 	/* Open pipe for mgr->child CLI */
 	AZ(pipe(cp));
 	heritage.cli_in = cp[0];
@@ -117,12 +117,15 @@ usage(void)
 	fprintf(stderr, FMT,
 	    "-s [name=]kind[,options]", "Backend storage specification");
 	fprintf(stderr, FMT, "", "  -s malloc[,<size>]");
+	fprintf(stderr, FMT, "", "  -s slab,<size>");
 	fprintf(stderr, FMT, "", "  -s file,<dir_or_file>");
 	fprintf(stderr, FMT, "", "  -s file,<dir_or_file>,<size>");
 	fprintf(stderr, FMT, "",
 	    "  -s file,<dir_or_file>,<size>,<granularity>");
 	fprintf(stderr, FMT, "",
 	    "  -s file,<dir_or_file>,<size>,<granularity>,<advice>");
+	fprintf(stderr, FMT, "",
+	    "  -s disk,<dir_or_file>,<size>[,<cache>[,<depth>]]");
 	fprintf(stderr, FMT, "", "  -s persistent (experimental)");
 	fprintf(stderr, FMT, "-T address:port",
 	    "Telnet listen address and port");
@@ -42,6 +42,7 @@
 
 #include "mgt/mgt_param.h"
 #include "vav.h"
+#include "vct.h"
 #include "vnum.h"
 
 /*--------------------------------------------------------------------
@@ -373,6 +374,46 @@ tweak_string(struct vsb *vsb, const struct parspec *par, const char *arg)
 
 /*--------------------------------------------------------------------*/
 
+int
+tweak_hdrparam(struct vsb *vsb, const struct parspec *par, const char *arg)
+{
+	volatile struct hdrparam *hp;
+	const char *p;
+	size_t l;
+
+	hp = par->priv;
+	if (arg == NULL) {
+		if (hp->hdr[0] == '\0')
+			VSB_quote(vsb, "", -1, 0);
+		else
+			VSB_printf(vsb, "%.*s", hp->hdr[0] - 1,
+			    (const char *)TRUST_ME(hp->hdr + 1));
+		return (0);
+	}
+	l = strlen(arg);
+	if (l + 3 > sizeof hp->hdr) {
+		VSB_printf(vsb, "Header name too long\n");
+		return (-1);
+	}
+	for (p = arg; *p != '\0'; p++) {
+		if (!vct_istchar(*p)) {
+			VSB_printf(vsb, "Illegal character in header name\n");
+			return (-1);
+		}
+	}
+	/* The child may be looking, only make it valid when complete */
+	hp->hdr[0] = '\0';
+	if (l == 0)
+		return (0);
+	memcpy(TRUST_ME(hp->hdr + 1), arg, l);
+	hp->hdr[l + 1] = ':';
+	hp->hdr[l + 2] = '\0';
+	hp->hdr[0] = (char)(l + 1);
+	return (0);
+}
+
+/*--------------------------------------------------------------------*/
+
 int
 tweak_poolparam(struct vsb *vsb, const struct parspec *par, const char *arg)
 {
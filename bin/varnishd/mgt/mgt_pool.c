@@ -97,6 +97,24 @@ struct parspec WRK_parspec[] = {
 		"restart to take effect.",
 		EXPERIMENTAL | DELAYED_EFFECT,
 		"2", "pools" },
+	{ "thread_pool_numa", tweak_bool, &mgt_param.wthread_numa,
+		NULL, NULL,
+		"Place the worker thread pools on the NUMA nodes of the "
+		"machine, pool n on node n modulo the number of nodes.\n"
+		"\n"
+		"The threads of a pool only run on the CPUs of its node, so "
+		"their stacks, workspaces and the pool's memory pools get "
+		"allocated there.  With listen_reuseport_cpu, connections "
+		"are handed to a pool on the node of the CPU which received "
+		"them.\n"
+		"\n"
+		"Set thread_pools to a multiple of the number of nodes.",
+#if defined(__linux__) && defined(HAVE_PTHREAD_SETAFFINITY_NP)
+		EXPERIMENTAL | MUST_RESTART,
+#else
+		NOT_IMPLEMENTED,
+#endif
+		"off", "bool" },
 	{ "thread_pool_max", tweak_thread_pool_max, &mgt_param.wthread_max,
 		NULL, NULL,
 		"The maximum number of worker threads in each pool.\n"
@@ -121,13 +121,48 @@ static const struct stevedore smp_fake_stevedore = {
  */
 
 static const struct choice STV_choice[] = {
+	{ "disk",			&dsk_stevedore },
 	{ "file",			&smf_stevedore },
 	{ "malloc",			&sma_stevedore },
+	{ "slab",			&slab_stevedore },
 	{ "deprecated_persistent",	&smp_stevedore },
 	{ "persistent",			&smp_fake_stevedore },
 	{ NULL,		NULL }
 };
 
+static const struct choice LRU_choice[] = {
+	{ "lru",			&lrul_policy },
+	{ "s3fifo",			&s3f_policy },
+	{ NULL,		NULL }
+};
+
+/*--------------------------------------------------------------------
+ * Pick out an 'evict=' argument for the eviction policy, the stevedore
+ * itself never sees it.
+ */
+
+static int
+stv_evict_arg(struct stevedore *stv, int ac, char **av)
+{
+	int i, j;
+
+	for (i = 0; i < ac; i++) {
+		if (strncmp(av[i], "evict=", 6))
+			continue;
+		if (stv->lru_policy != NULL)
+			ARGV_ERR("(-s%s) evict= given more than once\n",
+			    stv->name);
+		stv->lru_policy = MGT_Pick(LRU_choice, av[i] + 6,
+		    "eviction policy");
+		AN(stv->lru_policy);
+		for (j = i; j < ac; j++)
+			av[j] = av[j + 1];
+		ac--;
+		i--;
+	}
+	return (ac);
+}
+
 void
 STV_Config(const char *spec)
 {
@@ -188,6 +223,8 @@ STV_Config(const char *spec)
 			ARGV_ERR("(-s%s=%s) already defined once\n",
 			    stv->ident, stv->name);
 
+	ac = stv_evict_arg(stv, ac, av);
+
 	if (stv->init != NULL)
 		stv->init(stv, ac, av);
 	else if (ac != 0)
@@ -71,13 +71,13 @@ STV_next()
 
 /*-------------------------------------------------------------------
  * Allocate storage for an object, based on the header information.
- * XXX: If we know (a hint of) the length, we could allocate space
- * XXX: for the body in the same allocation while we are at it.
+ * If we know (a hint of) the length of the body, the stevedore may
+ * allocate space for it in the same allocation while it is at it.
  */
 
 int
 STV_NewObject(struct worker *wrk, struct objcore *oc,
-    const struct stevedore *stv, unsigned wsl)
+    const struct stevedore *stv, unsigned wsl, unsigned bodylen)
 {
 	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
 	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
@@ -85,7 +85,8 @@ STV_NewObject(struct worker *wrk, struct objcore *oc,
 	assert(wsl > 0);
 
 	AN(stv->allocobj);
-	if (stv->allocobj(wrk, stv, oc, wsl, cache_param->nuke_limit) == 0)
+	if (stv->allocobj(wrk, stv, oc, wsl, bodylen,
+	    cache_param->nuke_limit) == 0)
 		return (0);
 
 	wrk->stats->n_object++;
@@ -36,6 +36,7 @@ struct sess;
 struct objcore;
 struct worker;
 struct lru;
+struct lru_policy;
 struct vsl_log;
 struct vfp_ctx;
 struct obj_methods;
@@ -65,7 +66,7 @@ struct storage {
 typedef void storage_init_f(struct stevedore *, int ac, char * const *av);
 typedef void storage_open_f(struct stevedore *);
 typedef int storage_allocobj_f(struct worker *, const struct stevedore *,
-    struct objcore *, unsigned, int);
+    struct objcore *, unsigned, unsigned, int);
 typedef void storage_close_f(const struct stevedore *, int pass);
 typedef int storage_baninfo_f(const struct stevedore *, enum baninfo event,
     const uint8_t *ban, unsigned len);
@@ -77,6 +78,7 @@ typedef void storage_panic_f(struct vsb *vsb, const struct objcore *oc);
 typedef struct object *sml_getobj_f(struct worker *, struct objcore *);
 typedef struct storage *sml_alloc_f(const struct stevedore *, size_t size);
 typedef void sml_free_f(struct storage *);
+typedef int sml_extent_f(const struct storage *, int *fd, off_t *off);
 
 /* Prototypes for VCL variable responders */
 #define VRTSTVVAR(nm,vt,ct,def) \
@@ -105,11 +107,13 @@ struct stevedore {
 	sml_alloc_f		*sml_alloc;
 	sml_free_f		*sml_free;
 	sml_getobj_f		*sml_getobj;
+	sml_extent_f		*sml_extent;
 
 	const struct obj_methods
 				*methods;
 
 	/* Only if LRU is used */
+	const struct lru_policy	*lru_policy;
 	struct lru		*lru;
 
 #define VRTSTVVAR(nm, vtype, ctype, dval) stv_var_##nm *var_##nm;
@@ -136,15 +140,51 @@ int STV_GetFile(const char *fn, int *fdp, const char **fnp, const char *ctx);
 uintmax_t STV_FileSize(int fd, const char *size, unsigned *granularity,
     const char *ctx);
 
-/*--------------------------------------------------------------------*/
-struct lru *LRU_Alloc(void);
+/* Eviction policies -------------------------------------------------*/
+
+typedef void lru_init_f(struct lru *, const char *ident);
+typedef void lru_fini_f(struct lru *);
+typedef void lru_add_f(struct lru *, struct objcore *, double now);
+typedef void lru_remove_f(struct lru *, struct objcore *);
+typedef void lru_touch_f(struct lru *, struct objcore *, double now);
+typedef struct objcore *lru_nuke_f(struct worker *, struct lru *);
+typedef int lru_admit_f(struct worker *, struct lru *,
+    const struct objcore *);
+
+struct lru_policy {
+	unsigned		magic;
+#define LRU_POLICY_MAGIC	0x6fb1b4e5
+	const char		*name;
+	lru_init_f		*init;
+	lru_fini_f		*fini;
+	lru_add_f		*add;
+	lru_remove_f		*remove;
+	lru_touch_f		*touch;
+	lru_nuke_f		*nuke;
+	lru_admit_f		*admit;		/* optional */
+};
+
+struct lru {
+	unsigned		magic;
+#define LRU_MAGIC		0x3fec7bb0
+	const struct lru_policy	*policy;
+	void			*priv;
+};
+
+extern const struct lru_policy lrul_policy;
+extern const struct lru_policy s3f_policy;
+
+struct lru *LRU_Alloc(const struct stevedore *);
 void LRU_Free(struct lru **);
 void LRU_Add(struct objcore *, double now);
 void LRU_Remove(struct objcore *);
 int LRU_NukeOne(struct worker *, struct lru *);
+int LRU_Admit(struct worker *, struct lru *, const struct objcore *);
 void LRU_Touch(struct worker *, struct objcore *, double now);
 
 /*--------------------------------------------------------------------*/
 extern const struct stevedore sma_stevedore;
 extern const struct stevedore smf_stevedore;
 extern const struct stevedore smp_stevedore;
+extern const struct stevedore slab_stevedore;
+extern const struct stevedore dsk_stevedore;
@@ -0,0 +1,817 @@
+/*-
+ * Copyright (c) 2017 Varnish Software AS
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Storage method doing explicit I/O to a file
+ *
+ * Unlike -sfile, nothing is mmap'ed: bodies are written to the file
+ * with pwrite(2) once the fetch is done and read back with pread(2)
+ * when delivered, so a cold object never page-faults a worker thread.
+ *
+ * All I/O is handed to a fixed set of I/O threads through a queue of
+ * bounded depth, the workers only wait for the segments they need.
+ * Body segments which have been written are kept in a memory cache of
+ * bounded size, and delivery reads ahead of the segment it is sending.
+ *
+ * Object headers and auxiliary attributes always stay in memory, but
+ * all allocations reserve space in the file, so the file size is what
+ * bounds the storage and what LRU nuking works against.
+ */
+
+#include "config.h"
+
+#include "cache/cache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "cache/cache_obj.h"
+#include "hash/hash_slinger.h"
+
+#include "storage/storage.h"
+#include "storage/storage_simple.h"
+
+#include "vnum.h"
+#include "vrt.h"
+#include "vtim.h"
+#include "vtree.h"
+
+#define DSK_READAHEAD		4
+#define DSK_MAXDEPTH		64
+
+/*--------------------------------------------------------------------*/
+
+struct dsk_ext {
+	unsigned		magic;
+#define DSK_EXT_MAGIC		0x2c5b31e0
+	off_t			off;
+	off_t			len;
+	VRB_ENTRY(dsk_ext)	by_size;
+	VRB_ENTRY(dsk_ext)	by_off;
+};
+
+VRB_HEAD(dsk_size, dsk_ext);
+VRB_HEAD(dsk_off, dsk_ext);
+
+enum dsk_state {
+	DSK_MEM = 0,		/* Memory only, never evicted */
+	DSK_WRITING,
+	DSK_CLEAN,		/* On disk, maybe cached */
+	DSK_READING,
+};
+
+struct dsk_seg {
+	unsigned		magic;
+#define DSK_SEG_MAGIC		0x6a5d0c71
+	struct storage		s;
+	struct dsk_sc		*sc;
+
+	off_t			off;
+	size_t			size;
+	size_t			buflen;
+
+	enum dsk_state		state;
+	unsigned		refcnt;
+	unsigned		onlru;
+	unsigned		dead;
+	double			t_submit;
+
+	VTAILQ_ENTRY(dsk_seg)	list;
+};
+
+VTAILQ_HEAD(dsk_seghead, dsk_seg);
+
+struct dsk_sc {
+	unsigned		magic;
+#define DSK_SC_MAGIC		0x3f4c8d05
+	struct lock		mtx;
+	struct VSC_C_disk	*stats;
+
+	const char		*filename;
+	int			fd;
+	unsigned		pagesize;
+	uintmax_t		filesize;
+
+	struct dsk_size		free_size;
+	struct dsk_off		free_off;
+	uintmax_t		free_bytes;
+
+	size_t			cache_max;
+	size_t			cache_bytes;
+	struct dsk_seghead	lru;
+
+	unsigned		depth;
+	unsigned		nout;
+	struct dsk_seghead	ioq;
+	pthread_cond_t		io_cond;
+	pthread_cond_t		room_cond;
+	pthread_cond_t		done_cond;
+	pthread_t		*thr;
+};
+
+static struct VSC_C_lck *lck_dsk;
+static struct obj_methods dsk_methods;
+
+static inline int
+dsk_size_cmp(const struct dsk_ext *a, const struct dsk_ext *b)
+{
+
+	if (a->len != b->len)
+		return (a->len < b->len ? -1 : 1);
+	if (a->off != b->off)
+		return (a->off < b->off ? -1 : 1);
+	return (0);
+}
+
+static inline int
+dsk_off_cmp(const struct dsk_ext *a, const struct dsk_ext *b)
+{
+
+	if (a->off != b->off)
+		return (a->off < b->off ? -1 : 1);
+	return (0);
+}
+
+VRB_PROTOTYPE_STATIC(dsk_size, dsk_ext, by_size, dsk_size_cmp)
+VRB_GENERATE_STATIC(dsk_size, dsk_ext, by_size, dsk_size_cmp)
+VRB_PROTOTYPE_STATIC(dsk_off, dsk_ext, by_off, dsk_off_cmp)
+VRB_GENERATE_STATIC(dsk_off, dsk_ext, by_off, dsk_off_cmp)
+
+/*--------------------------------------------------------------------
+ * File space, best fit from a size ordered tree, merging neighbours
+ * found in an offset ordered tree on free.
+ */
+
+static void
+dsk_ext_ins(struct dsk_sc *sc, struct dsk_ext *e)
+{
+
+	AZ(VRB_INSERT(dsk_size, &sc->free_size, e));
+	AZ(VRB_INSERT(dsk_off, &sc->free_off, e));
+	sc->free_bytes += e->len;
+}
+
+static void
+dsk_ext_rem(struct dsk_sc *sc, struct dsk_ext *e)
+{
+
+	AN(VRB_REMOVE(dsk_size, &sc->free_size, e));
+	AN(VRB_REMOVE(dsk_off, &sc->free_off, e));
+	assert(sc->free_bytes >= e->len);
+	sc->free_bytes -= e->len;
+}
+
+static int
+dsk_ext_alloc(struct dsk_sc *sc, off_t len, off_t *off)
+{
+	struct dsk_ext *e, key;
+
+	Lck_AssertHeld(&sc->mtx);
+	key.len = len;
+	key.off = 0;
+	e = VRB_NFIND(dsk_size, &sc->free_size, &key);
+	if (e == NULL)
+		return (0);
+	CHECK_OBJ_NOTNULL(e, DSK_EXT_MAGIC);
+	assert(e->len >= len);
+	dsk_ext_rem(sc, e);
+	*off = e->off;
+	if (e->len == len) {
+		FREE_OBJ(e);
+		return (1);
+	}
+	e->off += len;
+	e->len -= len;
+	dsk_ext_ins(sc, e);
+	return (1);
+}
+
+static void
+dsk_ext_free(struct dsk_sc *sc, off_t off, off_t len)
+{
+	struct dsk_ext *e, *e2, key;
+
+	Lck_AssertHeld(&sc->mtx);
+	key.off = off;
+	e2 = VRB_NFIND(dsk_off, &sc->free_off, &key);
+	if (e2 != NULL) {
+		assert(e2->off >= off + len);
+		e = VRB_PREV(dsk_off, &sc->free_off, e2);
+	} else
+		e = VRB_MAX(dsk_off, &sc->free_off);
+
+	if (e != NULL && e->off + e->len == off) {
+		dsk_ext_rem(sc, e);
+		e->len += len;
+	} else {
+		ALLOC_OBJ(e, DSK_EXT_MAGIC);
+		AN(e);
+		e->off = off;
+		e->len = len;
+	}
+	if (e2 != NULL && e->off + e->len == e2->off) {
+		dsk_ext_rem(sc, e2);
+		e->len += e2->len;
+		FREE_OBJ(e2);
+	}
+	dsk_ext_ins(sc, e);
+}
+
+/*--------------------------------------------------------------------
+ * The memory cache of body segments
+ */
+
+static void
+dsk_lru_add(struct dsk_sc *sc, struct dsk_seg *seg)
+{
+
+	Lck_AssertHeld(&sc->mtx);
+	AZ(seg->onlru);
+	AZ(seg->refcnt);
+	assert(seg->state == DSK_CLEAN);
+	AN(seg->s.ptr);
+	VTAILQ_INSERT_TAIL(&sc->lru, seg, list);
+	seg->onlru = 1;
+}
+
+static void
+dsk_lru_rem(struct dsk_sc *sc, struct dsk_seg *seg)
+{
+
+	Lck_AssertHeld(&sc->mtx);
+	AN(seg->onlru);
+	VTAILQ_REMOVE(&sc->lru, seg, list);
+	seg->onlru = 0;
+}
+
+static void
+dsk_buf_free(struct dsk_sc *sc, struct dsk_seg *seg)
+{
+
+	Lck_AssertHeld(&sc->mtx);
+	if (seg->state != DSK_MEM && seg->s.ptr != NULL) {
+		assert(sc->cache_bytes >= seg->buflen);
+		sc->cache_bytes -= seg->buflen;
+		sc->stats->g_cache_bytes = sc->cache_bytes;
+	}
+	free(seg->s.ptr);
+	seg->s.ptr = NULL;
+	seg->buflen = 0;
+}
+
+static void
+dsk_cache_trim(struct dsk_sc *sc)
+{
+	struct dsk_seg *seg;
+
+	Lck_AssertHeld(&sc->mtx);
+	while (sc->cache_bytes > sc->cache_max) {
+		seg = VTAILQ_FIRST(&sc->lru);
+		if (seg == NULL)
+			break;
+		CHECK_OBJ_NOTNULL(seg, DSK_SEG_MAGIC);
+		dsk_lru_rem(sc, seg);
+		dsk_buf_free(sc, seg);
+		sc->stats->c_cache_evict++;
+	}
+}
+
+static void
+dsk_seg_destroy(struct dsk_sc *sc, struct dsk_seg *seg)
+{
+
+	Lck_AssertHeld(&sc->mtx);
+	AZ(seg->refcnt);
+	AZ(seg->onlru);
+	dsk_buf_free(sc, seg);
+	dsk_ext_free(sc, seg->off, seg->size);
+	FREE_OBJ(seg);
+}
+
+/*--------------------------------------------------------------------
+ * I/O queue and threads
+ */
+
+#define DSK_HIST(sc, pfx, d)					\
+	do {							\
+		if ((d) < 1e-4)					\
+			(sc)->stats->pfx##_lt100us++;		\
+		else if ((d) < 1e-3)				\
+			(sc)->stats->pfx##_lt1ms++;		\
+		else if ((d) < 1e-2)				\
+			(sc)->stats->pfx##_lt10ms++;		\
+		else if ((d) < 1e-1)				\
+			(sc)->stats->pfx##_lt100ms++;		\
+		else						\
+			(sc)->stats->pfx##_ge100ms++;		\
+	} while (0)
+
+static int
+dsk_submit(struct dsk_sc *sc, struct dsk_seg *seg, int wait)
+{
+
+	Lck_AssertHeld(&sc->mtx);
+	assert(seg->state == DSK_WRITING || seg->state == DSK_READING);
+	while (sc->nout >= sc->depth) {
+		if (!wait)
+			return (0);
+		sc->stats->c_queue_full++;
+		(void)Lck_CondWait(&sc->room_cond, &sc->mtx, 0);
+	}
+	sc->nout++;
+	sc->stats->g_queue = sc->nout;
+	seg->t_submit = VTIM_mono();
+	VTAILQ_INSERT_TAIL(&sc->ioq, seg, list);
+	AZ(pthread_cond_signal(&sc->io_cond));
+	return (1);
+}
+
+static void
+dsk_done(struct dsk_sc *sc, struct dsk_seg *seg, int ok)
+{
+
+	Lck_AssertHeld(&sc->mtx);
+	if (seg->state == DSK_WRITING) {
+		if (!ok) {
+			/* Keep it in memory for the rest of its life */
+			sc->stats->c_io_error++;
+			assert(sc->cache_bytes >= seg->buflen);
+			sc->cache_bytes -= seg->buflen;
+			sc->stats->g_cache_bytes = sc->cache_bytes;
+			seg->state = DSK_MEM;
+		} else
+			seg->state = DSK_CLEAN;
+	} else {
+		assert(seg->state == DSK_READING);
+		seg->state = DSK_CLEAN;
+		if (!ok) {
+			sc->stats->c_io_error++;
+			dsk_buf_free(sc, seg);
+		}
+		AZ(pthread_cond_broadcast(&sc->done_cond));
+	}
+	if (seg->dead) {
+		dsk_seg_destroy(sc, seg);
+		return;
+	}
+	if (seg->state == DSK_CLEAN && seg->refcnt == 0 && seg->s.ptr != NULL)
+		dsk_lru_add(sc, seg);
+	dsk_cache_trim(sc);
+}
+
+static int
+dsk_pio(const struct dsk_sc *sc, const struct dsk_seg *seg, int wr)
+{
+	size_t l = 0;
+	ssize_t i;
+
+	while (l < seg->s.len) {
+		if (wr)
+			i = pwrite(sc->fd, seg->s.ptr + l,
+			    seg->s.len - l, seg->off + l);
+		else
+			i = pread(sc->fd, seg->s.ptr + l,
+			    seg->s.len - l, seg->off + l);
+		if (i < 0 && errno == EINTR)
+			continue;
+		if (i <= 0)
+			return (0);
+		l += i;
+	}
+	return (1);
+}
+
+static void * __match_proto__(bgthread_t)
+dsk_io_thread(struct worker *wrk, void *priv)
+{
+	struct dsk_sc *sc;
+	struct dsk_seg *seg;
+	double t0, t1;
+	int ok, wr;
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	CAST_OBJ_NOTNULL(sc, priv, DSK_SC_MAGIC);
+	Lck_Lock(&sc->mtx);
+	while (1) {
+		seg = VTAILQ_FIRST(&sc->ioq);
+		if (seg == NULL) {
+			(void)Lck_CondWait(&sc->io_cond, &sc->mtx, 0);
+			continue;
+		}
+		CHECK_OBJ_NOTNULL(seg, DSK_SEG_MAGIC);
+		VTAILQ_REMOVE(&sc->ioq, seg, list);
+		wr = seg->state == DSK_WRITING;
+		t0 = VTIM_mono();
+		DSK_HIST(sc, c_submit, t0 - seg->t_submit);
+		Lck_Unlock(&sc->mtx);
+
+		ok = dsk_pio(sc, seg, wr);
+
+		t1 = VTIM_mono();
+		Lck_Lock(&sc->mtx);
+		DSK_HIST(sc, c_complete, t1 - t0);
+		if (wr) {
+			sc->stats->c_write++;
+			sc->stats->c_write_bytes += seg->s.len;
+		} else {
+			sc->stats->c_read++;
+			sc->stats->c_read_bytes += seg->s.len;
+		}
+		dsk_done(sc, seg, ok);
+		assert(sc->nout > 0);
+		sc->nout--;
+		sc->stats->g_queue = sc->nout;
+		AZ(pthread_cond_signal(&sc->room_cond));
+	}
+	NEEDLESS(Lck_Unlock(&sc->mtx));
+	NEEDLESS(return NULL);
+}
+
+/*--------------------------------------------------------------------
+ * Get a body segment into memory
+ */
+
+static int
+dsk_read(struct dsk_sc *sc, struct dsk_seg *seg, int wait)
+{
+
+	Lck_AssertHeld(&sc->mtx);
+	assert(seg->state == DSK_CLEAN);
+	AZ(seg->s.ptr);
+	seg->s.ptr = malloc(seg->s.len);
+	if (seg->s.ptr == NULL)
+		return (0);
+	seg->buflen = seg->s.len;
+	seg->state = DSK_READING;
+	if (!dsk_submit(sc, seg, wait)) {
+		seg->state = DSK_CLEAN;
+		free(seg->s.ptr);
+		seg->s.ptr = NULL;
+		seg->buflen = 0;
+		return (0);
+	}
+	sc->cache_bytes += seg->buflen;
+	sc->stats->g_cache_bytes = sc->cache_bytes;
+	return (1);
+}
+
+static void
+dsk_readahead(struct dsk_sc *sc, struct storage *st)
+{
+	struct dsk_seg *seg;
+	int n;
+
+	Lck_AssertHeld(&sc->mtx);
+	for (n = 0; n < DSK_READAHEAD && st != NULL;
+	    n++, st = VTAILQ_NEXT(st, list)) {
+		CAST_OBJ_NOTNULL(seg, st->priv, DSK_SEG_MAGIC);
+		if (seg->state != DSK_CLEAN || seg->s.ptr != NULL)
+			continue;
+		if (!dsk_read(sc, seg, 0))
+			break;
+		sc->stats->c_readahead++;
+	}
+}
+
+static void *
+dsk_get(struct dsk_sc *sc, struct dsk_seg *seg)
+{
+	void *p;
+
+	Lck_Lock(&sc->mtx);
+	seg->refcnt++;
+	if (seg->onlru)
+		dsk_lru_rem(sc, seg);
+	if (seg->state == DSK_CLEAN && seg->s.ptr == NULL) {
+		sc->stats->c_cache_miss++;
+		(void)dsk_read(sc, seg, 1);
+	} else if (seg->state == DSK_READING)
+		sc->stats->c_cache_miss++;
+	else
+		sc->stats->c_cache_hit++;
+	dsk_readahead(sc, VTAILQ_NEXT(&seg->s, list));
+	while (seg->state == DSK_READING)
+		(void)Lck_CondWait(&sc->done_cond, &sc->mtx, 0);
+	p = seg->s.ptr;
+	if (p == NULL)
+		seg->refcnt--;
+	Lck_Unlock(&sc->mtx);
+	return (p);
+}
+
+static void
+dsk_put(struct dsk_sc *sc, struct dsk_seg *seg)
+{
+
+	Lck_Lock(&sc->mtx);
+	assert(seg->refcnt > 0);
+	if (--seg->refcnt == 0 && seg->state == DSK_CLEAN) {
+		AN(seg->s.ptr);
+		dsk_lru_add(sc, seg);
+		dsk_cache_trim(sc);
+	}
+	Lck_Unlock(&sc->mtx);
+}
+
+/*--------------------------------------------------------------------*/
+
+static struct storage * __match_proto__(sml_alloc_f)
+dsk_alloc(const struct stevedore *st, size_t size)
+{
+	struct dsk_sc *sc;
+	struct dsk_seg *seg;
+	off_t off, len;
+
+	CAST_OBJ_NOTNULL(sc, st->priv, DSK_SC_MAGIC);
+	assert(size > 0);
+	len = size + (sc->pagesize - 1UL);
+	len &= ~(sc->pagesize - 1UL);
+
+	ALLOC_OBJ(seg, DSK_SEG_MAGIC);
+	if (seg == NULL)
+		return (NULL);
+	seg->s.ptr = malloc(size);
+	if (seg->s.ptr == NULL) {
+		FREE_OBJ(seg);
+		return (NULL);
+	}
+
+	Lck_Lock(&sc->mtx);
+	sc->stats->c_req++;
+	if (!dsk_ext_alloc(sc, len, &off)) {
+		sc->stats->c_fail++;
+		Lck_Unlock(&sc->mtx);
+		free(seg->s.ptr);
+		FREE_OBJ(seg);
+		return (NULL);
+	}
+	sc->stats->g_alloc++;
+	sc->stats->c_bytes += len;
+	sc->stats->g_bytes += len;
+	sc->stats->g_space -= len;
+	Lck_Unlock(&sc->mtx);
+
+	seg->sc = sc;
+	seg->off = off;
+	seg->size = len;
+	seg->buflen = size;
+	seg->s.magic = STORAGE_MAGIC;
+	seg->s.priv = seg;
+	seg->s.space = size;
+	seg->s.len = 0;
+	return (&seg->s);
+}
+
+static void __match_proto__(sml_free_f)
+dsk_free(struct storage *s)
+{
+	struct dsk_seg *seg;
+	struct dsk_sc *sc;
+
+	CHECK_OBJ_NOTNULL(s, STORAGE_MAGIC);
+	CAST_OBJ_NOTNULL(seg, s->priv, DSK_SEG_MAGIC);
+	sc = seg->sc;
+	CHECK_OBJ_NOTNULL(sc, DSK_SC_MAGIC);
+	Lck_Lock(&sc->mtx);
+	AZ(seg->refcnt);
+	sc->stats->g_alloc--;
+	sc->stats->c_freed += seg->size;
+	sc->stats->g_bytes -= seg->size;
+	sc->stats->g_space += seg->size;
+	if (seg->onlru)
+		dsk_lru_rem(sc, seg);
+	if (seg->state == DSK_WRITING || seg->state == DSK_READING)
+		seg->dead = 1;		/* dsk_done() finishes the job */
+	else
+		dsk_seg_destroy(sc, seg);
+	Lck_Unlock(&sc->mtx);
+}
+
+/*--------------------------------------------------------------------
+ * Once the fetch is done and nobody streams from the object any more,
+ * queue the body for writing.  The segments stay where they are until
+ * they are written and then become part of the cache.
+ */
+
+static void __match_proto__(objbocdone_f)
+dsk_bocdone(struct worker *wrk, struct objcore *oc, struct boc *boc)
+{
+	struct dsk_sc *sc;
+	struct dsk_seg *seg;
+	struct object *o;
+	struct storage *st;
+
+	SML_methods.objbocdone(wrk, oc, boc);
+
+	if (boc->state != BOS_FINISHED || (oc->flags & OC_F_PRIVATE))
+		return;
+
+	CAST_OBJ_NOTNULL(o, oc->stobj->priv, OBJECT_MAGIC);
+	CAST_OBJ_NOTNULL(sc, oc->stobj->stevedore->priv, DSK_SC_MAGIC);
+	Lck_Lock(&sc->mtx);
+	VTAILQ_FOREACH(st, &o->list, list) {
+		CAST_OBJ_NOTNULL(seg, st->priv, DSK_SEG_MAGIC);
+		if (st->len == 0 || seg->state != DSK_MEM)
+			continue;
+		seg->state = DSK_WRITING;
+		sc->cache_bytes += seg->buflen;
+		sc->stats->g_cache_bytes = sc->cache_bytes;
+		AN(dsk_submit(sc, seg, 1));
+	}
+	Lck_Unlock(&sc->mtx);
+}
+
+static int __match_proto__(objiterate_f)
+dsk_iterator(struct worker *wrk, struct objcore *oc,
+    void *priv, objiterate_f *func, int final)
+{
+	const struct stevedore *stv;
+	struct dsk_sc *sc;
+	struct dsk_seg *seg;
+	struct object *o;
+	struct storage *st, *stn;
+	struct boc *boc;
+	void *p;
+	int ret = 0;
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+
+	/* Still fetching, everything is in memory */
+	boc = HSH_RefBoc(oc);
+	if (boc != NULL) {
+		ret = SML_methods.objiterator(wrk, oc, priv, func, final);
+		HSH_DerefBoc(wrk, oc);
+		return (ret);
+	}
+
+	stv = oc->stobj->stevedore;
+	CHECK_OBJ_NOTNULL(stv, STEVEDORE_MAGIC);
+	CAST_OBJ_NOTNULL(sc, stv->priv, DSK_SC_MAGIC);
+	CAST_OBJ_NOTNULL(o, oc->stobj->priv, OBJECT_MAGIC);
+
+	VTAILQ_FOREACH_SAFE(st, &o->list, list, stn) {
+		if (ret == 0 && st->len > 0) {
+			CAST_OBJ_NOTNULL(seg, st->priv, DSK_SEG_MAGIC);
+			p = dsk_get(sc, seg);
+			if (p == NULL)
+				ret = -1;
+			else {
+				ret = func(priv, 1, p, st->len);
+				dsk_put(sc, seg);
+			}
+		}
+		if (final) {
+			VTAILQ_REMOVE(&o->list, st, list);
+			stv->sml_free(st);
+		} else if (ret)
+			break;
+	}
+	return (ret);
+}
+
+/*--------------------------------------------------------------------*/
+
+static VCL_BYTES __match_proto__(stv_var_used_space)
+dsk_used_space(const struct stevedore *st)
+{
+	struct dsk_sc *sc;
+
+	CAST_OBJ_NOTNULL(sc, st->priv, DSK_SC_MAGIC);
+	return (sc->filesize - sc->free_bytes);
+}
+
+static VCL_BYTES __match_proto__(stv_var_free_space)
+dsk_free_space(const struct stevedore *st)
+{
+	struct dsk_sc *sc;
+
+	CAST_OBJ_NOTNULL(sc, st->priv, DSK_SC_MAGIC);
+	return (sc->free_bytes);
+}
+
+static void
+dsk_init(struct stevedore *parent, int ac, char * const *av)
+{
+	const char *size, *e;
+	struct dsk_sc *sc;
+	uintmax_t u;
+
+	ASSERT_MGT();
+	AZ(av[ac]);
+	if (ac > 4)
+		ARGV_ERR("(-sdisk) too many arguments\n");
+	if (ac < 1 || *av[0] == '\0')
+		ARGV_ERR("(-sdisk) path is mandatory\n");
+	size = NULL;
+	if (ac > 1 && *av[1] != '\0')
+		size = av[1];
+
+	ALLOC_OBJ(sc, DSK_SC_MAGIC);
+	AN(sc);
+	VRB_INIT(&sc->free_size);
+	VRB_INIT(&sc->free_off);
+	VTAILQ_INIT(&sc->lru);
+	VTAILQ_INIT(&sc->ioq);
+	sc->cache_max = 64 * 1024 * 1024;
+	sc->depth = 8;
+
+	if (ac > 2 && *av[2] != '\0') {
+		e = VNUM_2bytes(av[2], &u, 0);
+		if (e != NULL)
+			ARGV_ERR("(-sdisk) cache size \"%s\": %s\n", av[2], e);
+		if (u != (uintmax_t)(size_t)u)
+			ARGV_ERR("(-sdisk) cache size \"%s\": too big\n",
+			    av[2]);
+		sc->cache_max = u;
+	}
+	if (ac > 3 && *av[3] != '\0') {
+		u = strtoul(av[3], NULL, 0);
+		if (u < 1 || u > DSK_MAXDEPTH)
+			ARGV_ERR("(-sdisk) queue depth \"%s\": "
+			    "must be 1 to %d\n", av[3], DSK_MAXDEPTH);
+		sc->depth = u;
+	}
+
+	sc->pagesize = getpagesize();
+	(void)STV_GetFile(av[0], &sc->fd, &sc->filename, "-sdisk");
+	MCH_Fd_Inherit(sc->fd, "storage_disk");
+	sc->filesize = STV_FileSize(sc->fd, size, &sc->pagesize, "-sdisk");
+	parent->priv = sc;
+}
+
+static void __match_proto__(storage_open_f)
+dsk_open(struct stevedore *st)
+{
+	struct dsk_sc *sc;
+	struct dsk_ext *e;
+	unsigned u;
+
+	ASSERT_CLI();
+	st->lru = LRU_Alloc(st);
+	if (lck_dsk == NULL)
+		lck_dsk = Lck_CreateClass("disk");
+	CAST_OBJ_NOTNULL(sc, st->priv, DSK_SC_MAGIC);
+	Lck_New(&sc->mtx, lck_dsk);
+	AZ(pthread_cond_init(&sc->io_cond, NULL));
+	AZ(pthread_cond_init(&sc->room_cond, NULL));
+	AZ(pthread_cond_init(&sc->done_cond, NULL));
+	sc->stats = VSM_Alloc(sizeof *sc->stats,
+	    VSC_CLASS, VSC_type_disk, st->ident);
+	memset(sc->stats, 0, sizeof *sc->stats);
+
+	ALLOC_OBJ(e, DSK_EXT_MAGIC);
+	AN(e);
+	e->off = 0;
+	e->len = sc->filesize;
+	Lck_Lock(&sc->mtx);
+	dsk_ext_ins(sc, e);
+	Lck_Unlock(&sc->mtx);
+	sc->stats->g_space = sc->filesize;
+
+	sc->thr = calloc(sc->depth, sizeof *sc->thr);
+	AN(sc->thr);
+	for (u = 0; u < sc->depth; u++)
+		WRK_BgThread(&sc->thr[u], "disk-io", dsk_io_thread, sc);
+
+	dsk_methods = SML_methods;
+	dsk_methods.objiterator = dsk_iterator;
+	dsk_methods.objbocdone = dsk_bocdone;
+}
+
+const struct stevedore dsk_stevedore = {
+	.magic		=	STEVEDORE_MAGIC,
+	.name		=	"disk",
+	.init		=	dsk_init,
+	.open		=	dsk_open,
+	.sml_alloc	=	dsk_alloc,
+	.sml_free	=	dsk_free,
+	.allocobj	=	SML_allocobj,
+	.panic		=	SML_panic,
+	.methods	=	&dsk_methods,
+	.var_free_space =	dsk_free_space,
+	.var_used_space =	dsk_used_space,
+};
@@ -44,6 +44,7 @@
 
 #include "vnum.h"
 #include "vfil.h"
+#include "vtree.h"
 
 #ifndef MAP_NOCORE
 #define MAP_NOCORE 0 /* XXX Linux */
@@ -56,13 +57,14 @@
 #define MINPAGES		128
 
 /*
- * Number of buckets on free-list.
- *
- * Last bucket is "larger than" so choose number so that the second
- * to last bucket matches the 128k CHUNKSIZE in cache_fetch.c when
- * using the a 4K minimal page size
+ * Free ranges no larger than this many pages are counted as "small"
+ * in the statistics.  It matches the 128k CHUNKSIZE in cache_fetch.c
+ * when using the a 4K minimal page size
  */
-#define NBUCKET			(128 / 4 + 1)
+#define SMALLPAGES		(128 / 4)
+
+/* Number of struct smf we allocate in one go */
+#define SMF_POOL		64
 
 static struct VSC_C_lck *lck_smf;
 
@@ -84,9 +86,18 @@ struct smf {
 
 	VTAILQ_ENTRY(smf)	order;
 	VTAILQ_ENTRY(smf)	status;
-	struct smfhead		*flist;
+	VRB_ENTRY(smf)		free_link;
 };
 
+/*
+ * Free ranges are kept in a tree ordered by size and then by offset,
+ * so that we can find the smallest range which fits, taking the one
+ * lowest in the file if there are several, in O(log n).  Neighbours,
+ * free or not, are found through the address ordered 'order' list.
+ */
+
+VRB_HEAD(smf_free, smf);
+
 struct smf_sc {
 	unsigned		magic;
 #define SMF_SC_MAGIC		0x52962ee7
@@ -99,10 +110,26 @@ struct smf_sc {
 	uintmax_t		filesize;
 	int			advice;
 	struct smfhead		order;
-	struct smfhead		free[NBUCKET];
+	struct smf_free		free;
+	uintmax_t		free_bytes;
 	struct smfhead		used;
+	struct smfhead		spare;
 };
 
+static inline int
+smf_free_cmp(const struct smf *a, const struct smf *b)
+{
+
+	if (a->size != b->size)
+		return (a->size < b->size ? -1 : 1);
+	if (a->offset != b->offset)
+		return (a->offset < b->offset ? -1 : 1);
+	return (0);
+}
+
+VRB_PROTOTYPE_STATIC(smf_free, smf, free_link, smf_free_cmp)
+VRB_GENERATE_STATIC(smf_free, smf, free_link, smf_free_cmp)
+
 /*--------------------------------------------------------------------*/
 
 static void
@@ -110,7 +137,6 @@ smf_init(struct stevedore *parent, int ac, char * const *av)
 {
 	const char *size, *fn, *r;
 	struct smf_sc *sc;
-	unsigned u;
 	uintmax_t page_size;
 	int advice = MADV_RANDOM;
 
@@ -148,9 +174,9 @@ smf_init(struct stevedore *parent, int ac, char * const *av)
 	ALLOC_OBJ(sc, SMF_SC_MAGIC);
 	XXXAN(sc);
 	VTAILQ_INIT(&sc->order);
-	for (u = 0; u < NBUCKET; u++)
-		VTAILQ_INIT(&sc->free[u]);
+	VRB_INIT(&sc->free);
 	VTAILQ_INIT(&sc->used);
+	VTAILQ_INIT(&sc->spare);
 	sc->pagesize = page_size;
 	sc->advice = advice;
 	parent->priv = sc;
@@ -163,103 +189,129 @@ smf_init(struct stevedore *parent, int ac, char * const *av)
 }
 
 /*--------------------------------------------------------------------
- * Insert/Remove from correct freelist
+ * struct smf comes out of pools of SMF_POOL, which are never returned.
+ */
+
+static struct smf *
+new_smf_struct(struct smf_sc *sc)
+{
+	struct smf *sp;
+	unsigned u;
+
+	Lck_AssertHeld(&sc->mtx);
+	sp = VTAILQ_FIRST(&sc->spare);
+	if (sp == NULL) {
+		sp = calloc(SMF_POOL, sizeof *sp);
+		XXXAN(sp);
+		for (u = 0; u < SMF_POOL; u++)
+			VTAILQ_INSERT_TAIL(&sc->spare, &sp[u], status);
+		sp = VTAILQ_FIRST(&sc->spare);
+	}
+	VTAILQ_REMOVE(&sc->spare, sp, status);
+	INIT_OBJ(sp, SMF_MAGIC);
+	sp->s.magic = STORAGE_MAGIC;
+	sp->sc = sc;
+	sc->stats->g_smf++;
+	return (sp);
+}
+
+static void
+del_smf_struct(struct smf_sc *sc, struct smf *sp)
+{
+
+	Lck_AssertHeld(&sc->mtx);
+	CHECK_OBJ_NOTNULL(sp, SMF_MAGIC);
+	sp->magic = 0;
+	sp->s.magic = 0;
+	VTAILQ_INSERT_HEAD(&sc->spare, sp, status);
+	sc->stats->g_smf--;
+}
+
+/*--------------------------------------------------------------------
+ * Update the gauges describing the free ranges
+ */
+
+static void
+smf_freestats(const struct smf_sc *sc)
+{
+	struct smf *sp;
+	uintmax_t l;
+
+	sp = VRB_MAX(smf_free, &sc->free);
+	l = sp == NULL ? 0 : sp->size;
+	sc->stats->g_smf_largest = l;
+	if (sc->free_bytes == 0)
+		sc->stats->g_smf_fragmentation = 0;
+	else
+		sc->stats->g_smf_fragmentation =
+		    100 - (100 * l) / sc->free_bytes;
+}
+
+/*--------------------------------------------------------------------
+ * Insert/Remove from the free tree
  */
 
 static void
 insfree(struct smf_sc *sc, struct smf *sp)
 {
-	size_t b;
-	struct smf *sp2;
-	size_t ns;
 
 	AZ(sp->alloc);
-	assert(sp->flist == NULL);
 	Lck_AssertHeld(&sc->mtx);
-	b = sp->size / sc->pagesize;
-	if (b >= NBUCKET) {
-		b = NBUCKET - 1;
+	if (sp->size > (off_t)sc->pagesize * SMALLPAGES)
 		sc->stats->g_smf_large++;
-	} else {
-		sc->stats->g_smf_frag++;
-	}
-	sp->flist = &sc->free[b];
-	ns = b * sc->pagesize;
-	VTAILQ_FOREACH(sp2, sp->flist, status) {
-		assert(sp2->size >= ns);
-		AZ(sp2->alloc);
-		assert(sp2->flist == sp->flist);
-		if (sp->offset < sp2->offset)
-			break;
-	}
-	if (sp2 == NULL)
-		VTAILQ_INSERT_TAIL(sp->flist, sp, status);
 	else
-		VTAILQ_INSERT_BEFORE(sp2, sp, status);
+		sc->stats->g_smf_frag++;
+	sc->free_bytes += sp->size;
+	AZ(VRB_INSERT(smf_free, &sc->free, sp));
 }
 
 static void
-remfree(const struct smf_sc *sc, struct smf *sp)
+remfree(struct smf_sc *sc, struct smf *sp)
 {
-	size_t b;
 
 	AZ(sp->alloc);
-	assert(sp->flist != NULL);
 	Lck_AssertHeld(&sc->mtx);
-	b = sp->size / sc->pagesize;
-	if (b >= NBUCKET) {
-		b = NBUCKET - 1;
+	if (sp->size > (off_t)sc->pagesize * SMALLPAGES)
 		sc->stats->g_smf_large--;
-	} else {
+	else
 		sc->stats->g_smf_frag--;
-	}
-	assert(sp->flist == &sc->free[b]);
-	VTAILQ_REMOVE(sp->flist, sp, status);
-	sp->flist = NULL;
+	assert(sc->free_bytes >= sp->size);
+	sc->free_bytes -= sp->size;
+	AN(VRB_REMOVE(smf_free, &sc->free, sp));
 }
 
 /*--------------------------------------------------------------------
- * Allocate a range from the first free range that is large enough.
+ * Allocate a range from the smallest free range that is large enough.
  */
 
 static struct smf *
 alloc_smf(struct smf_sc *sc, size_t bytes)
 {
 	struct smf *sp, *sp2;
-	size_t b;
+	struct smf key;
 
 	AZ(bytes % sc->pagesize);
-	b = bytes / sc->pagesize;
-	if (b >= NBUCKET)
-		b = NBUCKET - 1;
-	sp = NULL;
-	for (; b < NBUCKET - 1; b++) {
-		sp = VTAILQ_FIRST(&sc->free[b]);
-		if (sp != NULL)
-			break;
-	}
-	if (sp == NULL) {
-		VTAILQ_FOREACH(sp, &sc->free[NBUCKET -1], status)
-			if (sp->size >= bytes)
-				break;
-	}
+	key.size = bytes;
+	key.offset = 0;
+	sp = VRB_NFIND(smf_free, &sc->free, &key);
 	if (sp == NULL)
 		return (sp);
 
+	CHECK_OBJ_NOTNULL(sp, SMF_MAGIC);
 	assert(sp->size >= bytes);
 	remfree(sc, sp);
 
 	if (sp->size == bytes) {
 		sp->alloc = 1;
 		VTAILQ_INSERT_TAIL(&sc->used, sp, status);
+		smf_freestats(sc);
 		return (sp);
 	}
 
 	/* Split from front */
-	sp2 = malloc(sizeof *sp2);
-	XXXAN(sp2);
-	sc->stats->g_smf++;
-	*sp2 = *sp;
+	sp2 = new_smf_struct(sc);
+	sp2->ptr = sp->ptr;
+	sp2->offset = sp->offset;
 
 	sp->offset += bytes;
 	sp->ptr += bytes;
@@ -270,12 +322,13 @@ alloc_smf(struct smf_sc *sc, size_t bytes)
 	VTAILQ_INSERT_BEFORE(sp, sp2, order);
 	VTAILQ_INSERT_TAIL(&sc->used, sp2, status);
 	insfree(sc, sp);
+	smf_freestats(sc);
 	return (sp2);
 }
 
 /*--------------------------------------------------------------------
- * Free a range.  Attempt merge forward and backward, then sort into
- * free list according to age.
+ * Free a range.  Attempt merge forward and backward, then put it back
+ * in the free tree.
  */
 
 static void
@@ -299,8 +352,7 @@ free_smf(struct smf *sp)
 		sp->size += sp2->size;
 		VTAILQ_REMOVE(&sc->order, sp2, order);
 		remfree(sc, sp2);
-		free(sp2);
-		sc->stats->g_smf--;
+		del_smf_struct(sc, sp2);
 	}
 
 	sp2 = VTAILQ_PREV(sp, smfhead, order);
@@ -311,12 +363,12 @@ free_smf(struct smf *sp)
 		remfree(sc, sp2);
 		sp2->size += sp->size;
 		VTAILQ_REMOVE(&sc->order, sp, order);
-		free(sp);
-		sc->stats->g_smf--;
+		del_smf_struct(sc, sp);
 		sp = sp2;
 	}
 
 	insfree(sc, sp);
+	smf_freestats(sc);
 }
 
 /*--------------------------------------------------------------------
@@ -329,12 +381,8 @@ new_smf(struct smf_sc *sc, unsigned char *ptr, off_t off, size_t len)
 	struct smf *sp, *sp2;
 
 	AZ(len % sc->pagesize);
-	ALLOC_OBJ(sp, SMF_MAGIC);
-	XXXAN(sp);
-	sp->s.magic = STORAGE_MAGIC;
-	sc->stats->g_smf++;
+	sp = new_smf_struct(sc);
 
-	sp->sc = sc;
 	sp->size = len;
 	sp->ptr = ptr;
 	sp->offset = off;
@@ -406,7 +454,7 @@ smf_open(struct stevedore *st)
 	off_t sum = 0;
 
 	ASSERT_CLI();
-	st->lru = LRU_Alloc();
+	st->lru = LRU_Alloc(st);
 	if (lck_smf == NULL)
 		lck_smf = Lck_CreateClass("smf");
 	CAST_OBJ_NOTNULL(sc, st->priv, SMF_SC_MAGIC);
@@ -484,6 +532,20 @@ smf_free(struct storage *s)
 
 /*--------------------------------------------------------------------*/
 
+static int __match_proto__(sml_extent_f)
+smf_extent(const struct storage *s, int *fd, off_t *off)
+{
+	struct smf *smf;
+
+	CHECK_OBJ_NOTNULL(s, STORAGE_MAGIC);
+	CAST_OBJ_NOTNULL(smf, s->priv, SMF_MAGIC);
+	*fd = smf->sc->fd;
+	*off = smf->offset;
+	return (1);
+}
+
+/*--------------------------------------------------------------------*/
+
 const struct stevedore smf_stevedore = {
 	.magic		=	STEVEDORE_MAGIC,
 	.name		=	"file",
@@ -491,6 +553,7 @@ const struct stevedore smf_stevedore = {
 	.open		=	smf_open,
 	.sml_alloc	=	smf_alloc,
 	.sml_free	=	smf_free,
+	.sml_extent	=	smf_extent,
 	.allocobj	=	SML_allocobj,
 	.panic		=	SML_panic,
 	.methods	=	&SML_methods,
@@ -524,7 +587,7 @@ dumpit(void)
 		    s, s->offset, s->size, s->offset + s->size);
 	}
 	printf("Free:\n");
-	VTAILQ_FOREACH(s, &sc->free, status) {
+	VRB_FOREACH(s, smf_free, &sc->free) {
 		printf("%10p %12ju %12ju %12ju\n",
 		    s, s->offset, s->size, s->offset + s->size);
 	}
@@ -30,6 +30,7 @@
 
 #include "config.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 
 #include "cache/cache.h"
@@ -38,11 +39,21 @@
 
 #include "storage/storage.h"
 
-struct lru {
+struct lrul_shard {
 	unsigned		magic;
-#define LRU_MAGIC		0x3fec7bb0
+#define LRUL_SHARD_MAGIC	0x1e5b6b0a
 	VTAILQ_HEAD(,objcore)	lru_head;
 	struct lock		mtx;
+	struct VSC_C_lru	*stats;
+};
+
+struct lrul {
+	unsigned		magic;
+#define LRUL_MAGIC		0x5dfb1a2c
+	unsigned		clock;
+	unsigned		nshard;
+	unsigned		hand;
+	struct lrul_shard	*shard;
 };
 
 static struct lru *
@@ -54,15 +65,24 @@ lru_get(const struct objcore *oc)
 	return (oc->stobj->stevedore->lru);
 }
 
+/*--------------------------------------------------------------------
+ * The eviction policy is chosen per stevedore, the functions below
+ * only take care of what is common to all of them.
+ */
+
 struct lru *
-LRU_Alloc(void)
+LRU_Alloc(const struct stevedore *stv)
 {
 	struct lru *lru;
 
+	CHECK_OBJ_NOTNULL(stv, STEVEDORE_MAGIC);
 	ALLOC_OBJ(lru, LRU_MAGIC);
 	AN(lru);
-	VTAILQ_INIT(&lru->lru_head);
-	Lck_New(&lru->mtx, lck_lru);
+	lru->policy = stv->lru_policy;
+	if (lru->policy == NULL)
+		lru->policy = &lrul_policy;
+	CHECK_OBJ_NOTNULL(lru->policy, LRU_POLICY_MAGIC);
+	lru->policy->init(lru, stv->ident);
 	return (lru);
 }
 
@@ -72,10 +92,7 @@ LRU_Free(struct lru **pp)
 	struct lru *lru;
 
 	TAKE_OBJ_NOTNULL(lru, pp, LRU_MAGIC);
-	Lck_Lock(&lru->mtx);
-	AN(VTAILQ_EMPTY(&lru->lru_head));
-	Lck_Unlock(&lru->mtx);
-	Lck_Delete(&lru->mtx);
+	lru->policy->fini(lru);
 	FREE_OBJ(lru);
 }
 
@@ -93,12 +110,8 @@ LRU_Add(struct objcore *oc, double now)
 	AN(isnan(oc->last_lru));
 	AZ(isnan(now));
 	lru = lru_get(oc);
-	CHECK_OBJ_NOTNULL(lru, LRU_MAGIC);
-	Lck_Lock(&lru->mtx);
-	VTAILQ_INSERT_TAIL(&lru->lru_head, oc, lru_list);
-	oc->last_lru = now;
+	lru->policy->add(lru, oc, now);
 	AZ(isnan(oc->last_lru));
-	Lck_Unlock(&lru->mtx);
 }
 
 void
@@ -113,12 +126,8 @@ LRU_Remove(struct objcore *oc)
 
 	AZ(oc->boc);
 	lru = lru_get(oc);
-	CHECK_OBJ_NOTNULL(lru, LRU_MAGIC);
-	Lck_Lock(&lru->mtx);
-	AZ(isnan(oc->last_lru));
-	VTAILQ_REMOVE(&lru->lru_head, oc, lru_list);
-	oc->last_lru = NAN;
-	Lck_Unlock(&lru->mtx);
+	lru->policy->remove(lru, oc);
+	AN(isnan(oc->last_lru));
 }
 
 void __match_proto__(objtouch_f)
@@ -132,6 +141,187 @@ LRU_Touch(struct worker *wrk, struct objcore *oc, double now)
 	if (oc->flags & OC_F_PRIVATE || isnan(oc->last_lru))
 		return;
 
+	lru = lru_get(oc);
+	lru->policy->touch(lru, oc, now);
+}
+
+/*--------------------------------------------------------------------
+ * Returns: 1: did, 0: didn't;
+ */
+
+int
+LRU_NukeOne(struct worker *wrk, struct lru *lru)
+{
+	struct objcore *oc;
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	CHECK_OBJ_NOTNULL(lru, LRU_MAGIC);
+
+	oc = lru->policy->nuke(wrk, lru);
+	if (oc == NULL) {
+		VSLb(wrk->vsl, SLT_ExpKill, "LRU_Fail");
+		return (0);
+	}
+
+	/* XXX: We could grab and return one storage segment to our caller */
+	ObjSlim(wrk, oc);
+
+	VSLb(wrk->vsl, SLT_ExpKill, "LRU x=%u", ObjGetXID(wrk, oc));
+	(void)HSH_DerefObjCore(wrk, &oc, 0);	// Ref from HSH_Snipe
+	return (1);
+}
+
+/*--------------------------------------------------------------------
+ * Ask the policy if a new object is worth making room for.
+ *
+ * Returns: 1: go ahead, 0: store it elsewhere
+ */
+
+int
+LRU_Admit(struct worker *wrk, struct lru *lru, const struct objcore *oc)
+{
+
+	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
+	CHECK_OBJ_NOTNULL(lru, LRU_MAGIC);
+	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+
+	if (oc->flags & OC_F_PRIVATE || lru->policy->admit == NULL)
+		return (1);
+	return (lru->policy->admit(wrk, lru, oc));
+}
+
+/*--------------------------------------------------------------------
+ * The "lru" policy.
+ *
+ * With lru_shards set to zero, we keep a single list per stevedore and
+ * move objects to the tail when they are touched.
+ *
+ * Otherwise each stevedore gets that many lists, and objects are kept
+ * in order of insertion with the CLOCK algorithm: the sign of
+ * oc->last_lru serves as the reference bit, touching an object only
+ * sets it, and the nuking hand clears it and gives the object a second
+ * round before it becomes a candidate.  New objects start out with the
+ * reference bit set.
+ */
+
+static struct lrul_shard *
+lrul_shard(const struct lrul *ll, const struct objcore *oc)
+{
+	unsigned u;
+
+	CHECK_OBJ_NOTNULL(ll, LRUL_MAGIC);
+	if (ll->nshard == 1)
+		return (&ll->shard[0]);
+	CHECK_OBJ_NOTNULL(oc->objhead, OBJHEAD_MAGIC);
+	memcpy(&u, oc->objhead->digest + sizeof u, sizeof u);
+	return (&ll->shard[u % ll->nshard]);
+}
+
+static void __match_proto__(lru_init_f)
+lrul_init(struct lru *lru, const char *ident)
+{
+	struct lrul *ll;
+	struct lrul_shard *sh;
+	char buf[32];
+	unsigned u;
+
+	CHECK_OBJ_NOTNULL(lru, LRU_MAGIC);
+	AN(ident);
+	ALLOC_OBJ(ll, LRUL_MAGIC);
+	AN(ll);
+	ll->clock = cache_param->lru_shards > 0;
+	ll->nshard = ll->clock ? cache_param->lru_shards : 1;
+	ll->shard = calloc(ll->nshard, sizeof *ll->shard);
+	AN(ll->shard);
+	for (u = 0; u < ll->nshard; u++) {
+		sh = &ll->shard[u];
+		sh->magic = LRUL_SHARD_MAGIC;
+		VTAILQ_INIT(&sh->lru_head);
+		Lck_New(&sh->mtx, lck_lru);
+		if (ll->clock)
+			bprintf(buf, "%s.%u", ident, u);
+		else
+			bprintf(buf, "%s", ident);
+		sh->stats = VSM_Alloc(sizeof *sh->stats,
+		    VSC_CLASS, VSC_type_lru, buf);
+		AN(sh->stats);
+		memset(sh->stats, 0, sizeof *sh->stats);
+	}
+	lru->priv = ll;
+}
+
+static void __match_proto__(lru_fini_f)
+lrul_fini(struct lru *lru)
+{
+	struct lrul *ll;
+	struct lrul_shard *sh;
+	unsigned u;
+
+	CHECK_OBJ_NOTNULL(lru, LRU_MAGIC);
+	CAST_OBJ_NOTNULL(ll, lru->priv, LRUL_MAGIC);
+	lru->priv = NULL;
+	for (u = 0; u < ll->nshard; u++) {
+		sh = &ll->shard[u];
+		CHECK_OBJ(sh, LRUL_SHARD_MAGIC);
+		Lck_Lock(&sh->mtx);
+		AN(VTAILQ_EMPTY(&sh->lru_head));
+		Lck_Unlock(&sh->mtx);
+		Lck_Delete(&sh->mtx);
+		VSM_Free(sh->stats);
+	}
+	free(ll->shard);
+	FREE_OBJ(ll);
+}
+
+static void __match_proto__(lru_add_f)
+lrul_add(struct lru *lru, struct objcore *oc, double now)
+{
+	struct lrul *ll;
+	struct lrul_shard *sh;
+
+	CAST_OBJ_NOTNULL(ll, lru->priv, LRUL_MAGIC);
+	sh = lrul_shard(ll, oc);
+	Lck_Lock(&sh->mtx);
+	VTAILQ_INSERT_TAIL(&sh->lru_head, oc, lru_list);
+	sh->stats->g_objects++;
+	oc->last_lru = now;
+	Lck_Unlock(&sh->mtx);
+}
+
+static void __match_proto__(lru_remove_f)
+lrul_remove(struct lru *lru, struct objcore *oc)
+{
+	struct lrul *ll;
+	struct lrul_shard *sh;
+
+	CAST_OBJ_NOTNULL(ll, lru->priv, LRUL_MAGIC);
+	sh = lrul_shard(ll, oc);
+	Lck_Lock(&sh->mtx);
+	AZ(isnan(oc->last_lru));
+	VTAILQ_REMOVE(&sh->lru_head, oc, lru_list);
+	sh->stats->g_objects--;
+	oc->last_lru = NAN;
+	Lck_Unlock(&sh->mtx);
+}
+
+static void __match_proto__(lru_touch_f)
+lrul_touch(struct lru *lru, struct objcore *oc, double now)
+{
+	struct lrul *ll;
+	struct lrul_shard *sh;
+
+	CAST_OBJ_NOTNULL(ll, lru->priv, LRUL_MAGIC);
+
+	if (ll->clock) {
+		/*
+		 * Set the reference bit without any locking.  Losing a
+		 * race against the hand only costs a second chance.
+		 */
+		if (oc->last_lru < 0)
+			oc->last_lru = now;
+		return;
+	}
+
 	/*
 	 * To avoid the exphdl->mtx becoming a hotspot, we only
 	 * attempt to move objects if they have not been moved
@@ -142,62 +332,116 @@ LRU_Touch(struct worker *wrk, struct objcore *oc, double now)
 	if (now - oc->last_lru < cache_param->lru_interval)
 		return;
 
-	lru = lru_get(oc);
-	CHECK_OBJ_NOTNULL(lru, LRU_MAGIC);
+	sh = lrul_shard(ll, oc);
 
-	if (Lck_Trylock(&lru->mtx))
+	if (Lck_Trylock(&sh->mtx))
 		return;
 
 	if (!isnan(oc->last_lru)) {
-		VTAILQ_REMOVE(&lru->lru_head, oc, lru_list);
-		VTAILQ_INSERT_TAIL(&lru->lru_head, oc, lru_list);
-		VSC_C_main->n_lru_moved++;
+		VTAILQ_REMOVE(&sh->lru_head, oc, lru_list);
+		VTAILQ_INSERT_TAIL(&sh->lru_head, oc, lru_list);
+		VSC_Shard()->n_lru_moved++;
+		sh->stats->c_moved++;
 		oc->last_lru = now;
 	}
-	Lck_Unlock(&lru->mtx);
+	Lck_Unlock(&sh->mtx);
 }
 
 /*--------------------------------------------------------------------
  * Attempt to make space by nuking the oldest object on the LRU list
  * which isn't in use.
- * Returns: 1: did, 0: didn't;
  */
 
-int
-LRU_NukeOne(struct worker *wrk, struct lru *lru)
+static struct objcore *
+lrul_nuke_shard(struct worker *wrk, const struct lrul *ll,
+    struct lrul_shard *sh)
 {
 	struct objcore *oc, *oc2;
-
-	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
-	CHECK_OBJ_NOTNULL(lru, LRU_MAGIC);
-
-	/* Find the first currently unused object on the LRU.  */
-	Lck_Lock(&lru->mtx);
-	VTAILQ_FOREACH_SAFE(oc, &lru->lru_head, lru_list, oc2) {
-		CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
-		AZ(isnan(oc->last_lru));
-
-		VSLb(wrk->vsl, SLT_ExpKill, "LRU_Cand p=%p f=0x%x r=%d",
-		    oc, oc->flags, oc->refcnt);
-
-		if (HSH_Snipe(wrk, oc)) {
-			VSC_C_main->n_lru_nuked++; // XXX per lru ?
-			VTAILQ_REMOVE(&lru->lru_head, oc, lru_list);
-			VTAILQ_INSERT_TAIL(&lru->lru_head, oc, lru_list);
-			break;
+	uint64_t n;
+
+	Lck_Lock(&sh->mtx);
+	if (!ll->clock) {
+		/* Find the first currently unused object on the LRU.  */
+		VTAILQ_FOREACH_SAFE(oc, &sh->lru_head, lru_list, oc2) {
+			CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+			AZ(isnan(oc->last_lru));
+
+			VSLb(wrk->vsl, SLT_ExpKill, "LRU_Cand p=%p f=0x%x r=%d",
+			    oc, oc->flags, oc->refcnt);
+
+			if (HSH_Snipe(wrk, oc)) {
+				VTAILQ_REMOVE(&sh->lru_head, oc, lru_list);
+				VTAILQ_INSERT_TAIL(&sh->lru_head, oc, lru_list);
+				break;
+			}
 		}
+	} else {
+		/*
+		 * Sweep the hand until we find an unreferenced, unused
+		 * object.  Two full rounds clear every reference bit, so
+		 * if nothing turned up by then, everything is in use.
+		 */
+		oc = NULL;
+		for (n = 2 * sh->stats->g_objects; n > 0; n--) {
+			oc = VTAILQ_FIRST(&sh->lru_head);
+			CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+			AZ(isnan(oc->last_lru));
+			VTAILQ_REMOVE(&sh->lru_head, oc, lru_list);
+			VTAILQ_INSERT_TAIL(&sh->lru_head, oc, lru_list);
+			if (oc->last_lru > 0) {
+				oc->last_lru = -oc->last_lru;
+				VSC_Shard()->n_lru_moved++;
+				sh->stats->c_moved++;
+				continue;
+			}
+
+			VSLb(wrk->vsl, SLT_ExpKill, "LRU_Cand p=%p f=0x%x r=%d",
+			    oc, oc->flags, oc->refcnt);
+
+			if (HSH_Snipe(wrk, oc))
+				break;
+		}
+		if (n == 0)
+			oc = NULL;
 	}
-	Lck_Unlock(&lru->mtx);
-
-	if (oc == NULL) {
-		VSLb(wrk->vsl, SLT_ExpKill, "LRU_Fail");
-		return (0);
-	}
+	if (oc != NULL) {
+		VSC_Shard()->n_lru_nuked++;
+		sh->stats->c_nuked++;
+	} else
+		sh->stats->c_failed++;
+	Lck_Unlock(&sh->mtx);
+	return (oc);
+}
 
-	/* XXX: We could grab and return one storage segment to our caller */
-	ObjSlim(wrk, oc);
+/*
+ * With multiple shards, we start where the previous nuke left off and
+ * only move on to the next shard if this one has nothing to give.
+ */
 
-	VSLb(wrk->vsl, SLT_ExpKill, "LRU x=%u", ObjGetXID(wrk, oc));
-	(void)HSH_DerefObjCore(wrk, &oc, 0);	// Ref from HSH_Snipe
-	return (1);
+static struct objcore * __match_proto__(lru_nuke_f)
+lrul_nuke(struct worker *wrk, struct lru *lru)
+{
+	struct lrul *ll;
+	struct objcore *oc;
+	unsigned u, n;
+
+	CAST_OBJ_NOTNULL(ll, lru->priv, LRUL_MAGIC);
+
+	oc = NULL;
+	u = ll->hand++;		/* racy, but only used to spread the load */
+	for (n = 0; oc == NULL && n < ll->nshard; n++)
+		oc = lrul_nuke_shard(wrk, ll,
+		    &ll->shard[(u + n) % ll->nshard]);
+	return (oc);
 }
+
+const struct lru_policy lrul_policy = {
+	.magic =	LRU_POLICY_MAGIC,
+	.name =		"lru",
+	.init =		lrul_init,
+	.fini =		lrul_fini,
+	.add =		lrul_add,
+	.remove =	lrul_remove,
+	.touch =	lrul_touch,
+	.nuke =		lrul_nuke,
+};
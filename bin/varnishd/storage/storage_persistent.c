@@ -505,7 +505,7 @@ smp_allocx(const struct stevedore *st, size_t min_size, size_t max_size,
 
 static int __match_proto__(storage_allocobj_f)
 smp_allocobj(struct worker *wrk, const struct stevedore *stv,
-    struct objcore *oc, unsigned wsl, int nuke_limit)
+    struct objcore *oc, unsigned wsl, unsigned bodylen, int nuke_limit)
 {
 	struct object *o;
 	struct storage *st;
@@ -519,6 +519,7 @@ smp_allocobj(struct worker *wrk, const struct stevedore *stv,
 	CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
 	CAST_OBJ_NOTNULL(sc, stv->priv, SMP_SC_MAGIC);
 	assert(nuke_limit >= 0);
+	(void)bodylen;
 
 	/* Don't entertain already dead objects */
 	if (oc->flags & OC_F_DYING)
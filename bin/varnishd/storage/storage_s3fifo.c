@@ -0,0 +1,403 @@
+/*-
+ * Copyright (c) 2017 Varnish Software AS
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * S3-FIFO eviction with TinyLFU style admission.
+ *
+ * Objects enter a small probationary FIFO, and only move on to the main
+ * FIFO if they are hit while on probation.  Objects leaving the main
+ * FIFO get reinserted as long as they have been hit since they last
+ * passed the head, with the hit count capped at three and decremented
+ * on every pass.  The hit counts come from oc->hits, oc->last_lru holds
+ * a snapshot of it, and its sign tells which queue the object is on.
+ *
+ * A count-min sketch over the object digests stands in for the ghost
+ * queue: objects which have been seen recently go straight to the main
+ * FIFO.  The same sketch is used to decide if a new object is worth
+ * more than the one it would push out; if not, nothing is evicted and
+ * the fetch falls back to Transient storage.
+ *
+ * The sketch is updated without locking on hits, so the counts are
+ * somewhat approximate under contention.  That is fine for a
+ * frequency estimate.
+ */
+
+#include "config.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "cache/cache.h"
+#include "hash/hash_slinger.h"
+
+#include "storage/storage.h"
+
+#define S3F_ROWS	4
+#define S3F_WIDTH	(1U << 18)
+#define S3F_CMAX	15
+#define S3F_SAMPLE	(8U * S3F_WIDTH)
+#define S3F_SNAPMASK	((1L << 23) - 1)	/* float holds 24 bits */
+#define S3F_MAXFREQ	3
+
+struct s3f {
+	unsigned		magic;
+#define S3F_MAGIC		0x0c8cbd83
+	struct lock		mtx;
+	VTAILQ_HEAD(,objcore)	small;
+	VTAILQ_HEAD(,objcore)	main;
+	struct VSC_C_lru	*stats;
+	unsigned		nadd;
+	uint8_t			*sketch;
+	unsigned		pressure;
+	uint64_t		last_nuked;
+};
+
+/*--------------------------------------------------------------------
+ * Count-min sketch, indexed by the object digest.
+ */
+
+static uint8_t *
+s3f_cell(const struct s3f *s3, const struct objcore *oc, unsigned row)
+{
+	uint32_t u;
+
+	CHECK_OBJ_NOTNULL(oc->objhead, OBJHEAD_MAGIC);
+	memcpy(&u, oc->objhead->digest + 8 + row * sizeof u, sizeof u);
+	return (s3->sketch + row * S3F_WIDTH + (u & (S3F_WIDTH - 1)));
+}
+
+static unsigned
+s3f_estimate(const struct s3f *s3, const struct objcore *oc)
+{
+	unsigned r, n, m;
+
+	m = S3F_CMAX;
+	for (r = 0; r < S3F_ROWS; r++) {
+		n = *s3f_cell(s3, oc, r);
+		if (n < m)
+			m = n;
+	}
+	return (m);
+}
+
+/* Conservative update: only raise the cells holding the minimum */
+static void
+s3f_count(struct s3f *s3, const struct objcore *oc)
+{
+	unsigned r, m;
+	uint8_t *p;
+
+	m = s3f_estimate(s3, oc);
+	if (m == S3F_CMAX)
+		return;
+	for (r = 0; r < S3F_ROWS; r++) {
+		p = s3f_cell(s3, oc, r);
+		if (*p == m)
+			*p = m + 1;
+	}
+	s3->nadd++;
+}
+
+/* Halve all counters so old popularity fades.  Must hold s3->mtx */
+static void
+s3f_age(struct s3f *s3)
+{
+	unsigned u;
+
+	Lck_AssertHeld(&s3->mtx);
+	if (s3->nadd < S3F_SAMPLE)
+		return;
+	for (u = 0; u < S3F_ROWS * S3F_WIDTH; u++)
+		s3->sketch[u] >>= 1;
+	s3->nadd = 0;
+}
+
+/*--------------------------------------------------------------------
+ * Per object hit tracking through oc->last_lru
+ */
+
+static void
+s3f_mark(struct objcore *oc, int main_q, long hits)
+{
+	float f;
+
+	f = (float)((hits & S3F_SNAPMASK) + 1);
+	oc->last_lru = main_q ? f : -f;
+}
+
+static unsigned
+s3f_freq(const struct objcore *oc)
+{
+	long l;
+
+	AZ(isnan(oc->last_lru));
+	l = (long)fabsf(oc->last_lru) - 1;
+	l = (oc->hits - l) & S3F_SNAPMASK;
+	return (l > S3F_MAXFREQ ? S3F_MAXFREQ : (unsigned)l);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void __match_proto__(lru_init_f)
+s3f_init(struct lru *lru, const char *ident)
+{
+	struct s3f *s3;
+
+	CHECK_OBJ_NOTNULL(lru, LRU_MAGIC);
+	AN(ident);
+	ALLOC_OBJ(s3, S3F_MAGIC);
+	AN(s3);
+	Lck_New(&s3->mtx, lck_lru);
+	VTAILQ_INIT(&s3->small);
+	VTAILQ_INIT(&s3->main);
+	s3->sketch = calloc(S3F_ROWS, S3F_WIDTH);
+	AN(s3->sketch);
+	s3->stats = VSM_Alloc(sizeof *s3->stats,
+	    VSC_CLASS, VSC_type_lru, ident);
+	AN(s3->stats);
+	memset(s3->stats, 0, sizeof *s3->stats);
+	lru->priv = s3;
+}
+
+static void __match_proto__(lru_fini_f)
+s3f_fini(struct lru *lru)
+{
+	struct s3f *s3;
+
+	CHECK_OBJ_NOTNULL(lru, LRU_MAGIC);
+	CAST_OBJ_NOTNULL(s3, lru->priv, S3F_MAGIC);
+	lru->priv = NULL;
+	Lck_Lock(&s3->mtx);
+	AN(VTAILQ_EMPTY(&s3->small));
+	AN(VTAILQ_EMPTY(&s3->main));
+	Lck_Unlock(&s3->mtx);
+	Lck_Delete(&s3->mtx);
+	VSM_Free(s3->stats);
+	free(s3->sketch);
+	FREE_OBJ(s3);
+}
+
+static void __match_proto__(lru_add_f)
+s3f_add(struct lru *lru, struct objcore *oc, double now)
+{
+	struct s3f *s3;
+
+	CAST_OBJ_NOTNULL(s3, lru->priv, S3F_MAGIC);
+	(void)now;
+	Lck_Lock(&s3->mtx);
+	s3f_count(s3, oc);
+	if (s3f_estimate(s3, oc) > 1) {
+		/* Seen before, skip probation */
+		VTAILQ_INSERT_TAIL(&s3->main, oc, lru_list);
+		s3f_mark(oc, 1, oc->hits);
+	} else {
+		VTAILQ_INSERT_TAIL(&s3->small, oc, lru_list);
+		s3f_mark(oc, 0, oc->hits);
+		s3->stats->g_small++;
+	}
+	s3->stats->g_objects++;
+	s3f_age(s3);
+
+	/* Admission only kicks in if we had to evict to get here */
+	s3->pressure = s3->stats->c_nuked != s3->last_nuked;
+	s3->last_nuked = s3->stats->c_nuked;
+	Lck_Unlock(&s3->mtx);
+}
+
+static void __match_proto__(lru_remove_f)
+s3f_remove(struct lru *lru, struct objcore *oc)
+{
+	struct s3f *s3;
+
+	CAST_OBJ_NOTNULL(s3, lru->priv, S3F_MAGIC);
+	Lck_Lock(&s3->mtx);
+	AZ(isnan(oc->last_lru));
+	if (oc->last_lru > 0) {
+		VTAILQ_REMOVE(&s3->main, oc, lru_list);
+	} else {
+		VTAILQ_REMOVE(&s3->small, oc, lru_list);
+		s3->stats->g_small--;
+	}
+	s3->stats->g_objects--;
+	oc->last_lru = NAN;
+	Lck_Unlock(&s3->mtx);
+}
+
+static void __match_proto__(lru_touch_f)
+s3f_touch(struct lru *lru, struct objcore *oc, double now)
+{
+	struct s3f *s3;
+
+	CAST_OBJ_NOTNULL(s3, lru->priv, S3F_MAGIC);
+	(void)now;
+
+	/*
+	 * The queues themselves only look at oc->hits, the sketch
+	 * needs to know about the hits too.  The delivery of the miss
+	 * was already counted when the object was added.
+	 */
+	if (oc->hits == 0)
+		return;
+	s3f_count(s3, oc);
+	if (s3->nadd >= S3F_SAMPLE && !Lck_Trylock(&s3->mtx)) {
+		s3f_age(s3);
+		Lck_Unlock(&s3->mtx);
+	}
+}
+
+/*--------------------------------------------------------------------
+ * Find the next object to evict: take from the small FIFO while it
+ * holds more than a tenth of the objects, else from the main FIFO.
+ * Objects with hits get promoted or reinserted instead.  The victim
+ * is left at the head of its queue.
+ */
+
+static struct objcore *
+s3f_victim(struct s3f *s3)
+{
+	struct objcore *oc;
+	unsigned f;
+	uint64_t n;
+
+	Lck_AssertHeld(&s3->mtx);
+	for (n = 2 * s3->stats->g_objects + 1; n > 0; n--) {
+		if (!VTAILQ_EMPTY(&s3->small) && (VTAILQ_EMPTY(&s3->main) ||
+		    s3->stats->g_small * 10 >= s3->stats->g_objects)) {
+			oc = VTAILQ_FIRST(&s3->small);
+			CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+			f = s3f_freq(oc);
+			if (f == 0)
+				return (oc);
+			VTAILQ_REMOVE(&s3->small, oc, lru_list);
+			VTAILQ_INSERT_TAIL(&s3->main, oc, lru_list);
+			s3f_mark(oc, 1, oc->hits);
+			s3->stats->g_small--;
+			s3->stats->c_promoted++;
+		} else {
+			oc = VTAILQ_FIRST(&s3->main);
+			if (oc == NULL)
+				return (NULL);
+			CHECK_OBJ_NOTNULL(oc, OBJCORE_MAGIC);
+			f = s3f_freq(oc);
+			if (f == 0)
+				return (oc);
+			VTAILQ_REMOVE(&s3->main, oc, lru_list);
+			VTAILQ_INSERT_TAIL(&s3->main, oc, lru_list);
+			s3f_mark(oc, 1, oc->hits - (f - 1));
+			VSC_Shard()->n_lru_moved++;
+			s3->stats->c_moved++;
+		}
+	}
+	return (NULL);
+}
+
+static struct objcore * __match_proto__(lru_nuke_f)
+s3f_nuke(struct worker *wrk, struct lru *lru)
+{
+	struct s3f *s3;
+	struct objcore *oc;
+	uint64_t n;
+
+	CAST_OBJ_NOTNULL(s3, lru->priv, S3F_MAGIC);
+
+	Lck_Lock(&s3->mtx);
+	for (n = s3->stats->g_objects; n > 0; n--) {
+		oc = s3f_victim(s3);
+		if (oc == NULL)
+			break;
+
+		VSLb(wrk->vsl, SLT_ExpKill, "LRU_Cand p=%p f=0x%x r=%d",
+		    oc, oc->flags, oc->refcnt);
+
+		/* Out of the way, whether it goes or is in use */
+		if (oc->last_lru > 0) {
+			VTAILQ_REMOVE(&s3->main, oc, lru_list);
+			VTAILQ_INSERT_TAIL(&s3->main, oc, lru_list);
+		} else {
+			VTAILQ_REMOVE(&s3->small, oc, lru_list);
+			VTAILQ_INSERT_TAIL(&s3->small, oc, lru_list);
+		}
+
+		if (HSH_Snipe(wrk, oc)) {
+			VSC_Shard()->n_lru_nuked++;
+			s3->stats->c_nuked++;
+			Lck_Unlock(&s3->mtx);
+			return (oc);
+		}
+	}
+	s3->stats->c_failed++;
+	Lck_Unlock(&s3->mtx);
+	return (NULL);
+}
+
+/*--------------------------------------------------------------------
+ * Admission: while we are evicting, a new object only gets in if it
+ * has been asked for more often than the object it would replace.
+ * Only a refusal counts as an access here, an admitted object is
+ * counted when it is added.
+ */
+
+static int __match_proto__(lru_admit_f)
+s3f_admit(struct worker *wrk, struct lru *lru, const struct objcore *oc)
+{
+	struct s3f *s3;
+	struct objcore *victim;
+	unsigned c, v;
+
+	CAST_OBJ_NOTNULL(s3, lru->priv, S3F_MAGIC);
+
+	if (!s3->pressure)
+		return (1);
+
+	Lck_Lock(&s3->mtx);
+	victim = s3f_victim(s3);
+	if (victim == NULL) {
+		Lck_Unlock(&s3->mtx);
+		return (1);
+	}
+	c = s3f_estimate(s3, oc) + 1;
+	v = s3f_estimate(s3, victim);
+	if (c > v) {
+		Lck_Unlock(&s3->mtx);
+		return (1);
+	}
+	s3f_count(s3, oc);
+	s3f_age(s3);
+	s3->stats->c_rejected++;
+	Lck_Unlock(&s3->mtx);
+	VSLb(wrk->vsl, SLT_ExpKill, "LRU_Reject p=%p c=%u v=%u", victim, c, v);
+	return (0);
+}
+
+const struct lru_policy s3f_policy = {
+	.magic =	LRU_POLICY_MAGIC,
+	.name =		"s3fifo",
+	.init =		s3f_init,
+	.fini =		s3f_fini,
+	.add =		s3f_add,
+	.remove =	s3f_remove,
+	.touch =	s3f_touch,
+	.nuke =		s3f_nuke,
+	.admit =	s3f_admit,
+};
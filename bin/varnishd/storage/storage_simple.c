@@ -45,6 +45,9 @@
 /* Flags for allocating memory in sml_stv_alloc */
 #define LESS_MEM_ALLOCED_IS_OK	1
 
+/* Marks a body storage which lives inside the objects own allocation */
+static const uint8_t sml_bodystore_priv;
+
 /*-------------------------------------------------------------------*/
 
 static struct storage *
@@ -89,6 +92,8 @@ sml_stv_free(const struct stevedore *stv, struct storage *st)
 
 	CHECK_OBJ_NOTNULL(stv, STEVEDORE_MAGIC);
 	CHECK_OBJ_NOTNULL(st, STORAGE_MAGIC);
+	if (st->priv == &sml_bodystore_priv)
+		return;		/* Goes with the objstore */
 	if (stv->sml_free != NULL)
 		stv->sml_free(st);
 }
@@ -123,6 +128,50 @@ SML_MkObject(const struct stevedore *stv, struct objcore *oc, void *ptr)
 	return (o);
 }
 
+/*--------------------------------------------------------------------
+ * If the length of the body is known, try to get the object and the
+ * body in one allocation.  The body gets a struct storage of its own
+ * in the tail of the allocation, and the objstore is shortened so the
+ * variable attributes cannot spill into it.  The full size is kept in
+ * stobj->priv2 until the objstore is freed.  We do not nuke for this,
+ * if the storage is tight the ordinary chunked path is better anyway.
+ *
+ * Only private objects get this: LRU nuking relies on ObjSlim() giving
+ * the body storage back right away, and here the body can only go when
+ * the object does.  Stevedores with their own object methods manage
+ * the body storage themselves, and do not get it either.
+ *
+ * Should the body turn out longer than promised, sml_getspace() simply
+ * chains ordinary chunks after the body storage.
+ */
+
+static struct storage *
+sml_allocbody(const struct stevedore *stv, unsigned lobj, unsigned bodylen)
+{
+	struct storage *st, *bst;
+	size_t ltot;
+
+	ltot = (size_t)lobj + PRNDUP(sizeof *bst) + bodylen;
+	if (ltot > cache_param->fetch_maxchunksize || ltot > UINT_MAX)
+		return (NULL);
+	st = stv->sml_alloc(stv, ltot);
+	if (st == NULL)
+		return (NULL);
+	if (st->space < ltot) {
+		stv->sml_free(st);
+		return (NULL);
+	}
+	bst = (void*)(st->ptr + lobj);
+	assert(PAOK(bst));
+	INIT_OBJ(bst, STORAGE_MAGIC);
+	bst->priv = TRUST_ME(&sml_bodystore_priv);
+	bst->ptr = st->ptr + lobj + PRNDUP(sizeof *bst);
+	bst->space = st->space - (lobj + PRNDUP(sizeof *bst));
+	bst->len = 0;
+	st->space = lobj;
+	return (st);
+}
+
 /*--------------------------------------------------------------------
  * This is the default ->allocobj() which all stevedores who do not
  * implement persistent storage can rely on.
@@ -130,10 +179,11 @@ SML_MkObject(const struct stevedore *stv, struct objcore *oc, void *ptr)
 
 int __match_proto__(storage_allocobj_f)
 SML_allocobj(struct worker *wrk, const struct stevedore *stv,
-    struct objcore *oc, unsigned wsl, int nuke_limit)
+    struct objcore *oc, unsigned wsl, unsigned bodylen, int nuke_limit)
 {
 	struct object *o;
 	struct storage *st = NULL;
+	struct storage *bst = NULL;
 	unsigned ltot;
 
 	CHECK_OBJ_NOTNULL(wrk, WORKER_MAGIC);
@@ -143,8 +193,21 @@ SML_allocobj(struct worker *wrk, const struct stevedore *stv,
 	AN(stv->sml_alloc);
 	assert(nuke_limit >= 0);
 
+	/* Transient has nowhere else to go */
+	if (stv->lru != NULL && stv != stv_transient &&
+	    !LRU_Admit(wrk, stv->lru, oc))
+		return (0);
+
 	ltot = sizeof(struct object) + PRNDUP(wsl);
-	for (; nuke_limit >= 0; nuke_limit--) {
+	if (bodylen > 0 && (oc->flags & OC_F_PRIVATE) &&
+	    stv->methods == &SML_methods) {
+		st = sml_allocbody(stv, PRNDUP(ltot), bodylen);
+		if (st != NULL) {
+			bst = (void*)(st->ptr + PRNDUP(ltot));
+			wrk->stats->obj_onepiece++;
+		}
+	}
+	for (; st == NULL && nuke_limit >= 0; nuke_limit--) {
 		st = stv->sml_alloc(stv, ltot);
 		if (st != NULL && st->space < ltot) {
 			stv->sml_free(st);
@@ -160,6 +223,11 @@ SML_allocobj(struct worker *wrk, const struct stevedore *stv,
 	CHECK_OBJ_NOTNULL(o, OBJECT_MAGIC);
 	st->len = sizeof(*o);
 	o->objstore = st;
+	if (bst != NULL) {
+		CHECK_OBJ_NOTNULL(bst, STORAGE_MAGIC);
+		oc->stobj->priv2 = pdiff(st->ptr, bst->ptr + bst->space);
+		VTAILQ_INSERT_TAIL(&o->list, bst, list);
+	}
 	return (1);
 }
 
@@ -226,6 +294,11 @@ sml_objfree(struct worker *wrk, struct objcore *oc)
 	if (oc->boc == NULL && oc->stobj->stevedore->lru != NULL)
 		LRU_Remove(oc);
 
+	if (oc->stobj->priv2 != 0) {
+		/* Give the objstore back its full size */
+		assert(oc->stobj->priv2 > o->objstore->space);
+		o->objstore->space = oc->stobj->priv2;
+	}
 	sml_stv_free(oc->stobj->stevedore, o->objstore);
 
 	memset(oc->stobj, 0, sizeof oc->stobj);
@@ -334,6 +407,54 @@ sml_iterator(struct worker *wrk, struct objcore *oc,
 	return (ret);
 }
 
+/*--------------------------------------------------------------------
+ * Hand out body segments as file ranges if the stevedore has them.
+ * While the object is still being fetched we leave it to the normal
+ * iterator, the file may not have the data yet.
+ */
+
+static int __match_proto__(objiteratorfd_f)
+sml_iterator_fd(struct worker *wrk, struct objcore *oc,
+    void *priv, objiterate_f *func, objiteratefd_f *ffunc)
+{
+	struct boc *boc;
+	struct object *obj;
+	struct storage *st;
+	const struct stevedore *stv;
+	int ret = 0;
+	int fd, fdok;
+	off_t off;
+
+	stv = oc->stobj->stevedore;
+	CHECK_OBJ_NOTNULL(stv, STEVEDORE_MAGIC);
+
+	boc = HSH_RefBoc(oc);
+	if (boc != NULL || stv->sml_extent == NULL) {
+		ret = stv->methods->objiterator(wrk, oc, priv, func, 0);
+		if (boc != NULL)
+			HSH_DerefBoc(wrk, oc);
+		return (ret);
+	}
+
+	obj = sml_getobj(wrk, oc);
+	CHECK_OBJ_NOTNULL(obj, OBJECT_MAGIC);
+	VTAILQ_FOREACH(st, &obj->list, list) {
+		if (st->len == 0)
+			continue;
+		if (st->priv != &sml_bodystore_priv)
+			fdok = stv->sml_extent(st, &fd, &off);
+		else if ((fdok = stv->sml_extent(obj->objstore, &fd, &off)))
+			off += pdiff(obj->objstore->ptr, st->ptr);
+		if (fdok)
+			ret = ffunc(priv, fd, off, st->len);
+		else
+			ret = func(priv, 1, st->ptr, st->len);
+		if (ret)
+			break;
+	}
+	return (ret);
+}
+
 /*--------------------------------------------------------------------
  */
 
@@ -464,6 +585,9 @@ sml_trimstore(struct worker *wrk, struct objcore *oc)
 	if (st->space - st->len < 512)
 		return;
 
+	if (st->priv == &sml_bodystore_priv)
+		return;		/* Cannot give back part of the objstore */
+
 	st1 = sml_stv_alloc(stv, st->len, 0);
 	if (st1 == NULL)
 		return;
@@ -637,6 +761,7 @@ const struct obj_methods SML_methods = {
 	.objgetattr	= sml_getattr,
 	.objsetattr	= sml_setattr,
 	.objtouch	= LRU_Touch,
+	.objiteratorfd	= sml_iterator_fd,
 };
 
 static void
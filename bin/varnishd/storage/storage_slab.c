@@ -0,0 +1,624 @@
+/*-
+ * Copyright (c) 2017 Varnish Software AS
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * Storage method carving a single memory region into size classes.
+ *
+ * The region is split into 2MB pages, which are handed to size classes
+ * on demand and returned once all their chunks are free again.  Classes
+ * go in steps of a quarter of a power of two, from 64 bytes to 1MB, and
+ * the struct storage lives at the start of each chunk.  Each thread
+ * keeps a small cache of free chunks per class, so most allocations and
+ * frees take no lock at all.
+ *
+ * Chunks sitting in thread caches count as allocated in the statistics.
+ */
+
+#include "config.h"
+
+#include "cache/cache.h"
+
+#include <sys/mman.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "storage/storage.h"
+#include "storage/storage_simple.h"
+
+#include "vrt.h"
+#include "vnum.h"
+
+#ifndef MAP_NOCORE
+#define MAP_NOCORE 0 /* XXX Linux */
+#endif
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+#define SLAB_PAGE_BITS		21
+#define SLAB_PAGE		((size_t)1 << SLAB_PAGE_BITS)
+#define SLAB_MINBITS		6
+#define SLAB_MAXBITS		20
+#define SLAB_NCLASS		(1 + (SLAB_MAXBITS - SLAB_MINBITS) * 4)
+#define SLAB_HDR		PRNDUP(sizeof(struct storage))
+
+/* Thread cache limits, per class */
+#define SLAB_TCMAX		32
+#define SLAB_TCBYTES		(256 * 1024)
+
+struct slab_sc;
+
+struct slab_page {
+	unsigned		magic;
+#define SLAB_PAGE_MAGIC		0x2a5e1c77
+	unsigned		cls;
+	unsigned		nfree;
+	unsigned		nbump;
+	void			*free;
+	VTAILQ_ENTRY(slab_page)	list;
+};
+
+struct slab_class {
+	unsigned		magic;
+#define SLAB_CLASS_MAGIC	0x6c3e5f0d
+	unsigned		idx;
+	unsigned		size;
+	unsigned		nper;
+	unsigned		tcmax;
+	struct slab_sc		*sc;
+	struct lock		mtx;
+	VTAILQ_HEAD(,slab_page)	partial;
+	struct VSC_C_slabc	*stats;
+};
+
+struct slab_sc {
+	unsigned		magic;
+#define SLAB_SC_MAGIC		0x1b6a9e42
+	size_t			size;
+	unsigned		npage;
+	uint8_t			*base;
+	struct slab_page	*page;
+	struct lock		mtx;
+	VTAILQ_HEAD(,slab_page)	free_pages;
+	pthread_key_t		tc_key;
+	unsigned		drain;
+	struct VSC_C_slab	*stats;
+	struct slab_class	cls[SLAB_NCLASS];
+};
+
+struct slab_tc {
+	unsigned		magic;
+#define SLAB_TC_MAGIC		0x51ab7c0c
+	struct slab_sc		*sc;
+	unsigned		drain;
+	struct {
+		unsigned	n;
+		void		*p[SLAB_TCMAX];
+	}			c[SLAB_NCLASS];
+};
+
+static struct VSC_C_lck *lck_slab;
+
+/*--------------------------------------------------------------------*/
+
+static unsigned
+slab_cls_size(unsigned idx)
+{
+	unsigned b;
+
+	if (idx == 0)
+		return (1U << SLAB_MINBITS);
+	b = SLAB_MINBITS + (idx - 1) / 4;
+	return ((1U << b) + ((idx - 1) % 4 + 1) * (1U << (b - 2)));
+}
+
+static unsigned
+slab_cls_idx(size_t sz)
+{
+	unsigned b;
+	size_t base, step;
+
+	assert(sz <= ((size_t)1 << SLAB_MAXBITS));
+	if (sz <= (1U << SLAB_MINBITS))
+		return (0);
+	for (b = SLAB_MINBITS; ((size_t)2 << b) < sz; b++)
+		continue;
+	base = (size_t)1 << b;
+	step = base / 4;
+	return (1 + (b - SLAB_MINBITS) * 4 + (sz - base + step - 1) / step - 1);
+}
+
+/*--------------------------------------------------------------------
+ * Keep the stevedore wide gauges in step.  Must hold sc->mtx.
+ */
+
+static void
+slab_sumstat(struct slab_sc *sc, ssize_t bytes)
+{
+
+	Lck_AssertHeld(&sc->mtx);
+	sc->stats->g_bytes += bytes;
+	sc->stats->g_space -= bytes;
+	sc->stats->g_stranded =
+	    (sc->stats->g_pages - sc->stats->g_pages_free) * SLAB_PAGE -
+	    sc->stats->g_bytes;
+}
+
+/*--------------------------------------------------------------------
+ * Pages
+ */
+
+static uint8_t *
+slab_page_addr(const struct slab_sc *sc, const struct slab_page *pg)
+{
+
+	return (sc->base + (size_t)(pg - sc->page) * SLAB_PAGE);
+}
+
+static struct slab_page *
+slab_page_of(const struct slab_sc *sc, const void *p)
+{
+	size_t u;
+
+	assert((const uint8_t *)p >= sc->base);
+	u = (size_t)((const uint8_t *)p - sc->base) >> SLAB_PAGE_BITS;
+	assert(u < sc->npage);
+	CHECK_OBJ_NOTNULL(&sc->page[u], SLAB_PAGE_MAGIC);
+	return (&sc->page[u]);
+}
+
+static struct slab_page *
+slab_page_get(struct slab_sc *sc, struct slab_class *cl)
+{
+	struct slab_page *pg;
+
+	Lck_AssertHeld(&cl->mtx);
+	Lck_Lock(&sc->mtx);
+	pg = VTAILQ_FIRST(&sc->free_pages);
+	if (pg != NULL) {
+		VTAILQ_REMOVE(&sc->free_pages, pg, list);
+		sc->stats->g_pages_free--;
+		slab_sumstat(sc, 0);
+	}
+	Lck_Unlock(&sc->mtx);
+	if (pg == NULL)
+		return (NULL);
+	pg->cls = cl->idx;
+	pg->nfree = cl->nper;
+	pg->nbump = 0;
+	pg->free = NULL;
+	cl->stats->g_pages++;
+	cl->stats->g_free += cl->nper;
+	return (pg);
+}
+
+static void
+slab_page_put(struct slab_sc *sc, struct slab_class *cl, struct slab_page *pg)
+{
+
+	Lck_AssertHeld(&cl->mtx);
+	assert(pg->nfree == cl->nper);
+	cl->stats->g_pages--;
+	cl->stats->g_free -= cl->nper;
+	Lck_Lock(&sc->mtx);
+	VTAILQ_INSERT_HEAD(&sc->free_pages, pg, list);
+	sc->stats->g_pages_free++;
+	slab_sumstat(sc, 0);
+	Lck_Unlock(&sc->mtx);
+}
+
+/*--------------------------------------------------------------------
+ * Chunks
+ */
+
+static void *
+slab_get(struct slab_sc *sc, struct slab_class *cl)
+{
+	struct slab_page *pg;
+	void *p;
+
+	Lck_AssertHeld(&cl->mtx);
+	pg = VTAILQ_FIRST(&cl->partial);
+	if (pg == NULL) {
+		pg = slab_page_get(sc, cl);
+		if (pg == NULL)
+			return (NULL);
+		VTAILQ_INSERT_HEAD(&cl->partial, pg, list);
+	}
+	CHECK_OBJ_NOTNULL(pg, SLAB_PAGE_MAGIC);
+	assert(pg->nfree > 0);
+	if (pg->free != NULL) {
+		p = pg->free;
+		pg->free = *(void **)p;
+	} else {
+		assert(pg->nbump < cl->nper);
+		p = slab_page_addr(sc, pg) + (size_t)pg->nbump++ * cl->size;
+	}
+	if (--pg->nfree == 0)
+		VTAILQ_REMOVE(&cl->partial, pg, list);
+	cl->stats->g_chunks++;
+	cl->stats->g_free--;
+	return (p);
+}
+
+static void
+slab_put(struct slab_sc *sc, struct slab_class *cl, void *p)
+{
+	struct slab_page *pg;
+
+	Lck_AssertHeld(&cl->mtx);
+	pg = slab_page_of(sc, p);
+	assert(pg->cls == cl->idx);
+	*(void **)p = pg->free;
+	pg->free = p;
+	if (pg->nfree++ == 0)
+		VTAILQ_INSERT_TAIL(&cl->partial, pg, list);
+	cl->stats->g_chunks--;
+	cl->stats->g_free++;
+	if (pg->nfree == cl->nper) {
+		VTAILQ_REMOVE(&cl->partial, pg, list);
+		slab_page_put(sc, cl, pg);
+	}
+}
+
+/*--------------------------------------------------------------------
+ * Move chunks between a class and a thread cache, in batches.
+ */
+
+static void
+slab_refill(struct slab_sc *sc, struct slab_class *cl, struct slab_tc *tc)
+{
+	unsigned n = 0;
+	void *p;
+
+	Lck_Lock(&cl->mtx);
+	while (tc->c[cl->idx].n < (cl->tcmax + 1) / 2) {
+		p = slab_get(sc, cl);
+		if (p == NULL)
+			break;
+		tc->c[cl->idx].p[tc->c[cl->idx].n++] = p;
+		n++;
+	}
+	Lck_Lock(&sc->mtx);
+	sc->stats->c_refill++;
+	if (n == 0)
+		sc->stats->c_fail++;
+	slab_sumstat(sc, (ssize_t)n * cl->size);
+	Lck_Unlock(&sc->mtx);
+	Lck_Unlock(&cl->mtx);
+}
+
+static void
+slab_flush(struct slab_sc *sc, struct slab_class *cl, struct slab_tc *tc,
+    unsigned keep)
+{
+	unsigned n = 0;
+
+	Lck_Lock(&cl->mtx);
+	while (tc->c[cl->idx].n > keep) {
+		slab_put(sc, cl, tc->c[cl->idx].p[--tc->c[cl->idx].n]);
+		n++;
+	}
+	Lck_Lock(&sc->mtx);
+	sc->stats->c_flush++;
+	slab_sumstat(sc, -(ssize_t)n * cl->size);
+	Lck_Unlock(&sc->mtx);
+	Lck_Unlock(&cl->mtx);
+}
+
+static void
+slab_tc_flush(struct slab_sc *sc, struct slab_tc *tc)
+{
+	unsigned u;
+
+	for (u = 0; u < SLAB_NCLASS; u++)
+		if (tc->c[u].n > 0)
+			slab_flush(sc, &sc->cls[u], tc, 0);
+}
+
+static void
+slab_tc_fini(void *priv)
+{
+	struct slab_tc *tc;
+	struct slab_sc *sc;
+
+	CAST_OBJ_NOTNULL(tc, priv, SLAB_TC_MAGIC);
+	sc = tc->sc;
+	CHECK_OBJ_NOTNULL(sc, SLAB_SC_MAGIC);
+	slab_tc_flush(sc, tc);
+	FREE_OBJ(tc);
+}
+
+static struct slab_tc *
+slab_tc_get(struct slab_sc *sc)
+{
+	struct slab_tc *tc;
+
+	tc = pthread_getspecific(sc->tc_key);
+	if (tc == NULL) {
+		ALLOC_OBJ(tc, SLAB_TC_MAGIC);
+		AN(tc);
+		tc->sc = sc;
+		tc->drain = sc->drain;
+		AZ(pthread_setspecific(sc->tc_key, tc));
+	}
+	CHECK_OBJ_NOTNULL(tc, SLAB_TC_MAGIC);
+	if (tc->drain != sc->drain) {
+		tc->drain = sc->drain;
+		slab_tc_flush(sc, tc);
+	}
+	return (tc);
+}
+
+/*--------------------------------------------------------------------*/
+
+/*
+ * Chunks sitting in thread caches keep their pages from going back on
+ * the free list, which matters when we run dry, typically right after
+ * nuking an object.  A failed allocation bumps sc->drain, and every
+ * thread flushes its cache the next time it comes through here.
+ * Threads read sc->drain without the lock, a stale value only delays
+ * their flush to the next time around.
+ */
+
+static void
+slab_tc_drain(struct slab_sc *sc)
+{
+
+	Lck_Lock(&sc->mtx);
+	sc->drain++;
+	Lck_Unlock(&sc->mtx);
+	if (pthread_getspecific(sc->tc_key) != NULL)
+		(void)slab_tc_get(sc);
+}
+
+static void *
+slab_get_chunk(struct slab_sc *sc, struct slab_class *cl)
+{
+	struct slab_tc *tc;
+	void *p;
+
+	if (cl->tcmax > 0) {
+		tc = slab_tc_get(sc);
+		if (tc->c[cl->idx].n == 0)
+			slab_refill(sc, cl, tc);
+		if (tc->c[cl->idx].n == 0)
+			return (NULL);
+		return (tc->c[cl->idx].p[--tc->c[cl->idx].n]);
+	}
+	Lck_Lock(&cl->mtx);
+	p = slab_get(sc, cl);
+	Lck_Lock(&sc->mtx);
+	if (p == NULL)
+		sc->stats->c_fail++;
+	else
+		slab_sumstat(sc, cl->size);
+	Lck_Unlock(&sc->mtx);
+	Lck_Unlock(&cl->mtx);
+	return (p);
+}
+
+static struct storage * __match_proto__(sml_alloc_f)
+slab_alloc(const struct stevedore *st, size_t size)
+{
+	struct slab_sc *sc;
+	struct slab_class *cl;
+	struct storage *s;
+	void *p;
+
+	CAST_OBJ_NOTNULL(sc, st->priv, SLAB_SC_MAGIC);
+
+	/* Larger requests get cut down by our caller */
+	if (size + SLAB_HDR > ((size_t)1 << SLAB_MAXBITS))
+		return (NULL);
+
+	cl = &sc->cls[slab_cls_idx(size + SLAB_HDR)];
+	p = slab_get_chunk(sc, cl);
+	if (p == NULL) {
+		slab_tc_drain(sc);
+		p = slab_get_chunk(sc, cl);
+	}
+	if (p == NULL)
+		return (NULL);
+
+	s = p;
+	INIT_OBJ(s, STORAGE_MAGIC);
+	s->priv = cl;
+	s->ptr = (unsigned char *)p + SLAB_HDR;
+	s->len = 0;
+	s->space = cl->size - SLAB_HDR;
+	return (s);
+}
+
+static void __match_proto__(sml_free_f)
+slab_free(struct storage *s)
+{
+	struct slab_sc *sc;
+	struct slab_class *cl;
+	struct slab_tc *tc;
+
+	CHECK_OBJ_NOTNULL(s, STORAGE_MAGIC);
+	CAST_OBJ_NOTNULL(cl, s->priv, SLAB_CLASS_MAGIC);
+	sc = cl->sc;
+	CHECK_OBJ_NOTNULL(sc, SLAB_SC_MAGIC);
+	assert(s->space == cl->size - SLAB_HDR);
+	s->magic = 0;
+
+	if (cl->tcmax > 0) {
+		tc = slab_tc_get(sc);
+		if (tc->c[cl->idx].n == cl->tcmax)
+			slab_flush(sc, cl, tc, cl->tcmax / 2);
+		tc->c[cl->idx].p[tc->c[cl->idx].n++] = s;
+		return;
+	}
+
+	Lck_Lock(&cl->mtx);
+	slab_put(sc, cl, s);
+	Lck_Lock(&sc->mtx);
+	slab_sumstat(sc, -(ssize_t)cl->size);
+	Lck_Unlock(&sc->mtx);
+	Lck_Unlock(&cl->mtx);
+}
+
+static VCL_BYTES __match_proto__(stv_var_used_space)
+slab_used_space(const struct stevedore *st)
+{
+	struct slab_sc *sc;
+
+	CAST_OBJ_NOTNULL(sc, st->priv, SLAB_SC_MAGIC);
+	return (sc->stats->g_bytes);
+}
+
+static VCL_BYTES __match_proto__(stv_var_free_space)
+slab_free_space(const struct stevedore *st)
+{
+	struct slab_sc *sc;
+
+	CAST_OBJ_NOTNULL(sc, st->priv, SLAB_SC_MAGIC);
+	return (sc->stats->g_space);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void
+slab_init(struct stevedore *parent, int ac, char * const *av)
+{
+	const char *e;
+	uintmax_t u;
+	struct slab_sc *sc;
+	uint8_t *p;
+
+	ASSERT_MGT();
+	ALLOC_OBJ(sc, SLAB_SC_MAGIC);
+	AN(sc);
+	parent->priv = sc;
+
+	AZ(av[ac]);
+	if (ac > 1)
+		ARGV_ERR("(-sslab) too many arguments\n");
+	if (ac == 0 || *av[0] == '\0')
+		ARGV_ERR("(-sslab) size is mandatory\n");
+
+	e = VNUM_2bytes(av[0], &u, 0);
+	if (e != NULL)
+		ARGV_ERR("(-sslab) size \"%s\": %s\n", av[0], e);
+	if ((u != (uintmax_t)(size_t)u))
+		ARGV_ERR("(-sslab) size \"%s\": too big\n", av[0]);
+	if (u < 1024*1024)
+		ARGV_ERR("(-sslab) size \"%s\": too small, "
+			 "did you forget to specify M or G?\n", av[0]);
+
+	/* Round up to whole pages */
+	sc->npage = (u + SLAB_PAGE - 1) / SLAB_PAGE;
+	sc->size = (size_t)sc->npage * SLAB_PAGE;
+
+	/*
+	 * Map it here, so the child starts out with a clean copy
+	 * every time.  Align it, so it can be backed by huge pages.
+	 */
+	p = mmap(NULL, sc->size + SLAB_PAGE, PROT_READ | PROT_WRITE,
+	    MAP_NOCORE | MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+	if (p == MAP_FAILED)
+		ARGV_ERR("(-sslab) mmap of %zu bytes failed: %s\n",
+		    sc->size, strerror(errno));
+	sc->base = (uint8_t *)(((uintptr_t)p + SLAB_PAGE - 1) &
+	    ~(uintptr_t)(SLAB_PAGE - 1));
+#ifdef MADV_HUGEPAGE
+	(void)madvise(sc->base, sc->size, MADV_HUGEPAGE);
+#endif
+}
+
+static void __match_proto__(storage_open_f)
+slab_open(struct stevedore *st)
+{
+	struct slab_sc *sc;
+	struct slab_class *cl;
+	char buf[32];
+	unsigned u;
+
+	ASSERT_CLI();
+	st->lru = LRU_Alloc(st);
+	if (lck_slab == NULL)
+		lck_slab = Lck_CreateClass("slab");
+	CAST_OBJ_NOTNULL(sc, st->priv, SLAB_SC_MAGIC);
+
+	Lck_New(&sc->mtx, lck_slab);
+	AZ(pthread_key_create(&sc->tc_key, slab_tc_fini));
+	sc->stats = VSM_Alloc(sizeof *sc->stats,
+	    VSC_CLASS, VSC_type_slab, st->ident);
+	AN(sc->stats);
+	memset(sc->stats, 0, sizeof *sc->stats);
+
+	sc->page = calloc(sc->npage, sizeof *sc->page);
+	AN(sc->page);
+	VTAILQ_INIT(&sc->free_pages);
+	for (u = 0; u < sc->npage; u++) {
+		sc->page[u].magic = SLAB_PAGE_MAGIC;
+		VTAILQ_INSERT_TAIL(&sc->free_pages, &sc->page[u], list);
+	}
+	sc->stats->g_pages = sc->npage;
+	sc->stats->g_pages_free = sc->npage;
+	sc->stats->g_space = sc->size;
+
+	for (u = 0; u < SLAB_NCLASS; u++) {
+		cl = &sc->cls[u];
+		cl->magic = SLAB_CLASS_MAGIC;
+		cl->idx = u;
+		cl->size = slab_cls_size(u);
+		assert(slab_cls_idx(cl->size) == u);
+		cl->nper = SLAB_PAGE / cl->size;
+		cl->tcmax = SLAB_TCBYTES / cl->size;
+		if (cl->tcmax > SLAB_TCMAX)
+			cl->tcmax = SLAB_TCMAX;
+		if (cl->tcmax < 4)
+			cl->tcmax = 0;
+		cl->sc = sc;
+		Lck_New(&cl->mtx, lck_slab);
+		VTAILQ_INIT(&cl->partial);
+		bprintf(buf, "%s.%u", st->ident, cl->size);
+		cl->stats = VSM_Alloc(sizeof *cl->stats,
+		    VSC_CLASS, VSC_type_slabc, buf);
+		AN(cl->stats);
+		memset(cl->stats, 0, sizeof *cl->stats);
+	}
+	assert(sc->cls[SLAB_NCLASS - 1].size == (1U << SLAB_MAXBITS));
+}
+
+const struct stevedore slab_stevedore = {
+	.magic		=	STEVEDORE_MAGIC,
+	.name		=	"slab",
+	.init		=	slab_init,
+	.open		=	slab_open,
+	.sml_alloc	=	slab_alloc,
+	.sml_free	=	slab_free,
+	.allocobj	=	SML_allocobj,
+	.panic		=	SML_panic,
+	.methods	=	&SML_methods,
+	.var_free_space =	slab_free_space,
+	.var_used_space =	slab_used_space,
+};
@@ -134,7 +134,7 @@ vwe_thread(void *priv)
 			}
 			AZ(epoll_ctl(vwe->epfd, EPOLL_CTL_DEL, wp->fd, NULL));
 			vwe->nwaited--;
-			if (ep->events & EPOLLIN)
+			if (ep->events & (EPOLLIN | EPOLLOUT))
 				Wait_Call(w, wp, WAITER_ACTION, now);
 			else if (ep->events & EPOLLERR)
 				Wait_Call(w, wp, WAITER_REMCLOSE, now);
@@ -161,7 +161,10 @@ vwe_enter(void *priv, struct waited *wp)
 	struct epoll_event ee;
 
 	CAST_OBJ_NOTNULL(vwe, priv, VWE_MAGIC);
-	ee.events = EPOLLIN | EPOLLRDHUP;
+	if (wp->writable)
+		ee.events = EPOLLOUT;
+	else
+		ee.events = EPOLLIN | EPOLLRDHUP;
 	ee.data.ptr = wp;
 	Lck_Lock(&vwe->mtx);
 	vwe->nwaited++;
@@ -94,10 +94,11 @@ struct vws {
 };
 
 static inline void
-vws_add(struct vws *vws, int fd, void *data)
+vws_add(struct vws *vws, struct waited *wp)
 {
-	// POLLIN should be all we need here
-	AZ(port_associate(vws->dport, PORT_SOURCE_FD, fd, POLLIN, data));
+	// POLLIN should be all we need here, or POLLOUT for connects
+	AZ(port_associate(vws->dport, PORT_SOURCE_FD, wp->fd,
+	    wp->writable ? POLLOUT : POLLIN, wp));
 }
 
 static inline void
@@ -115,7 +116,7 @@ vws_port_ev(struct vws *vws, struct waiter *w, port_event_t *ev, double now)
 		assert(wp->fd >= 0);
 		vws->nwaited++;
 		Wait_HeapInsert(vws->waiter, wp);
-		vws_add(vws, wp->fd, wp);
+		vws_add(vws, wp);
 	} else {
 		assert(ev->portev_source == PORT_SOURCE_FD);
 		CAST_OBJ_NOTNULL(wp, ev->portev_user, WAITED_MAGIC);
@@ -30,6 +30,9 @@
  * connections and react if data arrives, the connection is closed or
  * if nothing happens for a specified timeout period.
  *
+ * A waited with .writable set is watched for the connection becoming
+ * writable instead, which is how a non-blocking connect(2) completes.
+ *
  * The "poll" waiter should be portable to just about anything, but it
  * is not very efficient because it has to setup state on each call to
  * poll(2).  Almost all kernels have made better facilities for that
@@ -64,6 +67,7 @@ struct waited {
 	waiter_handle_f		*func;
 	volatile double		*tmo;
 	double			idle;
+	unsigned		writable;	/* wait for POLLOUT */
 };
 
 /* cache_waiter.c */
@@ -2146,7 +2146,7 @@ cmd_rxcont(CMD_ARGS)
 
 	while (*++av)
 		if (!strcmp(*av, "-some")) {
-			STRTOU32(times, *av, p, vl, "-some");
+			STRTOU32_CHECK(times, av, p, vl, "-some", 0);
 			if (!times)
 				vtc_fatal(vl, "-some argument must be more"
 					       "than 0 (found \"%s\")\n", *av);
@@ -2197,7 +2197,7 @@ cmd_rxdata(CMD_ARGS)
 
 	while (*++av)
 		if (!strcmp(*av, "-some")) {
-			STRTOU32(times, *av, p, vl, "-some");
+			STRTOU32_CHECK(times, av, p, vl, "-some", 0);
 			if (!times)
 				vtc_fatal(vl, "-some argument must be more"
 					       "than 0 (found \"%s\")\n", *av);
@@ -65,6 +65,15 @@ CLI_CMD(BAN_LIST,
 	0, 0
 )
 
+CLI_CMD(PURGE_KEY,
+	"purge.key",
+	"purge.key <key> [<key> ...]",
+	"Purge all objects tagged with any of the surrogate keys.",
+	"  Objects are tagged with the keys in the response header named"
+	" by the surrogate_key_header parameter.",
+	1, -1
+)
+
 CLI_CMD(VCL_LOAD,
 	"vcl.load",
 	"vcl.load <configname> <filename> [auto|cold|warm]",
@@ -277,6 +286,26 @@ CLI_CMD(DEBUG_SRANDOM,
 	0, 1
 )
 
+CLI_CMD(DEBUG_SHMLOG_BENCH,
+	"debug.shmlog_bench",
+	"debug.shmlog_bench [<threads> [<transactions>]]",
+	"Write transactions to the shared memory log from many threads.",
+	"  Each thread writes the given number of transactions of 20"
+	" records, and we report the rate and how often the writers"
+	" got in each other's way.",
+	0, 2
+)
+
+CLI_CMD(DEBUG_HDRPACK_BENCH,
+	"debug.hdrpack_bench",
+	"debug.hdrpack_bench [<headers> [<iterations>]]",
+	"Time header lookups and decoding on packed object headers.",
+	"  A made up object with the given number of headers is packed"
+	" in both the old and the indexed format, and we report the time"
+	" to find the last header, to miss a header and to decode it all.",
+	0, 2
+)
+
 CLI_CMD(DEBUG_PANIC_WORKER,
 	"debug.panic.worker",
 	"debug.panic.worker",
@@ -32,15 +32,18 @@
 LOCK(backend)
 LOCK(backend_tcp)
 LOCK(ban)
+LOCK(banjob)
 LOCK(busyobj)
 LOCK(cli)
 LOCK(exp)
 LOCK(hcb)
+LOCK(hlf)
 LOCK(lru)
 LOCK(mempool)
 LOCK(objhdr)
 LOCK(pipestat)
 LOCK(sess)
+LOCK(skey)
 LOCK(vbe)
 LOCK(vcapace)
 LOCK(vcl)
@@ -188,6 +188,23 @@ PARAM(
 	/* func */	NULL
 )
 
+PARAM(
+	/* name */	ban_lurker_threads,
+	/* typ */	uint,
+	/* min */	"1",
+	/* max */	"64",
+	/* default */	"2",
+	/* units */	"threads",
+	/* flags */	EXPERIMENTAL,
+	/* s-text */
+	"How many threads test objects for the ban lurker.  The lurker "
+	"thread gets help from pool tasks when it has more than 16 "
+	"objects to test, one for every 16 objects.\n"
+	"All of them count towards ${ban_lurker_batch}.",
+	/* l-text */	"",
+	/* func */	NULL
+)
+
 PARAM(
 	/* name */	ban_lurker_holdoff,
 	/* typ */	timeout,
@@ -253,6 +270,26 @@ PARAM(
 	/* func */	NULL
 )
 
+PARAM(
+	/* name */	backend_warm_connections,
+	/* typ */	uint,
+	/* min */	"0",
+	/* max */	NULL,
+	/* default */	"0",
+	/* units */	"connections",
+	/* flags */	EXPERIMENTAL,
+	/* s-text */
+	"Keep at least this many idle connections open to each backend "
+	"address, so fetches find a connection ready instead of waiting "
+	"for one to be established.\n"
+	"This applies to each thread pool separately, and warming starts "
+	"with the first fetch from the pool and pauses while connecting "
+	"fails.  Idle connections are still closed after "
+	"backend_idle_timeout and then replaced.",
+	/* l-text */	"",
+	/* func */	NULL
+)
+
 PARAM(
 	/* name */	cli_buffer,
 	/* typ */	bytes_u,
@@ -357,8 +394,8 @@ PARAM(
 	/* units */	"seconds",
 	/* flags */	WIZARD,
 	/* s-text */
-	"How long the critbit hasher keeps deleted objheads on the cooloff "
-	"list.",
+	"How long the critbit and lockfree hashers keep deleted objheads "
+	"on the cooloff list.",
 	/* l-text */	"",
 	/* func */	NULL
 )
@@ -443,6 +480,22 @@ PARAM(
 	/* func */	NULL
 )
 
+PARAM(
+	/* name */	expiry_threads,
+	/* typ */	uint,
+	/* min */	"1",
+	/* max */	"64",
+	/* default */	"2",
+	/* units */	"threads",
+	/* flags */	MUST_RESTART| EXPERIMENTAL,
+	/* s-text */
+	"Number of expiry threads.\n"
+	"Objects are spread over the threads by address, each thread "
+	"has its own inbox and timers, and drains its inbox in batches.",
+	/* l-text */	"",
+	/* func */	NULL
+)
+
 #if 0
 /* actual location mgt_param_bits.c*/
 /* See tbl/feature_bits.h */
@@ -704,6 +757,56 @@ PARAM(
 	/* func */	NULL
 )
 
+#if defined(HAVE_SO_REUSEPORT)
+  #define XYZZY MUST_RESTART
+#else
+  #define XYZZY NOT_IMPLEMENTED
+#endif
+PARAM(
+	/* name */	listen_reuseport,
+	/* typ */	bool,
+	/* min */	NULL,
+	/* max */	NULL,
+	/* default */	"off",
+	/* units */	"bool",
+	/* flags */	XYZZY,
+	/* s-text */
+	"Give each thread pool its own sockets to accept connections on, "
+	"bound to the listen addresses with SO_REUSEPORT, and let the "
+	"kernel spread new connections over them, instead of all pools "
+	"accepting from the same sockets.\n"
+	"The sockets are opened when the child starts, one for each of "
+	"thread_pools, and pools added later share the first one.",
+	/* l-text */	NULL,
+	/* func */	NULL
+)
+#undef XYZZY
+
+#if defined(HAVE_SO_REUSEPORT) && defined(__linux__)
+  #define XYZZY MUST_RESTART
+#else
+  #define XYZZY NOT_IMPLEMENTED
+#endif
+PARAM(
+	/* name */	listen_reuseport_cpu,
+	/* typ */	bool,
+	/* min */	NULL,
+	/* max */	NULL,
+	/* default */	"off",
+	/* units */	"bool",
+	/* flags */	XYZZY,
+	/* s-text */
+	"With listen_reuseport, attach a BPF program to the sockets which "
+	"gives each connection to the pool numbered after the CPU which "
+	"received it, modulo thread_pools, instead of spreading them by "
+	"address hash.\n"
+	"This only pays off when the NIC queues are bound to CPUs and "
+	"thread_pools matches the number of CPUs.",
+	/* l-text */	NULL,
+	/* func */	NULL
+)
+#undef XYZZY
+
 PARAM(
 	/* name */	lru_interval,
 	/* typ */	timeout,
@@ -722,6 +825,26 @@ PARAM(
 	/* func */	NULL
 )
 
+PARAM(
+	/* name */	lru_shards,
+	/* typ */	uint,
+	/* min */	"0",
+	/* max */	"1024",
+	/* default */	"0",
+	/* units */	"shards",
+	/* flags */	MUST_RESTART| EXPERIMENTAL,
+	/* s-text */
+	"Number of LRU shards per storage backend.\n"
+	"Zero selects a single LRU list per storage, where objects are "
+	"moved to the tail when used, subject to lru_interval.\n"
+	"A non-zero value splits each storage's LRU into this many "
+	"lists, selected by object hash, each managed with the CLOCK "
+	"algorithm: using an object only sets a reference bit, and "
+	"objects are only moved when the eviction hand passes them.",
+	/* l-text */	"",
+	/* func */	NULL
+)
+
 PARAM(
 	/* name */	max_esi_depth,
 	/* typ */	uint,
@@ -928,6 +1051,24 @@ PARAM(
 	/* func */	NULL
 )
 
+PARAM(
+	/* name */	waitinglist_handoff,
+	/* typ */	bool,
+	/* min */	NULL,
+	/* max */	NULL,
+	/* default */	"off",
+	/* units */	"bool",
+	/* flags */	EXPERIMENTAL,
+	/* s-text */
+	"Hand a newly unbusied object directly to all the requests "
+	"waiting for it, instead of starting rush_exponent of them to "
+	"look it up again.\n"
+	"Requests are only handed the object if it is cacheable and "
+	"their Vary headers match, the others are rushed as usual.",
+	/* l-text */	"",
+	/* func */	NULL
+)
+
 PARAM(
 	/* name */	send_timeout,
 	/* typ */	timeout,
@@ -945,6 +1086,23 @@ PARAM(
 	/* func */	NULL
 )
 
+PARAM(
+	/* name */	sendfile_threshold,
+	/* typ */	bytes,
+	/* min */	"0",
+	/* max */	NULL,
+	/* default */	"1M",
+	/* units */	"bytes",
+	/* flags */	EXPERIMENTAL,
+	/* s-text */
+	"The minimum size of objects transmitted with sendfile(2).\n"
+	"HTTP/1 responses with a known length and no delivery processing "
+	"(ESI, gunzip, range) are sent straight from the storage file if "
+	"the storage has one.",
+	/* l-text */	"",
+	/* func */	NULL
+)
+
 PARAM(
 	/* name */	shm_reclen,
 	/* typ */	vsl_reclen,
@@ -989,6 +1147,24 @@ PARAM(
 	/* func */	NULL
 )
 
+PARAM(
+	/* name */	surrogate_key_header,
+	/* typ */	hdrparam,
+	/* min */	NULL,
+	/* max */	NULL,
+	/* default */	"Surrogate-Key",
+	/* units */	NULL,
+	/* flags */	0,
+	/* s-text */
+	"Backend response header with the surrogate keys of an object.\n"
+	"The keys are separated by white space or commas, and all objects "
+	"with a key can be purged with the purge.key CLI command or "
+	"std.purge_key() from VCL.  Set to the empty string to not "
+	"index objects by key.",
+	/* l-text */	"",
+	/* func */	NULL
+)
+
 PARAM(
 	/* name */	syslog_cli_traffic,
 	/* typ */	bool,
@@ -51,6 +51,14 @@ VSC_DO(MEMPOOL, mempool, VSC_type_mempool, "MEMORY POOL COUNTERS (MEMPOOL.*)")
   #undef VSC_DO_MEMPOOL
 VSC_DONE(MEMPOOL, mempool, VSC_type_mempool)
 
+VSC_DO(POOL, pool, VSC_type_pool, "THREAD POOL COUNTERS (POOL.*)")
+  #define VSC_DO_POOL
+    #define VSC_FF VSC_F
+    #include "tbl/vsc_fields.h"
+    #undef VSC_FF
+  #undef VSC_DO_POOL
+VSC_DONE(POOL, pool, VSC_type_pool)
+
 VSC_DO(SMA, sma, VSC_type_sma, "MALLOC STORAGE COUNTERS (SMA.*)")
   #define VSC_DO_SMA
     #define VSC_FF VSC_F
@@ -67,6 +75,38 @@ VSC_DO(SMF, smf, VSC_type_smf, "FILE STORAGE COUNTERS (SMF.*)")
   #undef VSC_DO_SMF
 VSC_DONE(SMF, smf, VSC_type_smf)
 
+VSC_DO(DISK, disk, VSC_type_disk, "DISK STORAGE COUNTERS (DISK.*)")
+  #define VSC_DO_DISK
+    #define VSC_FF VSC_F
+    #include "tbl/vsc_fields.h"
+    #undef VSC_FF
+  #undef VSC_DO_DISK
+VSC_DONE(DISK, disk, VSC_type_disk)
+
+VSC_DO(SLAB, slab, VSC_type_slab, "SLAB STORAGE COUNTERS (SLAB.*)")
+  #define VSC_DO_SLAB
+    #define VSC_FF VSC_F
+    #include "tbl/vsc_fields.h"
+    #undef VSC_FF
+  #undef VSC_DO_SLAB
+VSC_DONE(SLAB, slab, VSC_type_slab)
+
+VSC_DO(SLABC, slabc, VSC_type_slabc, "SLAB SIZE CLASS COUNTERS (SLABC.*)")
+  #define VSC_DO_SLABC
+    #define VSC_FF VSC_F
+    #include "tbl/vsc_fields.h"
+    #undef VSC_FF
+  #undef VSC_DO_SLABC
+VSC_DONE(SLABC, slabc, VSC_type_slabc)
+
+VSC_DO(LRU, lru, VSC_type_lru, "STORAGE LRU COUNTERS (LRU.*)")
+  #define VSC_DO_LRU
+    #define VSC_FF VSC_F
+    #include "tbl/vsc_fields.h"
+    #undef VSC_FF
+  #undef VSC_DO_LRU
+VSC_DONE(LRU, lru, VSC_type_lru)
+
 VSC_DO(VBE, vbe, VSC_type_vbe, "BACKEND COUNTERS (VBE.*)")
   #define VSC_DO_VBE
     #define VSC_FF VSC_F
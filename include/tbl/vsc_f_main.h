@@ -106,6 +106,13 @@ VSC_FF(cache_miss,		uint64_t, 1, 'c', 'i', info,
 	" backend before delivering it to the client."
 )
 
+VSC_FF(cache_scanned,		uint64_t, 1, 'c', 'i', diag,
+    "Objects examined in cache lookups",
+	"Number of objects examined by cache lookups.  Divide by the"
+	" number of lookups to find how many variants a lookup has to"
+	" look at."
+)
+
 /*---------------------------------------------------------------------*/
 
 VSC_FF(backend_conn,		uint64_t, 0, 'c', 'i', info,
@@ -149,6 +156,54 @@ VSC_FF(backend_retry,		uint64_t, 0, 'c', 'i', info,
 	""
 )
 
+VSC_FF(backend_steal,		uint64_t, 0, 'c', 'i', info,
+    "Backend conn. steals",
+	"Number of idle backend connections taken from the shard of"
+	" another thread pool, because our own had none."
+)
+
+VSC_FF(backend_wait,		uint64_t, 0, 'c', 'i', info,
+    "Backend conn. waits",
+	"Number of fetches which found no idle connection and waited"
+	" for one to be connected or recycled."
+)
+
+VSC_FF(backend_conn_idle,	uint64_t, 0, 'g', 'i', info,
+    "Backend conn. idle",
+	"Number of idle connections to backends."
+)
+
+VSC_FF(backend_conn_warm,	uint64_t, 0, 'g', 'i', info,
+    "Backend conn. warm",
+	"Number of idle connections to backends which have not been"
+	" used yet, see the backend_warm_connections parameter."
+)
+
+VSC_FF(backend_conn_connecting,	uint64_t, 0, 'g', 'i', info,
+    "Backend conn. connecting",
+	"Number of connections to backends being established."
+)
+
+VSC_FF(backend_connect_lt1ms,	uint64_t, 0, 'c', 'i', info,
+    "Backend connects less than 1ms",
+	"Number of backend connections established in less than 1ms."
+)
+
+VSC_FF(backend_connect_lt10ms,	uint64_t, 0, 'c', 'i', info,
+    "Backend connects 1ms to 10ms",
+	"Number of backend connections established in 1ms to 10ms."
+)
+
+VSC_FF(backend_connect_lt100ms,	uint64_t, 0, 'c', 'i', info,
+    "Backend connects 10ms to 100ms",
+	"Number of backend connections established in 10ms to 100ms."
+)
+
+VSC_FF(backend_connect_ge100ms,	uint64_t, 0, 'c', 'i', info,
+    "Backend connects 100ms or more",
+	"Number of backend connections established in 100ms or more."
+)
+
 /*---------------------------------------------------------------------
  * Backend fetch statistics
  */
@@ -275,6 +330,43 @@ VSC_FF(busy_killed,		uint64_t, 1, 'c', 'i', info,
 	" due to lack of resources."
 )
 
+VSC_FF(busy_handoff,		uint64_t, 1, 'c', 'i', info,
+    "Number of requests handed an object after sleep on busy objhdr",
+	"Number of requests taken off the busy object sleep list with"
+	" the unbusied object, saving a new lookup."
+	"  See the waitinglist_handoff parameter."
+)
+
+VSC_FF(busy_dwell_lt1ms,	uint64_t, 1, 'c', 'i', info,
+    "Requests on busy objhdr sleep list less than 1ms",
+	"Number of requests woken after less than 1ms on the busy"
+	" object sleep list."
+)
+
+VSC_FF(busy_dwell_lt10ms,	uint64_t, 1, 'c', 'i', info,
+    "Requests on busy objhdr sleep list 1ms to 10ms",
+	"Number of requests woken after 1ms to 10ms on the busy"
+	" object sleep list."
+)
+
+VSC_FF(busy_dwell_lt100ms,	uint64_t, 1, 'c', 'i', info,
+    "Requests on busy objhdr sleep list 10ms to 100ms",
+	"Number of requests woken after 10ms to 100ms on the busy"
+	" object sleep list."
+)
+
+VSC_FF(busy_dwell_lt1s,		uint64_t, 1, 'c', 'i', info,
+    "Requests on busy objhdr sleep list 100ms to 1s",
+	"Number of requests woken after 100ms to 1s on the busy"
+	" object sleep list."
+)
+
+VSC_FF(busy_dwell_ge1s,		uint64_t, 1, 'c', 'i', info,
+    "Requests on busy objhdr sleep list 1s or more",
+	"Number of requests woken after 1s or more on the busy"
+	" object sleep list."
+)
+
 VSC_FF(sess_queued,		uint64_t, 0, 'c', 'i', info,
     "Sessions queued for thread",
 	"Number of times session was queued waiting for a thread."
@@ -295,6 +387,12 @@ VSC_FF(n_object,			uint64_t, 1, 'g', 'i', info,
 	" in the cache."
 )
 
+VSC_FF(obj_onepiece,			uint64_t, 1, 'c', 'i', diag,
+    "Objects allocated in one piece",
+	"Number of objects where the headers and the body were allocated"
+	" together, because the length of the body was known up front."
+)
+
 VSC_FF(n_vampireobject,		uint64_t, 1, 'g', 'i', diag,
     "unresurrected objects",
 	"Number of unresurrected objects"
@@ -312,12 +410,18 @@ VSC_FF(n_objecthead,		uint64_t, 1, 'g', 'i', info,
 	"Approximate number of different hash entries in the cache."
 )
 
+VSC_FF(n_vary_idx,		uint64_t, 1, 'g', 'i', diag,
+    "objectheads with an index of variants",
+	"Number of objectheads with so many objects that they keep an"
+	" index of their variants by their Vary matching string."
+)
+
 VSC_FF(n_backend,		uint64_t, 0, 'g', 'i', info,
     "Number of backends",
 	"Number of backends known to us."
 )
 
-VSC_FF(n_expired,		uint64_t, 0, 'g', 'i', info,
+VSC_FF(n_expired,		uint64_t, 1, 'g', 'i', info,
     "Number of expired objects",
 	"Number of objects that expired from cache"
 	" because of old age."
@@ -389,6 +493,12 @@ VSC_FF(s_resp_bodybytes,		uint64_t, 1, 'c', 'B', info,
 	"Total response body bytes transmitted"
 )
 
+VSC_FF(s_sendfile_bytes,		uint64_t, 1, 'c', 'B', info,
+    "Response body bytes sent from file",
+	"Response body bytes transmitted with sendfile(2) straight from"
+	" storage, see the sendfile_threshold parameter."
+)
+
 VSC_FF(s_pipe_hdrbytes,		uint64_t, 0, 'c', 'B', info,
     "Pipe request header bytes",
 	"Total request bytes received for piped sessions"
@@ -406,6 +516,36 @@ VSC_FF(s_pipe_out,		uint64_t, 0, 'c', 'B', info,
 	" pipe sessions"
 )
 
+VSC_FF(s_pipe_splice,		uint64_t, 0, 'c', 'B', info,
+    "Piped bytes spliced",
+	"Total number of piped bytes, in either direction, which were"
+	" relayed with splice(2) through a kernel pipe without being"
+	" copied to userland"
+)
+
+VSC_FF(n_pipe,			uint64_t, 0, 'g', 'i', info,
+    "Pipe sessions in progress",
+	"Number of pipe sessions currently relaying bytes, each of"
+	" which occupies a worker thread"
+)
+
+VSC_FF(h2_tx_frames,		uint64_t, 1, 'c', 'i', diag,
+    "HTTP/2 frames written",
+	"Number of HTTP/2 frames written to clients.  Divided by"
+	" h2_tx_writev this is the number of frames per system call."
+)
+
+VSC_FF(h2_tx_writev,		uint64_t, 1, 'c', 'i', diag,
+    "HTTP/2 writev calls",
+	"Number of writev(2) calls writing batches of HTTP/2 frames"
+)
+
+VSC_FF(h2_tx_stall,		uint64_t, 1, 'c', 'i', diag,
+    "HTTP/2 write stalls",
+	"Number of times writing a batch of HTTP/2 frames was cut short"
+	" because the client did not read fast enough"
+)
+
 VSC_FF(sess_closed,		uint64_t, 1, 'c', 'i', info,
     "Session Closed",
 	""
@@ -462,8 +602,9 @@ VSC_FF(shm_flushes,		uint64_t, 0, 'c', 'i', diag,
 )
 
 VSC_FF(shm_cont,			uint64_t, 0, 'c', 'i', diag,
-    "SHM MTX contention",
-	""
+    "SHM write contention",
+	"Number of times a writer lost the race for log space to another"
+	" writer and had to try again."
 )
 
 VSC_FF(shm_cycles,		uint64_t, 0, 'c', 'i', diag,
@@ -584,6 +725,19 @@ VSC_FF(bans_lurker_contention,	uint64_t, 0, 'c', 'i', diag,
 	"Number of times the ban-lurker had to wait for lookups."
 )
 
+VSC_FF(bans_lurker_backlog,	uint64_t, 0, 'g', 'i', info,
+    "Objects waiting for the ban-lurker",
+	"Approximate number of objects on bans older than the newest,"
+	" which the ban-lurker has yet to test."
+)
+
+VSC_FF(bans_lurker_rate,	uint64_t, 0, 'g', 'i', info,
+    "Objects tested per second (lurker)",
+	"How many objects per second the ban-lurker tested in the last"
+	" pass which found objects to test, not counting the time it"
+	" slept."
+)
+
 VSC_FF(bans_persisted_bytes,	uint64_t, 0, 'g', 'B', diag,
     "Bytes used by the persisted ban lists",
 	"Number of bytes used by the persisted ban lists."
@@ -607,14 +761,37 @@ VSC_FF(n_obj_purged,		uint64_t, 0, 'g', 'i', info,
 	""
 )
 
+VSC_FF(n_skey,			uint64_t, 0, 'g', 'i', info,
+    "Number of surrogate keys",
+	"Number of distinct surrogate keys objects are tagged with,"
+	" see the surrogate_key_header parameter"
+)
+
+VSC_FF(n_skey_ref,		uint64_t, 0, 'g', 'i', info,
+    "Number of surrogate key references",
+	"Number of times an object is tagged with a surrogate key"
+)
+
 /*--------------------------------------------------------------------*/
 
-VSC_FF(exp_mailed,		uint64_t, 0, 'c', 'i', diag,
+VSC_FF(exp_mailed,		uint64_t, 1, 'c', 'i', diag,
     "Number of objects mailed to expiry thread",
 	"Number of objects mailed to expiry thread for handling."
 )
 
-VSC_FF(exp_received,		uint64_t, 0, 'c', 'i', diag,
+VSC_FF(exp_batches,		uint64_t, 1, 'c', 'i', diag,
+    "Number of expiry inbox batches",
+	"Number of times an expiry thread emptied (part of) its inbox."
+	"  exp_received divided by this is the average batch size."
+)
+
+VSC_FF(exp_wheel,		uint64_t, 1, 'c', 'i', diag,
+    "Objects put on the expiry timer wheel",
+	"Number of times an object was put on a timer wheel, rather"
+	" than on the binary heap used for long expiry times."
+)
+
+VSC_FF(exp_received,		uint64_t, 1, 'c', 'i', diag,
     "Number of objects received by expiry thread",
 	"Number of objects received by expiry thread for handling."
 )
@@ -638,6 +815,40 @@ VSC_FF(hcb_insert,		uint64_t, 0, 'c', 'i', debug,
 
 /*--------------------------------------------------------------------*/
 
+VSC_FF(hlf_nolock,		uint64_t, 1, 'c', 'i', debug,
+    "HLF Lookups without lock",
+	""
+)
+
+VSC_FF(hlf_lock,			uint64_t, 0, 'c', 'i', debug,
+    "HLF Lookups with lock",
+	""
+)
+
+VSC_FF(hlf_insert,		uint64_t, 0, 'c', 'i', debug,
+    "HLF Inserts",
+	""
+)
+
+VSC_FF(hlf_probes,		uint64_t, 1, 'c', 'i', debug,
+    "HLF Slots probed",
+	"Count of hash table slots examined by lookups.  Divided by the"
+	" number of lookups this gives the average probe length."
+)
+
+VSC_FF(hlf_resize,		uint64_t, 0, 'c', 'i', debug,
+    "HLF Table resizes",
+	"Count of times the hash table was rebuilt, either to grow"
+	" or to purge deleted slots."
+)
+
+VSC_FF(hlf_slots,		uint64_t, 0, 'g', 'i', debug,
+    "HLF Table size",
+	"Number of slots in the current hash table."
+)
+
+/*--------------------------------------------------------------------*/
+
 VSC_FF(esi_errors,		uint64_t, 0, 'c', 'i', diag,
     "ESI parse errors (unlock)",
 	""
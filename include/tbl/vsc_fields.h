@@ -130,7 +130,7 @@ VSC_FF(locks,			uint64_t, 0, 'c', 'i', debug,
  * All Stevedores support these counters
  */
 
-#if defined(VSC_DO_SMA) || defined (VSC_DO_SMF)
+#if defined(VSC_DO_SMA) || defined (VSC_DO_SMF) || defined (VSC_DO_DISK)
 VSC_FF(c_req,			uint64_t, 0, 'c', 'i', info,
     "Allocator requests",
 	"Number of times the storage has been asked to provide a storage segment."
@@ -191,6 +191,249 @@ VSC_FF(g_smf_large,		uint64_t, 0, 'g', 'i', info,
 	""
 )
 
+VSC_FF(g_smf_largest,		uint64_t, 0, 'g', 'B', info,
+    "Largest free smf",
+	"Size of the largest free range in the file."
+)
+
+VSC_FF(g_smf_fragmentation,	uint64_t, 0, 'g', 'i', info,
+    "Free space fragmentation",
+	"Percentage of the free space which is not in the largest free"
+	" range.  Zero means all free space is one contiguous range."
+)
+
+#endif
+
+/**********************************************************************/
+
+#ifdef VSC_DO_DISK
+VSC_FF(g_cache_bytes,		uint64_t, 0, 'g', 'B', info,
+    "Bytes cached",
+	"Bytes of body segments held in memory."
+)
+
+VSC_FF(c_cache_hit,		uint64_t, 0, 'c', 'i', info,
+    "Cache hits",
+	"Body segments delivered from memory."
+)
+
+VSC_FF(c_cache_miss,		uint64_t, 0, 'c', 'i', info,
+    "Cache misses",
+	"Body segments which had to be read from disk."
+)
+
+VSC_FF(c_cache_evict,		uint64_t, 0, 'c', 'i', info,
+    "Cache evictions",
+	"Body segments dropped from memory."
+)
+
+VSC_FF(c_readahead,		uint64_t, 0, 'c', 'i', info,
+    "Readahead reads",
+	"Reads queued ahead of delivery."
+)
+
+VSC_FF(c_read,			uint64_t, 0, 'c', 'i', info,
+    "Reads",
+	"Completed reads."
+)
+
+VSC_FF(c_read_bytes,		uint64_t, 0, 'c', 'B', info,
+    "Bytes read",
+	"Bytes read from disk."
+)
+
+VSC_FF(c_write,			uint64_t, 0, 'c', 'i', info,
+    "Writes",
+	"Completed writes."
+)
+
+VSC_FF(c_write_bytes,		uint64_t, 0, 'c', 'B', info,
+    "Bytes written",
+	"Bytes written to disk."
+)
+
+VSC_FF(c_io_error,		uint64_t, 0, 'c', 'i', info,
+    "I/O errors",
+	"Reads or writes which failed."
+)
+
+VSC_FF(g_queue,			uint64_t, 0, 'g', 'i', info,
+    "Outstanding I/O",
+	"Reads and writes queued or in progress."
+)
+
+VSC_FF(c_queue_full,		uint64_t, 0, 'c', 'i', info,
+    "Queue full",
+	"Times a worker waited for room in the I/O queue."
+)
+
+VSC_FF(c_submit_lt100us,		uint64_t, 0, 'c', 'i', info,
+    "Submit latency < 100us",
+	"I/O requests queued for < 100us before an I/O thread picked them up."
+)
+
+VSC_FF(c_submit_lt1ms,		uint64_t, 0, 'c', 'i', info,
+    "Submit latency < 1ms",
+	"I/O requests queued for < 1ms before an I/O thread picked them up."
+)
+
+VSC_FF(c_submit_lt10ms,		uint64_t, 0, 'c', 'i', info,
+    "Submit latency < 10ms",
+	"I/O requests queued for < 10ms before an I/O thread picked them up."
+)
+
+VSC_FF(c_submit_lt100ms,		uint64_t, 0, 'c', 'i', info,
+    "Submit latency < 100ms",
+	"I/O requests queued for < 100ms before an I/O thread picked them up."
+)
+
+VSC_FF(c_submit_ge100ms,		uint64_t, 0, 'c', 'i', info,
+    "Submit latency >= 100ms",
+	"I/O requests queued for >= 100ms before an I/O thread picked them up."
+)
+
+VSC_FF(c_complete_lt100us,	uint64_t, 0, 'c', 'i', info,
+    "Complete latency < 100us",
+	"I/O requests which took < 100us to complete."
+)
+
+VSC_FF(c_complete_lt1ms,		uint64_t, 0, 'c', 'i', info,
+    "Complete latency < 1ms",
+	"I/O requests which took < 1ms to complete."
+)
+
+VSC_FF(c_complete_lt10ms,	uint64_t, 0, 'c', 'i', info,
+    "Complete latency < 10ms",
+	"I/O requests which took < 10ms to complete."
+)
+
+VSC_FF(c_complete_lt100ms,	uint64_t, 0, 'c', 'i', info,
+    "Complete latency < 100ms",
+	"I/O requests which took < 100ms to complete."
+)
+
+VSC_FF(c_complete_ge100ms,	uint64_t, 0, 'c', 'i', info,
+    "Complete latency >= 100ms",
+	"I/O requests which took >= 100ms to complete."
+)
+#endif
+
+/**********************************************************************/
+
+#ifdef VSC_DO_SLAB
+VSC_FF(c_fail,			uint64_t, 0, 'c', 'i', info,
+    "Allocator failures",
+	"Number of times the storage has failed to provide a storage segment."
+)
+
+VSC_FF(c_refill,		uint64_t, 0, 'c', 'i', diag,
+    "Thread cache refills",
+	"Number of times a thread took a batch of chunks from a size"
+	" class into its cache."
+)
+
+VSC_FF(c_flush,			uint64_t, 0, 'c', 'i', diag,
+    "Thread cache flushes",
+	"Number of times a thread returned a batch of chunks from its"
+	" cache to a size class."
+)
+
+VSC_FF(g_bytes,			uint64_t, 0, 'g', 'B', info,
+    "Bytes outstanding",
+	"Number of bytes in chunks handed out, including chunks held in"
+	" per-thread caches."
+)
+
+VSC_FF(g_space,			uint64_t, 0, 'g', 'B', info,
+    "Bytes available",
+	"Number of bytes not handed out."
+)
+
+VSC_FF(g_stranded,		uint64_t, 0, 'g', 'B', info,
+    "Bytes stranded in size classes",
+	"Number of free bytes in pages owned by a size class, which"
+	" cannot be used for other sizes until the page is empty again."
+	"  Divided by g_space this is the fragmentation of the storage."
+)
+
+VSC_FF(g_pages,			uint64_t, 0, 'g', 'i', info,
+    "Pages",
+	"Number of pages in the storage."
+)
+
+VSC_FF(g_pages_free,		uint64_t, 0, 'g', 'i', info,
+    "Free pages",
+	"Number of pages not owned by any size class."
+)
+#endif
+
+/**********************************************************************/
+
+#ifdef VSC_DO_SLABC
+VSC_FF(g_pages,			uint64_t, 0, 'g', 'i', info,
+    "Pages",
+	"Number of pages owned by this size class."
+)
+
+VSC_FF(g_chunks,		uint64_t, 0, 'g', 'i', info,
+    "Chunks outstanding",
+	"Number of chunks of this size class handed out, including chunks"
+	" held in per-thread caches."
+)
+
+VSC_FF(g_free,			uint64_t, 0, 'g', 'i', info,
+    "Chunks free",
+	"Number of free chunks in the pages owned by this size class."
+)
+#endif
+
+/**********************************************************************/
+
+#ifdef VSC_DO_LRU
+VSC_FF(g_objects,		uint64_t, 0, 'g', 'i', info,
+    "Objects on the LRU list",
+	"Number of objects on this LRU list."
+)
+
+VSC_FF(c_nuked,			uint64_t, 0, 'c', 'i', info,
+    "Objects nuked",
+	"Number of objects forcefully evicted from this LRU list"
+	" to make room for a new object."
+)
+
+VSC_FF(c_moved,			uint64_t, 0, 'c', 'i', diag,
+    "Objects moved",
+	"Number of objects moved to the tail of this LRU list, either"
+	" because they were touched or because they were given a second"
+	" chance by the CLOCK hand."
+)
+
+VSC_FF(c_failed,		uint64_t, 0, 'c', 'i', info,
+    "Nuke failures",
+	"Number of times no object could be nuked from this LRU list."
+)
+
+VSC_FF(g_small,			uint64_t, 0, 'g', 'i', diag,
+    "Objects in the probationary queue",
+	"Number of objects in the small probationary FIFO of the s3fifo"
+	" eviction policy.  Included in g_objects."
+)
+
+VSC_FF(c_promoted,		uint64_t, 0, 'c', 'i', diag,
+    "Objects promoted",
+	"Number of objects the s3fifo eviction policy moved from the"
+	" probationary queue to the main queue because they were hit"
+	" while on probation or were recently seen before."
+)
+
+VSC_FF(c_rejected,		uint64_t, 0, 'c', 'i', info,
+    "Objects not admitted",
+	"Number of times the eviction policy refused to nuke an object to"
+	" make room for a new one, because the frequency sketch rated the"
+	" new object as less popular.  The new object is then stored in"
+	" Transient with a short TTL instead."
+)
+
 #endif
 
 /**********************************************************************/
@@ -249,6 +492,23 @@ VSC_FF(req,			uint64_t, 0, 'c', 'i', info,
 	""
 )
 
+VSC_FF(reuse,			uint64_t, 0, 'c', 'i', info,
+    "Backend connections reused",
+	"Number of backend requests sent on a connection which had been"
+	" used before or was opened ahead of time."
+)
+
+VSC_FF(recycle,			uint64_t, 0, 'c', 'i', info,
+    "Backend connections recycled",
+	"Number of backend connections kept open for reuse after a"
+	" backend request."
+)
+
+VSC_FF(close,			uint64_t, 0, 'c', 'i', info,
+    "Backend connections closed",
+	"Number of backend connections closed after a backend request."
+)
+
 #endif
 
 /**********************************************************************/
@@ -311,6 +571,24 @@ VSC_FF(randry,			uint64_t, 0, 'c', 'i', debug,
 
 #endif
 
+/**********************************************************************/
+
+#ifdef VSC_DO_POOL
+
+VSC_FF(sess_conn,		uint64_t, 0, 'c', 'i', info,
+    "Sessions accepted",
+	"Count of sessions successfully accepted by this thread pool."
+	"  With listen_reuseport this shows how evenly the kernel spreads"
+	" new connections over the pools."
+)
+
+VSC_FF(sess_fail,		uint64_t, 0, 'c', 'i', info,
+    "Session accept failures",
+	"Count of failures to accept TCP connection in this thread pool."
+)
+
+#endif
+
 #undef VSC_FF
 
 /*lint -restore */
@@ -52,6 +52,10 @@ VSC_TYPE_F(mempool,	"MEMPOOL",	"MEMPOOL",	"Memory pool",
     "Memory pool counters"
 )
 
+VSC_TYPE_F(pool,	"POOL",		"POOL",		"Thread pool",
+    "Thread pool counters"
+)
+
 VSC_TYPE_F(sma,		"SMA",		"SMA",		"Storage malloc",
     "Malloc storage counters"
 )
@@ -60,6 +64,22 @@ VSC_TYPE_F(smf,		"SMF",		"SMF",		"Storage file",
     "File storage counters"
 )
 
+VSC_TYPE_F(disk,	"DISK",		"DISK",		"Storage disk",
+    "Disk storage counters"
+)
+
+VSC_TYPE_F(slab,	"SLAB",		"SLAB",		"Storage slab",
+    "Slab storage counters"
+)
+
+VSC_TYPE_F(slabc,	"SLABC",	"SLABC",	"Slab class",
+    "Slab storage size class counters"
+)
+
+VSC_TYPE_F(lru,		"LRU",		"LRU",		"LRU",
+    "Storage LRU counters"
+)
+
 VSC_TYPE_F(vbe,		"VBE",		"VBE",		"Backend",
     "Backend counters"
 )
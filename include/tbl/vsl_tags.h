@@ -307,6 +307,10 @@ SLTM(ExpKill, 0, "Object expiry event",
 	"LRU_Fail\n"
 	"\tLogged when no suitable candidate object is found for LRU force"
 	" expiry.\n\n"
+	"LRU_Reject\n"
+	"\tLogged when the eviction policy declines to make room for a new"
+	" object because it is estimated to be less popular than the"
+	" candidate it would replace.\n\n"
 	"The format is::\n\n"
 	"\tEXP_Rearm p=%p E=%f e=%f f=0x%x\n"
 	"\tEXP_Inbox p=%p e=%f f=0x%x\n"
@@ -316,6 +320,7 @@ SLTM(ExpKill, 0, "Object expiry event",
 	"\tLRU_Cand p=%p f=0x%x r=%d\n"
 	"\tLRU x=%u\n"
 	"\tLRU_Fail\n"
+	"\tLRU_Reject p=%p c=%u v=%u\n"
 	"\t\n"
 	"\tLegend:\n"
 	"\tp=%p         Objcore pointer\n"
@@ -325,6 +330,8 @@ SLTM(ExpKill, 0, "Object expiry event",
 	"\tf=0x%x       Objcore flags\n"
 	"\tr=%d         Objcore refcount\n"
 	"\tx=%u         Object VXID\n"
+	"\tc=%u         Estimated frequency of the new object\n"
+	"\tv=%u         Estimated frequency of the eviction candidate\n"
 	"\n"
 )
 
@@ -47,6 +47,7 @@
  *	WS_ReserveLumps added
  *	WS_Inside added
  *	WS_Assert_Allocated added
+ *	VRT_purge_key added
  * 5.0:
  *	Varnish 5.0 release "better safe than sorry" bump
  * 4.0:
@@ -287,6 +288,7 @@ const char *VRT_regsub(VRT_CTX, int all, const char *, void *, const char *);
 
 void VRT_ban_string(VRT_CTX, const char *);
 void VRT_purge(VRT_CTX, double ttl, double grace, double keep);
+long VRT_purge_key(VRT_CTX, const char *key);
 
 void VRT_count(VRT_CTX, unsigned);
 void VRT_synth(VRT_CTX, unsigned, const char *);
@@ -45,6 +45,8 @@ void VTCP_hisname(int sock, char *abuf, unsigned alen,
     char *pbuf, unsigned plen);
 int VTCP_filter_http(int sock);
 int VTCP_fastopen(int sock, int depth);
+int VTCP_reuseport_cpu(int sock, const unsigned *map, unsigned nmap,
+    unsigned nsock);
 int VTCP_blocking(int sock);
 int VTCP_nonblocking(int sock);
 int VTCP_linger(int sock, int linger);
@@ -59,6 +61,7 @@ int VTCP_open(const char *addr, const char *def_port, double timeout,
     const char **err);
 void VTCP_close(int *s);
 int VTCP_bind(const struct suckaddr *addr, const char **errp);
+int VTCP_bind_reuseport(const struct suckaddr *addr, const char **errp);
 int VTCP_listen(const struct suckaddr *addr, int depth, const char **errp);
 int VTCP_listen_on(const char *addr, const char *def_port, int depth,
     const char **errp);
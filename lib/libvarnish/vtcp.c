@@ -39,6 +39,9 @@
 
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+#  include <linux/filter.h>
+#endif
 
 #include <errno.h>
 #include <math.h>
@@ -208,6 +211,66 @@ VTCP_fastopen(int sock, int depth)
 
 #endif
 
+/*--------------------------------------------------------------------
+ * Steer connections to the SO_REUSEPORT socket given by map[] for the
+ * CPU which received them, and CPUs not in the map to the socket with
+ * the same index, modulo the number of sockets.
+ */
+
+#ifdef SO_ATTACH_REUSEPORT_CBPF
+
+int
+VTCP_reuseport_cpu(int sock, const unsigned *map, unsigned nmap,
+    unsigned nsock)
+{
+	struct sock_filter *code, *p;
+	struct sock_fprog prog;
+	unsigned u;
+	int i, e;
+
+	assert(nsock > 0);
+	if (map == NULL || nmap > (BPF_MAXINSNS - 4) / 2)
+		nmap = 0;
+	code = calloc(2 * nmap + 3, sizeof *code);
+	if (code == NULL)
+		return (-1);
+	p = code;
+	*p++ = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+	    SKF_AD_OFF + SKF_AD_CPU);
+	for (u = 0; u < nmap; u++) {
+		*p++ = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+		    u, 0, 1);
+		*p++ = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K,
+		    map[u] % nsock);
+	}
+	*p++ = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, nsock);
+	*p++ = (struct sock_filter)BPF_STMT(BPF_RET | BPF_A, 0);
+	prog.len = p - code;
+	prog.filter = code;
+	i = setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+	    &prog, sizeof prog);
+	e = errno;
+	free(code);
+	errno = e;
+	return (i);
+}
+
+#else
+
+int
+VTCP_reuseport_cpu(int sock, const unsigned *map, unsigned nmap,
+    unsigned nsock)
+{
+	errno = EOPNOTSUPP;
+	(void)sock;
+	(void)map;
+	(void)nmap;
+	(void)nsock;
+	return (-1);
+}
+
+#endif
+
 /*--------------------------------------------------------------------
  * Functions for controlling NONBLOCK mode.
  *
@@ -405,10 +468,14 @@ VTCP_open(const char *addr, const char *def_port, double timeout,
  *
  * If the address is an IPv6 address, the IPV6_V6ONLY option is set to
  * avoid conflicts between INADDR_ANY and IN6ADDR_ANY.
+ *
+ * VTCP_bind_reuseport() also sets SO_REUSEPORT, so more sockets can be
+ * bound to the same address, and the kernel spreads connections over
+ * them.
  */
 
-int
-VTCP_bind(const struct suckaddr *sa, const char **errp)
+static int
+vtcp_bind(const struct suckaddr *sa, int reuseport, const char **errp)
 {
 	int sd, val, e;
 	socklen_t sl;
@@ -434,6 +501,23 @@ VTCP_bind(const struct suckaddr *sa, const char **errp)
 		errno = e;
 		return (-1);
 	}
+	if (reuseport) {
+#ifdef SO_REUSEPORT
+		val = 1;
+		e = setsockopt(sd, SOL_SOCKET, SO_REUSEPORT, &val, sizeof val);
+#else
+		e = -1;
+		errno = EOPNOTSUPP;
+#endif
+		if (e != 0) {
+			if (errp != NULL)
+				*errp = "setsockopt(SO_REUSEPORT, 1)";
+			e = errno;
+			closefd(&sd);
+			errno = e;
+			return (-1);
+		}
+	}
 #ifdef IPV6_V6ONLY
 	/* forcibly use separate sockets for IPv4 and IPv6 */
 	val = 1;
@@ -459,6 +543,20 @@ VTCP_bind(const struct suckaddr *sa, const char **errp)
 	return (sd);
 }
 
+int
+VTCP_bind(const struct suckaddr *sa, const char **errp)
+{
+
+	return (vtcp_bind(sa, 0, errp));
+}
+
+int
+VTCP_bind_reuseport(const struct suckaddr *sa, const char **errp)
+{
+
+	return (vtcp_bind(sa, 1, errp));
+}
+
 /*--------------------------------------------------------------------
  * Given a struct suckaddr, open a socket of the appropriate type, bind it
  * to the requested address, and start listening.
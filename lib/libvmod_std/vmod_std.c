@@ -255,3 +255,10 @@ vmod_getenv(VRT_CTX, VCL_STRING name)
 		return (NULL);
 	return (getenv(name));
 }
+
+VCL_INT __match_proto__(td_std_purge_key)
+vmod_purge_key(VRT_CTX, VCL_STRING key)
+{
+	CHECK_OBJ_NOTNULL(ctx, VRT_CTX_MAGIC);
+	return (VRT_purge_key(ctx, key));
+}